@@ -89,11 +89,13 @@ MDBDbi::MDBDbi(MDB_env* env, MDB_txn* txn, const string_view dbname, int flags)
   // Database names are keys in the unnamed database, and may be read but not written.
 }
 
-MDBEnv::MDBEnv(const char* fname, int flags, int mode, uint64_t mapsizeMB)
+MDBEnv::MDBEnv(const char* fname, int flags, int mode, uint64_t mapsizeMB, unsigned int maxReaders)
 {
   mdb_env_create(&d_env);
   if(mdb_env_set_mapsize(d_env, mapsizeMB * 1048576))
     throw std::runtime_error("setting map size");
+  if(maxReaders != 0 && mdb_env_set_maxreaders(d_env, maxReaders))
+    throw std::runtime_error("setting max readers");
     /*
 Various other options may also need to be set before opening the handle, e.g. mdb_env_set_mapsize(), mdb_env_set_maxreaders(), mdb_env_set_maxdbs(),
     */
@@ -150,7 +152,7 @@ int MDBEnv::getROTX()
 }
 
 
-std::shared_ptr<MDBEnv> getMDBEnv(const char* fname, int flags, int mode, uint64_t mapsizeMB)
+std::shared_ptr<MDBEnv> getMDBEnv(const char* fname, int flags, int mode, uint64_t mapsizeMB, unsigned int maxReaders)
 {
   struct Value
   {
@@ -167,7 +169,7 @@ std::shared_ptr<MDBEnv> getMDBEnv(const char* fname, int flags, int mode, uint64
       throw std::runtime_error("Unable to stat prospective mdb database: "+string(strerror(errno)));
     else {
       std::lock_guard<std::mutex> l(mut);
-      auto fresh = std::make_shared<MDBEnv>(fname, flags, mode, mapsizeMB);
+      auto fresh = std::make_shared<MDBEnv>(fname, flags, mode, mapsizeMB, maxReaders);
       if(stat(fname, &statbuf))
         throw std::runtime_error("Unable to stat prospective mdb database: "+string(strerror(errno)));
       auto key = std::tie(statbuf.st_dev, statbuf.st_ino);
@@ -192,7 +194,7 @@ std::shared_ptr<MDBEnv> getMDBEnv(const char* fname, int flags, int mode, uint64
     }
   }
 
-  auto fresh = std::make_shared<MDBEnv>(fname, flags, mode, mapsizeMB);
+  auto fresh = std::make_shared<MDBEnv>(fname, flags, mode, mapsizeMB, maxReaders);
   s_envs[key] = {fresh, flags};
 
   return fresh;
@@ -339,9 +341,12 @@ void MDBROTransactionImpl::abort()
   closeROCursors();
   // if d_txn is non-nullptr here, either the transaction object was invalidated earlier (e.g. by moving from it), or it is an RW transaction which has already cleaned up the d_txn pointer (with an abort).
   if (d_txn) {
-    d_parent->decROTX();
+    if (!d_reset) {
+      d_parent->decROTX();
+    }
     mdb_txn_abort(d_txn); // this appears to work better than abort for r/o database opening
     d_txn = nullptr;
+    d_reset = false;
   }
 }
 
@@ -350,12 +355,53 @@ void MDBROTransactionImpl::commit()
   closeROCursors();
   // if d_txn is non-nullptr here, either the transaction object was invalidated earlier (e.g. by moving from it), or it is an RW transaction which has already cleaned up the d_txn pointer (with an abort).
   if (d_txn) {
+    if (d_reset) {
+      // a reset transaction has nothing left to commit, and still needs to give back its reader slot
+      mdb_txn_abort(d_txn);
+      d_txn = nullptr;
+      d_reset = false;
+      return;
+    }
     d_parent->decROTX();
     mdb_txn_commit(d_txn); // this appears to work better than abort for r/o database opening
     d_txn = nullptr;
   }
 }
 
+void MDBROTransactionImpl::reset()
+{
+  closeROCursors();
+  if (!d_txn) {
+    throw std::runtime_error("Attempt to reset a closed RO transaction");
+  }
+  if (d_reset) {
+    return;
+  }
+
+  mdb_txn_reset(d_txn);
+  d_parent->decROTX();
+  d_reset = true;
+}
+
+void MDBROTransactionImpl::renew()
+{
+  if (!d_txn) {
+    throw std::runtime_error("Attempt to renew a closed RO transaction");
+  }
+  // renewing a live transaction gives it a fresh snapshot
+  reset();
+
+  if (d_parent->getRWTX()) {
+    throw std::runtime_error("Duplicate RO transaction");
+  }
+
+  if (int rc = mdb_txn_renew(d_txn)) {
+    throw std::runtime_error("Unable to renew RO transaction: " + MDBError(rc));
+  }
+  d_parent->incROTX();
+  d_reset = false;
+}
+
 
 
 void MDBRWTransactionImpl::clear(MDB_dbi dbi)
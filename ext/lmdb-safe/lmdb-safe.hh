@@ -65,7 +65,8 @@ using MDBRWTransaction = std::unique_ptr<MDBRWTransactionImpl>;
 class MDBEnv
 {
 public:
-  MDBEnv(const char* fname, int flags, int mode, uint64_t mapsizeMB);
+  //! maxReaders is the number of reader slots to set up if we create the lock file, 0 for the LMDB default of 126
+  MDBEnv(const char* fname, int flags, int mode, uint64_t mapsizeMB, unsigned int maxReaders = 0);
 
   ~MDBEnv()
   {
@@ -98,7 +99,9 @@ private:
   std::map<std::thread::id, int> d_ROtransactionsOut;
 };
 
-std::shared_ptr<MDBEnv> getMDBEnv(const char* fname, int flags, int mode, uint64_t mapsizeMB=(sizeof(void *)==4) ? 100 : 16000);
+constexpr uint64_t MDBDefaultMapSizeMB = (sizeof(void *)==4) ? 100 : 16000;
+
+std::shared_ptr<MDBEnv> getMDBEnv(const char* fname, int flags, int mode, uint64_t mapsizeMB=MDBDefaultMapSizeMB, unsigned int maxReaders=0);
 
 #ifndef DNSDIST
 
@@ -327,6 +330,7 @@ private:
 
 protected:
   MDB_txn* d_txn;
+  bool d_reset{false};
 
   void closeROCursors();
 
@@ -345,9 +349,20 @@ public:
   virtual void abort();
   virtual void commit();
 
+  /* A read-only transaction can be kept around for a long time: reset() releases its snapshot, but keeps
+     its reader slot, and renew() acquires a fresh snapshot without going through mdb_txn_begin() again.
+     This relies on MDB_NOTLS, which we always set. Cursors are closed by reset(). */
+  void reset();
+  void renew();
+
+  bool isReset() const
+  {
+    return d_reset;
+  }
+
   int get(MDB_dbi dbi, const MDBInVal& key, MDBOutVal& val)
   {
-    if(!d_txn)
+    if(!d_txn || d_reset)
       throw std::runtime_error("Attempt to use a closed RO transaction for get");
 
     int rc = mdb_get(d_txn, dbi, const_cast<MDB_val*>(&key.d_mdbval),
@@ -23,8 +23,10 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#include <atomic>
 #include <cerrno>
 #include <string>
+#include <thread>
 #include <set>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -44,6 +46,7 @@
 #include "pdns/dns.hh"
 #include "pdns/dnsbackend.hh"
 #include "bindbackend2.hh"
+#include "bindcompactstorage.hh"
 #include "pdns/dnspacket.hh"
 #include "pdns/zoneparser-tng.hh"
 #include "pdns/bindparserclasses.hh"
@@ -53,6 +56,7 @@
 #include "pdns/misc.hh"
 #include "pdns/dynlistener.hh"
 #include "pdns/lock.hh"
+#include "pdns/threadname.hh"
 #include "pdns/auth-zonecache.hh"
 #include "pdns/auth-caches.hh"
 
@@ -77,6 +81,8 @@
 SharedLockGuarded<Bind2Backend::state_t> Bind2Backend::s_state;
 int Bind2Backend::s_first = 1;
 bool Bind2Backend::s_ignore_broken_records = false;
+bool Bind2Backend::s_compact_storage = false;
+string Bind2Backend::s_snapshot_directory;
 
 std::mutex Bind2Backend::s_supermaster_config_lock; // protects writes to config file
 std::mutex Bind2Backend::s_startup_lock;
@@ -487,17 +493,105 @@ void Bind2Backend::alsoNotifies(const DNSName& domain, set<string>* ips)
   }
 }
 
+template <typename T>
+static size_t getHeapUsage(const T& str)
+{
+  /* short strings are stored inside the object itself */
+  const auto* object = reinterpret_cast<const char*>(&str);
+  if (str.data() >= object && str.data() < object + sizeof(str)) {
+    return 0;
+  }
+  return str.capacity() + 1;
+}
+
+/* an estimate for the regular storage: the multi_index nodes hold the record, the
+   links of the two ordered indexes (three pointers each) and of the hashed one
+   (one pointer, plus its bucket) */
+static size_t getRecordsMemoryUsage(const recordstorage_t& records)
+{
+  size_t usage = sizeof(records);
+  for (const auto& record : records) {
+    usage += sizeof(record) + 8 * sizeof(void*);
+    usage += getHeapUsage(record.qname.getStorage()) + getHeapUsage(record.content) + getHeapUsage(record.nsec3hash);
+  }
+  return usage;
+}
+
+bool Bind2Backend::getZoneNSEC3PARAM(const DNSName& name, NSEC3PARAMRecordContent* ns3p)
+{
+  if (d_hybrid) {
+    DNSSECKeeper dk;
+    return dk.getNSEC3PARAM(name, ns3p);
+  }
+  return getNSEC3PARAMuncached(name, ns3p);
+}
+
+static string getSnapshotPath(const string& directory, const DNSName& zone)
+{
+  /* zone names can hold anything, including slashes */
+  string path = directory + "/";
+  for (const auto chr : toLower(zone.toString())) {
+    if (isalnum(static_cast<unsigned char>(chr)) != 0 || chr == '.' || chr == '-' || chr == '_') {
+      path.append(1, chr);
+    }
+    else {
+      char escaped[4];
+      snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned int>(static_cast<unsigned char>(chr)));
+      path += escaped;
+    }
+  }
+  return path + "snapshot";
+}
+
+static bool loadSnapshot(BB2DomainInfo* bbd, const string& path, const Bind2CompactStorage::SnapshotInfo& info)
+{
+  std::shared_ptr<Bind2CompactStorage> compact;
+  try {
+    compact = Bind2CompactStorage::load(path, info);
+  }
+  catch (const PDNSException& e) {
+    g_log << Logger::Warning << "Ignoring the snapshot of zone '" << bbd->d_name << "': " << e.reason << endl;
+  }
+  if (!compact) {
+    return false;
+  }
+
+  g_log << Logger::Info << "Mapped zone '" << bbd->d_name << "' with serial " << compact->getSerial() << " from snapshot '" << path << "'" << endl;
+  bbd->d_memoryUsage = compact->getMemoryUsage();
+  bbd->d_compact = LookButDontTouch<Bind2CompactStorage>(std::move(compact));
+  bbd->d_records = LookButDontTouch<recordstorage_t>();
+  return true;
+}
+
 // only parses, does NOT add to s_state!
 void Bind2Backend::parseZoneFile(BB2DomainInfo* bbd)
 {
   NSEC3PARAMRecordContent ns3pr;
-  bool nsec3zone = false;
-  if (d_hybrid) {
-    DNSSECKeeper dk;
-    nsec3zone = dk.getNSEC3PARAM(bbd->d_name, &ns3pr);
+  bool nsec3zone = getZoneNSEC3PARAM(bbd->d_name, &ns3pr);
+  parseZoneFile(bbd, nsec3zone, ns3pr);
+}
+
+void Bind2Backend::parseZoneFile(BB2DomainInfo* bbd, bool nsec3zone, const NSEC3PARAMRecordContent& ns3pr)
+{
+  string snapshotPath;
+  Bind2CompactStorage::SnapshotInfo snapshotInfo;
+  struct stat st;
+  if (s_compact_storage && !s_snapshot_directory.empty() && stat(bbd->d_filename.c_str(), &st) == 0) {
+    snapshotPath = getSnapshotPath(s_snapshot_directory, bbd->d_name);
+    snapshotInfo.d_zoneFile = Bind2CompactStorage::FileInfo(st);
+    /* everything else the records depend on, the included files are only known once parsed */
+    snapshotInfo.d_params = bbd->d_filename + "\n" + s_binddirectory + "\n" + (nsec3zone ? ns3pr.getZoneRepresentation() : "") + "\n" + std::to_string(d_upgradeContent) + std::to_string(s_ignore_broken_records) + "\n" + ::arg()["max-generate-steps"] + "\n" + ::arg()["max-include-depth"];
+
+    if (loadSnapshot(bbd, snapshotPath, snapshotInfo)) {
+      bbd->setCtime();
+      bbd->d_loaded = true;
+      bbd->d_checknow = false;
+      bbd->d_status = "mapped into memory from snapshot at " + nowTime();
+      bbd->d_nsec3zone = nsec3zone;
+      bbd->d_nsec3param = ns3pr;
+      return;
+    }
   }
-  else
-    nsec3zone = getNSEC3PARAMuncached(bbd->d_name, &ns3pr);
 
   auto records = std::make_shared<recordstorage_t>();
   ZoneParserTNG zpt(bbd->d_filename, bbd->d_name, s_binddirectory, d_upgradeContent);
@@ -511,13 +605,35 @@ void Bind2Backend::parseZoneFile(BB2DomainInfo* bbd)
 
     insertRecord(records, bbd->d_name, rr.qname, rr.qtype, rr.content, rr.ttl, "");
   }
+  /* stat()ed when opened, like the zone file, so a change made while we parse invalidates the snapshot */
+  for (const auto& [name, st] : zpt.getIncludedFiles()) {
+    snapshotInfo.d_includes.emplace_back(name, Bind2CompactStorage::FileInfo(st));
+  }
   fixupOrderAndAuth(records, bbd->d_name, nsec3zone, ns3pr);
   doEmptyNonTerminals(records, bbd->d_name, nsec3zone, ns3pr);
   bbd->setCtime();
   bbd->d_loaded = true;
   bbd->d_checknow = false;
   bbd->d_status = "parsed into memory at " + nowTime();
-  bbd->d_records = LookButDontTouch<recordstorage_t>(std::move(records));
+  if (s_compact_storage) {
+    auto compact = std::make_shared<Bind2CompactStorage>(*records);
+    if (!snapshotPath.empty()) {
+      try {
+        compact->save(snapshotPath, snapshotInfo);
+      }
+      catch (const PDNSException& e) {
+        g_log << Logger::Warning << "Unable to save a snapshot of zone '" << bbd->d_name << "': " << e.reason << endl;
+      }
+    }
+    bbd->d_memoryUsage = compact->getMemoryUsage();
+    bbd->d_compact = LookButDontTouch<Bind2CompactStorage>(std::move(compact));
+    bbd->d_records = LookButDontTouch<recordstorage_t>();
+  }
+  else {
+    bbd->d_memoryUsage = getRecordsMemoryUsage(*records);
+    bbd->d_records = LookButDontTouch<recordstorage_t>(std::move(records));
+    bbd->d_compact = LookButDontTouch<Bind2CompactStorage>();
+  }
   bbd->d_nsec3zone = nsec3zone;
   bbd->d_nsec3param = ns3pr;
 }
@@ -587,6 +703,15 @@ string Bind2Backend::DLReloadNowHandler(const vector<string>& parts, Utility::pi
   return ret.str();
 }
 
+static void printDomainStatus(ostringstream& ret, const string& name, const BB2DomainInfo& info)
+{
+  ret << name << ": " << (info.d_loaded ? "" : "[rejected]") << "\t" << info.d_status;
+  if (info.d_loaded) {
+    ret << ", " << info.d_memoryUsage << " bytes in memory";
+  }
+  ret << "\n";
+}
+
 string Bind2Backend::DLDomStatusHandler(const vector<string>& parts, Utility::pid_t /* ppid */)
 {
   ostringstream ret;
@@ -595,7 +720,7 @@ string Bind2Backend::DLDomStatusHandler(const vector<string>& parts, Utility::pi
     for (auto i = parts.begin() + 1; i < parts.end(); ++i) {
       BB2DomainInfo bbd;
       if (safeGetBBDomainInfo(DNSName(*i), &bbd)) {
-        ret << *i << ": " << (bbd.d_loaded ? "" : "[rejected]") << "\t" << bbd.d_status << "\n";
+        printDomainStatus(ret, *i, bbd);
       }
       else {
         ret << *i << " no such domain\n";
@@ -605,7 +730,7 @@ string Bind2Backend::DLDomStatusHandler(const vector<string>& parts, Utility::pi
   else {
     auto state = s_state.read_lock();
     for (const auto& i : *state) {
-      ret << i.d_name << ": " << (i.d_loaded ? "" : "[rejected]") << "\t" << i.d_status << "\n";
+      printDomainStatus(ret, i.d_name.toString(), i);
     }
   }
 
@@ -641,7 +766,9 @@ static void printDomainExtendedStatus(ostringstream& ret, const BB2DomainInfo& i
   for (const auto& also : info.d_also_notify) {
     ret << "\t\t - " << also << std::endl;
   }
-  ret << "\t Number of records: " << info.d_records.getEntriesCount() << std::endl;
+  ret << "\t Number of records: " << info.d_records.getEntriesCount() + info.d_compact.getEntriesCount() << std::endl;
+  ret << "\t Storage: " << (info.d_compact.get() ? "compact" : "regular") << std::endl;
+  ret << "\t Memory usage: " << info.d_memoryUsage << " bytes" << std::endl;
   ret << "\t Loaded: " << info.d_loaded << std::endl;
   ret << "\t Check now: " << info.d_checknow << std::endl;
   ret << "\t Check interval: " << info.getCheckInterval() << std::endl;
@@ -750,6 +877,19 @@ Bind2Backend::Bind2Backend(const string& suffix, bool loadZones)
 
   d_transaction_id = 0;
   s_ignore_broken_records = mustDo("ignore-broken-records");
+  s_compact_storage = mustDo("compact-storage");
+  s_snapshot_directory = getArg("snapshot-directory");
+  if (!s_snapshot_directory.empty() && !s_compact_storage) {
+    g_log << Logger::Warning << d_logprefix << " Snapshots are only used with bind-compact-storage, ignoring bind-snapshot-directory" << endl;
+    s_snapshot_directory.clear();
+  }
+  {
+    vector<string> priorityZones;
+    stringtok(priorityZones, getArg("priority-zones"), ", \t");
+    for (const auto& zone : priorityZones) {
+      d_priorityZones.emplace_back(zone);
+    }
+  }
   d_upgradeContent = ::arg().mustDo("upgrade-unknown-types");
 
   if (!loadZones && d_hybrid)
@@ -882,6 +1022,94 @@ void Bind2Backend::doEmptyNonTerminals(std::shared_ptr<recordstorage_t>& records
   }
 }
 
+size_t Bind2Backend::getPriority(const DNSName& zone) const
+{
+  size_t priority = 0;
+  for (; priority < d_priorityZones.size(); priority++) {
+    if (zone.isPartOf(d_priorityZones.at(priority))) {
+      break;
+    }
+  }
+  return priority;
+}
+
+bool Bind2Backend::loadZone(ZoneLoadJob& job, string* status, std::mutex& lock)
+{
+  auto& bbd = job.bbd;
+  g_log << Logger::Info << d_logprefix << " parsing '" << bbd.d_name << "' from file '" << bbd.d_filename << "'" << endl;
+
+  ostringstream msg;
+  try {
+    NSEC3PARAMRecordContent ns3pr;
+    bool nsec3zone;
+    {
+      // the DNSSEC database is not ours to share
+      std::lock_guard<std::mutex> l(lock);
+      nsec3zone = getZoneNSEC3PARAM(bbd.d_name, &ns3pr);
+    }
+    parseZoneFile(&bbd, nsec3zone, ns3pr);
+  }
+  catch (PDNSException& ae) {
+    msg << " error at " + nowTime() + " parsing '" << bbd.d_name << "' from file '" << bbd.d_filename << "': " << ae.reason;
+  }
+  catch (std::system_error& ae) {
+    if (ae.code().value() == ENOENT && job.newSlave)
+      msg << " error at " + nowTime() << " no file found for new slave domain '" << bbd.d_name << "'. Has not been AXFR'd yet";
+    else
+      msg << " error at " + nowTime() + " parsing '" << bbd.d_name << "' from file '" << bbd.d_filename << "': " << ae.what();
+  }
+  catch (std::exception& ae) {
+    msg << " error at " + nowTime() + " parsing '" << bbd.d_name << "' from file '" << bbd.d_filename << "': " << ae.what();
+  }
+
+  bool loaded = msg.str().empty();
+  if (!loaded) {
+    bbd.d_status = msg.str();
+    g_log << Logger::Warning << d_logprefix << msg.str() << endl;
+    if (status != nullptr) {
+      std::lock_guard<std::mutex> l(lock);
+      *status += msg.str();
+    }
+  }
+  safePutBBDomainInfo(bbd);
+  return loaded;
+}
+
+int Bind2Backend::loadZones(vector<ZoneLoadJob>& jobs, string* status)
+{
+  std::mutex lock;
+  std::atomic<int> rejected{0};
+  std::atomic<size_t> next{0};
+
+  auto worker = [this, &jobs, status, &lock, &rejected, &next]() {
+    for (size_t pos = next++; pos < jobs.size(); pos = next++) {
+      if (!loadZone(jobs.at(pos), status, lock)) {
+        rejected++;
+      }
+    }
+  };
+
+  size_t numThreads = std::min(static_cast<size_t>(getArgAsNum("load-threads")), jobs.size());
+  if (numThreads <= 1) {
+    worker();
+    return rejected;
+  }
+
+  g_log << Logger::Warning << d_logprefix << " Loading " << jobs.size() << " zone(s) using " << numThreads << " threads" << endl;
+  vector<std::thread> threads;
+  threads.reserve(numThreads);
+  for (size_t idx = 0; idx < numThreads; idx++) {
+    threads.emplace_back([&worker]() {
+      setThreadName("pdns/bindload");
+      worker();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return rejected;
+}
+
 void Bind2Backend::loadConfig(string* status)
 {
   static int domain_id = 1;
@@ -924,6 +1152,7 @@ void Bind2Backend::loadConfig(string* status)
     }
 
     sort(domains.begin(), domains.end()); // put stuff in inode order
+    vector<ZoneLoadJob> jobs;
     for (const auto& domain : domains) {
       if (!(domain.hadFileDirective)) {
         g_log << Logger::Warning << d_logprefix << " Zone '" << domain.name << "' has no 'file' directive set in " << getArg("config") << endl;
@@ -970,52 +1199,17 @@ void Bind2Backend::loadConfig(string* status)
 
       newnames.insert(bbd.d_name);
       if (filenameChanged || !bbd.d_loaded || !bbd.current()) {
-        g_log << Logger::Info << d_logprefix << " parsing '" << domain.name << "' from file '" << domain.filename << "'" << endl;
-
-        try {
-          parseZoneFile(&bbd);
-        }
-        catch (PDNSException& ae) {
-          ostringstream msg;
-          msg << " error at " + nowTime() + " parsing '" << domain.name << "' from file '" << domain.filename << "': " << ae.reason;
-
-          if (status != nullptr)
-            *status += msg.str();
-          bbd.d_status = msg.str();
-
-          g_log << Logger::Warning << d_logprefix << msg.str() << endl;
-          rejected++;
-        }
-        catch (std::system_error& ae) {
-          ostringstream msg;
-          if (ae.code().value() == ENOENT && isNew && domain.type == "slave")
-            msg << " error at " + nowTime() << " no file found for new slave domain '" << domain.name << "'. Has not been AXFR'd yet";
-          else
-            msg << " error at " + nowTime() + " parsing '" << domain.name << "' from file '" << domain.filename << "': " << ae.what();
-
-          if (status != nullptr)
-            *status += msg.str();
-          bbd.d_status = msg.str();
-          g_log << Logger::Warning << d_logprefix << msg.str() << endl;
-          rejected++;
-        }
-        catch (std::exception& ae) {
-          ostringstream msg;
-          msg << " error at " + nowTime() + " parsing '" << domain.name << "' from file '" << domain.filename << "': " << ae.what();
-
-          if (status != nullptr)
-            *status += msg.str();
-          bbd.d_status = msg.str();
-
-          g_log << Logger::Warning << d_logprefix << msg.str() << endl;
-          rejected++;
-        }
-        safePutBBDomainInfo(bbd);
+        jobs.push_back({std::move(bbd), isNew && domain.type == "slave", getPriority(domain.name)});
       }
       else if (addressesChanged || kindChanged) {
         safePutBBDomainInfo(bbd);
       }
     }
+
+    // more important zones first, the others staying in inode order
+    stable_sort(jobs.begin(), jobs.end(), [](const ZoneLoadJob& a, const ZoneLoadJob& b) { return a.priority < b.priority; });
+    rejected += loadZones(jobs, status);
+
     vector<DNSName> diff;
 
     set_difference(oldnames.begin(), oldnames.end(), newnames.begin(), newnames.end(), back_inserter(diff));
@@ -1050,6 +1244,7 @@ void Bind2Backend::queueReloadAndStore(unsigned int id)
     /* make sure that nothing will be able to alter the existing records,
        we will load them from the zone file instead */
     bbnew.d_records = LookButDontTouch<recordstorage_t>();
+    bbnew.d_compact = LookButDontTouch<Bind2CompactStorage>();
     parseZoneFile(&bbnew);
     bbnew.d_wasRejectedLastReload = false;
     safePutBBDomainInfo(bbnew);
@@ -1107,12 +1302,79 @@ bool Bind2Backend::findBeforeAndAfterUnhashed(std::shared_ptr<const recordstorag
   return true;
 }
 
+bool Bind2Backend::getBeforeAndAfterNamesCompact(const std::shared_ptr<const Bind2CompactStorage>& records, const BB2DomainInfo& bbd, const DNSName& qname, DNSName& unhashed, DNSName& before, DNSName& after)
+{
+  const auto& storage = *records;
+  if (!bbd.d_nsec3zone) {
+    /* same walk as findBeforeAndAfterUnhashed() */
+    if (storage.empty()) {
+      return false;
+    }
+    auto isNSECName = [&storage](size_t pos) {
+      const auto& entry = storage[pos];
+      return (entry.d_auth || entry.d_qtype == QType::NS) && entry.d_qtype != 0;
+    };
+
+    size_t posBefore, posAfter;
+    posBefore = posAfter = storage.upperBound(qname.makeLowerCase());
+
+    if (posBefore != 0)
+      --posBefore;
+    while (!isNSECName(posBefore))
+      --posBefore;
+    before = storage.getName(storage[posBefore]);
+
+    if (posAfter == storage.size()) {
+      posAfter = 0;
+    }
+    else {
+      while (!isNSECName(posAfter)) {
+        ++posAfter;
+        if (posAfter == storage.size()) {
+          posAfter = 0;
+          break;
+        }
+      }
+    }
+    after = storage.getName(storage[posAfter]);
+
+    return true;
+  }
+
+  const auto& hashindex = storage.getNSEC3Index();
+  if (hashindex.empty()) {
+    return false;
+  }
+
+  auto pos = storage.upperBoundNSEC3(qname.toStringNoDot());
+  if (pos == hashindex.size()) {
+    --pos;
+    before = DNSName(storage.getNSEC3Hash(storage[hashindex[pos]]));
+    after = DNSName(storage.getNSEC3Hash(storage[hashindex[0]]));
+  }
+  else {
+    after = DNSName(storage.getNSEC3Hash(storage[hashindex[pos]]));
+    if (pos != 0)
+      --pos;
+    else
+      pos = hashindex.size() - 1;
+    before = DNSName(storage.getNSEC3Hash(storage[hashindex[pos]]));
+  }
+  unhashed = storage.getName(storage[hashindex[pos]]) + bbd.d_name;
+
+  return true;
+}
+
 bool Bind2Backend::getBeforeAndAfterNamesAbsolute(uint32_t id, const DNSName& qname, DNSName& unhashed, DNSName& before, DNSName& after)
 {
   BB2DomainInfo bbd;
   if (!safeGetBBDomainInfo(id, &bbd))
     return false;
 
+  if (auto compact = bbd.d_compact.get()) {
+    return getBeforeAndAfterNamesCompact(compact, bbd, qname, unhashed, before, after);
+  }
+
   shared_ptr<const recordstorage_t> records = bbd.d_records.get();
   if (!bbd.d_nsec3zone) {
     return findBeforeAndAfterUnhashed(records, qname, unhashed, before, after);
@@ -1197,17 +1459,22 @@ void Bind2Backend::lookup(const QType& qtype, const DNSName& qname, int zoneId,
     throw DBException("Zone for '" + d_handle.domain.toLogString() + "' in '" + bbd.d_filename + "' not loaded (file missing, corrupt or master dead)"); // fsck
   }
 
+  d_handle.mustlog = mustlog;
+  d_handle.d_list = false;
+
+  if ((d_handle.d_compact = bbd.d_compact.get())) {
+    std::tie(d_handle.d_compact_pos, d_handle.d_compact_end) = d_handle.d_compact->equalRange(d_handle.qname);
+    return;
+  }
+
   d_handle.d_records = bbd.d_records.get();
 
   if (d_handle.d_records->empty())
     DLOG(g_log << "Query with no results" << endl);
 
-  d_handle.mustlog = mustlog;
-
   const auto& hashedidx = boost::multi_index::get<UnorderedNameTag>(*d_handle.d_records);
   auto range = hashedidx.equal_range(d_handle.qname);
 
-  d_handle.d_list = false;
   d_handle.d_iter = range.first;
   d_handle.d_end_iter = range.second;
 }
@@ -1219,7 +1486,7 @@ Bind2Backend::handle::handle()
 
 bool Bind2Backend::get(DNSResourceRecord& r)
 {
-  if (!d_handle.d_records) {
+  if (!d_handle.d_records && !d_handle.d_compact) {
     if (d_handle.mustlog)
       g_log << Logger::Warning << "There were no answers" << endl;
     return false;
@@ -1238,8 +1505,91 @@ bool Bind2Backend::get(DNSResourceRecord& r)
   return true;
 }
 
+bool Bind2Backend::get(DNSZoneRecord& zr)
+{
+  if (!d_handle.d_compact) {
+    /* the regular storage only holds the content as text */
+    return DNSBackend::get(zr);
+  }
+
+  if (!d_handle.get(zr)) {
+    if (d_handle.mustlog)
+      g_log << Logger::Warning << "End of answers" << endl;
+
+    d_handle.reset();
+
+    return false;
+  }
+  if (d_handle.mustlog)
+    g_log << Logger::Warning << "Returning: '" << QType(zr.dr.d_type).toString() << "' of '" << zr.dr.d_name << "', content: '" << zr.dr.getContent()->getZoneRepresentation() << "'" << endl;
+  return true;
+}
+
+bool Bind2Backend::handle::next_compact(size_t& pos)
+{
+  while (d_compact_pos != d_compact_end) {
+    pos = d_compact_pos++;
+    if (d_list || qtype.getCode() == QType::ANY || (*d_compact)[pos].d_qtype == qtype.getCode()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Bind2Backend::handle::get(DNSZoneRecord& zr)
+{
+  size_t pos;
+  if (!next_compact(pos)) {
+    return false;
+  }
+
+  const auto& entry = (*d_compact)[pos];
+  if (d_list) {
+    zr.dr.d_name = d_compact->getName(entry) + domain;
+  }
+  else {
+    zr.dr.d_name = qname.empty() ? domain : (qname + domain);
+  }
+  zr.domain_id = id;
+  zr.scopeMask = 0;
+  zr.auth = entry.d_auth;
+  zr.dr.d_type = entry.d_qtype;
+  zr.dr.d_class = QClass::IN;
+  zr.dr.d_ttl = entry.d_ttl;
+  zr.dr.d_place = DNSResourceRecord::ANSWER;
+  zr.dr.d_clen = 0;
+  try {
+    zr.dr.setContent(d_compact->getRecordContent(entry, zr.dr.d_name));
+  }
+  catch (...) {
+    d_compact_pos = d_compact_end;
+    throw;
+  }
+  return true;
+}
+
 bool Bind2Backend::handle::get(DNSResourceRecord& r)
 {
+  if (d_compact) {
+    size_t pos;
+    if (!next_compact(pos)) {
+      return false;
+    }
+    const auto& entry = (*d_compact)[pos];
+    if (d_list) {
+      r.qname = d_compact->getName(entry) + domain;
+    }
+    else {
+      r.qname = qname.empty() ? domain : (qname + domain);
+    }
+    r.domain_id = id;
+    r.content = d_compact->getContent(entry, r.qname);
+    r.qtype = entry.d_qtype;
+    r.ttl = entry.d_ttl;
+    r.auth = entry.d_auth;
+    return true;
+  }
+
   if (d_list)
     return get_list(r);
   else
@@ -1249,6 +1599,7 @@ bool Bind2Backend::handle::get(DNSResourceRecord& r)
 void Bind2Backend::handle::reset()
 {
   d_records.reset();
+  d_compact.reset();
   qname.clear();
   mustlog = false;
 }
@@ -1301,9 +1652,15 @@ bool Bind2Backend::list(const DNSName& /* target */, int id, bool /* include_dis
     throw PDNSException("zone was not loaded, perhaps because of: " + bbd.d_status);
   }
 
-  d_handle.d_records = bbd.d_records.get(); // give it a copy, which will stay around
-  d_handle.d_qname_iter = d_handle.d_records->begin();
-  d_handle.d_qname_end = d_handle.d_records->end(); // iter now points to a vector of pointers to vector<BBResourceRecords>
+  if ((d_handle.d_compact = bbd.d_compact.get())) {
+    d_handle.d_compact_pos = 0;
+    d_handle.d_compact_end = d_handle.d_compact->size();
+  }
+  else {
+    d_handle.d_records = bbd.d_records.get(); // give it a copy, which will stay around
+    d_handle.d_qname_iter = d_handle.d_records->begin();
+    d_handle.d_qname_end = d_handle.d_records->end(); // iter now points to a vector of pointers to vector<BBResourceRecords>
+  }
 
   d_handle.id = id;
   d_handle.domain = bbd.d_name;
@@ -1466,6 +1823,25 @@ bool Bind2Backend::searchRecords(const string& pattern, int maxResults, vector<D
         continue;
       }
 
+      if (auto compact = h.d_compact.get()) {
+        for (size_t pos = 0; result.size() < static_cast<vector<DNSResourceRecord>::size_type>(maxResults) && pos < compact->size(); pos++) {
+          const auto& entry = (*compact)[pos];
+          DNSName name = compact->getName(entry) + i.d_name;
+          string content = compact->getContent(entry, name);
+          if (sm.match(name) || sm.match(content)) {
+            DNSResourceRecord r;
+            r.qname = name;
+            r.domain_id = i.d_id;
+            r.content = std::move(content);
+            r.qtype = entry.d_qtype;
+            r.ttl = entry.d_ttl;
+            r.auth = entry.d_auth;
+            result.push_back(std::move(r));
+          }
+        }
+        continue;
+      }
+
       shared_ptr<const recordstorage_t> rhandle = h.d_records.get();
 
       for (recordstorage_t::const_iterator ri = rhandle->begin(); result.size() < static_cast<vector<DNSResourceRecord>::size_type>(maxResults) && ri != rhandle->end(); ri++) {
@@ -1496,6 +1872,10 @@ public:
   void declareArguments(const string& suffix = "") override
   {
     declare(suffix, "ignore-broken-records", "Ignore records that are out-of-bound for the zone.", "no");
+    declare(suffix, "compact-storage", "Keep the records of the zones in compact, read-only arenas", "no");
+    declare(suffix, "load-threads", "Number of threads parsing the zone files when (re)loading the configuration", "1");
+    declare(suffix, "priority-zones", "Zones, with the zones below them, to load before the others, in this order", "");
+    declare(suffix, "snapshot-directory", "Directory to store the zones loaded with bind-compact-storage in, to map them on the next start. Empty for none", "");
     declare(suffix, "config", "Location of named.conf", "");
     declare(suffix, "check-interval", "Interval for zonefile changes", "0");
     declare(suffix, "supermaster-config", "Location of (part of) named.conf where pdns can write zone-statements to", "");
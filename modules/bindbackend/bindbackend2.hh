@@ -104,6 +104,8 @@ typedef multi_index_container<
     ordered_non_unique<tag<NSEC3Tag>, member<Bind2DNSRecord, std::string, &Bind2DNSRecord::nsec3hash>>>>
   recordstorage_t;
 
+class Bind2CompactStorage;
+
 template <typename T>
 class LookButDontTouch
 {
@@ -116,7 +118,7 @@ public:
   {
   }
 
-  shared_ptr<const T> get()
+  shared_ptr<const T> get() const
   {
     return d_records;
   }
@@ -156,6 +158,8 @@ public:
   vector<ComboAddress> d_masters; //!< IP address of the master of this domain
   set<string> d_also_notify; //!< IP list of hosts to also notify
   LookButDontTouch<recordstorage_t> d_records; //!< the actual records belonging to this domain
+  LookButDontTouch<Bind2CompactStorage> d_compact; //!< the records, instead of d_records, when bind-compact-storage is set
+  size_t d_memoryUsage{0}; //!< memory used by the records, estimated for d_records
   time_t d_ctime{0}; //!< last known ctime of the file on disk
   time_t d_lastcheck{0}; //!< last time domain was checked for freshness
   uint32_t d_lastnotified{0}; //!< Last serial number we notified our slaves of
@@ -192,6 +196,7 @@ public:
   void lookup(const QType&, const DNSName& qdomain, int zoneId, DNSPacket* p = nullptr) override;
   bool list(const DNSName& target, int id, bool include_disabled = false) override;
   bool get(DNSResourceRecord&) override;
+  bool get(DNSZoneRecord&) override;
   void getAllDomains(vector<DomainInfo>* domains, bool getSerial, bool include_disabled = false) override;
 
   static DNSBackend* maker();
@@ -232,6 +237,7 @@ public:
   static SharedLockGuarded<state_t> s_state;
 
   void parseZoneFile(BB2DomainInfo* bbd);
+  void parseZoneFile(BB2DomainInfo* bbd, bool nsec3zone, const NSEC3PARAMRecordContent& ns3pr); //!< does not use the DNSSEC database, can be called from several threads
   void rediscover(string* status = nullptr) override;
 
   // for autoprimary support
@@ -256,6 +262,7 @@ private:
   {
   public:
     bool get(DNSResourceRecord&);
+    bool get(DNSZoneRecord&);
     void reset();
 
     handle();
@@ -265,6 +272,9 @@ private:
 
     recordstorage_t::const_iterator d_qname_iter, d_qname_end;
 
+    shared_ptr<const Bind2CompactStorage> d_compact;
+    size_t d_compact_pos{0}, d_compact_end{0};
+
     DNSName qname;
     DNSName domain;
 
@@ -276,6 +286,7 @@ private:
   private:
     bool get_normal(DNSResourceRecord&);
     bool get_list(DNSResourceRecord&);
+    bool next_compact(size_t& pos);
 
     void operator=(const handle&); // don't go copying this
     handle(const handle&);
@@ -308,13 +319,28 @@ private:
   static int s_first; //!< this is raised on construction to prevent multiple instances of us being generated
   int d_transaction_id;
   static bool s_ignore_broken_records;
+  static bool s_compact_storage;
+  static string s_snapshot_directory;
   bool d_hybrid;
   bool d_upgradeContent;
+  vector<DNSName> d_priorityZones;
 
   BB2DomainInfo createDomainEntry(const DNSName& domain, const string& filename); //!< does not insert in s_state
 
   void queueReloadAndStore(unsigned int id);
+
+  struct ZoneLoadJob
+  {
+    BB2DomainInfo bbd;
+    bool newSlave;
+    size_t priority;
+  };
+  size_t getPriority(const DNSName& zone) const;
+  bool loadZone(ZoneLoadJob& job, string* status, std::mutex& lock);
+  int loadZones(vector<ZoneLoadJob>& jobs, string* status);
+  bool getZoneNSEC3PARAM(const DNSName& name, NSEC3PARAMRecordContent* ns3p);
   static bool findBeforeAndAfterUnhashed(std::shared_ptr<const recordstorage_t>& records, const DNSName& qname, DNSName& unhashed, DNSName& before, DNSName& after);
+  static bool getBeforeAndAfterNamesCompact(const std::shared_ptr<const Bind2CompactStorage>& records, const BB2DomainInfo& bbd, const DNSName& qname, DNSName& unhashed, DNSName& before, DNSName& after);
   static void insertRecord(std::shared_ptr<recordstorage_t>& records, const DNSName& zoneName, const DNSName& qname, const QType& qtype, const string& content, int ttl, const std::string& hashed = string(), bool* auth = nullptr);
   void reload() override;
   static string DLDomStatusHandler(const vector<string>& parts, Utility::pid_t ppid);
@@ -0,0 +1,476 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bindcompactstorage.hh"
+#include "pdns/misc.hh"
+#include "pdns/pdnsexception.hh"
+
+Bind2CompactStorage::Bind2CompactStorage(const recordstorage_t& records)
+{
+  d_entriesStorage.reserve(records.size());
+
+  size_t names = 0;
+  const Bind2DNSRecord* previous = nullptr;
+  Entry entry{};
+  for (const auto& record : records) {
+    if (previous == nullptr || !(previous->qname == record.qname)) {
+      const auto& storage = record.qname.getStorage();
+      entry.d_name = append(storage.data(), storage.size());
+      entry.d_nameLen = static_cast<uint8_t>(storage.size());
+      names++;
+    }
+    previous = &record;
+
+    /* the content is stored uncompressed, so it does not depend on the owner name */
+    entry.d_wire = false;
+    std::string content;
+    if (record.qtype != 0) {
+      try {
+        std::string text(record.content);
+        if (record.qtype == QType::TXT && !text.empty() && text[0] != '"') {
+          text = "\"" + text + "\"";
+        }
+        content = DNSRecordContent::mastermake(record.qtype, QClass::IN, text)->serialize(g_rootdnsname, true);
+        entry.d_wire = true;
+      }
+      catch (...) {
+        /* kept as text, it will fail the same way as with the regular storage when served */
+      }
+    }
+    if (!entry.d_wire) {
+      content = record.content;
+    }
+    entry.d_content = append(content.data(), content.size());
+    entry.d_contentLen = static_cast<uint32_t>(content.size());
+    append(record.nsec3hash.data(), record.nsec3hash.size());
+    entry.d_nsec3hashLen = static_cast<uint8_t>(record.nsec3hash.size());
+
+    entry.d_ttl = record.ttl;
+    entry.d_qtype = record.qtype;
+    entry.d_auth = record.auth;
+    d_entriesStorage.push_back(entry);
+
+    if (!record.nsec3hash.empty()) {
+      d_nsec3Storage.push_back(static_cast<uint32_t>(d_entriesStorage.size() - 1));
+    }
+  }
+  d_arenaStorage.shrink_to_fit();
+  d_arena = d_arenaStorage;
+  d_entries = View<Entry>(d_entriesStorage.data(), d_entriesStorage.size());
+
+  size_t slots = 1;
+  while (slots < names * 2) {
+    slots <<= 1;
+  }
+  d_namesStorage.resize(slots, 0);
+  const size_t mask = slots - 1;
+  for (size_t pos = 0; pos < d_entries.size(); pos++) {
+    if (pos > 0 && sameName(d_entries[pos], d_entries[pos - 1])) {
+      continue;
+    }
+    const auto& current = d_entries[pos];
+    size_t slot = burtleCI(reinterpret_cast<const unsigned char*>(d_arena.data()) + current.d_name, current.d_nameLen, 0) & mask;
+    while (d_namesStorage[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    d_namesStorage[slot] = static_cast<uint32_t>(pos + 1);
+  }
+  d_names = View<uint32_t>(d_namesStorage.data(), d_namesStorage.size());
+
+  std::sort(d_nsec3Storage.begin(), d_nsec3Storage.end(), [this](uint32_t a, uint32_t b) {
+    return getNSEC3Hash(d_entries[a]) < getNSEC3Hash(d_entries[b]);
+  });
+  d_nsec3 = View<uint32_t>(d_nsec3Storage.data(), d_nsec3Storage.size());
+}
+
+uint32_t Bind2CompactStorage::append(const char* data, size_t len)
+{
+  if (d_arenaStorage.size() + len > std::numeric_limits<uint32_t>::max()) {
+    throw PDNSException("Zone is too large for bind-compact-storage");
+  }
+  auto offset = static_cast<uint32_t>(d_arenaStorage.size());
+  d_arenaStorage.append(data, len);
+  return offset;
+}
+
+size_t Bind2CompactStorage::getMemoryUsage() const
+{
+  if (d_mapping) {
+    return sizeof(*this) + d_mappingSize;
+  }
+  return sizeof(*this) + d_arenaStorage.capacity() + d_entriesStorage.capacity() * sizeof(Entry) + d_namesStorage.capacity() * sizeof(uint32_t) + d_nsec3Storage.capacity() * sizeof(uint32_t);
+}
+
+uint32_t Bind2CompactStorage::getSerial() const
+{
+  /* the SOA sorts first */
+  if (d_entries.empty() || d_entries[0].d_qtype != QType::SOA) {
+    return 0;
+  }
+  auto soa = std::dynamic_pointer_cast<const SOARecordContent>(getRecordContent(d_entries[0], g_rootdnsname));
+  return soa ? soa->d_st.serial : 0;
+}
+
+namespace
+{
+/* a snapshot is this header, the parameters, the included files, then the arena and the three arrays,
+   each of them aligned on 8 bytes, in the byte order of the host that wrote it */
+struct SnapshotHeader
+{
+  char d_magic[8];
+  uint32_t d_version;
+  uint32_t d_byteOrder;
+  uint32_t d_entrySize;
+  uint32_t d_paramsLen;
+  uint64_t d_mtime;
+  uint64_t d_mtimeNsec;
+  uint64_t d_inode;
+  uint64_t d_size;
+  uint64_t d_includesLen;
+  uint64_t d_arenaLen;
+  uint64_t d_entriesCount;
+  uint64_t d_namesCount;
+  uint64_t d_nsec3Count;
+};
+
+const char s_snapshotMagic[8] = {'P', 'D', 'N', 'S', 'B', 'Z', 'S', '\0'};
+const uint32_t s_snapshotVersion = 3;
+const uint32_t s_snapshotByteOrder = 0x01020304;
+
+size_t padTo8(size_t len)
+{
+  return (len + 7) & ~static_cast<size_t>(7);
+}
+
+/* each included file is its FileInfo, the length of its name then the name, padded to 8 bytes */
+std::string serializeIncludes(const std::vector<std::pair<std::string, Bind2CompactStorage::FileInfo>>& includes)
+{
+  std::string result;
+  for (const auto& [name, fileInfo] : includes) {
+    uint64_t nameLen = name.size();
+    result.append(reinterpret_cast<const char*>(&fileInfo), sizeof(fileInfo));
+    result.append(reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
+    result.append(name);
+    result.append(padTo8(name.size()) - name.size(), '\0');
+  }
+  return result;
+}
+
+bool includesUnchanged(const char* data, size_t len, const std::string& path)
+{
+  size_t pos = 0;
+  while (pos < len) {
+    Bind2CompactStorage::FileInfo recorded;
+    uint64_t nameLen{0};
+    if (len - pos < sizeof(recorded) + sizeof(nameLen)) {
+      throw PDNSException("Snapshot '" + path + "' is corrupted");
+    }
+    memcpy(&recorded, data + pos, sizeof(recorded));
+    memcpy(&nameLen, data + pos + sizeof(recorded), sizeof(nameLen));
+    pos += sizeof(recorded) + sizeof(nameLen);
+    if (nameLen > len - pos) {
+      throw PDNSException("Snapshot '" + path + "' is corrupted");
+    }
+    std::string name(data + pos, nameLen);
+    pos += padTo8(nameLen);
+
+    struct stat st;
+    if (stat(name.c_str(), &st) != 0 || !(Bind2CompactStorage::FileInfo(st) == recorded)) {
+      return false;
+    }
+  }
+  return true;
+}
+}
+
+Bind2CompactStorage::FileInfo::FileInfo(const struct stat& st) :
+  d_mtime(st.st_mtime), d_mtimeNsec(st.st_mtim.tv_nsec), d_inode(st.st_ino), d_size(st.st_size)
+{
+}
+
+void Bind2CompactStorage::save(const std::string& path, const SnapshotInfo& info) const
+{
+  SnapshotHeader header{};
+  memcpy(header.d_magic, s_snapshotMagic, sizeof(header.d_magic));
+  header.d_version = s_snapshotVersion;
+  header.d_byteOrder = s_snapshotByteOrder;
+  header.d_entrySize = sizeof(Entry);
+  header.d_paramsLen = info.d_params.size();
+  header.d_mtime = info.d_zoneFile.d_mtime;
+  header.d_mtimeNsec = info.d_zoneFile.d_mtimeNsec;
+  header.d_inode = info.d_zoneFile.d_inode;
+  header.d_size = info.d_zoneFile.d_size;
+  const auto includes = serializeIncludes(info.d_includes);
+  header.d_includesLen = includes.size();
+  header.d_arenaLen = d_arena.size();
+  header.d_entriesCount = d_entries.size();
+  header.d_namesCount = d_names.size();
+  header.d_nsec3Count = d_nsec3.size();
+
+  std::string tmpPath = path + ".XXXXXX";
+  FDWrapper fd(mkstemp(&tmpPath.at(0)));
+  if (fd.getHandle() < 0) {
+    throw PDNSException("Unable to create snapshot '" + tmpPath + "': " + stringerror());
+  }
+
+  try {
+    static const char padding[8] = {0};
+    auto writeBlock = [&fd](const void* data, size_t len) {
+      writen2(fd, data, len);
+      writen2(fd, padding, padTo8(len) - len);
+    };
+    writeBlock(&header, sizeof(header));
+    writeBlock(info.d_params.data(), info.d_params.size());
+    writeBlock(includes.data(), includes.size());
+    writeBlock(d_arena.data(), d_arena.size());
+    writeBlock(d_entries.begin(), d_entries.size() * sizeof(Entry));
+    writeBlock(d_names.begin(), d_names.size() * sizeof(uint32_t));
+    writeBlock(d_nsec3.begin(), d_nsec3.size() * sizeof(uint32_t));
+    if (rename(tmpPath.c_str(), path.c_str()) < 0) {
+      throw PDNSException("Unable to rename snapshot '" + tmpPath + "' to '" + path + "': " + stringerror());
+    }
+  }
+  catch (const std::runtime_error& e) {
+    unlink(tmpPath.c_str());
+    throw PDNSException("Unable to write snapshot '" + path + "': " + e.what());
+  }
+  catch (...) {
+    unlink(tmpPath.c_str());
+    throw;
+  }
+}
+
+std::shared_ptr<Bind2CompactStorage> Bind2CompactStorage::load(const std::string& path, const SnapshotInfo& info)
+{
+  FDWrapper fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd.getHandle() < 0) {
+    if (errno == ENOENT) {
+      return nullptr;
+    }
+    throw PDNSException("Unable to open snapshot '" + path + "': " + stringerror());
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    throw PDNSException("Unable to stat snapshot '" + path + "': " + stringerror());
+  }
+  const auto fileSize = static_cast<size_t>(st.st_size);
+  if (fileSize < sizeof(SnapshotHeader)) {
+    return nullptr;
+  }
+
+  void* addr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    throw PDNSException("Unable to map snapshot '" + path + "': " + stringerror());
+  }
+  std::shared_ptr<const void> mapping(addr, [fileSize](const void* ptr) { munmap(const_cast<void*>(ptr), fileSize); });
+
+  const auto* data = static_cast<const char*>(addr);
+  SnapshotHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.d_magic, s_snapshotMagic, sizeof(header.d_magic)) != 0 || header.d_version != s_snapshotVersion || header.d_byteOrder != s_snapshotByteOrder || header.d_entrySize != sizeof(Entry)) {
+    /* written by another version, or on another kind of host */
+    return nullptr;
+  }
+  if (header.d_mtime != info.d_zoneFile.d_mtime || header.d_mtimeNsec != info.d_zoneFile.d_mtimeNsec || header.d_inode != info.d_zoneFile.d_inode || header.d_size != info.d_zoneFile.d_size || header.d_paramsLen != info.d_params.size()) {
+    return nullptr;
+  }
+
+  /* the counts are checked one at a time, so the sum cannot overflow */
+  size_t offset = padTo8(sizeof(header));
+  auto next = [&offset, fileSize, &path](uint64_t len) {
+    if (len > fileSize - offset) {
+      throw PDNSException("Snapshot '" + path + "' is truncated");
+    }
+    size_t start = offset;
+    offset = std::min(static_cast<size_t>(fileSize), offset + padTo8(len));
+    return start;
+  };
+  auto paramsOffset = next(header.d_paramsLen);
+  if (memcmp(data + paramsOffset, info.d_params.data(), info.d_params.size()) != 0) {
+    return nullptr;
+  }
+  auto includesOffset = next(header.d_includesLen);
+  if (!includesUnchanged(data + includesOffset, header.d_includesLen, path)) {
+    return nullptr;
+  }
+  if (header.d_entriesCount > fileSize / sizeof(Entry) || header.d_namesCount > fileSize / sizeof(uint32_t) || header.d_nsec3Count > fileSize / sizeof(uint32_t)) {
+    throw PDNSException("Snapshot '" + path + "' is corrupted");
+  }
+  auto arenaOffset = next(header.d_arenaLen);
+  auto entriesOffset = next(header.d_entriesCount * sizeof(Entry));
+  auto namesOffset = next(header.d_namesCount * sizeof(uint32_t));
+  auto nsec3Offset = next(header.d_nsec3Count * sizeof(uint32_t));
+
+  std::shared_ptr<Bind2CompactStorage> storage(new Bind2CompactStorage());
+  storage->d_arena = std::string_view(data + arenaOffset, header.d_arenaLen);
+  storage->d_entries = View<Entry>(reinterpret_cast<const Entry*>(data + entriesOffset), header.d_entriesCount);
+  storage->d_names = View<uint32_t>(reinterpret_cast<const uint32_t*>(data + namesOffset), header.d_namesCount);
+  storage->d_nsec3 = View<uint32_t>(reinterpret_cast<const uint32_t*>(data + nsec3Offset), header.d_nsec3Count);
+  storage->d_mapping = std::move(mapping);
+  storage->d_mappingSize = fileSize;
+  storage->validate();
+
+  return storage;
+}
+
+void Bind2CompactStorage::validate() const
+{
+  /* a damaged snapshot should not let us read outside of the mapping */
+  const auto corrupted = PDNSException("Snapshot is corrupted");
+  if (!d_entries.empty() && (d_names.empty() || (d_names.size() & (d_names.size() - 1)) != 0)) {
+    throw corrupted;
+  }
+  for (const auto& entry : d_entries) {
+    if (entry.d_name > d_arena.size() || entry.d_nameLen > d_arena.size() - entry.d_name) {
+      throw corrupted;
+    }
+    if (entry.d_content > d_arena.size() || static_cast<uint64_t>(entry.d_contentLen) + entry.d_nsec3hashLen > d_arena.size() - entry.d_content) {
+      throw corrupted;
+    }
+  }
+  size_t emptySlots = 0;
+  for (const auto pos : d_names) {
+    if (pos > d_entries.size()) {
+      throw corrupted;
+    }
+    if (pos == 0) {
+      emptySlots++;
+    }
+  }
+  /* equalRange() stops probing at the first empty slot, without one a miss would never end */
+  if (!d_entries.empty() && emptySlots == 0) {
+    throw corrupted;
+  }
+  for (const auto pos : d_nsec3) {
+    if (pos >= d_entries.size()) {
+      throw corrupted;
+    }
+  }
+}
+
+DNSName Bind2CompactStorage::getName(const Entry& entry) const
+{
+  if (entry.d_nameLen == 0) {
+    return DNSName();
+  }
+  return DNSName(d_arena.data() + entry.d_name, entry.d_nameLen, 0, false);
+}
+
+std::shared_ptr<const DNSRecordContent> Bind2CompactStorage::getRecordContent(const Entry& entry, const DNSName& qname) const
+{
+  if (!entry.d_wire) {
+    std::string content(d_arena.substr(entry.d_content, entry.d_contentLen));
+    if (entry.d_qtype == QType::TXT && !content.empty() && content[0] != '"') {
+      content = "\"" + content + "\"";
+    }
+    return DNSRecordContent::mastermake(entry.d_qtype, QClass::IN, content);
+  }
+
+  if (entry.d_qtype == QType::A && entry.d_contentLen == 4) {
+    uint32_t addr;
+    memcpy(&addr, d_arena.data() + entry.d_content, sizeof(addr));
+    return std::make_shared<ARecordContent>(addr);
+  }
+  return DNSRecordContent::deserialize(qname, entry.d_qtype, std::string(d_arena.substr(entry.d_content, entry.d_contentLen)));
+}
+
+std::string Bind2CompactStorage::getContent(const Entry& entry, const DNSName& qname) const
+{
+  if (!entry.d_wire) {
+    return std::string(d_arena.substr(entry.d_content, entry.d_contentLen));
+  }
+  return getRecordContent(entry, qname)->getZoneRepresentation();
+}
+
+bool Bind2CompactStorage::nameMatches(const Entry& entry, const DNSName::string_t& storage) const
+{
+  if (entry.d_nameLen != storage.size()) {
+    return false;
+  }
+  const char* name = d_arena.data() + entry.d_name;
+  for (size_t idx = 0; idx < storage.size(); idx++) {
+    if (dns_tolower(name[idx]) != dns_tolower(storage[idx])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::pair<size_t, size_t> Bind2CompactStorage::equalRange(const DNSName& qname) const
+{
+  if (d_entries.empty()) {
+    return {0, 0};
+  }
+
+  const auto& storage = qname.getStorage();
+  const size_t mask = d_names.size() - 1;
+  size_t slot = qname.hash() & mask;
+  while (d_names[slot] != 0) {
+    size_t first = d_names[slot] - 1;
+    if (nameMatches(d_entries[first], storage)) {
+      size_t last = first + 1;
+      while (last < d_entries.size() && sameName(d_entries[last], d_entries[first])) {
+        last++;
+      }
+      return {first, last};
+    }
+    slot = (slot + 1) & mask;
+  }
+  return {0, 0};
+}
+
+size_t Bind2CompactStorage::upperBound(const DNSName& qname) const
+{
+  size_t first = 0;
+  size_t count = d_entries.size();
+  while (count > 0) {
+    size_t step = count / 2;
+    size_t middle = first + step;
+    if (!qname.canonCompare(getName(d_entries[middle]))) {
+      first = middle + 1;
+      count -= step + 1;
+    }
+    else {
+      count = step;
+    }
+  }
+  return first;
+}
+
+size_t Bind2CompactStorage::upperBoundNSEC3(const std::string& hash) const
+{
+  auto iter = std::upper_bound(d_nsec3.begin(), d_nsec3.end(), hash, [this](const std::string& value, uint32_t pos) {
+    const auto& entry = d_entries[pos];
+    return d_arena.substr(entry.d_content + entry.d_contentLen, entry.d_nsec3hashLen).compare(value) > 0;
+  });
+  return iter - d_nsec3.begin();
+}
@@ -0,0 +1,196 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+
+#include "bindbackend2.hh"
+#include "pdns/dnsrecords.hh"
+
+/**
+  Read-only copy of the records of a zone, used instead of a recordstorage_t when
+  bind-compact-storage is set. It is built once the zone has been parsed, so the
+  ordering, auth and NSEC3 fixups are shared with the regular storage.
+
+  Names (relative to the zone, deduplicated) and rdata are packed in a single arena
+  per zone, in wire format whenever the content can be serialized. Records are small
+  fixed-size entries in canonical order pointing into that arena, with an open
+  addressing hash table on the name and a sorted index on the NSEC3 hash.
+
+  As nothing in there holds a pointer, the whole storage can be saved to a snapshot
+  file and mapped back into memory as is, instead of parsing the zone again.
+*/
+class Bind2CompactStorage
+{
+public:
+  struct Entry
+  {
+    uint32_t d_name; //!< offset of the name in the arena, in wire format
+    uint32_t d_content; //!< offset of the content, the NSEC3 hash, if any, follows it
+    uint32_t d_contentLen;
+    uint32_t d_ttl;
+    uint16_t d_qtype;
+    uint8_t d_nameLen;
+    uint8_t d_nsec3hashLen;
+    bool d_auth;
+    bool d_wire; //!< false if the content is kept as text, because it could not be serialized
+  };
+
+  //! Points into either the vectors owned by the storage or the mapped snapshot
+  template <typename T>
+  class View
+  {
+  public:
+    View() = default;
+    View(const T* data, size_t size) :
+      d_data(data), d_size(size)
+    {
+    }
+    const T& operator[](size_t pos) const
+    {
+      return d_data[pos];
+    }
+    const T* begin() const
+    {
+      return d_data;
+    }
+    const T* end() const
+    {
+      return d_data + d_size;
+    }
+    size_t size() const
+    {
+      return d_size;
+    }
+    bool empty() const
+    {
+      return d_size == 0;
+    }
+
+  private:
+    const T* d_data{nullptr};
+    size_t d_size{0};
+  };
+
+  /* the state of a file the zone was read from */
+  struct FileInfo
+  {
+    FileInfo() = default;
+    FileInfo(const struct stat& st);
+    bool operator==(const FileInfo& rhs) const
+    {
+      return d_mtime == rhs.d_mtime && d_mtimeNsec == rhs.d_mtimeNsec && d_inode == rhs.d_inode && d_size == rhs.d_size;
+    }
+
+    uint64_t d_mtime{0};
+    uint64_t d_mtimeNsec{0}; //!< two rewrites within one second usually differ here
+    uint64_t d_inode{0}; //!< changes when the file is replaced by a rename
+    uint64_t d_size{0};
+  };
+
+  /* what a snapshot was made from, it is only used if all of it still matches */
+  struct SnapshotInfo
+  {
+    FileInfo d_zoneFile;
+    //! the files pulled in by $INCLUDE, only known once the zone has been parsed, so load() checks the ones the snapshot lists
+    std::vector<std::pair<std::string, FileInfo>> d_includes;
+    std::string d_params; //!< anything else the records depend on, like the NSEC3 parameters
+  };
+
+  Bind2CompactStorage(const recordstorage_t& records);
+  Bind2CompactStorage(const Bind2CompactStorage&) = delete;
+  Bind2CompactStorage& operator=(const Bind2CompactStorage&) = delete;
+
+  //! Maps the snapshot at path, returns nullptr if there is none or it does not match info
+  static std::shared_ptr<Bind2CompactStorage> load(const std::string& path, const SnapshotInfo& info);
+  //! Atomically replaces the snapshot at path
+  void save(const std::string& path, const SnapshotInfo& info) const;
+
+  size_t size() const
+  {
+    return d_entries.size();
+  }
+  bool empty() const
+  {
+    return d_entries.empty();
+  }
+  const Entry& operator[](size_t pos) const
+  {
+    return d_entries[pos];
+  }
+  size_t getMemoryUsage() const;
+  bool isMapped() const
+  {
+    return d_mapping != nullptr;
+  }
+  uint32_t getSerial() const; //!< of the SOA record, 0 if there is none
+
+  DNSName getName(const Entry& entry) const; //!< relative to the zone
+  std::string getContent(const Entry& entry, const DNSName& qname) const; //!< zone file representation
+  std::shared_ptr<const DNSRecordContent> getRecordContent(const Entry& entry, const DNSName& qname) const;
+  std::string getNSEC3Hash(const Entry& entry) const
+  {
+    return std::string(d_arena.substr(entry.d_content + entry.d_contentLen, entry.d_nsec3hashLen));
+  }
+
+  //! positions of the records of the relative name qname, as [first, second)
+  std::pair<size_t, size_t> equalRange(const DNSName& qname) const;
+  //! position of the first record sorting canonically after the relative name qname
+  size_t upperBound(const DNSName& qname) const;
+
+  //! positions of the records holding an NSEC3 hash, sorted on that hash
+  const View<uint32_t>& getNSEC3Index() const
+  {
+    return d_nsec3;
+  }
+  //! position in getNSEC3Index() of the first hash after hash
+  size_t upperBoundNSEC3(const std::string& hash) const;
+
+private:
+  Bind2CompactStorage() = default;
+  uint32_t append(const char* data, size_t len);
+  void validate() const;
+  bool nameMatches(const Entry& entry, const DNSName::string_t& storage) const;
+  static bool sameName(const Entry& a, const Entry& b)
+  {
+    /* names are stored once, consecutive records of a name share them */
+    return a.d_name == b.d_name && a.d_nameLen == b.d_nameLen;
+  }
+
+  std::string_view d_arena;
+  View<Entry> d_entries;
+  View<uint32_t> d_names; //!< position + 1 of the first record of each name, 0 for an empty slot
+  View<uint32_t> d_nsec3;
+
+  /* backing the views above, unless we have been mapped from a snapshot */
+  std::string d_arenaStorage;
+  std::vector<Entry> d_entriesStorage;
+  std::vector<uint32_t> d_namesStorage;
+  std::vector<uint32_t> d_nsec3Storage;
+
+  std::shared_ptr<const void> d_mapping{nullptr};
+  size_t d_mappingSize{0};
+};
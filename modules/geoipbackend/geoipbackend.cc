@@ -30,10 +30,12 @@
 #include <glob.h>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/format.hpp>
+#include <atomic>
 #include <fstream>
 #include <yaml-cpp/yaml.h>
 
 ReadWriteLock GeoIPBackend::s_state_lock;
+ReadWriteLock GeoIPBackend::s_keys_lock;
 
 struct GeoIPDNSResourceRecord : DNSResourceRecord
 {
@@ -59,9 +61,30 @@ struct GeoIPDomain
   map<std::string, std::string> custom_mapping;
 };
 
-static vector<GeoIPDomain> s_domains;
+/* Everything a lookup needs, built in one go by initialize() and never changed
+   afterwards. Reloads publish a new snapshot, lookups keep using the one they
+   picked up until they are done with it, so no lock is needed to read it. */
+struct GeoIPState
+{
+  vector<GeoIPDomain> domains;
+  vector<std::unique_ptr<GeoIPInterface>> files;
+};
+
+static std::shared_ptr<const GeoIPState> s_state; // only accessed through std::atomic_load/std::atomic_store
+static std::atomic<uint64_t> s_state_generation{0}; // bumped after each store to s_state
 static int s_rc = 0; // refcount - always accessed under lock
 
+static std::shared_ptr<const GeoIPState> getState()
+{
+  return std::atomic_load(&s_state);
+}
+
+static void setState(std::shared_ptr<const GeoIPState> state)
+{
+  std::atomic_store(&s_state, std::move(state));
+  s_state_generation++;
+}
+
 const static std::array<string, 7> GeoIP_WEEKDAYS = {"mon", "tue", "wed", "thu", "fri", "sat", "sun"};
 const static std::array<string, 12> GeoIP_MONTHS = {"jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"};
 
@@ -87,16 +110,15 @@ GeoIPBackend::GeoIPBackend(const string& suffix)
     d_dnssec = true;
     closedir(d);
   }
+  d_answerCacheSize = pdns::checked_stoi<size_t>(getArg("answer-cache-size"));
   if (s_rc == 0) { // first instance gets to open everything
     initialize();
   }
   s_rc++;
 }
 
-static vector<std::unique_ptr<GeoIPInterface>> s_geoip_files;
-
 string getGeoForLua(const std::string& ip, int qaint);
-static string queryGeoIP(const Netmask& addr, GeoIPInterface::GeoIPQueryAttribute attribute, GeoIPNetmask& gl);
+static string queryGeoIP(const GeoIPState& state, const Netmask& addr, GeoIPInterface::GeoIPQueryAttribute attribute, GeoIPNetmask& gl);
 
 // validateMappingLookupFormats validates any custom format provided by the
 // user does not use the custom mapping placeholder again, else it would do an
@@ -124,18 +146,17 @@ void GeoIPBackend::initialize()
 {
   YAML::Node config;
   vector<GeoIPDomain> tmp_domains;
-
-  s_geoip_files.clear(); // reset pointers
+  auto state = std::make_shared<GeoIPState>();
 
   if (getArg("database-files").empty() == false) {
     vector<string> files;
     stringtok(files, getArg("database-files"), " ,\t\r\n");
     for (auto const& file : files) {
-      s_geoip_files.push_back(GeoIPInterface::makeInterface(file));
+      state->files.push_back(GeoIPInterface::makeInterface(file));
     }
   }
 
-  if (s_geoip_files.empty())
+  if (state->files.empty())
     g_log << Logger::Warning << "No GeoIP database files loaded!" << endl;
 
   if (!getArg("zones-file").empty()) {
@@ -366,8 +387,8 @@ void GeoIPBackend::initialize()
     tmp_domains.push_back(std::move(dom));
   }
 
-  s_domains.clear();
-  std::swap(s_domains, tmp_domains);
+  state->domains = std::move(tmp_domains);
+  setState(std::move(state));
 
   extern std::function<std::string(const std::string& ip, int)> g_getGeo;
   g_getGeo = getGeoForLua;
@@ -379,8 +400,7 @@ GeoIPBackend::~GeoIPBackend()
     WriteLock wl(&s_state_lock);
     s_rc--;
     if (s_rc == 0) { // last instance gets to cleanup
-      s_geoip_files.clear();
-      s_domains.clear();
+      setState(nullptr);
     }
   }
   catch (...) {
@@ -429,20 +449,62 @@ bool GeoIPBackend::lookup_static(const GeoIPDomain& dom, const DNSName& search,
 
 void GeoIPBackend::lookup(const QType& qtype, const DNSName& qdomain, int zoneId, DNSPacket* pkt_p)
 {
-  ReadLock rl(&s_state_lock);
-  const GeoIPDomain* dom;
-  GeoIPNetmask gl;
-  bool found = false;
-
   if (d_result.size() > 0)
     throw PDNSException("Cannot perform lookup while another is running");
 
-  d_result.clear();
+  // pick up the current snapshot, and forget answers computed from an older one
+  auto generation = s_state_generation.load();
+  if (!d_state || generation != d_stateGeneration) {
+    d_state = getState();
+    d_stateGeneration = generation;
+    d_answerCache.clear();
+    d_answerCacheEntries = 0;
+  }
+  if (!d_state)
+    return;
+
+  Netmask addr{"0.0.0.0/0"};
+  if (pkt_p != nullptr)
+    addr = Netmask(pkt_p->getRealRemote());
 
-  if (zoneId > -1 && zoneId < static_cast<int>(s_domains.size()))
-    dom = &(s_domains[zoneId]);
+  std::tuple<DNSName, uint16_t, int> key{qdomain, qtype.getCode(), zoneId};
+  if (d_answerCacheSize > 0) {
+    const auto& entry = d_answerCache.find(key);
+    if (entry != d_answerCache.end()) {
+      const auto* node = entry->second.lookup(addr);
+      if (node != nullptr) {
+        d_result = node->second;
+        return;
+      }
+    }
+  }
+
+  GeoIPNetmask gl;
+  gl.netmask = 0;
+  lookupUncached(qtype, qdomain, zoneId, addr, gl);
+
+  // the answer holds for every client within the scope we return, unless that scope is
+  // a single address (time based placeholders, %ip, weighted records), which we do not keep
+  if (d_answerCacheSize > 0 && gl.netmask < (addr.isIPv6() ? 128 : 32)) {
+    if (d_answerCacheEntries >= d_answerCacheSize) {
+      d_answerCache.clear();
+      d_answerCacheEntries = 0;
+    }
+    d_answerCache[key].insert_or_assign(Netmask(addr.getNetwork(), gl.netmask), d_result);
+    d_answerCacheEntries++;
+  }
+}
+
+void GeoIPBackend::lookupUncached(const QType& qtype, const DNSName& qdomain, int zoneId, const Netmask& addr, GeoIPNetmask& gl)
+{
+  const auto& domains = d_state->domains;
+  const GeoIPDomain* dom;
+  bool found = false;
+
+  if (zoneId > -1 && zoneId < static_cast<int>(domains.size()))
+    dom = &(domains[zoneId]);
   else {
-    for (const GeoIPDomain& i : s_domains) { // this is arguably wrong, we should probably find the most specific match
+    for (const GeoIPDomain& i : domains) { // this is arguably wrong, we should probably find the most specific match
       if (qdomain.isPartOf(i.domain)) {
         dom = &i;
         found = true;
@@ -453,12 +515,6 @@ void GeoIPBackend::lookup(const QType& qtype, const DNSName& qdomain, int zoneId
       return; // not found
   }
 
-  Netmask addr{"0.0.0.0/0"};
-  if (pkt_p != nullptr)
-    addr = Netmask(pkt_p->getRealRemote());
-
-  gl.netmask = 0;
-
   (void)this->lookup_static(*dom, qdomain, qtype, qdomain, addr, gl);
 
   const auto& target = (*dom).services.find(qdomain);
@@ -476,7 +532,7 @@ void GeoIPBackend::lookup(const QType& qtype, const DNSName& qdomain, int zoneId
     GeoIPNetmask tmp_gl;
     tmp_gl.netmask = 0;
     // get netmask from geoip backend
-    if (queryGeoIP(addr, GeoIPInterface::Name, tmp_gl) == "unknown") {
+    if (queryGeoIP(*d_state, addr, GeoIPInterface::Name, tmp_gl) == "unknown") {
       if (addr.isIPv6())
         gl.netmask = target->second.netmask6;
       else
@@ -533,11 +589,11 @@ bool GeoIPBackend::get(DNSResourceRecord& r)
   return true;
 }
 
-static string queryGeoIP(const Netmask& addr, GeoIPInterface::GeoIPQueryAttribute attribute, GeoIPNetmask& gl)
+static string queryGeoIP(const GeoIPState& state, const Netmask& addr, GeoIPInterface::GeoIPQueryAttribute attribute, GeoIPNetmask& gl)
 {
   string ret = "unknown";
 
-  for (auto const& gi : s_geoip_files) {
+  for (auto const& gi : state.files) {
     string val;
     const string ip = addr.toStringNoMask();
     bool found = false;
@@ -612,9 +668,12 @@ string getGeoForLua(const std::string& ip, int qaint)
 {
   GeoIPInterface::GeoIPQueryAttribute qa((GeoIPInterface::GeoIPQueryAttribute)qaint);
   try {
+    auto state = getState();
+    if (!state)
+      return "";
     const Netmask addr{ip};
     GeoIPNetmask gl;
-    string res = queryGeoIP(addr, qa, gl);
+    string res = queryGeoIP(*state, addr, qa, gl);
     //    cout<<"Result for "<<ip<<" lookup: "<<res<<endl;
     if (qa == GeoIPInterface::ASn && boost::starts_with(res, "as"))
       return res.substr(2);
@@ -629,10 +688,10 @@ string getGeoForLua(const std::string& ip, int qaint)
   return "";
 }
 
-static bool queryGeoLocation(const Netmask& addr, GeoIPNetmask& gl, double& lat, double& lon,
+static bool queryGeoLocation(const GeoIPState& state, const Netmask& addr, GeoIPNetmask& gl, double& lat, double& lon,
                              boost::optional<int>& alt, boost::optional<int>& prec)
 {
-  for (auto const& gi : s_geoip_files) {
+  for (auto const& gi : state.files) {
     string val;
     if (addr.isIPv6()) {
       if (gi->queryLocationV6(gl, addr.toStringNoMask(), lat, lon, alt, prec))
@@ -670,34 +729,34 @@ string GeoIPBackend::format2str(string sformat, const Netmask& addr, GeoIPNetmas
       }
     }
     else if (!sformat.compare(cur, 3, "%cn")) {
-      rep = queryGeoIP(addr, GeoIPInterface::Continent, tmp_gl);
+      rep = queryGeoIP(*d_state, addr, GeoIPInterface::Continent, tmp_gl);
     }
     else if (!sformat.compare(cur, 3, "%co")) {
-      rep = queryGeoIP(addr, GeoIPInterface::Country, tmp_gl);
+      rep = queryGeoIP(*d_state, addr, GeoIPInterface::Country, tmp_gl);
     }
     else if (!sformat.compare(cur, 3, "%cc")) {
-      rep = queryGeoIP(addr, GeoIPInterface::Country2, tmp_gl);
+      rep = queryGeoIP(*d_state, addr, GeoIPInterface::Country2, tmp_gl);
     }
     else if (!sformat.compare(cur, 3, "%af")) {
       rep = (addr.isIPv6() ? "v6" : "v4");
     }
     else if (!sformat.compare(cur, 3, "%as")) {
-      rep = queryGeoIP(addr, GeoIPInterface::ASn, tmp_gl);
+      rep = queryGeoIP(*d_state, addr, GeoIPInterface::ASn, tmp_gl);
     }
     else if (!sformat.compare(cur, 3, "%re")) {
-      rep = queryGeoIP(addr, GeoIPInterface::Region, tmp_gl);
+      rep = queryGeoIP(*d_state, addr, GeoIPInterface::Region, tmp_gl);
     }
     else if (!sformat.compare(cur, 3, "%na")) {
-      rep = queryGeoIP(addr, GeoIPInterface::Name, tmp_gl);
+      rep = queryGeoIP(*d_state, addr, GeoIPInterface::Name, tmp_gl);
     }
     else if (!sformat.compare(cur, 3, "%ci")) {
-      rep = queryGeoIP(addr, GeoIPInterface::City, tmp_gl);
+      rep = queryGeoIP(*d_state, addr, GeoIPInterface::City, tmp_gl);
     }
     else if (!sformat.compare(cur, 4, "%loc")) {
       char ns, ew;
       int d1, d2, m1, m2;
       double s1, s2;
-      if (!queryGeoLocation(addr, gl, lat, lon, alt, prec)) {
+      if (!queryGeoLocation(*d_state, addr, gl, lat, lon, alt, prec)) {
         rep = "";
         tmp_gl.netmask = (addr.isIPv6() ? 128 : 32);
       }
@@ -724,7 +783,7 @@ string GeoIPBackend::format2str(string sformat, const Netmask& addr, GeoIPNetmas
       nrep = 4;
     }
     else if (!sformat.compare(cur, 4, "%lat")) {
-      if (!queryGeoLocation(addr, gl, lat, lon, alt, prec)) {
+      if (!queryGeoLocation(*d_state, addr, gl, lat, lon, alt, prec)) {
         rep = "";
         tmp_gl.netmask = (addr.isIPv6() ? 128 : 32);
       }
@@ -734,7 +793,7 @@ string GeoIPBackend::format2str(string sformat, const Netmask& addr, GeoIPNetmas
       nrep = 4;
     }
     else if (!sformat.compare(cur, 4, "%lon")) {
-      if (!queryGeoLocation(addr, gl, lat, lon, alt, prec)) {
+      if (!queryGeoLocation(*d_state, addr, gl, lat, lon, alt, prec)) {
         rep = "";
         tmp_gl.netmask = (addr.isIPv6() ? 128 : 32);
       }
@@ -834,9 +893,9 @@ void GeoIPBackend::rediscover(string* /* status */)
 
 bool GeoIPBackend::getDomainInfo(const DNSName& domain, DomainInfo& di, bool /* getSerial */)
 {
-  ReadLock rl(&s_state_lock);
+  auto state = getState();
 
-  for (GeoIPDomain dom : s_domains) {
+  for (const auto& dom : state->domains) {
     if (dom.domain == domain) {
       SOAData sd;
       this->getSOA(domain, sd);
@@ -853,10 +912,10 @@ bool GeoIPBackend::getDomainInfo(const DNSName& domain, DomainInfo& di, bool /*
 
 void GeoIPBackend::getAllDomains(vector<DomainInfo>* domains, bool /* getSerial */, bool /* include_disabled */)
 {
-  ReadLock rl(&s_state_lock);
+  auto state = getState();
 
   DomainInfo di;
-  for (const auto& dom : s_domains) {
+  for (const auto& dom : state->domains) {
     SOAData sd;
     this->getSOA(dom.domain, sd);
     di.id = dom.id;
@@ -873,8 +932,8 @@ bool GeoIPBackend::getAllDomainMetadata(const DNSName& name, std::map<std::strin
   if (!d_dnssec)
     return false;
 
-  ReadLock rl(&s_state_lock);
-  for (GeoIPDomain dom : s_domains) {
+  auto state = getState();
+  for (const auto& dom : state->domains) {
     if (dom.domain == name) {
       if (hasDNSSECkey(dom.domain)) {
         meta[string("NSEC3NARROW")].push_back("1");
@@ -891,8 +950,8 @@ bool GeoIPBackend::getDomainMetadata(const DNSName& name, const std::string& kin
   if (!d_dnssec)
     return false;
 
-  ReadLock rl(&s_state_lock);
-  for (GeoIPDomain dom : s_domains) {
+  auto state = getState();
+  for (const auto& dom : state->domains) {
     if (dom.domain == name) {
       if (hasDNSSECkey(dom.domain)) {
         if (kind == "NSEC3NARROW")
@@ -910,8 +969,9 @@ bool GeoIPBackend::getDomainKeys(const DNSName& name, std::vector<DNSBackend::Ke
 {
   if (!d_dnssec)
     return false;
-  ReadLock rl(&s_state_lock);
-  for (GeoIPDomain dom : s_domains) {
+  auto state = getState();
+  ReadLock rl(&s_keys_lock);
+  for (const auto& dom : state->domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -954,10 +1014,11 @@ bool GeoIPBackend::removeDomainKey(const DNSName& name, unsigned int id)
 {
   if (!d_dnssec)
     return false;
-  WriteLock rl(&s_state_lock);
+  auto state = getState();
+  WriteLock wl(&s_keys_lock);
   ostringstream path;
 
-  for (GeoIPDomain dom : s_domains) {
+  for (const auto& dom : state->domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -990,10 +1051,11 @@ bool GeoIPBackend::addDomainKey(const DNSName& name, const KeyData& key, int64_t
 {
   if (!d_dnssec)
     return false;
-  WriteLock rl(&s_state_lock);
+  auto state = getState();
+  WriteLock wl(&s_keys_lock);
   unsigned int nextid = 1;
 
-  for (GeoIPDomain dom : s_domains) {
+  for (const auto& dom : state->domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -1028,8 +1090,9 @@ bool GeoIPBackend::activateDomainKey(const DNSName& name, unsigned int id)
 {
   if (!d_dnssec)
     return false;
-  WriteLock rl(&s_state_lock);
-  for (GeoIPDomain dom : s_domains) {
+  auto state = getState();
+  WriteLock wl(&s_keys_lock);
+  for (const auto& dom : state->domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -1063,8 +1126,9 @@ bool GeoIPBackend::deactivateDomainKey(const DNSName& name, unsigned int id)
 {
   if (!d_dnssec)
     return false;
-  WriteLock rl(&s_state_lock);
-  for (GeoIPDomain dom : s_domains) {
+  auto state = getState();
+  WriteLock wl(&s_keys_lock);
+  for (const auto& dom : state->domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -1127,6 +1191,7 @@ public:
     declare(suffix, "zones-file", "YAML file to load zone(s) configuration", "");
     declare(suffix, "database-files", "File(s) to load geoip data from ([driver:]path[;opt=value]", "");
     declare(suffix, "dnssec-keydir", "Directory to hold dnssec keys (also turns DNSSEC on)", "");
+    declare(suffix, "answer-cache-size", "Number of answers each backend instance keeps per client subnet, 0 to disable", "10000");
   }
 
   DNSBackend* make(const string& suffix) override
@@ -24,7 +24,9 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <string>
+#include <tuple>
 #include <pthread.h>
 #include <sys/types.h>
 #include <dirent.h>
@@ -37,6 +39,7 @@
 class GeoIPInterface;
 
 struct GeoIPDomain;
+struct GeoIPState;
 
 struct GeoIPNetmask
 {
@@ -70,13 +73,22 @@ public:
   bool unpublishDomainKey(const DNSName& name, unsigned int id) override;
 
 private:
-  static ReadWriteLock s_state_lock;
+  static ReadWriteLock s_state_lock; // serializes (re)loading the shared state
+  static ReadWriteLock s_keys_lock; // serializes changes to the dnssec-keydir
 
   void initialize();
+  void lookupUncached(const QType& qtype, const DNSName& qdomain, int zoneId, const Netmask& addr, GeoIPNetmask& gl);
   string format2str(string format, const Netmask& addr, GeoIPNetmask& gl, const GeoIPDomain& dom);
   bool d_dnssec;
   bool hasDNSSECkey(const DNSName& name);
   bool lookup_static(const GeoIPDomain& dom, const DNSName& search, const QType& qtype, const DNSName& qdomain, const Netmask& addr, GeoIPNetmask& gl);
   vector<DNSResourceRecord> d_result;
   vector<GeoIPInterface> d_files;
+
+  std::shared_ptr<const GeoIPState> d_state; // snapshot used by lookup()
+  uint64_t d_stateGeneration{0};
+  // answers per (qname, qtype, zone id), stored under the client subnet they were returned with
+  std::map<std::tuple<DNSName, uint16_t, int>, NetmaskTree<vector<DNSResourceRecord>>> d_answerCache;
+  size_t d_answerCacheEntries{0};
+  size_t d_answerCacheSize{0};
 };
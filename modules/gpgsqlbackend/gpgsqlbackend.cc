@@ -46,7 +46,8 @@ gPgSQLBackend::gPgSQLBackend(const string& mode, const string& suffix) :
                      getArg("user"),
                      getArg("password"),
                      getArg("extra-connection-parameters"),
-                     mustDo("prepared-statements")));
+                     mustDo("prepared-statements"),
+                     mustDo("pipelining")));
   }
 
   catch (SSqlException& e) {
@@ -92,6 +93,7 @@ public:
     declare(suffix, "password", "Database backend password to connect with", "");
     declare(suffix, "extra-connection-parameters", "Extra parameters to add to connection string", "");
     declare(suffix, "prepared-statements", "Use prepared statements instead of parameterized queries", "yes");
+    declare(suffix, "pipelining", "Send lookups known in advance in a single round-trip, if libpq supports pipeline mode", "yes");
 
     declare(suffix, "dnssec", "Enable DNSSEC processing", "no");
 
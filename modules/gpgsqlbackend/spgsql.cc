@@ -119,6 +119,42 @@ public:
     return this;
   }
 
+  bool executeBatch(const vector<row_t>& params, vector<result_t>& results)
+  {
+#ifdef LIBPQ_HAS_PIPELINING
+    if (!d_parent->usePipelining() || params.empty()) {
+      return false;
+    }
+    for (const auto& row : params) {
+      if (row.size() != static_cast<size_t>(d_nparams)) {
+        throw SSqlException("Attempt to bind " + std::to_string(row.size()) + " parameters to a query that has " + std::to_string(d_nparams) + ": " + d_query);
+      }
+    }
+    prepareStatement();
+    reset();
+
+    results.clear();
+    results.reserve(params.size());
+    // in blocking mode, a pipeline can deadlock once both socket buffers are full, so keep them short
+    for (size_t start = 0; start < params.size(); start += s_maxPipelineLength) {
+      size_t end = std::min(params.size(), start + s_maxPipelineLength);
+      if (d_dolog) {
+        g_log << Logger::Warning << "Query " << ((long)(void*)this) << ": Pipelining " << (end - start) << " runs of statement: " << d_query << endl;
+        d_dtime.set();
+      }
+      runPipeline(params, start, end, results);
+      if (d_dolog) {
+        g_log << Logger::Warning << "Query " << ((long)(void*)this) << ": " << d_dtime.udiffNoReset() << " us to execute the pipeline" << endl;
+      }
+    }
+    return true;
+#else
+    (void)params;
+    (void)results;
+    return false;
+#endif
+  }
+
   void nextResult()
   {
     if (d_res_set == nullptr)
@@ -151,23 +187,10 @@ public:
 
   SSqlStatement* nextRow(row_t& row)
   {
-    int i;
     row.clear();
     if (d_residx >= d_resnum || !d_res)
       return this;
-    row.reserve(PQnfields(d_res));
-    for (i = 0; i < PQnfields(d_res); i++) {
-      if (PQgetisnull(d_res, d_residx, i)) {
-        row.emplace_back("");
-      }
-      else if (PQftype(d_res, i) == 16) { // BOOLEAN
-        char* val = PQgetvalue(d_res, d_residx, i);
-        row.emplace_back(val[0] == 't' ? "1" : "0");
-      }
-      else {
-        row.emplace_back(PQgetvalue(d_res, d_residx, i));
-      }
-    }
+    row = getRow(d_res, d_residx);
     d_residx++;
     if (d_residx >= d_resnum) {
       PQclear(d_res);
@@ -230,6 +253,98 @@ private:
     return d_parent->db();
   }
 
+#ifdef LIBPQ_HAS_PIPELINING
+  static const size_t s_maxPipelineLength = 32;
+
+  void runPipeline(const vector<row_t>& params, size_t start, size_t end, vector<result_t>& results)
+  {
+    if (PQenterPipelineMode(d_db()) != 1) {
+      throw SSqlException("Unable to enter pipeline mode for query: " + d_query + string(": ") + PQerrorMessage(d_db()));
+    }
+
+    string errmsg;
+    vector<const char*> values(d_nparams);
+    vector<int> lengths(d_nparams);
+    for (size_t idx = start; idx < end && errmsg.empty(); ++idx) {
+      for (int i = 0; i < d_nparams; i++) {
+        values[i] = params[idx][i].c_str();
+        lengths[i] = static_cast<int>(params[idx][i].size());
+      }
+      int sent;
+      if (!d_stmt.empty()) {
+        sent = PQsendQueryPrepared(d_db(), d_stmt.c_str(), d_nparams, values.data(), lengths.data(), nullptr, 0);
+      }
+      else {
+        sent = PQsendQueryParams(d_db(), d_query.c_str(), d_nparams, nullptr, values.data(), lengths.data(), nullptr, 0);
+      }
+      if (sent != 1) {
+        errmsg = PQerrorMessage(d_db());
+        end = idx;
+      }
+    }
+
+    if (PQpipelineSync(d_db()) != 1) {
+      // the connection is no good anymore, leave it to the reconnection logic
+      PQexitPipelineMode(d_db());
+      throw SSqlException("Unable to send pipeline for query: " + d_query + string(": ") + PQerrorMessage(d_db()));
+    }
+
+    // every query sent has its results followed by a nullptr, and the whole pipeline ends with a PGRES_PIPELINE_SYNC
+    for (size_t idx = start; idx < end; ++idx) {
+      result_t result;
+      while (PGresult* res = PQgetResult(d_db())) {
+        ExecStatusType status = PQresultStatus(res);
+        if (status == PGRES_TUPLES_OK) {
+          result.reserve(result.size() + PQntuples(res));
+          for (int row = 0; row < PQntuples(res); row++) {
+            result.push_back(getRow(res, row));
+          }
+        }
+        else if (status != PGRES_COMMAND_OK && status != PGRES_NONFATAL_ERROR && errmsg.empty()) {
+          errmsg = PQresultErrorMessage(res);
+          if (errmsg.empty()) {
+            errmsg = "query aborted";
+          }
+        }
+        PQclear(res);
+      }
+      results.push_back(std::move(result));
+    }
+
+    while (PGresult* res = PQgetResult(d_db())) {
+      ExecStatusType status = PQresultStatus(res);
+      PQclear(res);
+      if (status == PGRES_PIPELINE_SYNC) {
+        break;
+      }
+    }
+    PQexitPipelineMode(d_db());
+
+    if (!errmsg.empty()) {
+      throw SSqlException("Fatal error during pipelined query: " + d_query + string(": ") + errmsg);
+    }
+  }
+#endif
+
+  static row_t getRow(PGresult* res, int rowidx)
+  {
+    row_t row;
+    row.reserve(PQnfields(res));
+    for (int i = 0; i < PQnfields(res); i++) {
+      if (PQgetisnull(res, rowidx, i)) {
+        row.emplace_back("");
+      }
+      else if (PQftype(res, i) == 16) { // BOOLEAN
+        char* val = PQgetvalue(res, rowidx, i);
+        row.emplace_back(val[0] == 't' ? "1" : "0");
+      }
+      else {
+        row.emplace_back(PQgetvalue(res, rowidx, i));
+      }
+    }
+    return row;
+  }
+
   void releaseStatement()
   {
     d_prepared = false;
@@ -306,7 +421,8 @@ static string escapeForPQparam(const string& v)
 }
 
 SPgSQL::SPgSQL(const string& database, const string& host, const string& port, const string& user,
-               const string& password, const string& extra_connection_parameters, const bool use_prepared)
+               const string& password, const string& extra_connection_parameters, const bool use_prepared,
+               const bool use_pipelining)
 {
   d_db = nullptr;
   d_in_trx = false;
@@ -336,6 +452,7 @@ SPgSQL::SPgSQL(const string& database, const string& host, const string& port, c
   }
 
   d_use_prepared = use_prepared;
+  d_use_pipelining = use_pipelining;
 
   d_db = PQconnectdb(d_connectstr.c_str());
 
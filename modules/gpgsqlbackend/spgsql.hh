@@ -29,7 +29,8 @@ class SPgSQL : public SSql
 public:
   SPgSQL(const string& database, const string& host = "", const string& port = "",
          const string& user = "", const string& password = "",
-         const string& extra_connection_parameters = "", const bool use_prepared = true);
+         const string& extra_connection_parameters = "", const bool use_prepared = true,
+         const bool use_pipelining = true);
 
   ~SPgSQL();
 
@@ -48,6 +49,7 @@ public:
   PGconn* db() { return d_db; }
   bool in_trx() const { return d_in_trx; }
   bool usePrepared() { return d_use_prepared; }
+  bool usePipelining() { return d_use_pipelining; }
 
 private:
   PGconn* d_db;
@@ -56,5 +58,6 @@ private:
   static bool s_dolog;
   bool d_in_trx;
   bool d_use_prepared;
+  bool d_use_pipelining;
   unsigned int d_nstatements;
 };
@@ -61,8 +61,23 @@ BOOST_CLASS_VERSION(DomainInfo, 1)
 
 static bool s_first = true;
 static int s_shards = 0;
+static unsigned int s_maxReaders = 0;
 static std::mutex s_lmdbStartupLock;
 
+// Every backend instance keeps a reset read-only transaction on each shard it has looked up in,
+// holding one reader slot of that shard for good, plus one for each transaction it has open.
+// Unless configured, make room for the backends of all the threads that may look up.
+static unsigned int getMaxReaders(int configured)
+{
+  if (configured > 0) {
+    return configured;
+  }
+  auto threads = [](const std::string& name) -> unsigned int {
+    return ::arg().parmIsset(name) ? std::max(::arg().asNum(name), 0) : 0;
+  };
+  return std::max(126U, threads("receiver-threads") * threads("distributor-threads") + threads("max-tcp-connections") + threads("retrieval-threads") + 32);
+}
+
 std::pair<uint32_t, uint32_t> LMDBBackend::getSchemaVersionAndShards(std::string& filename)
 {
   // cerr << "getting schema version for path " << filename << endl;
@@ -685,6 +700,7 @@ LMDBBackend::LMDBBackend(const std::string& suffix)
     std::lock_guard<std::mutex> l(s_lmdbStartupLock);
     if (s_first) {
       auto filename = getArg("filename");
+      s_maxReaders = getMaxReaders(getArgAsNum("max-readers"));
 
       auto currentSchemaVersionAndShards = getSchemaVersionAndShards(filename);
       uint32_t currentSchemaVersion = currentSchemaVersionAndShards.first;
@@ -714,7 +730,7 @@ LMDBBackend::LMDBBackend(const std::string& suffix)
         throw std::runtime_error("Somehow, we are not at schema version 5. Giving up");
       }
 
-      d_tdomains = std::make_shared<tdomains_t>(getMDBEnv(getArg("filename").c_str(), MDB_NOSUBDIR | d_asyncFlag, 0600, mapSize), "domains_v5");
+      d_tdomains = std::make_shared<tdomains_t>(getMDBEnv(getArg("filename").c_str(), MDB_NOSUBDIR | d_asyncFlag, 0600, mapSize, s_maxReaders), "domains_v5");
       d_tmeta = std::make_shared<tmeta_t>(d_tdomains->getEnv(), "metadata_v5");
       d_tkdb = std::make_shared<tkdb_t>(d_tdomains->getEnv(), "keydata_v5");
       d_ttsig = std::make_shared<ttsig_t>(d_tdomains->getEnv(), "tsig_v5");
@@ -761,12 +777,13 @@ LMDBBackend::LMDBBackend(const std::string& suffix)
   }
 
   if (!opened) {
-    d_tdomains = std::make_shared<tdomains_t>(getMDBEnv(getArg("filename").c_str(), MDB_NOSUBDIR | d_asyncFlag, 0600, mapSize), "domains_v5");
+    d_tdomains = std::make_shared<tdomains_t>(getMDBEnv(getArg("filename").c_str(), MDB_NOSUBDIR | d_asyncFlag, 0600, mapSize, s_maxReaders), "domains_v5");
     d_tmeta = std::make_shared<tmeta_t>(d_tdomains->getEnv(), "metadata_v5");
     d_tkdb = std::make_shared<tkdb_t>(d_tdomains->getEnv(), "keydata_v5");
     d_ttsig = std::make_shared<ttsig_t>(d_tdomains->getEnv(), "tsig_v5");
   }
   d_trecords.resize(s_shards);
+  d_lookuptxns.resize(s_shards);
   d_dolog = ::arg().mustDo("query-logging");
 }
 
@@ -928,6 +945,22 @@ static inline size_t serOneRRFromString(const string_view& str, LMDBBackend::LMD
   return 2 + len + 7;
 }
 
+// like serOneRRFromString(), but leaves the content where it is, which is usually a page of the map
+static inline size_t serOneRRViewFromString(const string_view& str, string_view& content, uint32_t& ttl, bool& auth, bool& disabled)
+{
+  uint16_t len;
+  memcpy(&len, &str[0], 2);
+  if (str.size() < 2 + static_cast<size_t>(len) + 7) {
+    throw std::runtime_error("Record content in LMDB is truncated");
+  }
+  content = str.substr(2, len);
+  memcpy(&ttl, &str[2] + len, 4);
+  auth = str[2 + len + 4];
+  disabled = str[2 + len + 4 + 1];
+
+  return 2 + len + 7;
+}
+
 template <>
 void serFromString(const string_view& str, LMDBBackend::LMDBResourceRecord& lrr)
 {
@@ -952,12 +985,14 @@ static std::string serializeContent(uint16_t qtype, const DNSName& domain, const
   return drc->serialize(domain, false);
 }
 
-static std::shared_ptr<DNSRecordContent> deserializeContentZR(uint16_t qtype, const DNSName& qname, const std::string& content)
+static std::shared_ptr<DNSRecordContent> deserializeContentZR(uint16_t qtype, const DNSName& qname, const string_view& content)
 {
   if (qtype == QType::A && content.size() == 4) {
-    return std::make_shared<ARecordContent>(*((uint32_t*)content.c_str()));
+    uint32_t addr;
+    memcpy(&addr, content.data(), sizeof(addr));
+    return std::make_shared<ARecordContent>(addr);
   }
-  return DNSRecordContent::deserialize(qname, qtype, content);
+  return WireRecordContent::make(qname, qtype, content);
 }
 
 /* design. If you ask a question without a zone id, we lookup the best
@@ -1202,7 +1237,7 @@ std::shared_ptr<LMDBBackend::RecordsRWTransaction> LMDBBackend::getRecordsRWTran
   auto& shard = d_trecords[id % s_shards];
   if (!shard.env) {
     shard.env = getMDBEnv((getArg("filename") + "-" + std::to_string(id % s_shards)).c_str(),
-                          MDB_NOSUBDIR | d_asyncFlag, 0600);
+                          MDB_NOSUBDIR | d_asyncFlag, 0600, MDBDefaultMapSizeMB, s_maxReaders);
     shard.dbi = shard.env->openDB("records_v5", MDB_CREATE);
   }
   auto ret = std::make_shared<RecordsRWTransaction>(shard.env->getRWTransaction());
@@ -1219,7 +1254,7 @@ std::shared_ptr<LMDBBackend::RecordsROTransaction> LMDBBackend::getRecordsROTran
       throw DBException("attempting to start nested transaction without open parent env");
     }
     shard.env = getMDBEnv((getArg("filename") + "-" + std::to_string(id % s_shards)).c_str(),
-                          MDB_NOSUBDIR | d_asyncFlag, 0600);
+                          MDB_NOSUBDIR | d_asyncFlag, 0600, MDBDefaultMapSizeMB, s_maxReaders);
     shard.dbi = shard.env->openDB("records_v5", MDB_CREATE);
   }
 
@@ -1235,6 +1270,33 @@ std::shared_ptr<LMDBBackend::RecordsROTransaction> LMDBBackend::getRecordsROTran
   }
 }
 
+// lookup() and list() reuse one read-only transaction per shard, which is reset once the lookup is done and renewed for the next one
+std::shared_ptr<LMDBBackend::RecordsROTransaction> LMDBBackend::getLookupROTransaction(uint32_t id)
+{
+  if (d_rwtxn) {
+    return getRecordsROTransaction(id, d_rwtxn);
+  }
+
+  auto& txn = d_lookuptxns.at(id % s_shards);
+  if (txn) {
+    txn->txn->renew();
+    return txn;
+  }
+
+  txn = getRecordsROTransaction(id);
+  txn->persistent = true;
+  return txn;
+}
+
+void LMDBBackend::releaseLookupROTransaction()
+{
+  d_getcursor.reset();
+  if (d_rotxn && d_rotxn->persistent && !d_rotxn->txn->isReset()) {
+    d_rotxn->txn->reset();
+  }
+  d_rotxn.reset();
+}
+
 #if 0
 // FIXME reinstate soon
 bool LMDBBackend::upgradeToSchemav3()
@@ -1385,7 +1447,8 @@ bool LMDBBackend::list(const DNSName& target, int /* id */, bool include_disable
     }
   }
 
-  d_rotxn = getRecordsROTransaction(di.id, d_rwtxn);
+  releaseLookupROTransaction();
+  d_rotxn = getLookupROTransaction(di.id);
   d_getcursor = std::make_shared<MDBROCursor>(d_rotxn->txn->getCursor(d_rotxn->db->dbi));
 
   compoundOrdername co;
@@ -1402,8 +1465,7 @@ bool LMDBBackend::list(const DNSName& target, int /* id */, bool include_disable
   d_lookupdomain = target;
 
   // Make sure we start with fresh data
-  d_currentrrset.clear();
-  d_currentrrsetpos = 0;
+  d_currentrrset = string_view();
 
   return true;
 }
@@ -1445,7 +1507,8 @@ void LMDBBackend::lookup(const QType& type, const DNSName& qdomain, int zoneId,
     return;
   }
   // cout<<"get will look for "<<relqname<< " in zone "<<hunt<<" with id "<<zoneId<<" and type "<<type.toString()<<endl;
-  d_rotxn = getRecordsROTransaction(zoneId, d_rwtxn);
+  releaseLookupROTransaction();
+  d_rotxn = getLookupROTransaction(zoneId);
 
   compoundOrdername co;
   d_getcursor = std::make_shared<MDBROCursor>(d_rotxn->txn->getCursor(d_rotxn->db->dbi));
@@ -1472,8 +1535,7 @@ void LMDBBackend::lookup(const QType& type, const DNSName& qdomain, int zoneId,
   d_lookupdomain = hunt;
 
   // Make sure we start with fresh data
-  d_currentrrset.clear();
-  d_currentrrsetpos = 0;
+  d_currentrrset = string_view();
 }
 
 bool LMDBBackend::get(DNSZoneRecord& zr)
@@ -1481,7 +1543,7 @@ bool LMDBBackend::get(DNSZoneRecord& zr)
   for (;;) {
     // std::cerr<<"d_getcursor="<<d_getcursor<<std::endl;
     if (!d_getcursor) {
-      d_rotxn.reset();
+      releaseLookupROTransaction();
       return false;
     }
 
@@ -1502,27 +1564,38 @@ bool LMDBBackend::get(DNSZoneRecord& zr)
         continue;
       }
 
-      serFromString(d_currentVal.get<string_view>(), d_currentrrset);
-      d_currentrrsetpos = 0;
+      // the records are read straight from the map, which stays valid until the transaction is reset
+      d_currentrrset = d_currentVal.get<string_view>();
+      if (d_currentrrset.size() < 9) { // minimum length for a record
+        d_currentrrset = string_view();
+        if (d_getcursor->next(d_currentKey, d_currentVal) || d_currentKey.getNoStripHeader<StringView>().rfind(d_matchkey, 0) != 0) {
+          d_getcursor.reset();
+        }
+        continue;
+      }
     }
     else {
       key = d_currentKey.getNoStripHeader<string_view>();
     }
     try {
-      const auto& lrr = d_currentrrset.at(d_currentrrsetpos++);
+      string_view content;
+      uint32_t ttl;
+      bool auth;
+      bool disabled;
+      d_currentrrset.remove_prefix(serOneRRViewFromString(d_currentrrset, content, ttl, auth, disabled));
 
-      zr.disabled = lrr.disabled;
+      zr.disabled = disabled;
       if (!zr.disabled || d_includedisabled) {
         zr.dr.d_name = compoundOrdername::getQName(key) + d_lookupdomain;
         zr.domain_id = compoundOrdername::getDomainID(key);
         zr.dr.d_type = compoundOrdername::getQType(key).getCode();
-        zr.dr.d_ttl = lrr.ttl;
-        zr.dr.setContent(deserializeContentZR(zr.dr.d_type, zr.dr.d_name, lrr.content));
-        zr.auth = lrr.auth;
+        zr.dr.d_ttl = ttl;
+        zr.dr.setContent(deserializeContentZR(zr.dr.d_type, zr.dr.d_name, content));
+        zr.auth = auth;
       }
 
-      if (d_currentrrsetpos >= d_currentrrset.size()) {
-        d_currentrrset.clear(); // will invalidate lrr
+      if (d_currentrrset.size() < 9) {
+        d_currentrrset = string_view();
         if (d_getcursor->next(d_currentKey, d_currentVal) || d_currentKey.getNoStripHeader<StringView>().rfind(d_matchkey, 0) != 0) {
           // cerr<<"resetting d_getcursor 2"<<endl;
           d_getcursor.reset();
@@ -2647,6 +2720,7 @@ public:
     declare(suffix, "schema-version", "Maximum allowed schema version to run on this DB. If a lower version is found, auto update is performed", std::to_string(SCHEMAVERSION));
     declare(suffix, "random-ids", "Numeric IDs inside the database are generated randomly instead of sequentially", "no");
     declare(suffix, "map-size", "LMDB map size in megabytes", (sizeof(void*) == 4) ? "100" : "16000");
+    declare(suffix, "max-readers", "Number of reader slots of each LMDB file, 0 to size them from the number of threads", "0");
     declare(suffix, "flag-deleted", "Flag entries on deletion instead of deleting them", "no");
     declare(suffix, "lightning-stream", "Run in Lightning Stream compatible mode", "no");
   }
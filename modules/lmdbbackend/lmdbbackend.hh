@@ -282,6 +282,7 @@ private:
     {}
     shared_ptr<RecordsDB> db;
     MDBROTransaction txn;
+    bool persistent{false}; // kept in d_lookuptxns, reset instead of closed
   };
   struct RecordsRWTransaction
   {
@@ -304,8 +305,11 @@ private:
 
   shared_ptr<RecordsROTransaction> d_rotxn; // for lookup and list
   shared_ptr<RecordsRWTransaction> d_rwtxn; // for feedrecord within begin/aborttransaction
+  vector<shared_ptr<RecordsROTransaction>> d_lookuptxns; // per shard, for lookup and list
   std::shared_ptr<RecordsRWTransaction> getRecordsRWTransaction(uint32_t id);
   std::shared_ptr<RecordsROTransaction> getRecordsROTransaction(uint32_t id, std::shared_ptr<LMDBBackend::RecordsRWTransaction> rwtxn = nullptr);
+  std::shared_ptr<RecordsROTransaction> getLookupROTransaction(uint32_t id);
+  void releaseLookupROTransaction();
   int genChangeDomain(const DNSName& domain, std::function<void(DomainInfo&)> func);
   int genChangeDomain(uint32_t id, std::function<void(DomainInfo&)> func);
   void deleteDomainRecords(RecordsRWTransaction& txn, uint32_t domain_id, uint16_t qtype = QType::ANY);
@@ -321,8 +325,7 @@ private:
   std::string d_matchkey;
   DNSName d_lookupdomain;
 
-  vector<LMDBResourceRecord> d_currentrrset;
-  size_t d_currentrrsetpos;
+  string_view d_currentrrset; // records of the current key not handed out yet, points into d_rotxn
   MDBOutVal d_currentKey;
   MDBOutVal d_currentVal;
   bool d_includedisabled;
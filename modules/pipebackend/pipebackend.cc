@@ -40,21 +40,35 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include "pdns/lock.hh"
+#include "pdns/statbag.hh"
 #include "pipebackend.hh"
 
 static const char* kBackendId = "[PIPEBackend]";
 
-CoWrapper::CoWrapper(const string& command, int timeout, int abiVersion)
+extern StatBag S;
+
+static std::atomic<uint64_t> s_outstanding{0}; // questions sent to shared coprocesses, not answered yet
+static std::atomic<uint64_t> s_latency{0}; // running average in usec, until the first line of an answer
+static std::atomic<uint64_t> s_restarts{0};
+
+CoWrapper::CoWrapper(const string& command, int timeout, int abiVersion, size_t coprocesses)
 {
   d_command = command;
   d_timeout = timeout;
   d_abiVersion = abiVersion;
+  d_coprocesses = std::max(coprocesses, static_cast<size_t>(1));
   launch(); // let exceptions fall through - if initial launch fails, we want to die
   // I think
 }
 
 CoWrapper::~CoWrapper()
 {
+  try {
+    finish();
+  }
+  catch (...) {
+  }
 }
 
 void CoWrapper::launch()
@@ -65,6 +79,16 @@ void CoWrapper::launch()
   if (d_command.empty())
     throw ArgException("pipe-command is not specified");
 
+  if (d_abiVersion >= 6) {
+    if (d_channels.empty()) {
+      d_channels = CoChannel::pool(d_command, d_timeout, d_abiVersion, d_coprocesses);
+    }
+    for (const auto& channel : d_channels) {
+      channel->start();
+    }
+    return;
+  }
+
   if (isUnixSocket(d_command)) {
     d_cp = std::make_unique<UnixRemote>(d_command);
   }
@@ -80,8 +104,27 @@ void CoWrapper::launch()
   g_log << Logger::Error << "Backend launched with banner: " << banner << endl;
 }
 
+void CoWrapper::finish()
+{
+  if (d_channel) {
+    d_channel->finish(d_requestId);
+    d_channel.reset();
+  }
+}
+
 void CoWrapper::send(const string& line)
 {
+  if (d_abiVersion >= 6) {
+    finish(); // whatever is left of the answer to our previous question is not wanted anymore
+    for (const auto& channel : d_channels) {
+      if (!d_channel || channel->outstanding() < d_channel->outstanding()) {
+        d_channel = channel;
+      }
+    }
+    d_requestId = d_channel->send(line);
+    return;
+  }
+
   launch();
   try {
     d_cp->send(line);
@@ -94,6 +137,23 @@ void CoWrapper::send(const string& line)
 }
 void CoWrapper::receive(string& line)
 {
+  if (d_abiVersion >= 6) {
+    if (!d_channel)
+      throw PDNSException("No question outstanding to receive an answer for");
+    try {
+      d_channel->receive(d_requestId, line);
+    }
+    catch (PDNSException& ae) {
+      g_log << Logger::Warning << kBackendId << " Unable to receive data from coprocess. " << ae.reason << endl;
+      finish();
+      throw;
+    }
+    auto type = line.substr(0, line.find('\t'));
+    if (type == "END" || type == "FAIL")
+      finish();
+    return;
+  }
+
   launch();
   try {
     d_cp->receive(line);
@@ -106,6 +166,180 @@ void CoWrapper::receive(string& line)
   }
 }
 
+CoChannel::CoChannel(const string& command, int timeout, int abiVersion) :
+  d_command(command), d_timeout(timeout), d_abiVersion(abiVersion)
+{
+}
+
+std::vector<std::shared_ptr<CoChannel>> CoChannel::pool(const string& command, int timeout, int abiVersion, size_t count)
+{
+  static LockGuarded<std::map<string, std::vector<std::shared_ptr<CoChannel>>>> s_channels;
+
+  auto channels = s_channels.lock();
+  auto& pool = (*channels)[std::to_string(abiVersion) + " " + std::to_string(timeout) + " " + command];
+  while (pool.size() < count) {
+    pool.push_back(std::make_shared<CoChannel>(command, timeout, abiVersion));
+  }
+  return pool;
+}
+
+void CoChannel::start()
+{
+  std::lock_guard<std::mutex> lock(d_lock);
+  launch();
+}
+
+// with d_lock held
+void CoChannel::launch()
+{
+  if (d_cp)
+    return;
+
+  if (isUnixSocket(d_command)) {
+    d_cp = std::make_shared<UnixRemote>(d_command);
+  }
+  else {
+    auto coprocess = std::make_shared<CoProcess>(d_command, d_timeout);
+    coprocess->launch();
+    d_cp = std::move(coprocess);
+  }
+
+  try {
+    d_cp->send("HELO\t" + std::to_string(d_abiVersion));
+    string banner;
+    d_cp->receive(banner);
+    g_log << Logger::Error << "Backend launched with banner: " << banner << endl;
+  }
+  catch (...) {
+    d_cp.reset();
+    throw;
+  }
+
+  if (d_launched)
+    s_restarts++;
+  d_launched = true;
+}
+
+// with d_lock held
+void CoChannel::fail(const string& reason)
+{
+  g_log << Logger::Warning << kBackendId << " Coprocess failed, restarting it for the next question: " << reason << endl;
+  d_cp.reset();
+  d_reading = false; // anybody still reading from the old one will notice, and ignore what they got
+  d_failure = reason;
+  for (auto& request : d_requests) {
+    request.second.failed = true;
+  }
+  d_cond.notify_all();
+}
+
+// with d_lock held
+void CoChannel::dispatch(const string& line)
+{
+  auto pos = line.find('\t');
+  uint64_t id = 0;
+  try {
+    id = pdns::checked_stoi<uint64_t>(line.substr(0, pos));
+  }
+  catch (const std::exception& e) {
+    g_log << Logger::Error << kBackendId << " Coprocess sent a line without request id, ignoring it: '" << line << "'" << endl;
+    return;
+  }
+
+  auto request = d_requests.find(id);
+  if (request == d_requests.end())
+    return; // answer to a question nobody is waiting for anymore
+
+  if (!request->second.answered) {
+    request->second.answered = true;
+    s_latency = (s_latency * 999 + request->second.sent.udiffNoReset()) / 1000;
+  }
+  request->second.lines.push_back(pos == string::npos ? string() : line.substr(pos + 1));
+}
+
+uint64_t CoChannel::send(const string& line)
+{
+  std::lock_guard<std::mutex> lock(d_lock);
+  launch();
+
+  uint64_t id = ++d_nextId;
+  try {
+    d_cp->send(std::to_string(id) + "\t" + line);
+  }
+  catch (PDNSException& ae) {
+    fail(ae.reason);
+    throw;
+  }
+
+  d_requests[id].sent.set();
+  d_outstanding++;
+  s_outstanding++;
+  return id;
+}
+
+void CoChannel::receive(uint64_t id, string& line)
+{
+  std::unique_lock<std::mutex> lock(d_lock);
+
+  for (;;) {
+    auto request = d_requests.find(id);
+    if (request == d_requests.end())
+      throw PDNSException("Question " + std::to_string(id) + " is not outstanding");
+
+    if (!request->second.lines.empty()) {
+      line = std::move(request->second.lines.front());
+      request->second.lines.pop_front();
+      return;
+    }
+    if (request->second.failed)
+      throw PDNSException(d_failure);
+
+    if (d_reading) {
+      // somebody else is reading, and will wake us up when there is news
+      d_cond.wait(lock);
+      continue;
+    }
+
+    d_reading = true;
+    auto cp = d_cp;
+    string received;
+    string error;
+    lock.unlock();
+    try {
+      cp->receive(received);
+    }
+    catch (PDNSException& ae) {
+      error = ae.reason;
+    }
+    catch (std::exception& e) {
+      error = e.what();
+    }
+    catch (...) {
+      error = "unknown error reading from coprocess";
+    }
+    lock.lock();
+
+    if (cp != d_cp)
+      continue; // that coprocess already failed, and its questions with it
+
+    d_reading = false;
+    if (!error.empty())
+      fail(error);
+    else
+      dispatch(received);
+    d_cond.notify_all();
+  }
+}
+
+void CoChannel::finish(uint64_t id)
+{
+  std::lock_guard<std::mutex> lock(d_lock);
+  if (d_requests.erase(id) != 0) {
+    d_outstanding--;
+    s_outstanding--;
+  }
+}
+
 PipeBackend::PipeBackend(const string& suffix)
 {
   d_disavow = false;
@@ -134,7 +368,7 @@ void PipeBackend::launch()
     }
     d_regexstr = getArg("regex");
     d_abiVersion = getArgAsNum("abi-version");
-    d_coproc = std::make_unique<CoWrapper>(getArg("command"), getArgAsNum("timeout"), getArgAsNum("abi-version"));
+    d_coproc = std::make_unique<CoWrapper>(getArg("command"), getArgAsNum("timeout"), getArgAsNum("abi-version"), getArgAsNum("coprocesses"));
   }
 
   catch (const ArgException& A) {
@@ -368,6 +602,17 @@ public:
     declare(suffix, "timeout", "Number of milliseconds to wait for an answer", "2000");
     declare(suffix, "regex", "Regular expression of queries to pass to coprocess", "");
     declare(suffix, "abi-version", "Version of the pipe backend ABI", "1");
+    declare(suffix, "coprocesses", "Number of coprocesses shared by all threads, from abi-version 6 on", "1");
+
+    static std::once_flag declared;
+    std::call_once(declared, [] {
+      S.declare(
+        "pipe-questions-outstanding", "Number of questions sent to shared pipe backend coprocesses that have not been answered yet", [](const std::string&) { return s_outstanding.load(); }, StatType::gauge);
+      S.declare(
+        "pipe-latency", "Average number of microseconds a shared pipe backend coprocess takes to start answering", [](const std::string&) { return s_latency.load(); }, StatType::gauge);
+      S.declare(
+        "pipe-coprocess-restarts", "Number of times a shared pipe backend coprocess was restarted", [](const std::string&) { return s_restarts.load(); }, StatType::counter);
+    });
   }
 
   DNSBackend* make(const string& suffix = "") override
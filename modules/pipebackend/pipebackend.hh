@@ -22,27 +22,85 @@
 #pragma once
 #include <string>
 #include <map>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <sys/types.h>
 
 #include "pdns/namespaces.hh"
 #include "pdns/misc.hh"
 
+/** A coprocess speaking abi-version 6 or later, shared by all backend instances (so all
+    threads) using the same command. Every question is tagged with a request id, and the
+    coprocess tags the lines of its answer with that id, so any number of questions can be
+    outstanding and they can be answered in any order. Whichever waiting thread finds
+    nobody reading does the reading, and hands lines for other requests to their owners.
+    A coprocess that fails or times out is killed, all its outstanding questions fail,
+    and the next question launches a new one. */
+class CoChannel
+{
+public:
+  CoChannel(const string& command, int timeout, int abiVersion);
+  void start();
+  uint64_t send(const string& line);
+  void receive(uint64_t id, string& line);
+  void finish(uint64_t id);
+  size_t outstanding() const { return d_outstanding; }
+
+  //! returns the `count' channels shared by everybody using this command
+  static std::vector<std::shared_ptr<CoChannel>> pool(const string& command, int timeout, int abiVersion, size_t count);
+
+private:
+  struct Request
+  {
+    std::deque<string> lines;
+    DTime sent;
+    bool answered{false};
+    bool failed{false};
+  };
+
+  void launch();
+  void fail(const string& reason);
+  void dispatch(const string& line);
+
+  std::mutex d_lock; // protects everything below
+  std::condition_variable d_cond;
+  std::shared_ptr<CoRemote> d_cp;
+  std::map<uint64_t, Request> d_requests;
+  string d_failure;
+  uint64_t d_nextId{0};
+  bool d_reading{false};
+  bool d_launched{false};
+  std::atomic<size_t> d_outstanding{0};
+  const string d_command;
+  const int d_timeout;
+  const int d_abiVersion;
+};
+
 /** The CoWrapper class wraps around a coprocess and restarts it if needed.
-    It may also send out pings and expect banners */
+    It may also send out pings and expect banners. From abi-version 6 on it
+    sends its questions to the shared CoChannels instead. */
 class CoWrapper
 {
 public:
-  CoWrapper(const string& command, int timeout, int abiVersion);
+  CoWrapper(const string& command, int timeout, int abiVersion, size_t coprocesses = 1);
   ~CoWrapper();
   void send(const string& line);
   void receive(string& line);
 
 private:
   std::unique_ptr<CoRemote> d_cp;
+  std::vector<std::shared_ptr<CoChannel>> d_channels; // abi-version 6 and up
+  std::shared_ptr<CoChannel> d_channel; // the channel our current question went to
+  uint64_t d_requestId{0};
   string d_command;
   void launch();
+  void finish();
   int d_timeout;
   int d_abiVersion;
+  size_t d_coprocesses;
 };
 
 class PipeBackend : public DNSBackend
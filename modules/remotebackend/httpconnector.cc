@@ -34,6 +34,20 @@
 #define UNIX_PATH_MAX 108
 #endif
 
+struct HTTPIdleConnection
+{
+  std::unique_ptr<Socket> socket;
+  ComboAddress addr;
+};
+
+// keep-alive connections left behind by connectors that went away, per host:port.
+// Never freed, connectors can still be destroyed while static objects go away at exit.
+static LockGuarded<std::map<std::string, std::vector<HTTPIdleConnection>>>& idleConnections()
+{
+  static auto* connections = new LockGuarded<std::map<std::string, std::vector<HTTPIdleConnection>>>();
+  return *connections;
+}
+
 HTTPConnector::HTTPConnector(std::map<std::string, std::string> options) :
   d_socket(nullptr)
 {
@@ -48,6 +62,7 @@ HTTPConnector::HTTPConnector(std::map<std::string, std::string> options) :
     YaHTTP::URL url(d_url);
     d_host = url.host;
     d_port = url.port;
+    d_endpoint = d_host + ":" + std::to_string(d_port);
   }
   catch (const std::exception& e) {
     throw PDNSException("Error parsing the 'url' option provided to the remote backend HTTP connector: " + std::string(e.what()));
@@ -62,10 +77,14 @@ HTTPConnector::HTTPConnector(std::map<std::string, std::string> options) :
   this->timeout = 2;
   this->d_post = false;
   this->d_post_json = false;
+  this->d_idle_connections = 16;
 
   if (options.find("timeout") != options.end()) {
     this->timeout = std::stoi(options.find("timeout")->second) / 1000;
   }
+  if (options.find("idle-connections") != options.end()) {
+    this->d_idle_connections = std::stoi(options.find("idle-connections")->second);
+  }
   if (options.find("post") != options.end()) {
     std::string val = options.find("post")->second;
     if (val == "yes" || val == "true" || val == "on" || val == "1") {
@@ -80,7 +99,49 @@ HTTPConnector::HTTPConnector(std::map<std::string, std::string> options) :
   }
 }
 
-HTTPConnector::~HTTPConnector() {}
+HTTPConnector::~HTTPConnector()
+{
+  try {
+    releaseConnection();
+  }
+  catch (...) {
+  }
+}
+
+// hands our connection back to the pool once an answer has been read, so that any connector
+// for the same endpoint can take it for its next request. We keep it if the pool is full.
+void HTTPConnector::releaseConnection()
+{
+  if (d_socket == nullptr || d_idle_connections == 0)
+    return;
+
+  auto idle = idleConnections().lock();
+  auto& connections = (*idle)[d_endpoint];
+  if (connections.size() < d_idle_connections) {
+    connections.push_back({std::move(d_socket), d_addr});
+  }
+}
+
+bool HTTPConnector::takeIdleConnection()
+{
+  auto idle = idleConnections().lock();
+  auto it = idle->find(d_endpoint);
+  if (it == idle->end())
+    return false;
+
+  auto& connections = it->second;
+  while (!connections.empty()) {
+    auto connection = std::move(connections.back());
+    connections.pop_back();
+    // anything readable on an idle connection means the server closed it
+    if (waitForRWData(connection.socket->getHandle(), true, 0, 0) == 0) {
+      d_socket = std::move(connection.socket);
+      d_addr = connection.addr;
+      return true;
+    }
+  }
+  return false;
+}
 
 void HTTPConnector::addUrlComponent(const Json& parameters, const string& element, std::stringstream& ss)
 {
@@ -278,6 +339,16 @@ void HTTPConnector::restful_requestbuilder(const std::string& method, const Json
     req.GET()["maxResults"] = std::to_string(parameters["maxResults"].int_value());
     verb = "GET";
   }
+  else if (method == "lookups") {
+    std::stringstream ss2;
+    for (const auto& param : parameters["qnames"].array_items()) {
+      ss2 << "qnames[]=" << YaHTTP::Utility::encodeURL(param.string_value(), false) << "&";
+    }
+    req.body = ss2.str().substr(0, ss2.str().size() - 1);
+    req.headers["content-type"] = "application/x-www-form-urlencoded; charset=utf-8";
+    req.headers["content-length"] = std::to_string(req.body.size());
+    verb = "POST";
+  }
   else if (method == "getAllDomains") {
     req.GET()["includeDisabled"] = (parameters["include_disabled"].bool_value() ? "true" : "false");
     verb = "GET";
@@ -348,11 +419,14 @@ int HTTPConnector::send_message(const Json& input)
 
   out << req;
 
+  if (this->d_socket == nullptr)
+    takeIdleConnection();
+
   // try sending with current socket, if it fails retry with new socket
   if (this->d_socket != nullptr) {
     fd = this->d_socket->getHandle();
-    // there should be no data waiting
-    if (waitForRWData(fd, true, 0, 1000) < 1) {
+    // there should be no data waiting, only check, do not wait for it
+    if (waitForRWData(fd, true, 0, 0) < 1) {
       try {
         d_socket->writenWithTimeout(out.str().c_str(), out.str().size(), timeout);
         rv = 1;
@@ -451,6 +525,12 @@ int HTTPConnector::recv_message(Json& output)
 
   arl.finalize();
 
+  // the server will not take another request on this one
+  if (resp.headers.count("connection") != 0 && pdns_iequals(resp.headers["connection"], "close"))
+    d_socket.reset();
+  else
+    releaseConnection();
+
   if ((resp.status < 200 || resp.status >= 400) && resp.status != 404) {
     // bad.
     throw PDNSException("Received unacceptable HTTP status code " + std::to_string(resp.status) + " from HTTP endpoint " + d_addr.toStringWithPort());
@@ -78,6 +78,7 @@ RemoteBackend::RemoteBackend(const std::string& suffix)
 
   this->d_connstr = getArg("connection-string");
   this->d_dnssec = mustDo("dnssec");
+  this->d_batchLookups = mustDo("batch-lookups");
   this->d_index = -1;
   this->d_trxid = 0;
 
@@ -196,6 +197,23 @@ void RemoteBackend::lookup(const QType& qtype, const DNSName& qdomain, int zoneI
   if (d_index != -1)
     throw PDNSException("Attempt to lookup while one running");
 
+  if (!d_prefetched.empty()) {
+    auto iter = d_prefetched.end();
+    if (qtype == d_prefetchedType && zoneId == d_prefetchedZone) {
+      iter = d_prefetched.find(qdomain);
+    }
+    if (iter != d_prefetched.end()) {
+      d_result = Json::object{{"result", std::move(iter->second)}};
+      d_prefetched.erase(iter);
+      if (d_result["result"].array_items().size() > 0) {
+        d_index = 0;
+      }
+      return;
+    }
+    // anything else means the lookups we prefetched for are over
+    d_prefetched.clear();
+  }
+
   string localIP = "0.0.0.0";
   string remoteIP = "0.0.0.0";
   string realRemote = "0.0.0.0/0";
@@ -221,6 +239,47 @@ void RemoteBackend::lookup(const QType& qtype, const DNSName& qdomain, int zoneI
   d_index = 0;
 }
 
+/**
+ * Asks for the records of several names in one 'lookups' call, if enabled.
+ * The remote end answers with one array of records per name, in the same order.
+ */
+void RemoteBackend::prefetch(const QType& qtype, const vector<DNSName>& qdomains, int zoneId)
+{
+  d_prefetched.clear();
+  if (!d_batchLookups || d_index != -1 || qdomains.size() < 2)
+    return;
+
+  Json::array qnames;
+  for (const auto& qdomain : qdomains) {
+    qnames.push_back(qdomain.toString());
+  }
+
+  Json query = Json::object{
+    {"method", "lookups"},
+    {"parameters", Json::object{{"qtype", qtype.toString()}, {"qnames", qnames}, {"zone-id", zoneId}}}};
+  Json answer;
+
+  if (this->send(query) == false || this->recv(answer) == false)
+    return;
+
+  const auto& results = answer["result"].array_items();
+  if (results.size() != qdomains.size())
+    return;
+
+  for (size_t idx = 0; idx < results.size(); idx++) {
+    if (results.at(idx).is_array()) {
+      d_prefetched[qdomains.at(idx)] = results.at(idx);
+    }
+  }
+  d_prefetchedType = qtype;
+  d_prefetchedZone = zoneId;
+}
+
+void RemoteBackend::endPrefetch()
+{
+  d_prefetched.clear();
+}
+
 bool RemoteBackend::list(const DNSName& target, int domain_id, bool include_disabled)
 {
   if (d_index != -1)
@@ -965,6 +1024,7 @@ public:
   {
     declare(suffix, "dnssec", "Enable dnssec support", "no");
     declare(suffix, "connection-string", "Connection string", "");
+    declare(suffix, "batch-lookups", "Fetch the records for the additional processing of an answer with one 'lookups' call", "no");
   }
 
   DNSBackend* make(const std::string& suffix = "") override
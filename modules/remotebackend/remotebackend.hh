@@ -110,10 +110,14 @@ private:
   void post_requestbuilder(const Json& input, YaHTTP::Request& req);
   void addUrlComponent(const Json& parameters, const string& element, std::stringstream& ss);
   std::string buildMemberListArgs(std::string prefix, const Json& args);
+  bool takeIdleConnection();
+  void releaseConnection();
   std::unique_ptr<Socket> d_socket;
   ComboAddress d_addr;
   std::string d_host;
   uint16_t d_port;
+  std::string d_endpoint;
+  size_t d_idle_connections;
 };
 
 #ifdef REMOTEBACKEND_ZEROMQ
@@ -165,6 +169,8 @@ public:
   ~RemoteBackend();
 
   void lookup(const QType& qtype, const DNSName& qdomain, int zoneId = -1, DNSPacket* pkt_p = nullptr) override;
+  void prefetch(const QType& qtype, const vector<DNSName>& qdomains, int zoneId) override;
+  void endPrefetch() override;
   bool get(DNSResourceRecord& rr) override;
   bool list(const DNSName& target, int domain_id, bool include_disabled = false) override;
 
@@ -210,7 +216,12 @@ private:
   int build();
   std::unique_ptr<Connector> connector;
   bool d_dnssec;
+  bool d_batchLookups;
   Json d_result;
+  // answers fetched by prefetch() with one 'lookups' call, handed out by the next lookup() of that name
+  std::map<DNSName, Json> d_prefetched;
+  QType d_prefetchedType;
+  int d_prefetchedZone{-1};
   int d_index;
   int64_t d_trxid;
   std::string d_connstr;
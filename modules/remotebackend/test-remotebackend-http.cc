@@ -76,6 +76,7 @@ struct RemotebackendSetup
       // then get us a instance of it
       ::arg().set("remote-connection-string") = "http:url=http://localhost:62434/dns";
       ::arg().set("remote-dnssec") = "yes";
+      ::arg().set("remote-batch-lookups") = "yes";
       be = BackendMakers().all()[0];
     }
     catch (PDNSException& ex) {
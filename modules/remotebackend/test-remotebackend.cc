@@ -59,6 +59,23 @@ BOOST_AUTO_TEST_CASE(test_method_lookup)
   BOOST_CHECK_EQUAL(rr.ttl, 300);
 }
 
+BOOST_AUTO_TEST_CASE(test_method_prefetch)
+{
+  BOOST_TEST_MESSAGE("Testing prefetch method");
+  DNSResourceRecord rr;
+  be->prefetch(QType(QType::A), {DNSName("ns1.unit.test."), DNSName("empty.unit.test.")}, -1);
+  // then the lookups are answered from what was fetched
+  be->lookup(QType(QType::A), DNSName("ns1.unit.test."), -1);
+  BOOST_CHECK(be->get(rr));
+  BOOST_CHECK_EQUAL(rr.qname.toString(), "ns1.unit.test.");
+  BOOST_CHECK_MESSAGE(rr.qtype == QType::A, "returned qtype was not A");
+  BOOST_CHECK_EQUAL(rr.content, "10.0.0.1");
+  BOOST_CHECK(!be->get(rr));
+  be->lookup(QType(QType::A), DNSName("empty.unit.test."), -1);
+  BOOST_CHECK(!be->get(rr));
+  be->endPrefetch();
+}
+
 BOOST_AUTO_TEST_CASE(test_method_lookup_empty)
 {
   BOOST_TEST_MESSAGE("Testing lookup method with empty result");
@@ -60,6 +60,13 @@ class Handler
      [ret]
    end
 
+   def do_lookups(args)
+     ret = args["qnames"].map do |qname|
+       do_lookup(args.merge("qname" => qname))[0]
+     end
+     [ret]
+   end
+
    def do_list(args)
      ret = []
      if args["zonename"] == "unit.test."
@@ -48,6 +48,10 @@ class DNSBackendHandler < WEBrick::HTTPServlet::AbstractServlet
           "qname" => url.shift,
           "qtype" => url.shift
          }
+     when "lookups"
+         {
+          "qtype" => url.shift
+         }
      when "list"
         {
 	  "id" => url.shift,
@@ -0,0 +1,262 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+
+#include <boost/algorithm/string.hpp>
+
+#include "auth-axfrcache.hh"
+
+extern StatBag S;
+
+AuthAXFRCache::AuthAXFRCache()
+{
+  S.declare("axfr-cache-hit", "Number of outgoing AXFRs which were sent from the AXFR cache");
+  S.declare("axfr-cache-miss", "Number of outgoing AXFRs which were not in the AXFR cache");
+  S.declare("axfr-cache-size", "Number of zone transfers held by the AXFR cache", StatType::gauge);
+  S.declare("axfr-cache-records", "Number of records held by the AXFR cache", StatType::gauge);
+
+  d_statnumhit = S.getPointer("axfr-cache-hit");
+  d_statnummiss = S.getPointer("axfr-cache-miss");
+  d_statnumentries = S.getPointer("axfr-cache-size");
+  d_statnumrecords = S.getPointer("axfr-cache-records");
+}
+
+// must be called with d_mutex held
+std::shared_ptr<const AuthAXFRCache::Transfer> AuthAXFRCache::lookup(const DNSName& zone, uint32_t serial, uint8_t variant, time_t now)
+{
+  auto iter = d_transfers.find(zone);
+  if (iter == d_transfers.end()) {
+    return nullptr;
+  }
+
+  const auto& transfer = iter->second;
+  if (transfer->d_serial == serial && transfer->d_variant == variant && transfer->d_ttd > now) {
+    return transfer;
+  }
+  /* the zone changed, or this transfer is too old */
+  erase(iter);
+  return nullptr;
+}
+
+// must be called with d_mutex held
+void AuthAXFRCache::erase(std::map<DNSName, std::shared_ptr<const Transfer>>::iterator iter)
+{
+  *d_statnumrecords -= iter->second->d_records;
+  (*d_statnumentries)--;
+  d_transfers.erase(iter);
+}
+
+std::shared_ptr<const AuthAXFRCache::Transfer> AuthAXFRCache::get(const DNSName& zone, uint32_t serial, uint8_t variant)
+{
+  std::lock_guard<std::mutex> lock(d_mutex);
+  auto transfer = lookup(zone, serial, variant, time(nullptr));
+  if (transfer) {
+    (*d_statnumhit)++;
+  }
+  else {
+    (*d_statnummiss)++;
+  }
+  return transfer;
+}
+
+std::shared_ptr<const AuthAXFRCache::Transfer> AuthAXFRCache::get(const DNSName& zone, uint32_t serial, uint8_t variant, std::unique_ptr<Recording>& recording)
+{
+  recording.reset();
+  auto key = std::tuple(zone, serial, variant);
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(d_ttl);
+
+  std::unique_lock<std::mutex> lock(d_mutex);
+  for (;;) {
+    auto transfer = lookup(zone, serial, variant, time(nullptr));
+    if (transfer) {
+      (*d_statnumhit)++;
+      return transfer;
+    }
+
+    auto iter = d_inFlight.find(key);
+    if (iter == d_inFlight.end()) {
+      auto inFlight = std::make_shared<InFlight>();
+      inFlight->d_key = std::move(key);
+      d_inFlight.emplace(inFlight->d_key, inFlight);
+      lock.unlock();
+      recording = std::make_unique<Recording>(*this, std::move(inFlight));
+      (*d_statnummiss)++;
+      return nullptr;
+    }
+
+    /* someone else is recording this transfer, wait for it instead of listing and signing the zone again */
+    auto inFlight = iter->second;
+    if (!inFlight->d_cond.wait_until(lock, deadline, [&inFlight] { return inFlight->d_done; }) || inFlight->d_tooLarge) {
+      (*d_statnummiss)++;
+      return nullptr;
+    }
+    /* it was either stored, or abandoned and we might record it ourselves */
+  }
+}
+
+std::shared_ptr<AuthAXFRCache::Transfer> AuthAXFRCache::make(const DNSName& zone, uint32_t serial, uint8_t variant)
+{
+  auto transfer = std::make_shared<Transfer>();
+  transfer->d_zone = zone;
+  transfer->d_serial = serial;
+  transfer->d_variant = variant;
+  return transfer;
+}
+
+// must be called with d_mutex held
+void AuthAXFRCache::store(std::shared_ptr<Transfer>&& transfer, time_t now)
+{
+  if (!fits(transfer->d_records)) {
+    return;
+  }
+
+  auto iter = d_transfers.find(transfer->d_zone);
+  if (iter != d_transfers.end()) {
+    erase(iter);
+  }
+
+  /* make room, dropping the transfers closest to their expiry first */
+  while (d_maxTotalRecords != 0 && *d_statnumrecords + transfer->d_records > d_maxTotalRecords && !d_transfers.empty()) {
+    auto oldest = std::min_element(d_transfers.begin(), d_transfers.end(), [](const auto& a, const auto& b) { return a.second->d_ttd < b.second->d_ttd; });
+    erase(oldest);
+  }
+
+  transfer->d_ttd = now + d_ttl;
+  *d_statnumrecords += transfer->d_records;
+  (*d_statnumentries)++;
+  const DNSName zone(transfer->d_zone);
+  d_transfers.emplace(zone, std::move(transfer));
+}
+
+void AuthAXFRCache::insert(std::shared_ptr<Transfer>&& transfer)
+{
+  std::lock_guard<std::mutex> lock(d_mutex);
+  store(std::move(transfer), time(nullptr));
+}
+
+AuthAXFRCache::Recording::Recording(AuthAXFRCache& cache, std::shared_ptr<InFlight> inFlight) :
+  d_cache(cache), d_inFlight(std::move(inFlight))
+{
+  const auto& [zone, serial, variant] = d_inFlight->d_key;
+  d_transfer = make(zone, serial, variant);
+}
+
+AuthAXFRCache::Recording::~Recording()
+{
+  release(false);
+}
+
+bool AuthAXFRCache::Recording::reserve(size_t records)
+{
+  if (d_tooLarge || !d_cache.fits(records)) {
+    d_tooLarge = true;
+    release(true);
+    return false;
+  }
+  return true;
+}
+
+bool AuthAXFRCache::Recording::add(const std::vector<DNSZoneRecord>& records)
+{
+  d_transfer->d_records += records.size();
+  d_transfer->d_chunks.push_back(records);
+  return reserve(d_transfer->d_records);
+}
+
+std::shared_ptr<const AuthAXFRCache::Transfer> AuthAXFRCache::Recording::commit()
+{
+  std::shared_ptr<const Transfer> transfer = d_transfer;
+  if (!d_inFlight) {
+    return transfer;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(d_cache.d_mutex);
+    d_cache.store(std::move(d_transfer), time(nullptr));
+  }
+  release(false);
+  return transfer;
+}
+
+void AuthAXFRCache::Recording::release(bool tooLarge)
+{
+  if (!d_inFlight) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(d_cache.d_mutex);
+    auto iter = d_cache.d_inFlight.find(d_inFlight->d_key);
+    if (iter != d_cache.d_inFlight.end() && iter->second == d_inFlight) {
+      d_cache.d_inFlight.erase(iter);
+    }
+    d_inFlight->d_done = true;
+    d_inFlight->d_tooLarge = tooLarge;
+  }
+  d_inFlight->d_cond.notify_all();
+  d_inFlight.reset();
+}
+
+template <typename T>
+uint64_t AuthAXFRCache::invalidate(T matches)
+{
+  uint64_t delcount = 0;
+  std::lock_guard<std::mutex> lock(d_mutex);
+  for (auto iter = d_transfers.begin(); iter != d_transfers.end();) {
+    if (matches(iter->first)) {
+      erase(iter++);
+      delcount++;
+    }
+    else {
+      ++iter;
+    }
+  }
+  return delcount;
+}
+
+uint64_t AuthAXFRCache::purge()
+{
+  return invalidate([](const DNSName&) { return true; });
+}
+
+uint64_t AuthAXFRCache::purge(const std::string& match)
+{
+  if (boost::ends_with(match, "$")) {
+    std::string prefix(match);
+    prefix.resize(prefix.size() - 1);
+    DNSName suffix(prefix);
+    /* the transfer of a parent zone holds the delegation to, and the glue of, a zone below it */
+    return invalidate([&suffix](const DNSName& zone) { return zone.isPartOf(suffix) || suffix.isPartOf(zone); });
+  }
+
+  return purgeExact(DNSName(match));
+}
+
+uint64_t AuthAXFRCache::purgeExact(const DNSName& qname)
+{
+  return invalidate([&qname](const DNSName& zone) { return qname.isPartOf(zone); });
+}
@@ -0,0 +1,170 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include "dnsname.hh"
+#include "dnspacket.hh"
+#include "statbag.hh"
+
+/** The messages of the last outgoing AXFR of each zone.
+
+    doAXFR() records the records of every message it sends, after listing, rectifying
+    and signing the zone. A later transfer of the same zone with the same SOA serial
+    and DNSSEC state sends these messages again, only the TSIG of each message is
+    computed anew. An entry is dropped when the serial of its zone changes, when
+    it is older than 'axfr-cache-ttl' seconds, when its zone is purged, or to make
+    room for another zone once 'axfr-cache-max-total-records' is reached.
+
+    Only one transfer of a zone serial is recorded at a time, the transfers missing
+    the cache in the meantime wait for it to be stored. The recording transfer sends
+    its messages only once they are all recorded and stored, so a slow client does not
+    hold back the others.
+
+    Transfers are immutable once stored, so the entries are shared by all the
+    transfers sending them.
+*/
+class AuthAXFRCache : public boost::noncopyable
+{
+public:
+  using chunks_t = std::vector<std::vector<DNSZoneRecord>>;
+
+  struct Transfer
+  {
+    DNSName d_zone;
+    chunks_t d_chunks; //!< the records of each message, without the SOA records that start and end the transfer
+    size_t d_records{0};
+    time_t d_ttd{0};
+    uint32_t d_serial{0};
+    uint8_t d_variant{0}; //!< DNSSEC state of the zone when it was transferred
+  };
+
+private:
+  using key_t = std::tuple<DNSName, uint32_t, uint8_t>;
+
+  struct InFlight
+  {
+    key_t d_key;
+    std::condition_variable d_cond;
+    bool d_done{false};
+    bool d_tooLarge{false};
+  };
+
+public:
+  /** A transfer being recorded. The transfers waiting for it are released by commit(),
+      when it turns out too large to be stored, or when it is destroyed without having been committed. */
+  class Recording : public boost::noncopyable
+  {
+  public:
+    Recording(AuthAXFRCache& cache, std::shared_ptr<InFlight> inFlight);
+    ~Recording();
+
+    //! Whether a zone holding that many records can be stored, if not the waiting transfers are released
+    bool reserve(size_t records);
+    /** Adds the records of one message, returns false if the transfer became too large to be stored.
+        The messages are kept anyway, so that they can still be sent from getChunks(). */
+    bool add(const std::vector<DNSZoneRecord>& records);
+    const chunks_t& getChunks() const
+    {
+      return d_transfer->d_chunks;
+    }
+    //! Stores the transfer if it is not too large, and returns it
+    std::shared_ptr<const Transfer> commit();
+
+  private:
+    void release(bool tooLarge);
+
+    AuthAXFRCache& d_cache;
+    std::shared_ptr<InFlight> d_inFlight;
+    std::shared_ptr<Transfer> d_transfer;
+    bool d_tooLarge{false};
+  };
+
+  AuthAXFRCache();
+
+  void setTTL(uint32_t ttl)
+  {
+    d_ttl = ttl;
+  }
+  void setMaxRecords(size_t maxRecords)
+  {
+    d_maxRecords = maxRecords;
+  }
+  void setMaxTotalRecords(size_t maxTotalRecords)
+  {
+    d_maxTotalRecords = maxTotalRecords;
+  }
+  bool enabled() const
+  {
+    return d_ttl > 0;
+  }
+  //! Whether a zone holding that many records can be stored
+  bool fits(size_t records) const
+  {
+    return enabled() && (d_maxRecords == 0 || records <= d_maxRecords) && (d_maxTotalRecords == 0 || records <= d_maxTotalRecords);
+  }
+
+  std::shared_ptr<const Transfer> get(const DNSName& zone, uint32_t serial, uint8_t variant);
+  /** Like get(), but on a miss 'recording' is set to a transfer to record into. Unless another transfer of
+      the same zone serial is being recorded: then this waits for it for at most 'axfr-cache-ttl' seconds,
+      and returns nullptr with 'recording' unset if it did not get stored. */
+  std::shared_ptr<const Transfer> get(const DNSName& zone, uint32_t serial, uint8_t variant, std::unique_ptr<Recording>& recording);
+  //! Returns a new transfer to record into, its d_ttd is set by insert()
+  static std::shared_ptr<Transfer> make(const DNSName& zone, uint32_t serial, uint8_t variant);
+  void insert(std::shared_ptr<Transfer>&& transfer);
+
+  uint64_t purge();
+  uint64_t purge(const std::string& match); // could be $ terminated. Is not a dnsname!
+  uint64_t purgeExact(const DNSName& qname); // drops the transfer of the zone holding qname
+
+  uint64_t size() const { return *d_statnumentries; }
+  uint64_t records() const { return *d_statnumrecords; }
+
+private:
+  std::shared_ptr<const Transfer> lookup(const DNSName& zone, uint32_t serial, uint8_t variant, time_t now);
+  void store(std::shared_ptr<Transfer>&& transfer, time_t now);
+  void erase(std::map<DNSName, std::shared_ptr<const Transfer>>::iterator iter);
+  template <typename T>
+  uint64_t invalidate(T matches);
+
+  std::mutex d_mutex;
+  /* protected by d_mutex */
+  std::map<DNSName, std::shared_ptr<const Transfer>> d_transfers;
+  std::map<key_t, std::shared_ptr<InFlight>> d_inFlight;
+
+  AtomicCounter* d_statnumhit;
+  AtomicCounter* d_statnummiss;
+  AtomicCounter* d_statnumentries;
+  AtomicCounter* d_statnumrecords;
+
+  size_t d_maxRecords{0};
+  size_t d_maxTotalRecords{0};
+  uint32_t d_ttl{0};
+};
@@ -21,11 +21,19 @@
  */
 
 #include "auth-caches.hh"
+#include "auth-axfrcache.hh"
+#include "auth-compiledzone.hh"
+#include "auth-memoryzones.hh"
+#include "auth-nsec3cache.hh"
 #include "auth-querycache.hh"
 #include "auth-packetcache.hh"
 
 extern AuthPacketCache PC;
 extern AuthQueryCache QC;
+extern AuthCompiledZones g_compiledZones;
+extern AuthMemoryZones g_memoryZones;
+extern AuthAXFRCache g_axfrCache;
+extern AuthNSEC3Cache g_nsec3Cache;
 
 /* empty all caches */
 uint64_t purgeAuthCaches()
@@ -33,6 +41,10 @@ uint64_t purgeAuthCaches()
   uint64_t ret = 0;
   ret += PC.purge();
   ret += QC.purge();
+  ret += g_compiledZones.purge();
+  ret += g_memoryZones.purge();
+  ret += g_axfrCache.purge();
+  ret += g_nsec3Cache.purge();
   return ret;
 }
 
@@ -42,6 +54,10 @@ uint64_t purgeAuthCaches(const std::string& match)
   uint64_t ret = 0;
   ret += PC.purge(match);
   ret += QC.purge(match);
+  ret += g_compiledZones.purge(match);
+  ret += g_memoryZones.purge(match);
+  ret += g_axfrCache.purge(match);
+  ret += g_nsec3Cache.purge(match);
   return ret;
 }
 
@@ -51,6 +67,10 @@ uint64_t purgeAuthCachesExact(const DNSName& qname)
   uint64_t ret = 0;
   ret += PC.purgeExact(qname);
   ret += QC.purgeExact(qname);
+  ret += g_compiledZones.purgeExact(qname);
+  ret += g_memoryZones.purgeExact(qname);
+  ret += g_axfrCache.purgeExact(qname);
+  ret += g_nsec3Cache.purgeExact(qname);
   return ret;
 }
 
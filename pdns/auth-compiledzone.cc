@@ -0,0 +1,265 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
+
+#include "auth-compiledzone.hh"
+#include "dns.hh"
+#include "qtype.hh"
+
+extern StatBag S;
+
+AuthCompiledZones::AuthCompiledZones()
+{
+  S.declare("compiled-zones-hit", "Number of packets which were answered from a compiled zone");
+  S.declare("compiled-zones-size", "Number of answers held by the compiled zones", StatType::gauge);
+
+  d_statnumhit = S.getPointer("compiled-zones-hit");
+  d_statnumentries = S.getPointer("compiled-zones-size");
+}
+
+void AuthCompiledZones::setZones(const std::vector<DNSName>& zones)
+{
+  {
+    std::lock_guard<std::mutex> lock(d_mutex);
+    for (const auto& zone : zones) {
+      if (d_generations.emplace(zone, 1).second) {
+        d_pending.push_back(zone);
+      }
+    }
+    d_enabled = !d_generations.empty();
+  }
+  d_cond.notify_one();
+}
+
+bool AuthCompiledZones::isCompilableType(uint16_t qtype)
+{
+  /* answers to these types depend on more than the records of the name, or are
+     synthesized by the PacketHandler, they are always sent to the backends */
+  switch (qtype) {
+  case QType::ANY:
+  case QType::AXFR:
+  case QType::IXFR:
+  case QType::DS:
+  case QType::DNSKEY:
+  case QType::CDNSKEY:
+  case QType::CDS:
+  case QType::NSEC3PARAM:
+  case QType::RRSIG:
+  case QType::NSEC:
+  case QType::NSEC3:
+  case QType::TKEY:
+  case QType::TSIG:
+  case QType::OPT:
+  case QType::MAILA:
+  case QType::MAILB:
+  case QType::ALIAS:
+  case QType::LUA:
+  case QType::ENT:
+    return false;
+  default:
+    return qtype != s_noDataType;
+  }
+}
+
+bool AuthCompiledZones::get(LocalStateHolder<zones_t>& zones, DNSPacket& p, DNSPacket& cached)
+{
+  if (zones->empty()) {
+    return false;
+  }
+
+  /* only plain questions, for which the answer does not depend on anything else
+     than the name, the type and the EDNS variant */
+  if (p.d_tcp || p.d.opcode != Opcode::Query || p.qclass != QClass::IN || ntohs(p.d.qdcount) != 1 || p.d.ancount != 0 || p.d.nscount != 0 || ntohs(p.d.arcount) != (p.hasEDNS() ? 1 : 0)) {
+    return false;
+  }
+  if (!p.couldBeCached() || p.hasEDNSSubnet() || p.getEDNSVersion() != 0) {
+    return false;
+  }
+  const uint16_t qtype = p.qtype.getCode();
+  if (!isCompilableType(qtype)) {
+    return false;
+  }
+
+  const Zone* zone = nullptr;
+  DNSName zoneName(p.qdomain);
+  do {
+    auto iter = zones->find(zoneName);
+    if (iter != zones->end()) {
+      zone = iter->second.get();
+      break;
+    }
+  } while (zoneName.chopOff());
+
+  if (zone == nullptr) {
+    return false;
+  }
+
+  auto name = zone->d_names.find(p.qdomain);
+  if (name == zone->d_names.end()) {
+    return false;
+  }
+
+  const answers_t* answers = &name->second.d_noData;
+  bool noData = true;
+  for (const auto& type : name->second.d_types) {
+    if (type.first == qtype) {
+      answers = &type.second;
+      noData = false;
+      break;
+    }
+  }
+
+  Variant variant = p.hasEDNS() ? (p.d_dnssecOk ? EDNSWithDO : EDNS) : NoEDNS;
+  const auto& answer = (*answers)[variant];
+  if (answer.d_packet.empty()) {
+    return false;
+  }
+
+  if (variant != NoEDNS) {
+    /* EDNS answers are compiled for the largest size we are willing to send */
+    if (answer.d_truncated ? p.getMaxReplyLen() < DNSPacket::s_udpTruncationThreshold : answer.d_packet.size() > p.getMaxReplyLen()) {
+      return false;
+    }
+  }
+
+  if (noData) {
+    std::string packet(answer.d_packet);
+    const uint16_t type = htons(qtype);
+    memcpy(&packet.at(sizeof(dnsheader) + p.qdomain.wirelength()), &type, sizeof(type));
+    cached.noparse(packet.c_str(), packet.size());
+  }
+  else {
+    cached.noparse(answer.d_packet.c_str(), answer.d_packet.size());
+  }
+
+  (*d_statnumhit)++;
+  cached.spoofQuestion(p); // for correct case
+  cached.qdomain = p.qdomain;
+  cached.qtype = p.qtype;
+
+  return true;
+}
+
+void AuthCompiledZones::waitForPending(DNSName& zone, uint64_t& generation)
+{
+  std::unique_lock<std::mutex> lock(d_mutex);
+  d_cond.wait(lock, [this] { return !d_pending.empty(); });
+
+  zone = d_pending.front();
+  d_pending.pop_front();
+  generation = d_generations.at(zone);
+}
+
+bool AuthCompiledZones::store(uint64_t generation, std::shared_ptr<const Zone>&& zone)
+{
+  std::lock_guard<std::mutex> lock(d_mutex);
+  auto current = d_generations.find(zone->d_zone);
+  if (current == d_generations.end() || current->second != generation) {
+    /* purged while we were compiling it, it has been queued again */
+    return false;
+  }
+
+  *d_statnumentries += zone->d_answers;
+  const DNSName name(zone->d_zone);
+  if (zone->d_dependencies.empty()) {
+    d_dependencies.erase(name);
+  }
+  else {
+    d_dependencies[name] = zone->d_dependencies;
+  }
+  d_zones.modify([&name, &zone](zones_t& zones) {
+    zones[name] = std::move(zone);
+  });
+  return true;
+}
+
+template <typename Z, typename N>
+uint64_t AuthCompiledZones::invalidate(Z zoneMatches, N dependencyMatches)
+{
+  uint64_t delcount = 0;
+  {
+    std::lock_guard<std::mutex> lock(d_mutex);
+    std::vector<DNSName> dropped;
+    for (auto& generation : d_generations) {
+      if (!zoneMatches(generation.first)) {
+        auto dependencies = d_dependencies.find(generation.first);
+        if (dependencies == d_dependencies.end() || std::none_of(dependencies->second.begin(), dependencies->second.end(), dependencyMatches)) {
+          continue;
+        }
+      }
+      d_dependencies.erase(generation.first);
+      generation.second++;
+      if (std::find(d_pending.begin(), d_pending.end(), generation.first) == d_pending.end()) {
+        d_pending.push_back(generation.first);
+      }
+      dropped.push_back(generation.first);
+    }
+
+    if (dropped.empty()) {
+      return 0;
+    }
+
+    d_zones.modify([&dropped, &delcount](zones_t& zones) {
+      for (const auto& zone : dropped) {
+        auto iter = zones.find(zone);
+        if (iter != zones.end()) {
+          delcount += iter->second->d_answers;
+          zones.erase(iter);
+        }
+      }
+    });
+    *d_statnumentries -= delcount;
+  }
+  d_cond.notify_one();
+
+  return delcount;
+}
+
+uint64_t AuthCompiledZones::purge()
+{
+  return invalidate([](const DNSName&) { return true; }, [](const DNSName&) { return true; });
+}
+
+uint64_t AuthCompiledZones::purge(const std::string& match)
+{
+  if (boost::ends_with(match, "$")) {
+    std::string prefix(match);
+    prefix.resize(prefix.size() - 1);
+    DNSName suffix(prefix);
+    /* a parent zone may hold the referral to, or answers rendered from, a zone below it */
+    return invalidate([&suffix](const DNSName& zone) { return zone.isPartOf(suffix) || suffix.isPartOf(zone); },
+                      [&suffix](const DNSName& name) { return name.isPartOf(suffix); });
+  }
+
+  return purgeExact(DNSName(match));
+}
+
+uint64_t AuthCompiledZones::purgeExact(const DNSName& qname)
+{
+  return invalidate([&qname](const DNSName& zone) { return qname.isPartOf(zone); },
+                    [&qname](const DNSName& name) { return name == qname; });
+}
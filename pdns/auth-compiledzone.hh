@@ -0,0 +1,130 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include "dnsname.hh"
+#include "dnspacket.hh"
+#include "sholder.hh"
+#include "statbag.hh"
+
+/** Pre-rendered answers for the zones listed in 'compiled-zones'.
+
+    For every name of such a zone, the answers to the existing types, and one NODATA
+    answer that is valid for any other ordinary type, are rendered once by the
+    AuthZoneCompiler, for queries without EDNS, with EDNS and with EDNS and the DO bit.
+    Lookups only copy the answer and patch the ID, the RD bit and the question.
+
+    Each compiled zone is immutable, the set of zones is published through a
+    GlobalStateHolder so lookups take no lock. Purging a zone drops its table, its
+    queries then go through the backends again until it has been compiled anew. So does
+    purging a name outside of the zone that its answers depend on, like the target of a
+    CNAME into another zone.
+*/
+class AuthCompiledZones : public boost::noncopyable
+{
+public:
+  enum Variant : uint8_t
+  {
+    NoEDNS = 0,
+    EDNS = 1,
+    EDNSWithDO = 2
+  };
+
+  struct Answer
+  {
+    std::string d_packet; //!< empty if this answer could not be compiled
+    bool d_truncated{false};
+  };
+  using answers_t = std::array<Answer, 3>;
+
+  struct Name
+  {
+    std::vector<std::pair<uint16_t, answers_t>> d_types;
+    answers_t d_noData;
+  };
+
+  struct Zone
+  {
+    DNSName d_zone;
+    std::unordered_map<DNSName, Name> d_names;
+    std::vector<DNSName> d_dependencies; //!< names outside of the zone whose records the answers hold or point to
+    size_t d_answers{0};
+  };
+
+  using zones_t = std::unordered_map<DNSName, std::shared_ptr<const Zone>>;
+
+  AuthCompiledZones();
+
+  void setZones(const std::vector<DNSName>& zones); //!< the zones to compile, all of them are queued for compilation
+  bool enabled() const
+  {
+    return d_enabled;
+  }
+
+  LocalStateHolder<zones_t> getLocal()
+  {
+    return d_zones.getLocal();
+  }
+  bool get(LocalStateHolder<zones_t>& zones, DNSPacket& p, DNSPacket& cached); //!< The caller still needs to copy the ID and the RD bit of p into cached
+
+  //! Blocks until a zone needs to be compiled
+  void waitForPending(DNSName& zone, uint64_t& generation);
+  //! Publishes a compiled zone, unless it has been purged since its compilation started
+  bool store(uint64_t generation, std::shared_ptr<const Zone>&& zone);
+
+  uint64_t purge();
+  uint64_t purge(const std::string& match); // could be $ terminated. Is not a dnsname!
+  uint64_t purgeExact(const DNSName& qname); // drops the zone holding qname
+
+  uint64_t size() const { return *d_statnumentries; }
+
+  static bool isCompilableType(uint16_t qtype);
+  static const uint16_t s_noDataType = 65280;
+
+private:
+  template <typename Z, typename N>
+  uint64_t invalidate(Z zoneMatches, N dependencyMatches);
+
+  GlobalStateHolder<zones_t> d_zones;
+
+  std::mutex d_mutex;
+  std::condition_variable d_cond;
+  /* protected by d_mutex */
+  std::map<DNSName, uint64_t> d_generations;
+  std::map<DNSName, std::vector<DNSName>> d_dependencies; // of the compiled zones
+  std::deque<DNSName> d_pending;
+
+  AtomicCounter* d_statnumhit;
+  AtomicCounter* d_statnumentries;
+  bool d_enabled{false};
+};
@@ -106,8 +106,10 @@ bool g_8bitDNS;
 #ifdef HAVE_LUA_RECORDS
 bool g_doLuaRecord;
 int g_luaRecordExecLimit;
+int g_luaRecordResultCacheTTL;
 time_t g_luaHealthChecksInterval{5};
 time_t g_luaHealthChecksExpireDelay{3600};
+size_t g_luaHealthChecksMaxConcurrent{256};
 #endif
 #ifdef ENABLE_GSS_TSIG
 bool g_doGssTSIG;
@@ -119,6 +121,13 @@ StatBag S; //!< Statistics are gathered across PDNS via the StatBag class S
 AuthPacketCache PC; //!< This is the main PacketCache, shared across all threads
 AuthQueryCache QC;
 AuthZoneCache g_zoneCache;
+AuthCompiledZones g_compiledZones;
+AuthMemoryZones g_memoryZones;
+AuthRRL g_rrl;
+AuthAXFRCache g_axfrCache;
+AuthNSEC3Cache g_nsec3Cache;
+static AuthZoneCompiler s_zoneCompiler(g_compiledZones);
+static AuthMemoryZoneLoader s_memoryZoneLoader(g_memoryZones);
 std::unique_ptr<DNSProxy> DP{nullptr};
 static std::unique_ptr<DynListener> s_dynListener{nullptr};
 CommunicatorClass Communicator;
@@ -201,6 +210,12 @@ static void declareArguments()
   ::arg().set("queue-limit", "Maximum number of milliseconds to queue a query") = "1500";
   ::arg().set("resolver", "Use this resolver for ALIAS and the internal stub resolver") = "no";
   ::arg().set("udp-truncation-threshold", "Maximum UDP response size before we truncate") = "1232";
+  ::arg().set("rrl-responses-per-second", "Number of UDP answers per second of the same kind a client prefix can receive, 0 disables Response Rate Limiting") = "0";
+  ::arg().set("rrl-slip", "Send a truncated answer instead of every Nth dropped one, 0 to drop them all") = "2";
+  ::arg().set("rrl-table-size", "Number of token buckets of Response Rate Limiting") = "262144";
+  ::arg().set("rrl-ipv4-prefix-length", "Length of the IPv4 prefix clients are grouped by for Response Rate Limiting") = "24";
+  ::arg().set("rrl-ipv6-prefix-length", "Length of the IPv6 prefix clients are grouped by for Response Rate Limiting") = "56";
+  ::arg().set("rrl-exempt-from", "Clients whose answers are never rate limited") = "";
 
   ::arg().set("config-name", "Name of this virtual configuration - will rename the binary image") = "";
 
@@ -213,6 +228,9 @@ static void declareArguments()
   ::arg().set("allow-notify-from", "Allow AXFR NOTIFY from these IP ranges. If empty, drop all incoming notifies.") = "0.0.0.0/0,::/0";
   ::arg().set("slave-cycle-interval", "Schedule slave freshness checks once every .. seconds") = "";
   ::arg().set("xfr-cycle-interval", "Schedule primary/secondary SOA freshness checks once every .. seconds") = "60";
+  ::arg().set("xfr-max-inflight-soa-checks", "Maximum number of SOA freshness checks in flight") = "200";
+  ::arg().set("xfr-max-inflight-soa-checks-per-primary", "Maximum number of SOA freshness checks in flight to a single primary, 0 for no limit") = "0";
+  ::arg().set("xfr-max-soa-checks-per-second-per-primary", "Maximum number of SOA freshness checks sent to a single primary per second, 0 for no limit") = "0";
   ::arg().set("secondary-check-signature-freshness", "Check signatures in SOA freshness check. Sets DO flag on SOA queries. Outside some very problematic scenarios, say yes here.") = "yes";
 
   ::arg().set("tcp-control-address", "If set, PowerDNS can be controlled over TCP on this address") = "";
@@ -255,6 +273,7 @@ static void declareArguments()
   ::arg().set("cache-ttl", "Seconds to store packets in the PacketCache") = "20";
   ::arg().set("negquery-cache-ttl", "Seconds to store negative query results in the QueryCache") = "60";
   ::arg().set("query-cache-ttl", "Seconds to store query results in the QueryCache") = "20";
+  ::arg().set("query-coalescing-timeout", "Milliseconds to wait for another thread already sending the same query to the backends, 0 to disable") = "50";
   ::arg().set("zone-cache-refresh-interval", "Seconds to cache list of known zones") = "300";
   ::arg().set("server-id", "Returned when queried for 'id.server' TXT or NSID, defaults to hostname - disabled or custom") = "";
   ::arg().set("default-soa-content", "Default SOA content") = "a.misconfigured.dns.server.invalid hostmaster.@ 0 10800 3600 604800 3600";
@@ -275,6 +294,8 @@ static void declareArguments()
   ::arg().set("max-tcp-transactions-per-conn", "Maximum number of subsequent queries per TCP connection") = "0";
   ::arg().set("max-tcp-connection-duration", "Maximum time in seconds that a TCP DNS connection is allowed to stay open.") = "0";
   ::arg().set("tcp-idle-timeout", "Maximum time in seconds that a TCP DNS connection is allowed to stay open while being idle") = "5";
+  ::arg().set("udp-mmsg-vector-size", "Number of UDP datagrams a receiver thread reads and answers per system call, 1 to disable") = "1";
+  ::arg().set("tcp-worker-threads", "Number of threads serving TCP connections, 0 to use one thread per connection") = "0";
 
   ::arg().setSwitch("no-shuffle", "Set this to prevent random shuffling of answers - for regression testing") = "off";
 
@@ -283,8 +304,16 @@ static void declareArguments()
 
   ::arg().set("max-cache-entries", "Maximum number of entries in the query cache") = "1000000";
   ::arg().set("max-packet-cache-entries", "Maximum number of entries in the packet cache") = "1000000";
+  ::arg().set("packet-cache-engine", "Storage used by the packet cache, 'classic' or 'flat'") = "classic";
+  ::arg().set("compiled-zones", "Zones for which all answers are rendered in advance") = "";
+  ::arg().set("memory-zones", "Zones which are loaded in memory and no longer looked up in the backends") = "";
+  ::arg().set("memory-zones-check-interval", "Seconds between checks of the serials of the zones loaded in memory, 0 to disable") = "60";
   ::arg().set("max-signature-cache-entries", "Maximum number of signatures cache entries") = "";
+  ::arg().set("signature-cache-snapshot", "File to save the signature cache to, and to load it from at startup") = "";
+  ::arg().set("signature-cache-snapshot-interval", "Seconds between two saves of the signature cache to signature-cache-snapshot") = "300";
   ::arg().set("max-ent-entries", "Maximum number of empty non-terminals in a zone") = "100000";
+  ::arg().set("nsec3-cache-ttl", "Seconds to keep the NSEC3 owner hashes learned from the backends, 0 to disable the NSEC3 cache") = "60";
+  ::arg().set("max-nsec3-cache-entries", "Maximum number of NSEC3 hashes and of NSEC3 intervals in the NSEC3 cache") = "100000";
   ::arg().set("entropy-source", "If set, read entropy from this file") = "/dev/urandom";
 
   ::arg().set("lua-prequery-script", "Lua script with prequery handler (DO NOT USE)") = "";
@@ -305,18 +334,27 @@ static void declareArguments()
 
   ::arg().setSwitch("expand-alias", "Expand ALIAS records") = "no";
   ::arg().set("outgoing-axfr-expand-alias", "Expand ALIAS records during outgoing AXFR") = "no";
+  ::arg().set("alias-cache-max-entries", "Maximum number of ALIAS targets for which the A and AAAA answers are cached, 0 to disable") = "10000";
+  ::arg().set("alias-cache-refresh-ttl-perc", "Refresh a cached ALIAS target answer when less than this percentage of its TTL is left") = "10";
   ::arg().setSwitch("8bit-dns", "Allow 8bit dns queries") = "no";
 #ifdef HAVE_LUA_RECORDS
   ::arg().setSwitch("enable-lua-records", "Process LUA records for all zones (metadata overrides this)") = "no";
   ::arg().set("lua-records-exec-limit", "LUA records scripts execution limit (instructions count). Values <= 0 mean no limit") = "1000";
+  ::arg().set("lua-records-result-cache-ttl", "Seconds to reuse the result of a LUA record for the same name, type and client subnet, 0 to disable") = "0";
   ::arg().set("lua-health-checks-expire-delay", "Stops doing health checks after the record hasn't been used for that delay (in seconds)") = "3600";
   ::arg().set("lua-health-checks-interval", "LUA records health checks monitoring interval in seconds") = "5";
+  ::arg().set("lua-health-checks-max-concurrent", "Maximum number of LUA records health checks running at the same time") = "256";
 #endif
   ::arg().setSwitch("axfr-lower-serial", "Also AXFR a zone from a master with a lower serial") = "no";
 
   ::arg().set("lua-axfr-script", "Script to be used to edit incoming AXFRs") = "";
   ::arg().set("xfr-max-received-mbytes", "Maximum number of megabytes received from an incoming XFR") = "100";
+  ::arg().set("axfr-cache-ttl", "Seconds to keep the messages of an outgoing AXFR for the next transfers of the same zone serial, 0 to disable") = "60";
+  ::arg().set("axfr-cache-max-records", "Maximum number of records of a zone for its outgoing AXFR to be cached, 0 for no limit") = "4000000";
+  ::arg().set("axfr-cache-max-total-records", "Maximum number of records held by the AXFR cache for all zones together, 0 for no limit") = "8000000";
   ::arg().set("axfr-fetch-timeout", "Maximum time in seconds for inbound AXFR to start or be idle after starting") = "10";
+  ::arg().set("axfr-ingest-batch-size", "Number of records of an inbound AXFR held in memory, larger transfers are spooled to disk and stored in batches of this size") = "10000";
+  ::arg().set("axfr-spool-directory", "Directory for the spool files of inbound AXFRs, the temporary directory of the system when empty") = "";
 
   ::arg().set("tcp-fast-open", "Enable TCP Fast Open support on the listening sockets, using the supplied numerical value as the queue size") = "0";
 
@@ -357,6 +395,24 @@ static uint64_t getTCPConnectionCount(const std::string& /* str */)
   return s_tcpNameserver->numTCPConnections();
 }
 
+static uint64_t getQueueLatency(const std::string& /* str */)
+{
+  double total = 0;
+  size_t count = 0;
+  for (const auto& d : s_distributors) {
+    if (!d)
+      continue;
+    total += d->getQueueWait();
+    count++;
+  }
+  return count ? round(total / count) : 0;
+}
+
+static uint64_t getAliasCacheSize(const std::string& /* str */)
+{
+  return DP ? DP->getAliasCacheSize() : 0;
+}
+
 static uint64_t getQCount(const std::string& /* str */)
 try {
   int totcount = 0;
@@ -421,6 +477,10 @@ static void declareStats()
   S.declare("recursion-unanswered", "Number of packets unanswered by configured recursor");
   S.declare("recursing-answers", "Number of recursive answers sent out");
   S.declare("recursing-questions", "Number of questions sent to recursor");
+  S.declare("alias-cache-hits", "Number of ALIAS target lookups answered from the ALIAS cache");
+  S.declare("alias-cache-misses", "Number of ALIAS target lookups not answered from the ALIAS cache");
+  S.declare("alias-cache-refreshes", "Number of queries sent to refresh the ALIAS cache");
+  S.declare("alias-cache-size", "Number of entries in the ALIAS cache", getAliasCacheSize, StatType::gauge);
   S.declare("corrupt-packets", "Number of corrupt packets received");
   S.declare("signatures", "Number of DNSSEC signatures made");
   S.declare("tcp-queries", "Number of TCP queries received");
@@ -439,6 +499,7 @@ static void declareStats()
   S.declare("open-tcp-connections", "Number of currently open TCP connections", getTCPConnectionCount, StatType::gauge);
 
   S.declare("qsize-q", "Number of questions waiting for database attention", getQCount, StatType::gauge);
+  S.declare("queue-latency", "Average number of microseconds a question waits for a backend thread", getQueueLatency, StatType::gauge);
 
   S.declare("dnsupdate-queries", "DNS update packets received.");
   S.declare("dnsupdate-answers", "DNS update packets successfully answered.");
@@ -446,6 +507,15 @@ static void declareStats()
   S.declare("dnsupdate-changes", "DNS update changes to records in total.");
 
   S.declare("incoming-notifications", "NOTIFY packets received.");
+#ifdef HAVE_LUA_RECORDS
+  S.declare("lua-health-checks", "Number of LUA records health checks done");
+  S.declare("lua-health-check-latency", "Average number of microseconds a LUA records health check took, over the last second", StatType::gauge);
+  S.declare("lua-health-checks-queued", "Number of LUA records health checks that are due and wait for a free thread", StatType::gauge);
+  S.declare("lua-health-checks-targets", "Number of targets monitored by LUA records health checks", StatType::gauge);
+#endif
+  S.declare("secondary-soa-checks", "SOA queries sent to primaries to check the freshness of secondary zones");
+  S.declare("secondary-soa-check-timeouts", "SOA queries to primaries that timed out");
+  S.declare("secondary-refresh-lag", "Largest number of seconds a secondary zone was checked after its refresh time, in the last check cycle", StatType::gauge);
 
   S.declare("uptime", "Uptime of process in seconds", uptimeOfProcess, StatType::counter);
   S.declare("real-memory-usage", "Actual unique use of memory in bytes (approx)", getRealMemoryUsage, StatType::gauge);
@@ -538,6 +608,7 @@ try {
   DNSDistributor* distributor = s_distributors[num]; // the big dispatcher!
   DNSPacket question(true);
   DNSPacket cached(false);
+  auto compiledZones = g_compiledZones.getLocal();
 
   AtomicCounter& numreceived = *S.getPointer("udp-queries");
   AtomicCounter& numreceiveddo = *S.getPointer("udp-do-queries");
@@ -566,102 +637,155 @@ try {
     NS = s_udpNameserver;
   }
 
-  for (;;) {
-    try {
-      if (g_proxyProtocolACL.empty()) {
-        buffer.resize(DNSPacket::s_udpTruncationThreshold);
-      }
-      else {
-        buffer.resize(DNSPacket::s_udpTruncationThreshold + g_proxyProtocolMaximumSize);
-      }
+  const size_t bufferSize = g_proxyProtocolACL.empty() ? DNSPacket::s_udpTruncationThreshold : DNSPacket::s_udpTruncationThreshold + g_proxyProtocolMaximumSize;
 
-      if (!NS->receive(question, buffer)) { // receive a packet         inline
-        continue; // packet was broken, try again
-      }
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+  const size_t vectorSize = ::arg().asNum("udp-mmsg-vector-size");
+  std::unique_ptr<UDPNameserver::MultipleMessages> batch{nullptr};
+  if (vectorSize > 1) {
+    batch = std::make_unique<UDPNameserver::MultipleMessages>(vectorSize, bufferSize);
+  }
+#endif
 
-      diff = question.d_dt.udiffNoReset();
-      receive_latency = 0.999 * receive_latency + 0.001 * std::max(diff, 0);
+  // sends the answer to 'question' that has been retrieved in 'cached'
+  auto sendCachedAnswer = [&](const std::function<void(DNSPacket&)>& sendCached) {
+    cached.setRemote(&question.d_remote); // inlined
+    cached.d_inner_remote = question.d_inner_remote;
+    cached.setSocket(question.getSocket()); // inlined
+    cached.d_anyLocal = question.d_anyLocal;
+    cached.setMaxReplyLen(question.getMaxReplyLen());
+    cached.d.rd = question.d.rd; // copy in recursion desired bit
+    cached.d.id = question.d.id;
+    cached.commitD(); // commit d to the packet                        inlined
+
+    diff = question.d_dt.udiffNoReset();
+    cache_latency = 0.999 * cache_latency + 0.001 * std::max(diff - start, 0);
+    start = diff;
 
-      numreceived++;
+    sendCached(cached); // answer it then                              inlined
 
-      accountremote = question.d_remote;
-      if (question.d_inner_remote)
-        accountremote = *question.d_inner_remote;
+    diff = question.d_dt.udiff();
+    send_latency = 0.999 * send_latency + 0.001 * std::max(diff - start, 0);
+    avg_latency = 0.999 * avg_latency + 0.001 * std::max(diff, 0); // 'EWMA'
+  };
 
-      if (accountremote.sin4.sin_family == AF_INET)
-        numreceived4++;
-      else
-        numreceived6++;
+  // handles the query in 'question', cache hits are handed to sendCached, the rest goes to the distributor
+  auto handleQuestion = [&](const std::function<void(DNSPacket&)>& sendCached) {
+    diff = question.d_dt.udiffNoReset();
+    receive_latency = 0.999 * receive_latency + 0.001 * std::max(diff, 0);
 
-      if (question.d_dnssecOk)
-        numreceiveddo++;
+    numreceived++;
 
-      if (question.hasEDNSCookie())
-        numreceivedcookie++;
+    accountremote = question.d_remote;
+    if (question.d_inner_remote)
+      accountremote = *question.d_inner_remote;
 
-      if (question.d.qr)
-        continue;
+    if (accountremote.sin4.sin_family == AF_INET)
+      numreceived4++;
+    else
+      numreceived6++;
 
-      S.ringAccount("queries", question.qdomain, question.qtype);
-      S.ringAccount("remotes", question.getInnerRemote());
-      if (logDNSQueries) {
-        g_log << Logger::Notice << "Remote " << question.getRemoteString() << " wants '" << question.qdomain << "|" << question.qtype << "', do = " << question.d_dnssecOk << ", bufsize = " << question.getMaxReplyLen();
-        if (question.d_ednsRawPacketSizeLimit > 0 && question.getMaxReplyLen() != (unsigned int)question.d_ednsRawPacketSizeLimit)
-          g_log << " (" << question.d_ednsRawPacketSizeLimit << ")";
-      }
+    if (question.d_dnssecOk)
+      numreceiveddo++;
 
-      if (PC.enabled() && (question.d.opcode != Opcode::Notify && question.d.opcode != Opcode::Update) && question.couldBeCached()) {
-        start = diff;
-        bool haveSomething = PC.get(question, cached); // does the PacketCache recognize this question?
-        if (haveSomething) {
-          if (logDNSQueries)
-            g_log << ": packetcache HIT" << endl;
-          cached.setRemote(&question.d_remote); // inlined
-          cached.d_inner_remote = question.d_inner_remote;
-          cached.setSocket(question.getSocket()); // inlined
-          cached.d_anyLocal = question.d_anyLocal;
-          cached.setMaxReplyLen(question.getMaxReplyLen());
-          cached.d.rd = question.d.rd; // copy in recursion desired bit
-          cached.d.id = question.d.id;
-          cached.commitD(); // commit d to the packet                        inlined
-
-          diff = question.d_dt.udiffNoReset();
-          cache_latency = 0.999 * cache_latency + 0.001 * std::max(diff - start, 0);
-          start = diff;
-
-          NS->send(cached); // answer it then                              inlined
-
-          diff = question.d_dt.udiff();
-          send_latency = 0.999 * send_latency + 0.001 * std::max(diff - start, 0);
-          avg_latency = 0.999 * avg_latency + 0.001 * std::max(diff, 0); // 'EWMA'
-          continue;
-        }
-        diff = question.d_dt.udiffNoReset();
-        cache_latency = 0.999 * cache_latency + 0.001 * std::max(diff - start, 0);
+    if (question.hasEDNSCookie())
+      numreceivedcookie++;
+
+    if (question.d.qr)
+      return;
+
+    S.ringAccount("queries", question.qdomain, question.qtype);
+    S.ringAccount("remotes", question.getInnerRemote());
+    if (logDNSQueries) {
+      g_log << Logger::Notice << "Remote " << question.getRemoteString() << " wants '" << question.qdomain << "|" << question.qtype << "', do = " << question.d_dnssecOk << ", bufsize = " << question.getMaxReplyLen();
+      if (question.d_ednsRawPacketSizeLimit > 0 && question.getMaxReplyLen() != (unsigned int)question.d_ednsRawPacketSizeLimit)
+        g_log << " (" << question.d_ednsRawPacketSizeLimit << ")";
+    }
+
+    if (PC.enabled() && (question.d.opcode != Opcode::Notify && question.d.opcode != Opcode::Update) && question.couldBeCached()) {
+      start = diff;
+      bool haveSomething = PC.get(question, cached); // does the PacketCache recognize this question?
+      if (haveSomething) {
+        if (logDNSQueries)
+          g_log << ": packetcache HIT" << endl;
+        sendCachedAnswer(sendCached);
+        return;
       }
+      diff = question.d_dt.udiffNoReset();
+      cache_latency = 0.999 * cache_latency + 0.001 * std::max(diff - start, 0);
+    }
 
-      if (distributor->isOverloaded()) {
+    if (g_compiledZones.enabled()) {
+      start = diff;
+      if (g_compiledZones.get(compiledZones, question, cached)) {
         if (logDNSQueries)
-          g_log << ": Dropped query, backends are overloaded" << endl;
-        overloadDrops++;
-        continue;
+          g_log << ": compiled zone HIT" << endl;
+        sendCachedAnswer(sendCached);
+        return;
       }
+    }
+
+    if (distributor->isOverloaded()) {
+      if (logDNSQueries)
+        g_log << ": Dropped query, backends are overloaded" << endl;
+      overloadDrops++;
+      return;
+    }
+
+    if (logDNSQueries) {
+      if (PC.enabled()) {
+        g_log << ": packetcache MISS" << endl;
+      }
+      else {
+        g_log << endl;
+      }
+    }
 
-      if (logDNSQueries) {
-        if (PC.enabled()) {
-          g_log << ": packetcache MISS" << endl;
+    try {
+      distributor->question(question, &sendout); // otherwise, give to the distributor
+    }
+    catch (DistributorFatal& df) { // when this happens, we have leaked loads of memory. Bailing out time.
+      _exit(1);
+    }
+  };
+
+  const auto sendNow = [&NS](DNSPacket& answer) { NS->send(answer); };
+
+  for (;;) {
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+    if (batch) {
+      const auto queueAnswer = [&NS, &batch](DNSPacket& answer) { NS->queue(*batch, answer); };
+      size_t received = NS->receive(*batch);
+      for (size_t idx = 0; idx < received; idx++) {
+        try {
+          if (!NS->getPacket(*batch, idx, question)) {
+            continue; // packet was broken, try the next one
+          }
+          handleQuestion(queueAnswer);
         }
-        else {
-          g_log << endl;
+        catch (const std::exception& e) {
+          g_log << Logger::Error << "Caught unhandled exception in question thread: " << e.what() << endl;
         }
       }
 
       try {
-        distributor->question(question, &sendout); // otherwise, give to the distributor
+        NS->flush(*batch);
       }
-      catch (DistributorFatal& df) { // when this happens, we have leaked loads of memory. Bailing out time.
-        _exit(1);
+      catch (const std::exception& e) {
+        g_log << Logger::Error << "Caught unhandled exception while sending responses: " << e.what() << endl;
       }
+      continue;
+    }
+#endif
+
+    try {
+      buffer.resize(bufferSize);
+
+      if (!NS->receive(question, buffer)) { // receive a packet         inline
+        continue; // packet was broken, try again
+      }
+
+      handleQuestion(sendNow);
     }
     catch (const std::exception& e) {
       g_log << Logger::Error << "Caught unhandled exception in question thread: " << e.what() << endl;
@@ -700,8 +824,10 @@ static void mainthread()
   g_doLuaRecord = ::arg().mustDo("enable-lua-records");
   g_LuaRecordSharedState = (::arg()["enable-lua-records"] == "shared");
   g_luaRecordExecLimit = ::arg().asNum("lua-records-exec-limit");
+  g_luaRecordResultCacheTTL = ::arg().asNum("lua-records-result-cache-ttl");
   g_luaHealthChecksInterval = ::arg().asNum("lua-health-checks-interval");
   g_luaHealthChecksExpireDelay = ::arg().asNum("lua-health-checks-expire-delay");
+  g_luaHealthChecksMaxConcurrent = std::max(::arg().asNum("lua-health-checks-max-concurrent"), 1);
 #endif
 #ifdef ENABLE_GSS_TSIG
   g_doGssTSIG = ::arg().mustDo("enable-gss-tsig");
@@ -714,6 +840,17 @@ static void mainthread()
   g_proxyProtocolACL.toMasks(::arg()["proxy-protocol-from"]);
   g_proxyProtocolMaximumSize = ::arg().asNum("proxy-protocol-maximum-size");
 
+  if (::arg().asNum("rrl-responses-per-second") > 0) {
+    if (::arg().asNum("rrl-table-size") <= 0 || static_cast<size_t>(::arg().asNum("rrl-table-size")) > AuthRRL::s_maxTableSize) {
+      g_log << Logger::Error << "rrl-table-size must be between 1 and " << AuthRRL::s_maxTableSize << endl;
+      exit(1);
+    }
+    NetmaskGroup exempt;
+    exempt.toMasks(::arg()["rrl-exempt-from"]);
+    g_rrl.setExempt(exempt);
+    g_rrl.setLimits(::arg().asNum("rrl-responses-per-second"), ::arg().asNum("rrl-slip"), ::arg().asNum("rrl-table-size"), ::arg().asNum("rrl-ipv4-prefix-length"), ::arg().asNum("rrl-ipv6-prefix-length"));
+  }
+
   if (::arg()["edns-cookie-secret"].size() != 0) {
     // User wants cookie processing
 #ifdef HAVE_CRYPTO_SHORTHASH // we can do siphash-based cookies
@@ -735,9 +872,40 @@ static void mainthread()
   }
 
   PC.setTTL(::arg().asNum("cache-ttl"));
+  PC.setEngine(::arg()["packet-cache-engine"]);
   PC.setMaxEntries(::arg().asNum("max-packet-cache-entries"));
   QC.setMaxEntries(::arg().asNum("max-cache-entries"));
   DNSSECKeeper::setMaxEntries(::arg().asNum("max-cache-entries"));
+  g_nsec3Cache.setTTL(::arg().asNum("nsec3-cache-ttl"));
+  g_nsec3Cache.setMaxEntries(::arg().asNum("max-nsec3-cache-entries"));
+  g_axfrCache.setTTL(::arg().asNum("axfr-cache-ttl"));
+  g_axfrCache.setMaxRecords(::arg().asNum("axfr-cache-max-records"));
+  g_axfrCache.setMaxTotalRecords(::arg().asNum("axfr-cache-max-total-records"));
+
+  if (!::arg()["compiled-zones"].empty()) {
+    if (!::arg()["lua-prequery-script"].empty()) {
+      g_log << Logger::Error << "Ignoring compiled-zones, which can not be used together with lua-prequery-script" << endl;
+    }
+    else {
+      vector<string> parts;
+      stringtok(parts, ::arg()["compiled-zones"], ", \t");
+      vector<DNSName> zones;
+      for (const auto& part : parts) {
+        zones.emplace_back(part);
+      }
+      g_compiledZones.setZones(zones);
+    }
+  }
+
+  if (!::arg()["memory-zones"].empty()) {
+    vector<string> parts;
+    stringtok(parts, ::arg()["memory-zones"], ", \t");
+    vector<DNSName> zones;
+    for (const auto& part : parts) {
+      zones.emplace_back(part);
+    }
+    g_memoryZones.setZones(zones);
+  }
 
   if (!PC.enabled() && ::arg().mustDo("log-dns-queries")) {
     g_log << Logger::Warning << "Packet cache disabled, logging queries without HIT/MISS" << endl;
@@ -775,6 +943,17 @@ static void mainthread()
   AuthWebServer webserver;
   Utility::dropUserPrivs(newuid);
 
+  // after chroot and dropping privileges, the snapshot is written from there too
+  if (!::arg()["signature-cache-snapshot"].empty()) {
+    try {
+      auto count = loadSignatureCache(::arg()["signature-cache-snapshot"]);
+      g_log << Logger::Info << "Loaded " << count << " signatures from '" << ::arg()["signature-cache-snapshot"] << "'" << endl;
+    }
+    catch (const std::exception& e) {
+      g_log << Logger::Error << "Unable to load the signature cache: " << e.what() << endl;
+    }
+  }
+
   if (::arg().mustDo("resolver")) {
     DP = std::make_unique<DNSProxy>(::arg()["resolver"]);
     DP->go();
@@ -856,6 +1035,14 @@ static void mainthread()
 
   s_tcpNameserver->go(); // tcp nameserver launch
 
+  if (g_compiledZones.enabled()) {
+    s_zoneCompiler.go();
+  }
+
+  if (g_memoryZones.enabled()) {
+    s_memoryZoneLoader.go(::arg().asNum("memory-zones-check-interval"));
+  }
+
   unsigned int max_rthreads = ::arg().asNum("receiver-threads", 1);
   s_distributors.resize(max_rthreads);
   for (unsigned int n = 0; n < max_rthreads; ++n) {
@@ -877,10 +1064,28 @@ static void mainthread()
   const uint32_t secpollInterval = 1800;
   uint32_t secpollSince = 0;
   uint32_t zoneCacheUpdateSince = 0;
+  const string& signatureSnapshot = ::arg()["signature-cache-snapshot"];
+  const uint32_t signatureSnapshotInterval = signatureSnapshot.empty() ? 0 : ::arg().asNum("signature-cache-snapshot-interval");
+  uint32_t signatureSnapshotSince = 0;
   for (;;) {
-    const uint32_t sleeptime = g_zoneCache.getRefreshInterval() == 0 ? secpollInterval : std::min(secpollInterval, g_zoneCache.getRefreshInterval());
+    uint32_t sleeptime = g_zoneCache.getRefreshInterval() == 0 ? secpollInterval : std::min(secpollInterval, g_zoneCache.getRefreshInterval());
+    if (signatureSnapshotInterval != 0) {
+      sleeptime = std::min(sleeptime, signatureSnapshotInterval);
+    }
     sleep(sleeptime); // if any signals arrive, we might run more often than expected.
 
+    signatureSnapshotSince += sleeptime;
+    if (signatureSnapshotInterval != 0 && signatureSnapshotSince >= signatureSnapshotInterval) {
+      signatureSnapshotSince = 0;
+      try {
+        auto count = saveSignatureCache(signatureSnapshot);
+        g_log << Logger::Debug << "Saved " << count << " signatures to '" << signatureSnapshot << "'" << endl;
+      }
+      catch (const std::exception& e) {
+        g_log << Logger::Error << "Unable to save the signature cache: " << e.what() << endl;
+      }
+    }
+
     zoneCacheUpdateSince += sleeptime;
     if (zoneCacheUpdateSince >= g_zoneCache.getRefreshInterval()) {
       try {
@@ -20,9 +20,16 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #pragma once
+#include "auth-axfrcache.hh"
+#include "auth-compiledzone.hh"
+#include "auth-memoryzoneloader.hh"
+#include "auth-memoryzones.hh"
+#include "auth-nsec3cache.hh"
 #include "auth-packetcache.hh"
 #include "auth-querycache.hh"
+#include "auth-rrl.hh"
 #include "auth-zonecache.hh"
+#include "auth-zonecompiler.hh"
 #include "utility.hh"
 #include "arguments.hh"
 #include "communicator.hh"
@@ -40,6 +47,10 @@ extern ArgvMap theArg;
 extern StatBag S; //!< Statistics are gathered across PDNS via the StatBag class S
 extern AuthPacketCache PC; //!< This is the main PacketCache, shared across all threads
 extern AuthQueryCache QC;
+extern AuthCompiledZones g_compiledZones;
+extern AuthMemoryZones g_memoryZones;
+extern AuthAXFRCache g_axfrCache;
+extern AuthNSEC3Cache g_nsec3Cache;
 extern std::unique_ptr<DNSProxy> DP;
 extern CommunicatorClass Communicator;
 void carbonDumpThread(); // Implemented in auth-carbon.cc. Avoids having an auth-carbon.hh declaring exactly one function.
@@ -52,4 +63,5 @@ extern bool g_doLuaRecord;
 extern bool g_LuaRecordSharedState;
 extern time_t g_luaHealthChecksInterval;
 extern time_t g_luaHealthChecksExpireDelay;
+extern size_t g_luaHealthChecksMaxConcurrent;
 #endif // HAVE_LUA_RECORDS
@@ -0,0 +1,131 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <thread>
+#include <vector>
+
+#include "auth-memoryzoneloader.hh"
+#include "logger.hh"
+#include "threadname.hh"
+
+void AuthMemoryZoneLoader::go(time_t checkInterval)
+{
+  d_checkInterval = checkInterval;
+  std::thread loader([this]() { worker(); });
+  loader.detach();
+}
+
+void AuthMemoryZoneLoader::worker()
+{
+  setThreadName("pdns/memzones");
+
+  time_t lastCheck = time(nullptr);
+  for (;;) {
+    DNSName zone;
+    uint64_t generation = 0;
+    bool pending = d_zones.waitForPending(zone, generation, d_checkInterval);
+
+    try {
+      if (!d_backend) {
+        d_backend = std::make_unique<UeberBackend>();
+      }
+
+      if (pending) {
+        DTime dt;
+        dt.set();
+        auto loaded = load(zone);
+        if (loaded) {
+          auto names = loaded->d_names.size();
+          auto records = loaded->d_records;
+          if (d_zones.store(generation, std::move(loaded))) {
+            g_log << Logger::Info << "Loaded zone '" << zone << "' in memory, " << names << " names and " << records << " records in " << dt.udiff() / 1000 << " ms" << endl;
+          }
+        }
+      }
+
+      if (d_checkInterval > 0 && time(nullptr) - lastCheck >= d_checkInterval) {
+        checkSerials();
+        lastCheck = time(nullptr);
+      }
+    }
+    catch (const PDNSException& e) {
+      g_log << Logger::Error << (pending ? "Unable to load zone '" + zone.toLogString() + "' in memory: " : "Unable to check the serials of the zones in memory: ") << e.reason << endl;
+      d_backend.reset();
+    }
+    catch (const std::exception& e) {
+      g_log << Logger::Error << (pending ? "Unable to load zone '" + zone.toLogString() + "' in memory: " : "Unable to check the serials of the zones in memory: ") << e.what() << endl;
+      d_backend.reset();
+    }
+  }
+}
+
+void AuthMemoryZoneLoader::checkSerials()
+{
+  std::vector<std::pair<DNSName, uint32_t>> serials;
+  {
+    auto zones = d_zones.getLocal();
+    serials.reserve(zones->size());
+    for (const auto& zone : *zones) {
+      serials.emplace_back(zone.first, zone.second->d_serial);
+    }
+  }
+
+  for (const auto& zone : serials) {
+    SOAData sd;
+    if (!d_backend->getSOAUncached(zone.first, sd) || sd.serial != zone.second) {
+      g_log << Logger::Info << "Serial of zone '" << zone.first << "' changed, loading it in memory again" << endl;
+      d_zones.reload(zone.first);
+    }
+  }
+}
+
+std::shared_ptr<AuthMemoryZones::Zone> AuthMemoryZoneLoader::load(const DNSName& zone)
+{
+  SOAData sd;
+  if (!d_backend->getSOAUncached(zone, sd)) {
+    g_log << Logger::Warning << "Not loading zone '" << zone << "' in memory, it has no SOA" << endl;
+    return nullptr;
+  }
+
+  if (!sd.db->list(zone, sd.domain_id)) {
+    throw PDNSException("backend signals error condition while listing the zone");
+  }
+
+  auto loaded = std::make_shared<AuthMemoryZones::Zone>();
+  loaded->d_zone = zone;
+  loaded->d_zoneId = sd.domain_id;
+  loaded->d_serial = sd.serial;
+
+  DNSZoneRecord zrr;
+  while (sd.db->get(zrr)) {
+    if (!zrr.dr.d_name.isPartOf(zone)) {
+      continue;
+    }
+    zrr.dr.d_place = DNSResourceRecord::ANSWER;
+    loaded->d_names[zrr.dr.d_name].push_back(std::move(zrr));
+    loaded->d_records++;
+  }
+
+  return loaded;
+}
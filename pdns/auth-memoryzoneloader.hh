@@ -0,0 +1,50 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <ctime>
+#include <memory>
+
+#include "auth-memoryzones.hh"
+#include "ueberbackend.hh"
+
+/** Loads the zones queued by AuthMemoryZones, with one list() of the backend
+    serving each of them, and checks the SOA serial of the loaded zones every
+    check interval, so changes made directly in the database are picked up too. */
+class AuthMemoryZoneLoader
+{
+public:
+  AuthMemoryZoneLoader(AuthMemoryZones& zones) :
+    d_zones(zones)
+  {
+  }
+
+  void go(time_t checkInterval); //!< starts the loader thread, 0 disables the serial checks
+
+private:
+  void worker();
+  void checkSerials();
+  std::shared_ptr<AuthMemoryZones::Zone> load(const DNSName& zone);
+
+  AuthMemoryZones& d_zones;
+  std::unique_ptr<UeberBackend> d_backend{nullptr};
+  time_t d_checkInterval{0};
+};
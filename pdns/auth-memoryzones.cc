@@ -0,0 +1,202 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
+
+#include "auth-memoryzones.hh"
+#include "qtype.hh"
+
+extern StatBag S;
+
+AuthMemoryZones::AuthMemoryZones()
+{
+  S.declare("memory-zones-hit", "Number of backend lookups which were answered from a zone held in memory");
+  S.declare("memory-zones-size", "Number of records held by the zones in memory", StatType::gauge);
+
+  d_statnumhit = S.getPointer("memory-zones-hit");
+  d_statnumentries = S.getPointer("memory-zones-size");
+}
+
+void AuthMemoryZones::setZones(const std::vector<DNSName>& zones)
+{
+  {
+    std::lock_guard<std::mutex> lock(d_mutex);
+    for (const auto& zone : zones) {
+      if (d_generations.emplace(zone, 1).second) {
+        d_pending.push_back(zone);
+      }
+    }
+    d_enabled = !d_generations.empty();
+  }
+  d_cond.notify_one();
+}
+
+const AuthMemoryZones::Zone* AuthMemoryZones::findZone(LocalStateHolder<zones_t>& zones, const DNSName& qname, int zoneId)
+{
+  if (zoneId < 0 || zones->empty()) {
+    return nullptr;
+  }
+
+  /* the closest enclosing zone in memory has to be the one the lookup is made for,
+     a zone below it might be served from another backend */
+  DNSName zoneName(qname);
+  do {
+    auto iter = zones->find(zoneName);
+    if (iter != zones->end()) {
+      return iter->second->d_zoneId == zoneId ? iter->second.get() : nullptr;
+    }
+  } while (zoneName.chopOff());
+
+  return nullptr;
+}
+
+bool AuthMemoryZones::get(LocalStateHolder<zones_t>& zones, const DNSName& qname, int zoneId, uint16_t qtype, std::vector<DNSZoneRecord>& records)
+{
+  const Zone* zone = findZone(zones, qname, zoneId);
+  if (zone == nullptr) {
+    return false;
+  }
+
+  records.clear();
+  auto name = zone->d_names.find(qname);
+  if (name != zone->d_names.end()) {
+    for (const auto& record : name->second) {
+      if (qtype == QType::ANY || record.dr.d_type == qtype) {
+        records.push_back(record);
+        /* backends answer with the case of the question */
+        records.back().dr.d_name = qname;
+      }
+    }
+  }
+
+  (*d_statnumhit)++;
+  return true;
+}
+
+bool AuthMemoryZones::waitForPending(DNSName& zone, uint64_t& generation, time_t timeout)
+{
+  std::unique_lock<std::mutex> lock(d_mutex);
+  auto pending = [this] { return !d_pending.empty(); };
+  if (timeout == 0) {
+    d_cond.wait(lock, pending);
+  }
+  else if (!d_cond.wait_for(lock, std::chrono::seconds(timeout), pending)) {
+    return false;
+  }
+
+  zone = d_pending.front();
+  d_pending.pop_front();
+  generation = d_generations.at(zone);
+  return true;
+}
+
+bool AuthMemoryZones::store(uint64_t generation, std::shared_ptr<const Zone>&& zone)
+{
+  std::lock_guard<std::mutex> lock(d_mutex);
+  auto current = d_generations.find(zone->d_zone);
+  if (current == d_generations.end() || current->second != generation) {
+    /* purged while we were loading it, it has been queued again */
+    return false;
+  }
+
+  const DNSName name(zone->d_zone);
+  uint64_t replaced = 0;
+  *d_statnumentries += zone->d_records;
+  d_zones.modify([&name, &zone, &replaced](zones_t& zones) {
+    auto& entry = zones[name];
+    if (entry) {
+      replaced = entry->d_records;
+    }
+    entry = std::move(zone);
+  });
+  *d_statnumentries -= replaced;
+  return true;
+}
+
+template <typename T>
+uint64_t AuthMemoryZones::invalidate(T matches)
+{
+  uint64_t delcount = 0;
+  {
+    std::lock_guard<std::mutex> lock(d_mutex);
+    std::vector<DNSName> dropped;
+    for (auto& generation : d_generations) {
+      if (!matches(generation.first)) {
+        continue;
+      }
+      generation.second++;
+      if (std::find(d_pending.begin(), d_pending.end(), generation.first) == d_pending.end()) {
+        d_pending.push_back(generation.first);
+      }
+      dropped.push_back(generation.first);
+    }
+
+    if (dropped.empty()) {
+      return 0;
+    }
+
+    d_zones.modify([&dropped, &delcount](zones_t& zones) {
+      for (const auto& zone : dropped) {
+        auto iter = zones.find(zone);
+        if (iter != zones.end()) {
+          delcount += iter->second->d_records;
+          zones.erase(iter);
+        }
+      }
+    });
+    *d_statnumentries -= delcount;
+  }
+  d_cond.notify_one();
+
+  return delcount;
+}
+
+uint64_t AuthMemoryZones::reload(const DNSName& zone)
+{
+  return invalidate([&zone](const DNSName& name) { return name == zone; });
+}
+
+uint64_t AuthMemoryZones::purge()
+{
+  return invalidate([](const DNSName&) { return true; });
+}
+
+uint64_t AuthMemoryZones::purge(const std::string& match)
+{
+  if (boost::ends_with(match, "$")) {
+    std::string prefix(match);
+    prefix.resize(prefix.size() - 1);
+    DNSName suffix(prefix);
+    return invalidate([&suffix](const DNSName& zone) { return zone.isPartOf(suffix) || suffix.isPartOf(zone); });
+  }
+
+  return purgeExact(DNSName(match));
+}
+
+uint64_t AuthMemoryZones::purgeExact(const DNSName& qname)
+{
+  return invalidate([&qname](const DNSName& zone) { return qname.isPartOf(zone); });
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include "dnsname.hh"
+#include "dnsparser.hh"
+#include "sholder.hh"
+#include "statbag.hh"
+
+/** Complete copies of the zones listed in 'memory-zones'.
+
+    Each zone is loaded by the AuthMemoryZoneLoader with a single list() of its
+    backend, and the UeberBackend then answers every lookup for a name of the zone
+    from memory, including the ones for names that do not exist, so random
+    subdomain floods do not reach the database.
+
+    Loaded zones are immutable, the set of zones is published through a
+    GlobalStateHolder so lookups take no lock. Purging a zone, or a change of its
+    SOA serial noticed by the loader, drops its copy: its lookups then go to the
+    backends again until it has been loaded anew.
+*/
+class AuthMemoryZones : public boost::noncopyable
+{
+public:
+  struct Zone
+  {
+    DNSName d_zone;
+    int d_zoneId{-1};
+    uint32_t d_serial{0};
+    std::map<DNSName, std::vector<DNSZoneRecord>> d_names; //!< in canonical order, as listed by the backend, ENT records included
+    size_t d_records{0};
+  };
+
+  using zones_t = std::unordered_map<DNSName, std::shared_ptr<const Zone>>;
+
+  AuthMemoryZones();
+
+  void setZones(const std::vector<DNSName>& zones); //!< the zones to load, all of them are queued for loading
+  bool enabled() const
+  {
+    return d_enabled;
+  }
+
+  LocalStateHolder<zones_t> getLocal()
+  {
+    return d_zones.getLocal();
+  }
+  //! Returns false if qname does not belong to a loaded zone with that id, records are filtered on qtype unless it is ANY
+  bool get(LocalStateHolder<zones_t>& zones, const DNSName& qname, int zoneId, uint16_t qtype, std::vector<DNSZoneRecord>& records);
+  //! Whether get() would answer for qname, without counting a hit
+  bool has(LocalStateHolder<zones_t>& zones, const DNSName& qname, int zoneId) const
+  {
+    return findZone(zones, qname, zoneId) != nullptr;
+  }
+
+  //! Blocks until a zone needs to be loaded, or until timeout seconds (0 for no limit) have passed, in which case false is returned
+  bool waitForPending(DNSName& zone, uint64_t& generation, time_t timeout);
+  //! Publishes a loaded zone, unless it has been purged since its loading started
+  bool store(uint64_t generation, std::shared_ptr<const Zone>&& zone);
+  //! Drops the copy of that zone only, and queues it for loading
+  uint64_t reload(const DNSName& zone);
+
+  uint64_t purge();
+  uint64_t purge(const std::string& match); // could be $ terminated. Is not a dnsname!
+  uint64_t purgeExact(const DNSName& qname); // drops the zones holding qname
+
+  uint64_t size() const { return *d_statnumentries; }
+
+private:
+  static const Zone* findZone(LocalStateHolder<zones_t>& zones, const DNSName& qname, int zoneId);
+  template <typename T>
+  uint64_t invalidate(T matches);
+
+  GlobalStateHolder<zones_t> d_zones;
+
+  std::mutex d_mutex;
+  std::condition_variable d_cond;
+  /* protected by d_mutex */
+  std::map<DNSName, uint64_t> d_generations;
+  std::deque<DNSName> d_pending;
+
+  AtomicCounter* d_statnumhit;
+  AtomicCounter* d_statnumentries;
+  bool d_enabled{false};
+};
+
+extern AuthMemoryZones g_memoryZones;
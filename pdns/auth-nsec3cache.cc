@@ -0,0 +1,236 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <boost/algorithm/string.hpp>
+
+#include "auth-nsec3cache.hh"
+#include "dnssecinfra.hh"
+
+extern StatBag S;
+
+AuthNSEC3Cache::AuthNSEC3Cache(size_t shardsCount) :
+  d_hashes(shardsCount)
+{
+  S.declare("nsec3-hash-cache-hit", "Number of NSEC3 hashes which were found in the NSEC3 cache");
+  S.declare("nsec3-neighbour-cache-hit", "Number of NSEC3 owner hash lookups which were answered by the NSEC3 cache");
+  S.declare("nsec3-cache-size", "Number of NSEC3 intervals held by the NSEC3 cache", StatType::gauge);
+
+  d_stathashhit = S.getPointer("nsec3-hash-cache-hit");
+  d_statneighbourhit = S.getPointer("nsec3-neighbour-cache-hit");
+  d_statnumentries = S.getPointer("nsec3-cache-size");
+}
+
+std::string AuthNSEC3Cache::hash(const NSEC3PARAMRecordContent& ns3rc, const DNSName& qname)
+{
+  if (!enabled()) {
+    return hashQNameWithSalt(ns3rc, qname);
+  }
+
+  std::string key;
+  key.reserve(3 + ns3rc.d_salt.size() + qname.wirelength());
+  key.append(1, static_cast<char>(ns3rc.d_iterations >> 8));
+  key.append(1, static_cast<char>(ns3rc.d_iterations & 0xff));
+  key.append(1, static_cast<char>(ns3rc.d_salt.size()));
+  key.append(ns3rc.d_salt);
+  key.append(qname.toDNSStringLC());
+
+  auto& shard = d_hashes[std::hash<std::string>()(key) % d_hashes.size()];
+  {
+    auto hashes = shard.lock();
+    auto iter = hashes->d_map.find(key);
+    if (iter != hashes->d_map.end()) {
+      hashes->d_lru.splice(hashes->d_lru.begin(), hashes->d_lru, iter->second);
+      (*d_stathashhit)++;
+      return iter->second->second;
+    }
+  }
+
+  std::string hashed = hashQNameWithSalt(ns3rc, qname);
+
+  const size_t maxShardSize = std::max(d_maxEntries / d_hashes.size(), static_cast<size_t>(1));
+  auto hashes = shard.lock();
+  if (hashes->d_map.count(key) == 0) {
+    hashes->d_lru.emplace_front(key, hashed);
+    hashes->d_map.emplace(std::move(key), hashes->d_lru.begin());
+    while (hashes->d_lru.size() > maxShardSize) {
+      hashes->d_map.erase(hashes->d_lru.back().first);
+      hashes->d_lru.pop_back();
+    }
+  }
+  return hashed;
+}
+
+bool AuthNSEC3Cache::getNeighbours(const DNSName& zoneName, int domainId, uint32_t serial, const std::string& hashed, bool wantBefore, DNSName& unhashed, std::string& before, std::string& after)
+{
+  if (!enabled()) {
+    return false;
+  }
+
+  time_t now = time(nullptr);
+  auto zones = d_zones.read_lock();
+  auto zone = zones->find(zoneName);
+  if (zone == zones->end() || zone->second.d_domainId != domainId || zone->second.d_serial != serial || zone->second.d_ttd <= now) {
+    return false;
+  }
+
+  const auto& intervals = zone->second.d_intervals;
+  if (intervals.empty()) {
+    return false;
+  }
+
+  /* the interval starting at the largest owner hash not above hashed, or the one
+     wrapping around from the largest owner hash of the zone */
+  auto iter = intervals.upper_bound(hashed);
+  if (iter == intervals.begin()) {
+    iter = intervals.end();
+  }
+  --iter;
+
+  const auto& start = iter->first;
+  const auto& interval = iter->second;
+  bool wraps = interval.d_after <= start;
+  bool inside = wraps ? (hashed >= start || hashed < interval.d_after) : (hashed >= start && hashed < interval.d_after);
+  if (!inside) {
+    return false;
+  }
+
+  if (wantBefore) {
+    before = start;
+    unhashed = interval.d_unhashed;
+  }
+  after = interval.d_after;
+  zone->second.d_lastUsed.store(now, std::memory_order_relaxed);
+  (*d_statneighbourhit)++;
+  return true;
+}
+
+void AuthNSEC3Cache::insertNeighbours(const DNSName& zone, int domainId, uint32_t serial, const std::string& before, const std::string& after, const DNSName& unhashed)
+{
+  if (!enabled() || before.empty() || after.empty()) {
+    return;
+  }
+
+  time_t now = time(nullptr);
+  auto zones = d_zones.write_lock();
+  auto& entry = (*zones)[zone];
+  if (entry.d_domainId != domainId || entry.d_serial != serial || entry.d_ttd <= now) {
+    *d_statnumentries -= entry.d_intervals.size();
+    entry.d_intervals.clear();
+    entry.d_domainId = domainId;
+    entry.d_serial = serial;
+    entry.d_ttd = now + d_ttl;
+  }
+
+  entry.d_lastUsed.store(now, std::memory_order_relaxed);
+
+  if (d_maxEntries != 0 && *d_statnumentries >= d_maxEntries) {
+    makeRoom(*zones, zone, now);
+    if (*d_statnumentries >= d_maxEntries) {
+      /* this zone holds all of them */
+      return;
+    }
+  }
+
+  auto inserted = entry.d_intervals.emplace(before, Interval{after, unhashed});
+  if (inserted.second) {
+    (*d_statnumentries)++;
+  }
+}
+
+void AuthNSEC3Cache::makeRoom(std::map<DNSName, Zone>& zones, const DNSName& keep, time_t now)
+{
+  /* the zones nobody asked for since they expired would otherwise be counted forever */
+  for (auto iter = zones.begin(); iter != zones.end();) {
+    if (iter->second.d_ttd <= now && iter->first != keep) {
+      *d_statnumentries -= iter->second.d_intervals.size();
+      iter = zones.erase(iter);
+    }
+    else {
+      ++iter;
+    }
+  }
+
+  while (*d_statnumentries >= d_maxEntries) {
+    auto oldest = zones.end();
+    for (auto iter = zones.begin(); iter != zones.end(); ++iter) {
+      if (iter->first == keep || iter->second.d_intervals.empty()) {
+        continue;
+      }
+      if (oldest == zones.end() || iter->second.d_lastUsed.load(std::memory_order_relaxed) < oldest->second.d_lastUsed.load(std::memory_order_relaxed)) {
+        oldest = iter;
+      }
+    }
+    if (oldest == zones.end()) {
+      break;
+    }
+    *d_statnumentries -= oldest->second.d_intervals.size();
+    zones.erase(oldest);
+  }
+}
+
+template <typename T>
+uint64_t AuthNSEC3Cache::invalidate(T matches)
+{
+  uint64_t delcount = 0;
+  auto zones = d_zones.write_lock();
+  for (auto iter = zones->begin(); iter != zones->end();) {
+    if (matches(iter->first)) {
+      delcount += iter->second.d_intervals.size();
+      iter = zones->erase(iter);
+    }
+    else {
+      ++iter;
+    }
+  }
+  *d_statnumentries -= delcount;
+  return delcount;
+}
+
+uint64_t AuthNSEC3Cache::purge()
+{
+  for (auto& shard : d_hashes) {
+    auto hashes = shard.lock();
+    hashes->d_map.clear();
+    hashes->d_lru.clear();
+  }
+  return invalidate([](const DNSName&) { return true; });
+}
+
+uint64_t AuthNSEC3Cache::purge(const std::string& match)
+{
+  if (boost::ends_with(match, "$")) {
+    std::string prefix(match);
+    prefix.resize(prefix.size() - 1);
+    DNSName suffix(prefix);
+    return invalidate([&suffix](const DNSName& zone) { return zone.isPartOf(suffix); });
+  }
+
+  return purgeExact(DNSName(match));
+}
+
+uint64_t AuthNSEC3Cache::purgeExact(const DNSName& qname)
+{
+  return invalidate([&qname](const DNSName& zone) { return qname.isPartOf(zone); });
+}
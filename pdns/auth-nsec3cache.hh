@@ -0,0 +1,119 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <atomic>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include "dnsname.hh"
+#include "dnsrecords.hh"
+#include "lock.hh"
+#include "statbag.hh"
+
+/** Spares PacketHandler::addNSEC3() most of its hashing and backend queries.
+
+    The NSEC3 hashes of the names that keep coming back, like closest enclosers and the
+    wildcards below them, are kept in a LRU list per shard.
+
+    The answers of getBeforeAndAfterNamesAbsolute() are kept per zone as intervals: the
+    owner hash found before a hashed name, its unhashed name, and the next owner hash. No
+    other owner hash lies inside such an interval, so any hash falling into it gets the
+    same neighbours without asking the backend. This is what makes floods of random names
+    cheap. The intervals of a zone are dropped when its serial changes, after 'nsec3-cache-ttl'
+    seconds, and when the zone is purged. Once 'max-nsec3-cache-entries' intervals are held, the
+    expired zones are dropped to make room, then the least recently used ones.
+*/
+class AuthNSEC3Cache : public boost::noncopyable
+{
+public:
+  AuthNSEC3Cache(size_t shardsCount = 64);
+
+  void setTTL(uint32_t ttl)
+  {
+    d_ttl = ttl;
+  }
+  void setMaxEntries(size_t maxEntries)
+  {
+    d_maxEntries = maxEntries;
+  }
+  bool enabled() const
+  {
+    return d_ttl > 0;
+  }
+
+  //! hashQNameWithSalt(), from the cache when possible
+  std::string hash(const NSEC3PARAMRecordContent& ns3rc, const DNSName& qname);
+
+  /** Finds the owner hashes around hashed in the intervals learned for that zone and serial.
+      before and unhashed are only set when wantBefore is true */
+  bool getNeighbours(const DNSName& zone, int domainId, uint32_t serial, const std::string& hashed, bool wantBefore, DNSName& unhashed, std::string& before, std::string& after);
+  //! Records that before, owned by unhashed, is followed by after in that zone
+  void insertNeighbours(const DNSName& zone, int domainId, uint32_t serial, const std::string& before, const std::string& after, const DNSName& unhashed);
+
+  uint64_t purge();
+  uint64_t purge(const std::string& match); // could be $ terminated. Is not a dnsname!
+  uint64_t purgeExact(const DNSName& qname); // drops the intervals of the zone holding qname
+
+  uint64_t size() const { return *d_statnumentries; }
+
+private:
+  struct HashShard
+  {
+    using lru_t = std::list<std::pair<std::string, std::string>>;
+    lru_t d_lru; // most recently used first
+    std::unordered_map<std::string, lru_t::iterator> d_map;
+  };
+
+  struct Interval
+  {
+    std::string d_after;
+    DNSName d_unhashed;
+  };
+
+  struct Zone
+  {
+    std::map<std::string, Interval> d_intervals; // by the owner hash starting the interval
+    time_t d_ttd{0};
+    mutable std::atomic<time_t> d_lastUsed{0}; // updated under the read lock too
+    int d_domainId{-1};
+    uint32_t d_serial{0};
+  };
+
+  template <typename T>
+  uint64_t invalidate(T matches);
+  void makeRoom(std::map<DNSName, Zone>& zones, const DNSName& keep, time_t now);
+
+  std::vector<LockGuarded<HashShard>> d_hashes;
+  SharedLockGuarded<std::map<DNSName, Zone>> d_zones;
+
+  AtomicCounter* d_stathashhit;
+  AtomicCounter* d_statneighbourhit;
+  AtomicCounter* d_statnumentries;
+
+  size_t d_maxEntries{0};
+  uint32_t d_ttl{0};
+};
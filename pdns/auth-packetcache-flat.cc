@@ -0,0 +1,389 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <unordered_set>
+
+#include "auth-packetcache-flat.hh"
+#include "packetcache.hh"
+
+namespace
+{
+/* Epoch-based reclamation, shared by all instances.
+
+   A reader publishes the global epoch in its slot for the duration of a lookup.
+   A writer tags each unlinked entry with the global epoch, and frees it once the
+   epoch has moved on and every active reader has published a more recent one,
+   as these readers started after the entry was unlinked and cannot see it.
+   All the operations involved are sequentially consistent, the fences make sure
+   that a reader's loads from the table are ordered after the publication of its
+   epoch, and that a writer's unlink is ordered before the tagging. */
+struct alignas(64) ReaderSlot
+{
+  std::atomic<uint64_t> d_epoch{0};
+  std::atomic<bool> d_taken{false};
+};
+
+const size_t s_maxReaders = 256;
+std::array<ReaderSlot, s_maxReaders> s_readers;
+std::atomic<uint64_t> s_epoch{1};
+
+struct ReaderRegistration
+{
+  ReaderRegistration()
+  {
+    for (auto& slot : s_readers) {
+      bool expected = false;
+      if (slot.d_taken.compare_exchange_strong(expected, true)) {
+        d_slot = &slot;
+        break;
+      }
+    }
+  }
+
+  ~ReaderRegistration()
+  {
+    if (d_slot != nullptr) {
+      d_slot->d_epoch.store(0);
+      d_slot->d_taken.store(false);
+    }
+  }
+
+  ReaderRegistration(const ReaderRegistration&) = delete;
+  ReaderRegistration& operator=(const ReaderRegistration&) = delete;
+
+  ReaderSlot* d_slot{nullptr};
+};
+
+thread_local ReaderRegistration t_reader;
+
+class ReadGuard
+{
+public:
+  /* returns false if every slot is taken, the caller then needs to take the shard lock */
+  ReadGuard() :
+    d_slot(t_reader.d_slot)
+  {
+    if (d_slot != nullptr) {
+      d_slot->d_epoch.store(s_epoch.load());
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+
+  ~ReadGuard()
+  {
+    if (d_slot != nullptr) {
+      d_slot->d_epoch.store(0, std::memory_order_release);
+    }
+  }
+
+  ReadGuard(const ReadGuard&) = delete;
+  ReadGuard& operator=(const ReadGuard&) = delete;
+
+  bool active() const
+  {
+    return d_slot != nullptr;
+  }
+
+private:
+  ReaderSlot* d_slot;
+};
+}
+
+FlatPacketCache::FlatPacketCache(size_t shardsCount, size_t maxEntries) :
+  d_shards(std::max(shardsCount, static_cast<size_t>(1)))
+{
+  const size_t perShard = maxEntries / d_shards.size();
+  const size_t bucketsCount = std::max((perShard + s_ways - 1) / s_ways, static_cast<size_t>(1));
+
+  for (auto& shard : d_shards) {
+    shard.d_buckets = std::make_unique<Bucket[]>(bucketsCount);
+    shard.d_bucketsCount = bucketsCount;
+  }
+}
+
+FlatPacketCache::~FlatPacketCache()
+{
+  /* no reader can be left at this point */
+  for (auto& shard : d_shards) {
+    auto state = shard.d_state.lock();
+    for (const auto& names : state->d_names) {
+      delete names.second;
+    }
+    for (const auto& retired : state->d_retired) {
+      delete retired.second;
+    }
+  }
+}
+
+bool FlatPacketCache::lookup(const Shard& shard, const std::string& query, uint32_t hash, const DNSName& qname, uint16_t qtype, bool tcp, time_t now, std::string& value)
+{
+  static const std::unordered_set<uint16_t> skippedEDNSTypes{EDNSOptionCode::COOKIE};
+
+  const size_t slot = getSlot(shard, hash);
+  const Bucket& bucket = shard.d_buckets[slot / s_ways];
+
+  for (size_t way = 0; way < s_ways; way++) {
+    if (bucket.d_hashes[way].load(std::memory_order_relaxed) != hash) {
+      continue;
+    }
+
+    const Entry* entry = bucket.d_entries[way].load(std::memory_order_acquire);
+    if (entry == nullptr || entry->hash != hash || entry->ttd < now) {
+      continue;
+    }
+
+    if (entry->tcp != tcp || entry->qtype != qtype || entry->qname != qname || !PacketCache::queryMatches(entry->query, query, qname, skippedEDNSTypes)) {
+      continue;
+    }
+
+    /* avoid dirtying the cache line when the bit is already set */
+    if (!entry->referenced.load(std::memory_order_relaxed)) {
+      entry->referenced.store(true, std::memory_order_relaxed);
+    }
+    value = entry->value;
+    return true;
+  }
+
+  return false;
+}
+
+bool FlatPacketCache::get(const std::string& query, uint32_t hash, const DNSName& qname, uint16_t qtype, bool tcp, time_t now, std::string& value)
+{
+  auto& shard = getShard(qname);
+
+  ReadGuard guard;
+  if (guard.active()) {
+    return lookup(shard, query, hash, qname, qtype, tcp, now, value);
+  }
+
+  auto state = shard.d_state.lock();
+  return lookup(shard, query, hash, qname, qtype, tcp, now, value);
+}
+
+void FlatPacketCache::unlink(Shard& shard, WriterState& state, Entry* entry)
+{
+  auto& bucket = shard.d_buckets[entry->slot / s_ways];
+  bucket.d_entries[entry->slot % s_ways].store(nullptr);
+  bucket.d_hashes[entry->slot % s_ways].store(0, std::memory_order_relaxed);
+  state.d_names.erase(entry->nameIt);
+  retire(state, entry);
+}
+
+void FlatPacketCache::retire(WriterState& state, Entry* entry)
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  state.d_retired.emplace_back(s_epoch.load(), entry);
+}
+
+void FlatPacketCache::reclaim(WriterState& state)
+{
+  if (state.d_retired.empty()) {
+    return;
+  }
+
+  s_epoch.fetch_add(1);
+
+  uint64_t oldest = std::numeric_limits<uint64_t>::max();
+  for (const auto& reader : s_readers) {
+    auto epoch = reader.d_epoch.load();
+    if (epoch != 0) {
+      oldest = std::min(oldest, epoch);
+    }
+  }
+
+  auto last = std::partition(state.d_retired.begin(), state.d_retired.end(), [oldest](const std::pair<uint64_t, Entry*>& retired) {
+    return retired.first >= oldest;
+  });
+
+  for (auto iter = last; iter != state.d_retired.end(); ++iter) {
+    delete iter->second;
+  }
+  state.d_retired.erase(last, state.d_retired.end());
+}
+
+bool FlatPacketCache::insert(std::string&& query, std::string&& value, uint32_t hash, const DNSName& qname, uint16_t qtype, bool tcp, time_t ttd)
+{
+  static const std::unordered_set<uint16_t> skippedEDNSTypes{EDNSOptionCode::COOKIE};
+
+  auto& shard = getShard(qname);
+  const size_t first = getSlot(shard, hash);
+  auto& bucket = shard.d_buckets[first / s_ways];
+
+  auto entry = std::make_unique<Entry>();
+  entry->query = std::move(query);
+  entry->value = std::move(value);
+  entry->qname = qname;
+  entry->ttd = ttd;
+  entry->hash = hash;
+  entry->qtype = qtype;
+  entry->tcp = tcp;
+
+  auto state = shard.d_state.lock();
+  time_t now = time(nullptr);
+
+  /* look for an entry to refresh, otherwise a free or expired slot */
+  std::optional<size_t> freeWay;
+  std::optional<size_t> victim;
+  for (size_t way = 0; way < s_ways; way++) {
+    Entry* existing = bucket.d_entries[way].load(std::memory_order_relaxed);
+    if (existing == nullptr) {
+      if (!freeWay) {
+        freeWay = way;
+      }
+      continue;
+    }
+    if (existing->hash == hash && existing->tcp == tcp && existing->qtype == qtype && existing->qname == qname && PacketCache::queryMatches(existing->query, entry->query, qname, skippedEDNSTypes)) {
+      victim = way;
+      break;
+    }
+    if (!victim && existing->ttd < now) {
+      victim = way;
+    }
+  }
+
+  bool tookFreeSlot = false;
+  if (!victim) {
+    if (freeWay) {
+      tookFreeSlot = true;
+    }
+    else {
+      /* CLOCK: skip and clear the entries that have been used since the hand last passed */
+      for (size_t step = 0; step < 2 * s_ways; step++) {
+        size_t way = bucket.d_hand;
+        bucket.d_hand = (bucket.d_hand + 1) % s_ways;
+        Entry* existing = bucket.d_entries[way].load(std::memory_order_relaxed);
+        if (!existing->referenced.exchange(false, std::memory_order_relaxed)) {
+          victim = way;
+          break;
+        }
+      }
+      if (!victim) {
+        victim = bucket.d_hand;
+      }
+    }
+  }
+
+  size_t way = victim ? *victim : *freeWay;
+  if (victim) {
+    unlink(shard, *state, bucket.d_entries[way].load(std::memory_order_relaxed));
+  }
+
+  Entry* raw = entry.release();
+  raw->slot = first + way;
+  raw->nameIt = state->d_names.emplace(raw->qname, raw);
+  bucket.d_hashes[way].store(hash, std::memory_order_relaxed);
+  bucket.d_entries[way].store(raw, std::memory_order_release);
+
+  if (state->d_retired.size() >= 64) {
+    reclaim(*state);
+  }
+
+  return tookFreeSlot;
+}
+
+uint64_t FlatPacketCache::clear(Shard& shard, WriterState& state)
+{
+  uint64_t delcount = state.d_names.size();
+  for (size_t idx = 0; idx < shard.d_bucketsCount; idx++) {
+    auto& bucket = shard.d_buckets[idx];
+    for (size_t way = 0; way < s_ways; way++) {
+      bucket.d_entries[way].store(nullptr);
+      bucket.d_hashes[way].store(0, std::memory_order_relaxed);
+    }
+  }
+  for (const auto& names : state.d_names) {
+    retire(state, names.second);
+  }
+  state.d_names.clear();
+  reclaim(state);
+  return delcount;
+}
+
+uint64_t FlatPacketCache::purge()
+{
+  uint64_t delcount = 0;
+  for (auto& shard : d_shards) {
+    auto state = shard.d_state.lock();
+    delcount += clear(shard, *state);
+  }
+  return delcount;
+}
+
+uint64_t FlatPacketCache::purge(const DNSName& suffix)
+{
+  uint64_t delcount = 0;
+  for (auto& shard : d_shards) {
+    auto state = shard.d_state.lock();
+    auto iter = state->d_names.lower_bound(suffix);
+    while (iter != state->d_names.end() && iter->first.isPartOf(suffix)) {
+      Entry* entry = iter->second;
+      ++iter;
+      unlink(shard, *state, entry);
+      delcount++;
+    }
+    reclaim(*state);
+  }
+  return delcount;
+}
+
+uint64_t FlatPacketCache::purgeExact(const DNSName& qname)
+{
+  uint64_t delcount = 0;
+  auto& shard = getShard(qname);
+  auto state = shard.d_state.lock();
+  auto range = state->d_names.equal_range(qname);
+  for (auto iter = range.first; iter != range.second;) {
+    Entry* entry = iter->second;
+    ++iter;
+    unlink(shard, *state, entry);
+    delcount++;
+  }
+  reclaim(*state);
+  return delcount;
+}
+
+uint64_t FlatPacketCache::expire(time_t now)
+{
+  uint64_t delcount = 0;
+  for (auto& shard : d_shards) {
+    auto state = shard.d_state.lock();
+    size_t toScan = std::max(shard.d_bucketsCount / 10, static_cast<size_t>(1));
+    for (; toScan > 0; toScan--) {
+      auto& bucket = shard.d_buckets[state->d_cleanCursor];
+      state->d_cleanCursor = (state->d_cleanCursor + 1) % shard.d_bucketsCount;
+      for (size_t way = 0; way < s_ways; way++) {
+        Entry* entry = bucket.d_entries[way].load(std::memory_order_relaxed);
+        if (entry != nullptr && entry->ttd < now) {
+          unlink(shard, *state, entry);
+          delcount++;
+        }
+      }
+    }
+    reclaim(*state);
+  }
+  return delcount;
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dnsname.hh"
+#include "lock.hh"
+
+/* Alternative storage for the AuthPacketCache, optimized for the hit path.
+
+   Each shard is a fixed array of cache-line sized buckets holding four hash/pointer
+   pairs, so a lookup touches a single line of the table before reaching the entry.
+   Entries are immutable once published: an update or an eviction swaps the pointer
+   and retires the old entry, which is only freed once no reader can still hold it
+   (epoch-based reclamation). Readers therefore never take a lock.
+
+   Writers serialize on a per-shard lock, which also protects an ordered name index
+   used to purge entries by name or by suffix. When a set is full, the victim is
+   chosen by a CLOCK sweep over the set, using a 'referenced' bit set on hits.
+*/
+class FlatPacketCache
+{
+public:
+  FlatPacketCache(size_t shardsCount, size_t maxEntries);
+  ~FlatPacketCache();
+  FlatPacketCache(const FlatPacketCache&) = delete;
+  FlatPacketCache& operator=(const FlatPacketCache&) = delete;
+
+  bool get(const std::string& query, uint32_t hash, const DNSName& qname, uint16_t qtype, bool tcp, time_t now, std::string& value);
+  /* returns true if the entry took a free slot, false if it replaced or evicted another entry */
+  bool insert(std::string&& query, std::string&& value, uint32_t hash, const DNSName& qname, uint16_t qtype, bool tcp, time_t ttd);
+
+  uint64_t purge();
+  uint64_t purge(const DNSName& suffix);
+  uint64_t purgeExact(const DNSName& qname);
+  /* removes expired entries from a tenth of each shard, returns the number of removed entries */
+  uint64_t expire(time_t now);
+
+  static const size_t s_ways = 4;
+
+private:
+  struct Entry;
+  using nameindex_t = std::multimap<DNSName, Entry*, CanonDNSNameCompare>;
+
+  struct Entry
+  {
+    std::string query;
+    std::string value;
+    DNSName qname;
+    time_t ttd{0};
+    uint32_t hash{0};
+    uint16_t qtype{0};
+    bool tcp{false};
+
+    mutable std::atomic<bool> referenced{false};
+    /* only accessed with the shard lock held */
+    nameindex_t::iterator nameIt;
+    size_t slot{0};
+  };
+
+  struct alignas(64) Bucket
+  {
+    std::array<std::atomic<uint32_t>, s_ways> d_hashes{};
+    std::array<std::atomic<Entry*>, s_ways> d_entries{};
+    /* CLOCK hand, only accessed with the shard lock held */
+    uint8_t d_hand{0};
+  };
+
+  struct WriterState
+  {
+    nameindex_t d_names;
+    std::vector<std::pair<uint64_t, Entry*>> d_retired;
+    size_t d_cleanCursor{0};
+  };
+
+  struct Shard
+  {
+    std::unique_ptr<Bucket[]> d_buckets;
+    size_t d_bucketsCount{0};
+    LockGuarded<WriterState> d_state;
+  };
+
+  Shard& getShard(const DNSName& qname)
+  {
+    return d_shards[qname.hash() % d_shards.size()];
+  }
+
+  static size_t getSlot(const Shard& shard, uint32_t hash)
+  {
+    return ((static_cast<uint64_t>(hash) * shard.d_bucketsCount) >> 32) * s_ways;
+  }
+
+  static bool lookup(const Shard& shard, const std::string& query, uint32_t hash, const DNSName& qname, uint16_t qtype, bool tcp, time_t now, std::string& value);
+  static void unlink(Shard& shard, WriterState& state, Entry* entry);
+  static void retire(WriterState& state, Entry* entry);
+  static void reclaim(WriterState& state);
+  static uint64_t clear(Shard& shard, WriterState& state);
+
+  std::vector<Shard> d_shards;
+};
@@ -50,6 +50,19 @@ void AuthPacketCache::MapCombo::reserve(size_t numberOfEntries)
 #endif /* BOOST_VERSION >= 105600 */
 }
 
+void AuthPacketCache::setEngine(const std::string& engine)
+{
+  if (engine == "flat") {
+    d_flat = std::make_unique<FlatPacketCache>(d_maps.size(), d_maxEntries);
+  }
+  else if (engine == "classic") {
+    d_flat.reset();
+  }
+  else {
+    throw PDNSException("Unknown packet cache engine '" + engine + "'");
+  }
+}
+
 bool AuthPacketCache::get(DNSPacket& p, DNSPacket& cached)
 {
   if(!d_ttl) {
@@ -65,8 +78,12 @@ bool AuthPacketCache::get(DNSPacket& p, DNSPacket& cached)
   string value;
   bool haveSomething;
   time_t now = time(nullptr);
-  auto& mc = getMap(p.qdomain);
-  {
+  if (d_flat) {
+    haveSomething = d_flat->get(p.getString(), hash, p.qdomain, p.qtype.getCode(), p.d_tcp, now, value);
+  }
+  else {
+    auto& mc = getMap(p.qdomain);
+
     auto map = mc.d_map.try_read_lock();
     if (!map.owns_lock()) {
       S.inc("deferred-packetcache-lookup");
@@ -130,6 +147,13 @@ void AuthPacketCache::insert(DNSPacket& q, DNSPacket& r, unsigned int maxTTL)
   entry.value = r.getString();
   entry.tcp = r.d_tcp;
   entry.query = q.getString();
+
+  if (d_flat) {
+    if (d_flat->insert(std::move(entry.query), std::move(entry.value), hash, entry.qname, entry.qtype, entry.tcp, entry.ttd)) {
+      ++(*d_statnumentries);
+    }
+    return;
+  }
   
   auto& mc = getMap(entry.qname);
   {
@@ -199,13 +223,23 @@ uint64_t AuthPacketCache::purge()
 
   d_statnumentries->store(0);
 
+  if (d_flat) {
+    return d_flat->purge();
+  }
+
   return purgeLockedCollectionsVector(d_maps);
 }
 
 uint64_t AuthPacketCache::purgeExact(const DNSName& qname)
 {
-  auto& mc = getMap(qname);
-  uint64_t delcount = purgeExactLockedCollection<NameTag>(mc, qname);
+  uint64_t delcount;
+  if (d_flat) {
+    delcount = d_flat->purgeExact(qname);
+  }
+  else {
+    auto& mc = getMap(qname);
+    delcount = purgeExactLockedCollection<NameTag>(mc, qname);
+  }
 
   *d_statnumentries -= delcount;
 
@@ -222,7 +256,14 @@ uint64_t AuthPacketCache::purge(const string &match)
   uint64_t delcount = 0;
 
   if(boost::ends_with(match, "$")) {
-    delcount = purgeLockedCollectionsVector<NameTag>(d_maps, match);
+    if (d_flat) {
+      std::string prefix(match);
+      prefix.resize(prefix.size() - 1);
+      delcount = d_flat->purge(DNSName(prefix));
+    }
+    else {
+      delcount = purgeLockedCollectionsVector<NameTag>(d_maps, match);
+    }
     *d_statnumentries -= delcount;
   }
   else {
@@ -234,7 +275,13 @@ uint64_t AuthPacketCache::purge(const string &match)
 			   
 void AuthPacketCache::cleanup()
 {
-  uint64_t totErased = pruneLockedCollectionsVector<SequencedTag>(d_maps);
+  uint64_t totErased;
+  if (d_flat) {
+    totErased = d_flat->expire(time(nullptr));
+  }
+  else {
+    totErased = pruneLockedCollectionsVector<SequencedTag>(d_maps);
+  }
   *d_statnumentries -= totErased;
 
   DLOG(g_log<<"Done with cache clean, cacheSize: "<<(*d_statnumentries)<<", totErased"<<totErased<<endl);
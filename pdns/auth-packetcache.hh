@@ -36,6 +36,7 @@ using namespace ::boost::multi_index;
 #include "dnspacket.hh"
 #include "lock.hh"
 #include "packetcache.hh"
+#include "auth-packetcache-flat.hh"
 
 /** This class performs 'whole packet caching'. Feed it a question packet and it will
     try to find an answer. If you have an answer, insert it to have it cached for later use. 
@@ -67,10 +68,15 @@ public:
   void setMaxEntries(uint64_t maxEntries) 
   {
     d_maxEntries = maxEntries;
+    if (d_flat) {
+      d_flat = std::make_unique<FlatPacketCache>(d_maps.size(), d_maxEntries);
+      return;
+    }
     for (auto& shard : d_maps) {
       shard.reserve(maxEntries / d_maps.size());
     }
   }
+  void setEngine(const std::string& engine); //!< "classic" or "flat", to be called before setMaxEntries()
   void setTTL(uint32_t ttl)
   {
     d_ttl = ttl;
@@ -123,6 +129,8 @@ private:
   };
 
   vector<MapCombo> d_maps;
+  /* when set, entries live in this table instead of d_maps */
+  std::unique_ptr<FlatPacketCache> d_flat;
   MapCombo& getMap(const DNSName& name)
   {
     return d_maps[name.hash() % d_maps.size()];
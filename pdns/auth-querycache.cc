@@ -70,6 +70,21 @@ bool AuthQueryCache::getEntry(const DNSName &qname, const QType& qtype, vector<D
   }
 }
 
+bool AuthQueryCache::hasEntry(const DNSName &qname, const QType& qtype, int zoneID)
+{
+  time_t now = time(nullptr);
+  uint16_t qt = qtype.getCode();
+  auto& mc = getMap(qname);
+  auto map = mc.d_map.try_read_lock();
+  if (!map.owns_lock()) {
+    return false;
+  }
+
+  auto& idx = boost::multi_index::get<HashTag>(*map);
+  auto iter = idx.find(std::tie(qname, qt, zoneID));
+  return iter != idx.end() && iter->ttd >= now;
+}
+
 void AuthQueryCache::insert(const DNSName &qname, const QType& qtype, vector<DNSZoneRecord>&& value, uint32_t ttl, int zoneID)
 {
   cleanupIfNeeded();
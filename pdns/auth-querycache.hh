@@ -45,6 +45,8 @@ public:
   void insert(const DNSName &qname, const QType& qtype, vector<DNSZoneRecord>&& content, uint32_t ttl, int zoneID);
 
   bool getEntry(const DNSName &qname, const QType& qtype, vector<DNSZoneRecord>& entry, int zoneID);
+  //! Like getEntry() but without copying the entry out or counting a hit or miss
+  bool hasEntry(const DNSName &qname, const QType& qtype, int zoneID);
 
   size_t size() { return *d_statnumentries; } //!< number of entries in the cache
   void cleanup(); //!< force the cache to preen itself from expired queries
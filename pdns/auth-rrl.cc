@@ -0,0 +1,262 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <algorithm>
+#include <limits>
+
+#include "auth-rrl.hh"
+#include "burtle.hh"
+#include "dns.hh"
+#include "dns_random.hh"
+#include "dnsname.hh"
+
+extern StatBag S;
+
+AuthRRL::AuthRRL()
+{
+  S.declare("rrl-dropped", "Number of answers dropped by Response Rate Limiting");
+  S.declare("rrl-slipped", "Number of answers replaced by a truncated answer by Response Rate Limiting");
+
+  d_statdropped = S.getPointer("rrl-dropped");
+  d_statslipped = S.getPointer("rrl-slipped");
+}
+
+void AuthRRL::setLimits(unsigned int responsesPerSecond, unsigned int slip, size_t tableSize, uint8_t ipv4PrefixLength, uint8_t ipv6PrefixLength)
+{
+  if (responsesPerSecond == 0 || tableSize == 0) {
+    d_responsesPerSecond = 0;
+    return;
+  }
+
+  d_sets = (std::min(tableSize, s_maxTableSize) + s_ways - 1) / s_ways;
+  d_table = std::make_unique<std::atomic<uint64_t>[]>(d_sets * s_ways);
+  for (size_t idx = 0; idx < d_sets * s_ways; idx++) {
+    d_table[idx].store(0, std::memory_order_relaxed);
+  }
+  d_seed = dns_random_uint32();
+  d_slip = slip;
+  d_ipv4PrefixLength = std::min(ipv4PrefixLength, static_cast<uint8_t>(32));
+  d_ipv6PrefixLength = std::min(ipv6PrefixLength, static_cast<uint8_t>(128));
+  d_responsesPerSecond = std::min(responsesPerSecond, s_maxResponsesPerSecond);
+}
+
+/* returns the offset following the name starting at offset, or std::string::npos if it does not fit */
+static size_t skipName(const std::string& packet, size_t offset)
+{
+  while (offset < packet.size()) {
+    const uint8_t len = packet[offset];
+    if (len == 0) {
+      return offset + 1;
+    }
+    if ((len & 0xc0) == 0xc0) {
+      return offset + 2 <= packet.size() ? offset + 2 : std::string::npos;
+    }
+    offset += len + 1;
+  }
+  return std::string::npos;
+}
+
+/* returns the offset following the only question, or std::string::npos */
+static size_t skipQuestion(const std::string& packet)
+{
+  dnsheader dh;
+  memcpy(&dh, packet.data(), sizeof(dh));
+  if (ntohs(dh.qdcount) != 1) {
+    return std::string::npos;
+  }
+
+  size_t offset = skipName(packet, sizeof(dnsheader));
+  if (offset == std::string::npos || offset + 4 > packet.size()) {
+    return std::string::npos;
+  }
+  return offset + 4;
+}
+
+AuthRRL::ResponseClass AuthRRL::getResponseClass(const std::string& answer)
+{
+  dnsheader dh;
+  memcpy(&dh, answer.data(), sizeof(dh));
+
+  if (dh.rcode == RCode::NXDomain) {
+    return ResponseClass::NXDomain;
+  }
+  if (dh.rcode != RCode::NoError) {
+    return ResponseClass::Error;
+  }
+  if (dh.ancount != 0) {
+    return ResponseClass::Answer;
+  }
+  if (!dh.aa && dh.nscount != 0) {
+    return ResponseClass::Referral;
+  }
+  return ResponseClass::NoData;
+}
+
+uint32_t AuthRRL::getKeyHash(const ComboAddress& remote, ResponseClass responseClass, const std::string& answer) const
+{
+  ComboAddress prefix(remote);
+  uint32_t hash;
+  if (prefix.isIPv4()) {
+    prefix.truncate(d_ipv4PrefixLength);
+    hash = burtle(reinterpret_cast<const unsigned char*>(&prefix.sin4.sin_addr.s_addr), sizeof(prefix.sin4.sin_addr.s_addr), d_seed + AF_INET);
+  }
+  else {
+    prefix.truncate(d_ipv6PrefixLength);
+    hash = burtle(reinterpret_cast<const unsigned char*>(&prefix.sin6.sin6_addr.s6_addr), sizeof(prefix.sin6.sin6_addr.s6_addr), d_seed + AF_INET6);
+  }
+
+  const uint8_t kind = static_cast<uint8_t>(responseClass);
+  hash = burtle(&kind, sizeof(kind), hash);
+  if (responseClass == ResponseClass::Error) {
+    return hash;
+  }
+
+  const size_t questionEnd = skipQuestion(answer);
+  if (questionEnd == std::string::npos) {
+    return hash;
+  }
+
+  if (responseClass != ResponseClass::Answer) {
+    /* the zone or the delegation, so floods of random names are accounted together */
+    dnsheader dh;
+    memcpy(&dh, answer.data(), sizeof(dh));
+    size_t offset = questionEnd;
+    for (uint16_t idx = 0; offset != std::string::npos && idx < ntohs(dh.ancount); idx++) {
+      offset = skipName(answer, offset);
+      if (offset == std::string::npos || offset + 10 > answer.size()) {
+        offset = std::string::npos;
+        break;
+      }
+      uint16_t rdlength;
+      memcpy(&rdlength, &answer.at(offset + 8), sizeof(rdlength));
+      offset += 10 + ntohs(rdlength);
+    }
+    if (offset != std::string::npos && offset < answer.size() && dh.nscount != 0) {
+      try {
+        DNSName owner(answer.data(), answer.size(), offset, true);
+        return owner.hash(hash);
+      }
+      catch (const std::exception&) {
+        /* fall back to the question */
+      }
+    }
+  }
+
+  /* the question is never compressed, and hashed the same way as a DNSName */
+  return burtleCI(reinterpret_cast<const unsigned char*>(&answer.at(sizeof(dnsheader))), questionEnd - 4 - sizeof(dnsheader), hash);
+}
+
+static thread_local unsigned int t_slipCounter{0};
+
+/* a slot is tag:24, second it was last used:24, tokens:16. The top bit of the tag is always
+   set, so an unused slot (0) never matches */
+static constexpr uint64_t s_tagMask = 0xffffff0000000000ULL;
+static constexpr uint32_t s_secondMask = 0xffffff;
+
+static uint32_t getLastUsed(uint64_t slot)
+{
+  return (slot >> 16) & s_secondMask;
+}
+
+/* seconds from the last use of slot to second. Negative when a thread with an older second
+   races with one that already stored a more recent one */
+static int32_t getElapsed(uint64_t slot, uint32_t second)
+{
+  return static_cast<int32_t>(((second - getLastUsed(slot)) & s_secondMask) << 8) >> 8;
+}
+
+AuthRRL::Verdict AuthRRL::check(const ComboAddress& remote, const std::string& answer, time_t now)
+{
+  if (answer.size() < sizeof(dnsheader)) {
+    return Verdict::Send;
+  }
+  if (!d_exempt.empty() && d_exempt.match(remote)) {
+    return Verdict::Send;
+  }
+
+  const uint32_t hash = getKeyHash(remote, getResponseClass(answer), answer);
+  const uint64_t tag = (static_cast<uint64_t>(hash >> 8) | 0x800000) << 40;
+  const uint32_t second = static_cast<uint32_t>(now) & s_secondMask;
+  std::atomic<uint64_t>* set = &d_table[(hash % d_sets) * s_ways];
+
+  /* our own slot, otherwise an unused one, otherwise the least recently used one */
+  std::atomic<uint64_t>* slot = nullptr;
+  int32_t oldest = -1;
+  for (size_t way = 0; way < s_ways; way++) {
+    const uint64_t content = set[way].load(std::memory_order_relaxed);
+    if ((content & s_tagMask) == tag) {
+      slot = &set[way];
+      break;
+    }
+    const int32_t idle = content == 0 ? std::numeric_limits<int32_t>::max() : getElapsed(content, second);
+    if (idle > oldest) {
+      oldest = idle;
+      slot = &set[way];
+    }
+  }
+
+  uint64_t current = slot->load(std::memory_order_relaxed);
+  uint64_t updated;
+  do {
+    uint64_t tokens = d_responsesPerSecond;
+    uint32_t lastUsed = second;
+    if (current != 0) {
+      /* an evicted key hands its tokens over, so colliding keys cannot be used to refill a bucket */
+      const int32_t elapsed = getElapsed(current, second);
+      if (elapsed < 0) {
+        lastUsed = getLastUsed(current);
+      }
+      tokens = std::min(static_cast<uint64_t>(d_responsesPerSecond), (current & 0xffff) + static_cast<uint64_t>(std::max(elapsed, 0)) * d_responsesPerSecond);
+    }
+    if (tokens == 0) {
+      /* nothing to update, the bucket is refilled from the second it was last used */
+      if (d_slip > 0 && ++t_slipCounter % d_slip == 0) {
+        (*d_statslipped)++;
+        return Verdict::Slip;
+      }
+      (*d_statdropped)++;
+      return Verdict::Drop;
+    }
+    updated = tag | (static_cast<uint64_t>(lastUsed) << 16) | (tokens - 1);
+  } while (!slot->compare_exchange_weak(current, updated, std::memory_order_relaxed));
+
+  return Verdict::Send;
+}
+
+bool AuthRRL::makeSlip(const std::string& answer, std::string& slipped)
+{
+  const size_t questionEnd = skipQuestion(answer);
+  if (questionEnd == std::string::npos) {
+    return false;
+  }
+
+  slipped.assign(answer, 0, questionEnd);
+  dnsheader dh;
+  memcpy(&dh, slipped.data(), sizeof(dh));
+  dh.tc = 1;
+  dh.qdcount = htons(1);
+  dh.ancount = dh.nscount = dh.arcount = 0;
+  memcpy(&slipped.at(0), &dh, sizeof(dh));
+  return true;
+}
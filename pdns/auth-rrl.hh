@@ -0,0 +1,109 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <string>
+
+#include <boost/utility.hpp>
+
+#include "iputils.hh"
+#include "statbag.hh"
+
+/** Response Rate Limiting of the answers sent over UDP.
+
+    Answers are accounted in token buckets, keyed by the prefix of the client, the
+    kind of answer and the name it is about: the question for positive answers, the
+    owner of the first authority record (the zone or the delegation) for NXDOMAIN,
+    NODATA and referrals, and no name at all for errors. A bucket holds up to
+    'rrl-responses-per-second' tokens and is refilled at that rate. Answers finding
+    their bucket empty are dropped, except every 'rrl-slip'th one, which is replaced
+    by an empty truncated answer so real clients can retry over TCP.
+
+    The buckets live in a fixed-size table of atomic words, each holding a tag of its
+    key, the second it was last used and its tokens, and are updated with a
+    compare-and-swap: checking an answer takes no lock, and the memory used does not
+    depend on the number of clients. A key can use any of the 's_ways' slots of its
+    set. When they are all taken, the least recently used one is evicted and the
+    newcomer inherits its tokens, so rotating through colliding keys does not refill
+    any bucket. The hash is seeded randomly, so colliding keys cannot be computed
+    in advance.
+*/
+class AuthRRL : public boost::noncopyable
+{
+public:
+  enum class Verdict : uint8_t
+  {
+    Send,
+    Drop,
+    Slip
+  };
+
+  enum class ResponseClass : uint8_t
+  {
+    Answer,
+    Referral,
+    NoData,
+    NXDomain,
+    Error
+  };
+
+  AuthRRL();
+
+  void setLimits(unsigned int responsesPerSecond, unsigned int slip, size_t tableSize, uint8_t ipv4PrefixLength, uint8_t ipv6PrefixLength);
+  void setExempt(const NetmaskGroup& exempt)
+  {
+    d_exempt = exempt;
+  }
+  bool enabled() const
+  {
+    return d_responsesPerSecond > 0;
+  }
+
+  //! Decides what to do with answer, a complete DNS message about to be sent to remote
+  Verdict check(const ComboAddress& remote, const std::string& answer, time_t now);
+
+  //! The header and the question of answer, flagged as truncated. Returns false if answer is malformed
+  static bool makeSlip(const std::string& answer, std::string& slipped);
+  static ResponseClass getResponseClass(const std::string& answer);
+
+  static constexpr unsigned int s_maxResponsesPerSecond = 0xffff;
+  static constexpr size_t s_ways = 4;
+  static constexpr size_t s_maxTableSize = 1 << 27;
+
+private:
+  uint32_t getKeyHash(const ComboAddress& remote, ResponseClass responseClass, const std::string& answer) const;
+
+  std::unique_ptr<std::atomic<uint64_t>[]> d_table{nullptr};
+  size_t d_sets{0};
+  NetmaskGroup d_exempt;
+  AtomicCounter* d_statdropped;
+  AtomicCounter* d_statslipped;
+  unsigned int d_responsesPerSecond{0};
+  unsigned int d_slip{0};
+  uint32_t d_seed{0};
+  uint8_t d_ipv4PrefixLength{32};
+  uint8_t d_ipv6PrefixLength{128};
+};
+
+extern AuthRRL g_rrl;
@@ -0,0 +1,158 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdlib>
+#include <unistd.h>
+
+#include "auth-xfrspool.hh"
+#include "logger.hh"
+#include "misc.hh"
+
+AuthXFRSpool::AuthXFRSpool(size_t batchSize, std::string directory) :
+  d_directory(std::move(directory)), d_batchSize(batchSize > 0 ? batchSize : 1)
+{
+  d_records.reserve(d_batchSize);
+}
+
+AuthXFRSpool::~AuthXFRSpool()
+{
+  if (d_file != nullptr) {
+    fclose(d_file);
+  }
+}
+
+bool AuthXFRSpool::openFile()
+{
+  std::string dir = d_directory;
+  if (dir.empty()) {
+    const char* tmpdir = getenv("TMPDIR");
+    dir = tmpdir != nullptr && *tmpdir != '\0' ? tmpdir : "/tmp";
+  }
+  std::string path = dir + "/pdns-xfr-XXXXXX";
+  int fd = mkstemp(path.data());
+  if (fd < 0) {
+    g_log << Logger::Warning << "Unable to create a spool file for an incoming zone transfer in '" << dir << "', keeping the records in memory: " << stringerror() << endl;
+    return false;
+  }
+  // nobody else needs the file, it goes away when we close it
+  unlink(path.c_str());
+  d_file = fdopen(fd, "w+");
+  if (d_file == nullptr) {
+    close(fd);
+    return false;
+  }
+  return true;
+}
+
+void AuthXFRSpool::push(const DNSResourceRecord& rr)
+{
+  d_records.push_back(rr);
+  ++d_size;
+  if (d_records.size() < d_batchSize || d_fileFailed) {
+    return;
+  }
+  if (d_file == nullptr && !openFile()) {
+    d_fileFailed = true;
+    return;
+  }
+  writeBatch();
+}
+
+void AuthXFRSpool::writeBatch()
+{
+  std::string buffer;
+  for (const auto& rr : d_records) {
+    const auto name = rr.qname.toDNSString();
+    const uint16_t nameLen = name.size();
+    const uint16_t qtype = rr.qtype.getCode();
+    const uint8_t flags = (rr.auth ? 1 : 0) | (rr.disabled ? 2 : 0);
+    const int32_t domainId = rr.domain_id;
+    const uint32_t contentLen = rr.content.size();
+
+    buffer.append(reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
+    buffer.append(name);
+    buffer.append(reinterpret_cast<const char*>(&qtype), sizeof(qtype));
+    buffer.append(reinterpret_cast<const char*>(&rr.qclass), sizeof(rr.qclass));
+    buffer.append(reinterpret_cast<const char*>(&flags), sizeof(flags));
+    buffer.append(reinterpret_cast<const char*>(&rr.ttl), sizeof(rr.ttl));
+    buffer.append(reinterpret_cast<const char*>(&domainId), sizeof(domainId));
+    buffer.append(reinterpret_cast<const char*>(&contentLen), sizeof(contentLen));
+    buffer.append(rr.content);
+  }
+  if (fwrite(buffer.data(), 1, buffer.size(), d_file) != buffer.size()) {
+    throw std::runtime_error("Unable to write to the spool file of an incoming zone transfer: " + stringerror());
+  }
+  d_spilled += d_records.size();
+  d_records.clear();
+}
+
+void AuthXFRSpool::rewind()
+{
+  if (fflush(d_file) != 0 || fseek(d_file, 0, SEEK_SET) != 0) {
+    throw std::runtime_error("Unable to rewind the spool file of an incoming zone transfer: " + stringerror());
+  }
+  d_read = 0;
+}
+
+bool AuthXFRSpool::readBatch(std::vector<DNSResourceRecord>& batch)
+{
+  batch.clear();
+  std::string name;
+  auto readOrThrow = [this](void* dest, size_t len) {
+    if (len > 0 && fread(dest, 1, len, d_file) != len) {
+      throw std::runtime_error("Unable to read from the spool file of an incoming zone transfer");
+    }
+  };
+
+  while (d_read < d_spilled && batch.size() < d_batchSize) {
+    DNSResourceRecord rr;
+    uint16_t nameLen{0};
+    uint16_t qtype{0};
+    uint8_t flags{0};
+    int32_t domainId{0};
+    uint32_t contentLen{0};
+
+    readOrThrow(&nameLen, sizeof(nameLen));
+    name.resize(nameLen);
+    readOrThrow(name.data(), nameLen);
+    rr.qname = DNSName(name.data(), name.size(), 0, false);
+    readOrThrow(&qtype, sizeof(qtype));
+    rr.qtype = qtype;
+    readOrThrow(&rr.qclass, sizeof(rr.qclass));
+    readOrThrow(&flags, sizeof(flags));
+    rr.auth = (flags & 1) != 0;
+    rr.disabled = (flags & 2) != 0;
+    readOrThrow(&rr.ttl, sizeof(rr.ttl));
+    readOrThrow(&domainId, sizeof(domainId));
+    rr.domain_id = domainId;
+    readOrThrow(&contentLen, sizeof(contentLen));
+    rr.content.resize(contentLen);
+    readOrThrow(rr.content.data(), contentLen);
+
+    batch.push_back(std::move(rr));
+    ++d_read;
+  }
+  return !batch.empty();
+}
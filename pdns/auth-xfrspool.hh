@@ -0,0 +1,94 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include "dns.hh"
+
+/** The records of an incoming zone transfer, between retrieval and storage.
+
+    The records can only be stored once the whole transfer has been seen:
+    their 'auth' fields and ordernames depend on the delegations and the NSEC3
+    parameters of the zone, which may come at any point of the transfer. The
+    spool holds up to 'batchSize' records in memory, full batches are appended
+    to an unlinked temporary file in 'directory'. replay() hands the records
+    back in the order they were pushed, one batch at a time, so the memory used
+    does not depend on the size of the zone.
+
+    If the temporary file can not be created, all records stay in memory.
+*/
+class AuthXFRSpool : public boost::noncopyable
+{
+public:
+  AuthXFRSpool(size_t batchSize, std::string directory);
+  ~AuthXFRSpool();
+
+  void push(const DNSResourceRecord& rr);
+  //! Call visitor on each batch of records, in order. The records may be modified.
+  template <typename T>
+  void replay(T visitor)
+  {
+    std::vector<DNSResourceRecord> batch;
+    if (d_file != nullptr) {
+      rewind();
+      while (readBatch(batch)) {
+        visitor(batch);
+      }
+    }
+    if (!d_records.empty()) {
+      visitor(d_records);
+    }
+  }
+
+  size_t size() const
+  {
+    return d_size;
+  }
+  bool empty() const
+  {
+    return d_size == 0;
+  }
+  //! Whether records were written to the temporary file
+  bool spilled() const
+  {
+    return d_spilled > 0;
+  }
+
+private:
+  bool openFile();
+  void writeBatch();
+  void rewind();
+  bool readBatch(std::vector<DNSResourceRecord>& batch);
+
+  std::vector<DNSResourceRecord> d_records;
+  std::string d_directory;
+  FILE* d_file{nullptr};
+  size_t d_batchSize;
+  size_t d_size{0};
+  size_t d_spilled{0};
+  size_t d_read{0};
+  bool d_fileFailed{false};
+};
@@ -27,11 +27,9 @@
 #include "logger.hh"
 #include "statbag.hh"
 #include "arguments.hh"
-#include "cachecleaner.hh"
 extern StatBag S;
 
-AuthZoneCache::AuthZoneCache(size_t mapsCount) :
-  d_maps(mapsCount)
+AuthZoneCache::AuthZoneCache()
 {
   S.declare("zone-cache-hit", "Number of zone cache hits");
   S.declare("zone-cache-miss", "Number of zone cache misses");
@@ -42,17 +40,41 @@ AuthZoneCache::AuthZoneCache(size_t mapsCount) :
   d_statnumentries = S.getPointer("zone-cache-size");
 }
 
-bool AuthZoneCache::getEntry(const DNSName& zone, int& zoneId)
+AuthZoneCache::CacheValue* AuthZoneCache::findExact(const ctree_t& tree, const DNSName& zone)
+{
+  DNSName match;
+  auto* value = tree.lookup(zone, match);
+  if (value != nullptr && match == zone) {
+    return value;
+  }
+  return nullptr;
+}
+
+bool AuthZoneCache::getEntry(LocalStateHolder<ctree_t>& zones, const DNSName& zone, int& zoneId)
 {
-  auto& mc = getMap(zone);
   bool found = false;
-  {
-    auto map = mc.d_map.read_lock();
-    auto iter = map->find(zone);
-    if (iter != map->end()) {
-      found = true;
-      zoneId = iter->second.zoneId;
-    }
+  auto* value = findExact(*zones, zone);
+  if (value != nullptr) {
+    found = true;
+    zoneId = value->zoneId;
+  }
+
+  if (found) {
+    (*d_statnumhit)++;
+  }
+  else {
+    (*d_statnummiss)++;
+  }
+  return found;
+}
+
+bool AuthZoneCache::getClosestEntry(LocalStateHolder<ctree_t>& zones, const DNSName& name, DNSName& zone, int& zoneId)
+{
+  bool found = false;
+  auto* value = zones->lookup(name, zone);
+  if (value != nullptr) {
+    found = true;
+    zoneId = value->zoneId;
   }
 
   if (found) {
@@ -71,7 +93,8 @@ bool AuthZoneCache::isEnabled() const
 
 void AuthZoneCache::clear()
 {
-  purgeLockedCollectionsVector(d_maps);
+  d_zones.setState(ctree_t());
+  d_statnumentries->store(0);
 }
 
 void AuthZoneCache::replace(const vector<std::tuple<DNSName, int>>& zone_indices)
@@ -79,22 +102,18 @@ void AuthZoneCache::replace(const vector<std::tuple<DNSName, int>>& zone_indices
   if (!d_refreshinterval)
     return;
 
-  size_t count = zone_indices.size();
-  vector<cmap_t> newMaps(d_maps.size());
+  size_t count = 0;
+  ctree_t newZones;
 
-  // build new maps
+  // build new tree
   for (const std::tuple<DNSName, int>& tup : zone_indices) {
     const DNSName& zone = std::get<0>(tup);
     CacheValue val;
     val.zoneId = std::get<1>(tup);
-    auto& mc = newMaps[getMapIndex(zone)];
-    auto iter = mc.find(zone);
-    if (iter != mc.end()) {
-      iter->second = std::move(val);
-    }
-    else {
-      mc.emplace(zone, val);
+    if (findExact(newZones, zone) == nullptr) {
+      count++;
     }
+    newZones.add(zone, std::move(val));
   }
 
   {
@@ -106,28 +125,21 @@ void AuthZoneCache::replace(const vector<std::tuple<DNSName, int>>& zone_indices
       CacheValue val;
       val.zoneId = std::get<1>(tup);
       bool insert = std::get<2>(tup);
-      auto& mc = newMaps[getMapIndex(zone)];
-      auto iter = mc.find(zone);
-      if (iter != mc.end()) {
-        if (insert) {
-          iter->second = std::move(val);
-        }
-        else {
-          mc.erase(iter);
-          count--;
+      bool exists = findExact(newZones, zone) != nullptr;
+      if (insert) {
+        if (!exists) {
+          count++;
         }
+        newZones.add(zone, std::move(val));
       }
-      else if (insert) {
-        mc.emplace(zone, val);
-        count++;
+      else if (exists) {
+        newZones.remove(zone);
+        count--;
       }
     }
 
-    for (size_t mapIndex = 0; mapIndex < d_maps.size(); mapIndex++) {
-      auto& mc = d_maps[mapIndex];
-      auto map = mc.d_map.write_lock();
-      *map = std::move(newMaps[mapIndex]);
-    }
+    // the old tree is freed by the last lookup still using it
+    d_zones.setState(std::move(newZones));
 
     pending->d_pendingUpdates.clear();
     pending->d_replacePending = false;
@@ -151,19 +163,13 @@ void AuthZoneCache::add(const DNSName& zone, const int zoneId)
   CacheValue val;
   val.zoneId = zoneId;
 
-  int mapIndex = getMapIndex(zone);
-  {
-    auto& mc = d_maps[mapIndex];
-    auto map = mc.d_map.write_lock();
-    auto iter = map->find(zone);
-    if (iter != map->end()) {
-      iter->second = std::move(val);
-    }
-    else {
-      map->emplace(zone, val);
+  // copies the tree, zones are added far less often than they are looked up
+  d_zones.modify([this, &zone, &val](ctree_t& zones) {
+    if (findExact(zones, zone) == nullptr) {
       (*d_statnumentries)++;
     }
-  }
+    zones.add(zone, std::move(val));
+  });
 }
 
 void AuthZoneCache::remove(const DNSName& zone)
@@ -178,14 +184,12 @@ void AuthZoneCache::remove(const DNSName& zone)
     }
   }
 
-  int mapIndex = getMapIndex(zone);
-  {
-    auto& mc = d_maps[mapIndex];
-    auto map = mc.d_map.write_lock();
-    if (map->erase(zone)) {
+  d_zones.modify([this, &zone](ctree_t& zones) {
+    if (findExact(zones, zone) != nullptr) {
+      zones.remove(zone);
       (*d_statnumentries)--;
     }
-  }
+  });
 }
 
 void AuthZoneCache::setReplacePending()
@@ -20,24 +20,47 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #pragma once
+#include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include "dnsname.hh"
 #include "lock.hh"
 #include "misc.hh"
+#include "sholder.hh"
 
+/** The id of every zone, so the backends need not be asked which zone encloses a name.
+
+    The zones live in a tree by reversed labels, so the closest enclosing zone of a name is
+    found in one walk. The tree is never modified once published: replace() builds a new one,
+    add() and remove() a modified copy, and lookups go through a LocalStateHolder so they
+    take no lock.
+*/
 class AuthZoneCache : public boost::noncopyable
 {
+private:
+  struct CacheValue
+  {
+    int zoneId{-1};
+  };
+
 public:
-  AuthZoneCache(size_t mapsCount = 1024);
+  using ctree_t = SuffixMatchTree<CacheValue>;
+
+  AuthZoneCache();
 
   void replace(const vector<std::tuple<DNSName, int>>& zone);
   void add(const DNSName& zone, const int zoneId);
   void remove(const DNSName& zone);
   void setReplacePending(); //!< call this when data collection for the subsequent replace() call starts.
 
-  bool getEntry(const DNSName& zone, int& zoneId);
+  LocalStateHolder<ctree_t> getLocal()
+  {
+    return d_zones.getLocal();
+  }
+
+  bool getEntry(LocalStateHolder<ctree_t>& zones, const DNSName& zone, int& zoneId);
+  //! finds the closest zone enclosing `name' (which may be `name' itself)
+  bool getClosestEntry(LocalStateHolder<ctree_t>& zones, const DNSName& name, DNSName& zone, int& zoneId);
 
   size_t size() { return *d_statnumentries; } //!< number of entries in the cache
 
@@ -56,32 +79,9 @@ public:
   void clear();
 
 private:
-  struct CacheValue
-  {
-    int zoneId{-1};
-  };
-
-  typedef std::unordered_map<DNSName, CacheValue, std::hash<DNSName>> cmap_t;
-
-  struct MapCombo
-  {
-    MapCombo() {}
-    ~MapCombo() {}
-    MapCombo(const MapCombo&) = delete;
-    MapCombo& operator=(const MapCombo&) = delete;
+  GlobalStateHolder<ctree_t> d_zones;
 
-    SharedLockGuarded<cmap_t> d_map;
-  };
-
-  vector<MapCombo> d_maps;
-  size_t getMapIndex(const DNSName& zone)
-  {
-    return zone.hash() % d_maps.size();
-  }
-  MapCombo& getMap(const DNSName& qname)
-  {
-    return d_maps[getMapIndex(qname)];
-  }
+  static CacheValue* findExact(const ctree_t& tree, const DNSName& zone);
 
   AtomicCounter* d_statnumhit;
   AtomicCounter* d_statnummiss;
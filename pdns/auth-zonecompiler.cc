@@ -0,0 +1,221 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <limits>
+#include <set>
+#include <thread>
+
+#include "auth-zonecompiler.hh"
+#include "dnsrecords.hh"
+#include "dnsseckeeper.hh"
+#include "dnswriter.hh"
+#include "logger.hh"
+#include "threadname.hh"
+
+void AuthZoneCompiler::go()
+{
+  std::thread compiler([this]() { worker(); });
+  compiler.detach();
+}
+
+void AuthZoneCompiler::worker()
+{
+  setThreadName("pdns/compiler");
+
+  for (;;) {
+    DNSName zone;
+    uint64_t generation;
+    d_zones.waitForPending(zone, generation);
+
+    try {
+      if (!d_handler) {
+        d_handler = std::make_unique<PacketHandler>();
+      }
+
+      DTime dt;
+      dt.set();
+      auto compiled = compile(zone);
+      if (!compiled) {
+        continue;
+      }
+      auto names = compiled->d_names.size();
+      auto answers = compiled->d_answers;
+      if (d_zones.store(generation, std::move(compiled))) {
+        g_log << Logger::Info << "Compiled zone '" << zone << "', " << names << " names and " << answers << " answers in " << dt.udiff() / 1000 << " ms" << endl;
+      }
+    }
+    catch (const PDNSException& e) {
+      g_log << Logger::Error << "Unable to compile zone '" << zone << "': " << e.reason << endl;
+      d_handler.reset();
+    }
+    catch (const std::exception& e) {
+      g_log << Logger::Error << "Unable to compile zone '" << zone << "': " << e.what() << endl;
+      d_handler.reset();
+    }
+  }
+}
+
+/* Records the names outside of the zone an answer depends on: owners of records that came from another
+   zone, like the end of a CNAME chain, and targets that are looked up elsewhere when answering, whose
+   records may appear once that other zone is added or changed */
+static void addDependencies(const DNSName& zone, const vector<DNSZoneRecord>& rrs, std::set<DNSName>& dependencies)
+{
+  for (const auto& rr : rrs) {
+    if (rr.dr.d_type == QType::OPT) {
+      continue;
+    }
+    if (!rr.dr.d_name.isPartOf(zone)) {
+      dependencies.insert(rr.dr.d_name);
+    }
+
+    DNSName target;
+    switch (rr.dr.d_type) {
+    case QType::CNAME:
+      target = getRR<CNAMERecordContent>(rr.dr)->getTarget();
+      break;
+    case QType::SVCB: /* fall-through */
+    case QType::HTTPS:
+      target = getRR<SVCBBaseRecordContent>(rr.dr)->getTarget();
+      break;
+    default:
+      continue;
+    }
+    if (!target.empty() && !target.isRoot() && !target.isPartOf(zone)) {
+      dependencies.insert(target);
+    }
+  }
+}
+
+bool AuthZoneCompiler::render(const DNSName& zone, const DNSName& qname, uint16_t qtype, AuthCompiledZones::answers_t& answers, std::set<DNSName>& dependencies)
+{
+  AuthCompiledZones::answers_t rendered;
+  for (const auto variant : {AuthCompiledZones::NoEDNS, AuthCompiledZones::EDNS, AuthCompiledZones::EDNSWithDO}) {
+    vector<uint8_t> packet;
+    DNSPacketWriter pw(packet, qname, qtype);
+    if (variant != AuthCompiledZones::NoEDNS) {
+      /* the answer is then limited by udp-truncation-threshold only */
+      pw.addOpt(std::numeric_limits<uint16_t>::max(), 0, variant == AuthCompiledZones::EDNSWithDO ? EDNSOpts::DNSSECOK : 0);
+    }
+    pw.commit();
+
+    DNSPacket question(true);
+    if (question.parse(reinterpret_cast<const char*>(packet.data()), packet.size()) < 0) {
+      return false;
+    }
+
+    auto answer = d_handler->question(question);
+    if (!answer || answer->d.rcode != RCode::NoError) {
+      return false;
+    }
+    for (const auto& record : answer->getRRS()) {
+      if (record.scopeMask != 0) {
+        return false;
+      }
+    }
+    addDependencies(zone, answer->getRRS(), dependencies);
+
+    auto& compiled = rendered[variant];
+    compiled.d_packet = answer->getString();
+    compiled.d_truncated = reinterpret_cast<const dnsheader*>(compiled.d_packet.data())->tc;
+  }
+
+  answers = std::move(rendered);
+  return true;
+}
+
+std::shared_ptr<AuthCompiledZones::Zone> AuthZoneCompiler::compile(const DNSName& zone)
+{
+  UeberBackend* B = d_handler->getBackend();
+  DNSSECKeeper dk(B);
+
+  if (dk.isSecuredZone(zone, false) && !dk.isPresigned(zone, false)) {
+    g_log << Logger::Warning << "Not compiling zone '" << zone << "', which is signed online" << endl;
+    return nullptr;
+  }
+
+  SOAData sd;
+  if (!B->getSOAUncached(zone, sd)) {
+    g_log << Logger::Warning << "Not compiling zone '" << zone << "', which has no SOA" << endl;
+    return nullptr;
+  }
+
+  std::map<DNSName, std::set<uint16_t>> types;
+  std::set<DNSName> dynamic;
+  if (!sd.db->list(zone, sd.domain_id)) {
+    throw PDNSException("backend signals error condition while listing the zone");
+  }
+
+  DNSZoneRecord zrr;
+  while (sd.db->get(zrr)) {
+    if (!zrr.dr.d_name.isPartOf(zone)) {
+      continue;
+    }
+    if (zrr.dr.d_type == QType::ALIAS || zrr.dr.d_type == QType::LUA) {
+      dynamic.insert(zrr.dr.d_name);
+    }
+    auto& nameTypes = types[zrr.dr.d_name];
+    if (zrr.dr.d_type != QType::ENT) {
+      nameTypes.insert(zrr.dr.d_type);
+    }
+  }
+
+  auto compiled = std::make_shared<AuthCompiledZones::Zone>();
+  compiled->d_zone = zone;
+  compiled->d_names.reserve(types.size() - dynamic.size());
+  std::set<DNSName> dependencies;
+
+  for (const auto& name : types) {
+    if (dynamic.count(name.first) != 0) {
+      continue;
+    }
+
+    AuthCompiledZones::Name entry;
+    for (const auto type : name.second) {
+      if (!AuthCompiledZones::isCompilableType(type)) {
+        continue;
+      }
+      AuthCompiledZones::answers_t answers;
+      if (render(zone, name.first, type, answers, dependencies)) {
+        entry.d_types.emplace_back(type, std::move(answers));
+        compiled->d_answers++;
+      }
+    }
+
+    /* the answer to a type that does not exist is the same for all of them, except
+       when a CNAME sends us elsewhere */
+    if (name.second.count(QType::CNAME) == 0 && name.second.count(AuthCompiledZones::s_noDataType) == 0) {
+      if (render(zone, name.first, AuthCompiledZones::s_noDataType, entry.d_noData, dependencies)) {
+        compiled->d_answers++;
+      }
+    }
+
+    if (!entry.d_types.empty() || !entry.d_noData[AuthCompiledZones::NoEDNS].d_packet.empty()) {
+      entry.d_types.shrink_to_fit();
+      compiled->d_names.emplace(name.first, std::move(entry));
+    }
+  }
+
+  compiled->d_dependencies.assign(dependencies.begin(), dependencies.end());
+  return compiled;
+}
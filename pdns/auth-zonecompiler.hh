@@ -0,0 +1,53 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <memory>
+#include <set>
+
+#include "auth-compiledzone.hh"
+#include "packethandler.hh"
+
+/** Renders the answers of the zones queued by AuthCompiledZones, by asking the
+    PacketHandler the same questions a client would, so compiled answers are identical
+    to the ones sent for a cache miss. Zones that are signed online are not compiled,
+    as their signatures would expire, and names holding records synthesized at query
+    time (ALIAS, LUA) or answers depending on the client are left to the backends.
+    The names outside of the zone that answers depend on are recorded, so that a change
+    to them drops the compiled zone. */
+class AuthZoneCompiler
+{
+public:
+  AuthZoneCompiler(AuthCompiledZones& zones) :
+    d_zones(zones)
+  {
+  }
+
+  void go(); //!< starts the compiler thread
+
+private:
+  void worker();
+  std::shared_ptr<AuthCompiledZones::Zone> compile(const DNSName& zone);
+  bool render(const DNSName& zone, const DNSName& qname, uint16_t qtype, AuthCompiledZones::answers_t& answers, std::set<DNSName>& dependencies);
+
+  AuthCompiledZones& d_zones;
+  std::unique_ptr<PacketHandler> d_handler{nullptr};
+};
@@ -465,6 +465,10 @@ void GSQLBackend::getUnfreshSlaveInfos(vector<DomainInfo> *unfreshDomains)
         continue;
       }
       di.serial = sd.serial;
+      di.last_check = last_check;
+    }
+    else {
+      di.last_check = 0;
     }
 
     try {
@@ -1326,8 +1330,65 @@ bool GSQLBackend::setDomainMetadata(const DNSName& name, const std::string& kind
   return true;
 }
 
+void GSQLBackend::prefetch(const QType& qtype, const vector<DNSName>& qnames, int domain_id)
+{
+  d_prefetched.clear();
+  if (qtype.getCode() != QType::ANY || domain_id < 0 || qnames.size() < 2) {
+    return;
+  }
+
+  vector<SSqlStatement::row_t> params;
+  params.reserve(qnames.size());
+  for (const auto& qname : qnames) {
+    // same order and format as the binds in lookup()
+    params.push_back({qname.makeLowerCase().toStringRootDot(), std::to_string(domain_id)});
+  }
+
+  vector<SSqlStatement::result_t> results;
+  try {
+    reconnectIfNeeded();
+
+    if (!d_ANYIdQuery_stmt->executeBatch(params, results)) {
+      return;
+    }
+  }
+  catch (SSqlException &e) {
+    throw PDNSException("GSQLBackend unable to prefetch " + std::to_string(qnames.size()) + " names: " + e.txtReason());
+  }
+
+  for (size_t idx = 0; idx < qnames.size() && idx < results.size(); ++idx) {
+    d_prefetched[qnames.at(idx)] = std::move(results.at(idx));
+  }
+  d_prefetchedZone = domain_id;
+}
+
+void GSQLBackend::endPrefetch()
+{
+  d_prefetched.clear();
+}
+
 void GSQLBackend::lookup(const QType& qtype, const DNSName& qname, int domain_id, DNSPacket* /* pkt_p */)
 {
+  if (!d_prefetched.empty()) {
+    auto iter = d_prefetched.end();
+    if (qtype.getCode() == QType::ANY && domain_id == d_prefetchedZone) {
+      iter = d_prefetched.find(qname);
+    }
+    if (iter != d_prefetched.end()) {
+      d_prefetchedResult = std::move(iter->second);
+      d_prefetchedRow = 0;
+      d_usePrefetched = true;
+      d_prefetched.erase(iter);
+      d_query_name = "any-id-query";
+      d_list = false;
+      d_qname = qname;
+      return;
+    }
+    // anything else means the lookups we prefetched for are over
+    d_prefetched.clear();
+  }
+  d_usePrefetched = false;
+
   try {
     reconnectIfNeeded();
 
@@ -1393,6 +1454,8 @@ bool GSQLBackend::list(const DNSName &target, int domain_id, bool include_disabl
 
   d_list=true;
   d_qname.clear();
+  d_prefetched.clear();
+  d_usePrefetched=false;
 
   return true;
 }
@@ -1418,6 +1481,8 @@ bool GSQLBackend::listSubZone(const DNSName &zone, int domain_id) {
 
   d_list=false;
   d_qname.clear();
+  d_prefetched.clear();
+  d_usePrefetched=false;
 
   return true;
 }
@@ -1427,6 +1492,22 @@ bool GSQLBackend::get(DNSResourceRecord &r)
   // g_log << "GSQLBackend get() was called for "<<qtype.toString() << " record: ";
   SSqlStatement::row_t row;
 
+  if (d_usePrefetched) {
+    while (d_prefetchedRow < d_prefetchedResult.size()) {
+      auto& prefetchedRow = d_prefetchedResult.at(d_prefetchedRow++);
+      ASSERT_ROW_COLUMNS(d_query_name, prefetchedRow, 8);
+      try {
+        extractRecord(prefetchedRow, r);
+      } catch (...) {
+        continue;
+      }
+      return true;
+    }
+    d_prefetchedResult.clear();
+    d_usePrefetched = false;
+    return false;
+  }
+
 skiprow:
   if((*d_query_stmt)->hasNextRow()) {
     try {
@@ -195,6 +195,8 @@ protected:
 
 public:
   void lookup(const QType &, const DNSName &qdomain, int zoneId, DNSPacket *p=nullptr) override;
+  void prefetch(const QType& qtype, const vector<DNSName>& qdomains, int zoneId) override;
+  void endPrefetch() override;
   bool list(const DNSName &target, int domain_id, bool include_disabled=false) override;
   bool get(DNSResourceRecord &r) override;
   void getAllDomains(vector<DomainInfo>* domains, bool getSerial, bool include_disabled) override;
@@ -288,6 +290,13 @@ protected:
   SSqlStatement::result_t d_result;
   unique_ptr<SSqlStatement>* d_query_stmt;
 
+  // answers to ANY lookups fetched by prefetch(), handed out by the next lookup() of that name
+  std::map<DNSName, SSqlStatement::result_t> d_prefetched;
+  int d_prefetchedZone{-1};
+  SSqlStatement::result_t d_prefetchedResult;
+  size_t d_prefetchedRow{0};
+  bool d_usePrefetched{false};
+
 private:
   string d_NoIdQuery;
   string d_IdQuery;
@@ -69,6 +69,13 @@ public:
   virtual SSqlStatement* getResult(result_t& result)=0;
   virtual SSqlStatement* reset()=0;
   virtual const std::string& getQuery()=0;
+  /* Runs the statement once for each row of params, binding the values in order, and stores the
+     rows of each run in results. Drivers that can do this in a single round-trip to the database
+     override this; the default returns false and leaves it to the caller to run them one by one. */
+  virtual bool executeBatch(const vector<row_t>& /* params */, vector<result_t>& /* results */)
+  {
+    return false;
+  }
   virtual ~SSqlStatement();
 };
 
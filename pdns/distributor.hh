@@ -31,6 +31,9 @@
 #include <pthread.h>
 #include "threadname.hh"
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 #include "logger.hh"
 #include "dns.hh"
 #include "dnsbackend.hh"
@@ -39,6 +42,7 @@
 #include <atomic>
 #include "statbag.hh"
 #include "gss_context.hh"
+#include "mpsc-queue.hh"
 
 extern StatBag S;
 
@@ -58,6 +62,7 @@ public:
   typedef std::function<void(std::unique_ptr<Answer>&, int)> callback_t;
   virtual int question(Question&, callback_t callback) =0; //!< Submit a question to the Distributor
   virtual int getQueueSize() =0; //!< Returns length of question queue
+  virtual double getQueueWait() =0; //!< Returns the average time in microseconds a question waited for a backend thread
   virtual bool isOverloaded() =0;
   virtual ~Distributor() { cerr<<__func__<<endl;}
 };
@@ -75,6 +80,10 @@ public:
     return 0;
   }
 
+  double getQueueWait() override {
+    return 0;
+  }
+
   bool isOverloaded() override
   {
     return false;
@@ -98,6 +107,10 @@ public:
     return d_queued;
   }
 
+  double getQueueWait() override {
+    return d_queueWait;
+  }
+
   struct QuestionData
   {
     QuestionData(const Question& query): Q(query)
@@ -117,12 +130,31 @@ public:
   }
 
 private:
-  int nextid;
+  /* Questions for one backend thread. The thread only sleeps once its queue is
+     empty, and producers only wake it up if it does, so a busy thread
+     takes a whole batch of questions without any system call. */
+  struct ThreadQueue
+  {
+    ThreadQueue(size_t capacity);
+    ~ThreadQueue();
+    void wait();
+    void notify();
+
+    pdns::MPSCQueue<QuestionData*> d_questions;
+    std::atomic<bool> d_sleeping{false};
+    int d_readFD{-1};
+    int d_writeFD{-1};
+  };
+
+  ThreadQueue& pickQueue();
+
+  std::atomic<unsigned int> nextid{0}; // the TCP workers share a Distributor
   time_t d_last_started;
   unsigned int d_overloadQueueLength, d_maxQueueLength;
   int d_num_threads;
   std::atomic<unsigned int> d_queued{0};
-  std::vector<std::pair<int,int>> d_pipes;
+  std::atomic<double> d_queueWait{0.0};
+  std::vector<std::unique_ptr<ThreadQueue>> d_queues;
 };
 
 //template<class Answer, class Question, class Backend>::nextid;
@@ -159,14 +191,11 @@ template<class Answer, class Question, class Backend>MultiThreadDistributor<Answ
   d_num_threads=n;
   d_overloadQueueLength=::arg().asNum("overload-queue-length");
   d_maxQueueLength=::arg().asNum("max-queue-length");
-  nextid=0;
   d_last_started=time(0);
 
   for(int i=0; i < n; ++i) {
-    int fds[2];
-    if(pipe(fds) < 0)
-      unixDie("Creating pipe");
-    d_pipes.emplace_back(fds[0], fds[1]);
+    // room for the whole max-queue-length in every queue, so that limit is the one that matters
+    d_queues.push_back(std::make_unique<ThreadQueue>(d_maxQueueLength + 1));
   }
   
   if (n<1) {
@@ -184,6 +213,68 @@ template<class Answer, class Question, class Backend>MultiThreadDistributor<Answ
 }
 
 
+template<class Answer, class Question, class Backend>MultiThreadDistributor<Answer,Question,Backend>::ThreadQueue::ThreadQueue(size_t capacity) :
+  d_questions(capacity)
+{
+#ifdef __linux__
+  d_readFD = d_writeFD = eventfd(0, EFD_CLOEXEC);
+  if(d_readFD < 0)
+    unixDie("Creating eventfd");
+#else
+  int fds[2];
+  if(pipe(fds) < 0)
+    unixDie("Creating pipe");
+  d_readFD = fds[0];
+  d_writeFD = fds[1];
+#endif
+}
+
+template<class Answer, class Question, class Backend>MultiThreadDistributor<Answer,Question,Backend>::ThreadQueue::~ThreadQueue()
+{
+  close(d_readFD);
+  if(d_writeFD != d_readFD)
+    close(d_writeFD);
+}
+
+template<class Answer, class Question, class Backend>void MultiThreadDistributor<Answer,Question,Backend>::ThreadQueue::wait()
+{
+  d_sleeping.store(true);
+  // pairs with the fence in notify(): either we see the new question, or they see us sleeping
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(!d_questions.empty()) {
+    d_sleeping.store(false);
+    return;
+  }
+
+#ifdef __linux__
+  uint64_t value;
+#else
+  char value;
+#endif
+  while(read(d_readFD, &value, sizeof(value)) != sizeof(value)) {
+    if(errno != EINTR)
+      unixDie("read");
+  }
+  d_sleeping.store(false);
+}
+
+template<class Answer, class Question, class Backend>void MultiThreadDistributor<Answer,Question,Backend>::ThreadQueue::notify()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(!d_sleeping.exchange(false))
+    return;
+
+#ifdef __linux__
+  uint64_t value = 1;
+#else
+  char value = 1;
+#endif
+  while(write(d_writeFD, &value, sizeof(value)) != sizeof(value)) {
+    if(errno != EINTR)
+      unixDie("write");
+  }
+}
+
 // start of a new thread
 template<class Answer, class Question, class Backend>void MultiThreadDistributor<Answer,Question,Backend>::distribute(int ournum)
 {
@@ -193,19 +284,23 @@ template<class Answer, class Question, class Backend>void MultiThreadDistributor
   try {
     std::unique_ptr<Backend> b= make_unique<Backend>(); // this will answer our questions
     int queuetimeout=::arg().asNum("queue-limit"); 
+    ThreadQueue& queue = *d_queues.at(ournum);
 
     for(;;) {
     
       QuestionData* tempQD = nullptr;
-      if(read(d_pipes.at(ournum).first, &tempQD, sizeof(tempQD)) != sizeof(tempQD))
-	unixDie("read");
+      while(!queue.d_questions.pop(tempQD))
+        queue.wait();
       --d_queued;
       std::unique_ptr<QuestionData> QD = std::unique_ptr<QuestionData>(tempQD);
       tempQD = nullptr;
       std::unique_ptr<Answer> a = nullptr;
 
+      d_queueWait = 0.999 * d_queueWait + 0.001 * QD->Q.d_dt.udiffNoReset();
+
       if(queuetimeout && QD->Q.d_dt.udiff()>queuetimeout*1000) {
         S.inc("timedout-packets");
+        QD->callback(a, QD->start); // no answer, but the caller might be waiting for one
         continue;
       }        
 
@@ -325,23 +420,46 @@ retry:
 
 struct DistributorFatal{};
 
+//! Returns the queue of the least busy thread, starting the search at the next one in turn so ties are spread evenly
+template<class Answer, class Question, class Backend>typename MultiThreadDistributor<Answer,Question,Backend>::ThreadQueue& MultiThreadDistributor<Answer,Question,Backend>::pickQueue()
+{
+  const size_t count = d_queues.size();
+  const size_t first = nextid % count;
+  size_t best = first;
+  size_t bestSize = d_queues[first]->d_questions.size();
+
+  for(size_t n = 1; n < count && bestSize > 0; ++n) {
+    size_t idx = (first + n) % count;
+    size_t size = d_queues[idx]->d_questions.size();
+    if(size < bestSize) {
+      best = idx;
+      bestSize = size;
+    }
+  }
+
+  return *d_queues[best];
+}
+
 template<class Answer, class Question, class Backend>int MultiThreadDistributor<Answer,Question,Backend>::question(Question& q, callback_t callback)
 {
-  // this is passed to other process over pipe and released there
+  // this is passed to another thread through its queue and released there
   auto QD=new QuestionData(q);
-  auto ret = QD->id = nextid++; // might be deleted after write!
+  ThreadQueue& queue = pickQueue();
+  auto ret = QD->id = static_cast<int>(nextid++); // might be deleted after push!
   QD->callback=callback;
 
   ++d_queued;
-  if(write(d_pipes.at(QD->id % d_pipes.size()).second, &QD, sizeof(QD)) != sizeof(QD)) {
+  if(!queue.d_questions.push(QD)) {
     --d_queued;
     delete QD;
-    unixDie("write");
+    g_log<<Logger::Error<<"Queue of a backend thread is full, respawning"<<endl;
+    throw DistributorFatal();
   }
+  queue.notify();
 
   if(d_queued > d_maxQueueLength) {
     g_log<<Logger::Error<< d_queued <<" questions waiting for database/backend attention. Limit is "<<::arg().asNum("max-queue-length")<<", respawning"<<endl;
-    // this will leak the entire contents of all pipes, nothing will be freed. Respawn when this happens!
+    // this will leak the entire contents of all queues, nothing will be freed. Respawn when this happens!
     throw DistributorFatal();
   }
 
@@ -156,6 +156,10 @@ public:
   virtual void lookup(const QType &qtype, const DNSName &qdomain, int zoneId=-1, DNSPacket *pkt_p=nullptr)=0;
   virtual bool get(DNSResourceRecord &)=0; //!< retrieves one DNSResource record, returns false if no more were available
   virtual bool get(DNSZoneRecord &r);
+  //! Announces that lookup() is about to be called for each of qdomains, so the backend can fetch them in one go. Only a hint, the default does nothing
+  virtual void prefetch(const QType& /* qtype */, const vector<DNSName>& /* qdomains */, int /* zoneId */) {}
+  //! The lookups announced by prefetch() are over, whatever was fetched and not looked up yet must be dropped
+  virtual void endPrefetch() {}
 
   //! Initiates a list of the specified domain
   /** Once initiated, DNSResourceRecord objects can be retrieved using get(). Should return false
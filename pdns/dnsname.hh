@@ -462,6 +462,39 @@ struct SuffixMatchTree
     return nullptr;
   }
 
+  /* like lookup(), but also sets `match' to the name of the node that was found,
+     in the same walk */
+  T* lookup(const DNSName& name, DNSName& match) const
+  {
+    const SuffixMatchTree* best = endNode ? this : nullptr;
+    size_t bestDepth = 0;
+    size_t depth = 0;
+    const SuffixMatchTree* node = this;
+    auto visitor = name.getRawLabelsVisitor();
+    while (!visitor.empty()) {
+      const LightKey lk{visitor.back()};
+      auto child = node->children.find(lk);
+      if (child == node->children.end()) {
+        break;
+      }
+      visitor.pop_back();
+      depth++;
+      node = &*child;
+      if (node->endNode) {
+        best = node;
+        bestDepth = depth;
+      }
+    }
+    if (best == nullptr) {
+      return nullptr;
+    }
+    match = name;
+    for (auto labels = name.countLabels(); labels > bestDepth; labels--) {
+      match.chopOff();
+    }
+    return &best->d_value;
+  }
+
   std::optional<DNSName> getBestMatch(const DNSName& name) const
   {
     if (children.empty()) { // speed up empty set
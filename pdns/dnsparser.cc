@@ -78,6 +78,45 @@ void UnknownRecordContent::toPacket(DNSPacketWriter& pw) const
   pw.xfrBlob(string(d_record.begin(),d_record.end()));
 }
 
+string WireRecordContent::getZoneRepresentation(bool noDot) const
+{
+  return DNSRecordContent::deserialize(g_rootdnsname, d_qtype, d_record)->getZoneRepresentation(noDot);
+}
+
+void WireRecordContent::toPacket(DNSPacketWriter& pw) const
+{
+  pw.xfrBlob(d_record);
+}
+
+bool WireRecordContent::isPassThroughType(uint16_t qtype)
+{
+  switch (qtype) {
+  case QType::TXT:
+  case QType::SPF:
+  case QType::HINFO:
+  case QType::LOC:
+  case QType::CERT:
+  case QType::SSHFP:
+  case QType::DHCID:
+  case QType::TLSA:
+  case QType::SMIMEA:
+  case QType::OPENPGPKEY:
+  case QType::URI:
+  case QType::CAA:
+    return true;
+  default:
+    return false;
+  }
+}
+
+shared_ptr<DNSRecordContent> WireRecordContent::make(const DNSName& qname, uint16_t qtype, std::string_view content)
+{
+  if (isPassThroughType(qtype)) {
+    return std::make_shared<WireRecordContent>(qtype, content);
+  }
+  return DNSRecordContent::deserialize(qname, qtype, string(content));
+}
+
 shared_ptr<DNSRecordContent> DNSRecordContent::deserialize(const DNSName& qname, uint16_t qtype, const string& serialized)
 {
   dnsheader dnsheader;
@@ -449,6 +449,38 @@ private:
   vector<uint8_t> d_record;
 };
 
+/* Holds the content of a record in wire format, as stored by a backend, and writes it back as is.
+   Only used for types whose content has no names that could be compressed, and which are never looked
+   into when answering a query, see isPassThroughType(). The zone representation is computed on demand. */
+class WireRecordContent : public DNSRecordContent
+{
+public:
+  WireRecordContent(uint16_t qtype, std::string_view content) :
+    d_record(content), d_qtype(qtype)
+  {
+  }
+
+  string getZoneRepresentation(bool noDot) const override;
+  void toPacket(DNSPacketWriter& pw) const override;
+  uint16_t getType() const override
+  {
+    return d_qtype;
+  }
+
+  const string& getRawContent() const
+  {
+    return d_record;
+  }
+
+  static bool isPassThroughType(uint16_t qtype);
+  //! Parses content in wire format without compression pointers, as produced by serialize(), or wraps it in a WireRecordContent
+  static std::shared_ptr<DNSRecordContent> make(const DNSName& qname, uint16_t qtype, std::string_view content);
+
+private:
+  string d_record;
+  uint16_t d_qtype;
+};
+
 //! This class can be used to parse incoming packets, and is copyable
 class MOADNSParser : public boost::noncopyable
 {
@@ -24,8 +24,10 @@
 #endif
 
 #include <sys/types.h>
+#include <limits>
 #include <thread>
 
+#include "cachecleaner.hh"
 #include "packetcache.hh"
 #include "utility.hh"
 #include "dnsproxy.hh"
@@ -45,6 +47,11 @@ DNSProxy::DNSProxy(const string &remote): d_xor(dns_random_uint16())
   d_resanswers=S.getPointer("recursing-answers");
   d_resquestions=S.getPointer("recursing-questions");
   d_udpanswers=S.getPointer("udp-answers");
+  d_aliascachehits=S.getPointer("alias-cache-hits");
+  d_aliascachemisses=S.getPointer("alias-cache-misses");
+  d_aliascacherefreshes=S.getPointer("alias-cache-refreshes");
+  d_aliascachemaxentries=::arg().asNum("alias-cache-max-entries");
+  d_aliascacherefreshperc=::arg().asNum("alias-cache-refresh-ttl-perc");
 
   vector<string> addresses;
   stringtok(addresses, remote, " ,\t");
@@ -96,9 +103,9 @@ bool DNSProxy::completePacket(std::unique_ptr<DNSPacket>& r, const DNSName& targ
     int ret1 = 0, ret2 = 0;
 
     if(r->qtype == QType::A || r->qtype == QType::ANY)
-      ret1 = stubDoResolve(target, QType::A, ips);
+      ret1 = resolveAlias(target, QType::A, ips);
     if(r->qtype == QType::AAAA || r->qtype == QType::ANY)
-      ret2 = stubDoResolve(target, QType::AAAA, ips);
+      ret2 = resolveAlias(target, QType::AAAA, ips);
 
     if(ret1 != RCode::NoError || ret2 != RCode::NoError) {
       g_log<<Logger::Error<<"Error resolving for "<<aname<<" ALIAS "<<target<<" over UDP, original query came in over TCP";
@@ -127,6 +134,13 @@ bool DNSProxy::completePacket(std::unique_ptr<DNSPacket>& r, const DNSName& targ
     return true;
   }
 
+  if(completeFromAliasCache(*r, target, aname)) {
+    sendReply(*r);
+    (*d_udpanswers)++;
+    r.reset();
+    return true;
+  }
+
   uint16_t id;
   uint16_t qtype = r->qtype.getCode();
   {
@@ -147,6 +161,13 @@ bool DNSProxy::completePacket(std::unique_ptr<DNSPacket>& r, const DNSName& targ
     (*conntrack)[id]=std::move(ce);
   }
 
+  sendQuery(target, qtype, id);
+  return true;
+
+}
+
+void DNSProxy::sendQuery(const DNSName& target, uint16_t qtype, uint16_t id)
+{
   vector<uint8_t> packet;
   DNSPacketWriter pw(packet, target, qtype);
   pw.getHeader()->rd=true;
@@ -155,9 +176,251 @@ bool DNSProxy::completePacket(std::unique_ptr<DNSPacket>& r, const DNSName& targ
   if(send(d_sock,&packet[0], packet.size() , 0)<0) { // zoom
     g_log<<Logger::Error<<"Unable to send a packet to our recursing backend: "<<stringerror()<<endl;
   }
+}
+
+void DNSProxy::sendReply(DNSPacket& r)
+{
+  struct msghdr msgh;
+  struct iovec iov;
+  cmsgbuf_aligned cbuf;
+
+  /* Set up iov and msgh structures. */
+  memset(&msgh, 0, sizeof(struct msghdr));
+  const string& reply = r.getString();
+  iov.iov_base = (void*)reply.c_str();
+  iov.iov_len = reply.length();
+  msgh.msg_iov = &iov;
+  msgh.msg_iovlen = 1;
+  msgh.msg_name = (struct sockaddr*)&r.d_remote;
+  msgh.msg_namelen = r.d_remote.getSocklen();
+  msgh.msg_control=nullptr;
+
+  if(r.d_anyLocal) {
+    addCMsgSrcAddr(&msgh, &cbuf, r.d_anyLocal.get_ptr(), 0);
+  }
+  if(sendmsg(r.getSocket(), &msgh, 0) < 0) {
+    int err = errno;
+    g_log<<Logger::Warning<<"dnsproxy.cc: Error sending reply with sendmsg (socket="<<r.getSocket()<<"): "<<stringerror(err)<<endl;
+  }
+}
+
+//! returns false if the entry is missing or expired, sets refresh if the caller has to send a refresh of the entry
+bool DNSProxy::getFromAliasCache(const DNSName& target, uint16_t qtype, vector<DNSRecord>& records, bool& refresh)
+{
+  time_t now = time(nullptr);
+  auto cache = d_aliascache.lock();
+  auto entry = cache->find(std::tie(target, qtype));
+  if(entry == cache->end()) {
+    (*d_aliascachemisses)++;
+    return false;
+  }
+  if(entry->ttd <= now) {
+    cache->erase(entry);
+    (*d_aliascachemisses)++;
+    return false;
+  }
+
+  uint32_t left = entry->ttd - now;
+  for(const auto& record : entry->records) {
+    records.push_back(record);
+    records.back().d_ttl = left;
+  }
+  if(!entry->refreshing && static_cast<uint64_t>(left) * 100 < static_cast<uint64_t>(entry->ttl) * d_aliascacherefreshperc) {
+    entry->refreshing = true;
+    refresh = true;
+  }
+  moveCacheItemToBack<SequencedTag>(*cache, entry);
+  (*d_aliascachehits)++;
+  return true;
+}
+
+//! fills in r from the ALIAS cache, if all the types it needs are there
+bool DNSProxy::completeFromAliasCache(DNSPacket& r, const DNSName& target, const DNSName& aname)
+{
+  if(d_aliascachemaxentries == 0) {
+    return false;
+  }
+
+  const uint16_t qtype = r.qtype.getCode();
+  vector<uint16_t> qtypes;
+  if(qtype == QType::ANY) {
+    qtypes = {QType::A, QType::AAAA};
+  }
+  else {
+    qtypes = {qtype};
+  }
+
+  vector<DNSRecord> records;
+  vector<uint16_t> refresh;
+  bool complete = true;
+  for(const auto type : qtypes) {
+    bool needsRefresh = false;
+    if(!getFromAliasCache(target, type, records, needsRefresh)) {
+      /* the answer to the query we are about to send fills the cache, for ANY too */
+      complete = false;
+    }
+    else if(needsRefresh) {
+      refresh.push_back(type);
+    }
+  }
+
+  for(const auto type : refresh) {
+    refreshAlias(target, type);
+  }
+
+  if(!complete) {
+    return false;
+  }
 
+  for(auto& record : records) {
+    DNSZoneRecord dzr;
+    dzr.dr = std::move(record);
+    dzr.dr.d_name = aname;
+    dzr.dr.d_place = DNSResourceRecord::ANSWER;
+    r.addRecord(std::move(dzr));
+  }
+  r.setRcode(RCode::NoError);
   return true;
+}
+
+//! resolves target synchronously, unless the answer is in the ALIAS cache
+int DNSProxy::resolveAlias(const DNSName& target, uint16_t qtype, vector<DNSZoneRecord>& ips)
+{
+  if(d_aliascachemaxentries > 0) {
+    vector<DNSRecord> records;
+    bool refresh = false;
+    if(getFromAliasCache(target, qtype, records, refresh)) {
+      if(refresh) {
+        refreshAlias(target, qtype);
+      }
+      for(auto& record : records) {
+        DNSZoneRecord zrr;
+        zrr.dr = std::move(record);
+        ips.push_back(std::move(zrr));
+      }
+      return RCode::NoError;
+    }
+  }
+
+  vector<DNSZoneRecord> resolved;
+  int ret = stubDoResolve(target, qtype, resolved);
+  if(ret == RCode::NoError && d_aliascachemaxentries > 0 && !resolved.empty()) {
+    /* stubDoResolve does not tell us how long a NODATA answer can be cached, only positive answers are */
+    vector<DNSRecord> records;
+    uint32_t ttl = std::numeric_limits<uint32_t>::max();
+    for(const auto& zrr : resolved) {
+      ttl = std::min(ttl, zrr.dr.d_ttl);
+      records.push_back(zrr.dr);
+    }
+    addToAliasCache(target, qtype, std::move(records), ttl);
+  }
+  for(auto& zrr : resolved) {
+    ips.push_back(std::move(zrr));
+  }
+  return ret;
+}
+
+/* cacheNoData is false for the types taken from an answer to ANY, which a resolver is free to
+   answer with only some of the types it has (RFC 8482), so a missing type says nothing */
+void DNSProxy::addToAliasCache(const DNSName& target, uint16_t qtype, const MOADNSParser& mdp, bool cacheNoData)
+{
+  if(d_aliascachemaxentries == 0) {
+    return;
+  }
+
+  vector<DNSRecord> records;
+  uint32_t ttl = std::numeric_limits<uint32_t>::max();
+  bool haveSOA = false;
+  if(mdp.d_header.rcode == RCode::NoError) {
+    for(const auto& answer : mdp.d_answers) {
+      if(answer.first.d_place == DNSResourceRecord::ANSWER && answer.first.d_type == qtype) {
+        ttl = std::min(ttl, answer.first.d_ttl);
+        records.push_back(answer.first);
+        records.back().d_name = target;
+      }
+      else if(answer.first.d_place == DNSResourceRecord::AUTHORITY && answer.first.d_type == QType::SOA) {
+        haveSOA = true;
+      }
+    }
+    if(records.empty() && haveSOA) {
+      /* NODATA, cached for the TTL of the SOA record, which is capped by its minimum by the resolver */
+      for(const auto& answer : mdp.d_answers) {
+        if(answer.first.d_place == DNSResourceRecord::AUTHORITY && answer.first.d_type == QType::SOA) {
+          ttl = std::min(ttl, answer.first.d_ttl);
+        }
+      }
+    }
+  }
+
+  if(records.empty() && !cacheNoData) {
+    return;
+  }
+  if(records.empty() && !haveSOA) {
+    /* nothing we can cache, keep what we had so the next hit tries again */
+    auto cache = d_aliascache.lock();
+    auto entry = cache->find(std::tie(target, qtype));
+    if(entry != cache->end()) {
+      entry->refreshing = false;
+    }
+    return;
+  }
+
+  addToAliasCache(target, qtype, std::move(records), ttl);
+}
+
+void DNSProxy::addToAliasCache(const DNSName& target, uint16_t qtype, vector<DNSRecord>&& records, uint32_t ttl)
+{
+  if(ttl == 0) {
+    return;
+  }
+
+  time_t now = time(nullptr);
+  auto cache = d_aliascache.lock();
+  auto entry = cache->find(std::tie(target, qtype));
+  if(entry == cache->end()) {
+    if(cache->size() >= d_aliascachemaxentries) {
+      cache->get<SequencedTag>().pop_front();
+    }
+    AliasCacheEntry newEntry;
+    newEntry.target = target;
+    newEntry.qtype = qtype;
+    entry = cache->insert(std::move(newEntry)).first;
+  }
+  else {
+    moveCacheItemToBack<SequencedTag>(*cache, entry);
+  }
 
+  entry->records = std::move(records);
+  entry->ttd = now + ttl;
+  entry->ttl = ttl;
+  entry->refreshing = false;
+}
+
+//! asks the resolver for target again, the answer only updates the ALIAS cache
+void DNSProxy::refreshAlias(const DNSName& target, uint16_t qtype)
+{
+  uint16_t id;
+  {
+    auto conntrack = d_conntrack.lock();
+    id = getID_locked(*conntrack);
+
+    ConntrackEntry ce;
+    ce.id       = 0;
+    ce.outsock  = -1;
+    ce.created  = time( nullptr );
+    ce.qtype = qtype;
+    ce.qname = target;
+    ce.anameScopeMask = 0;
+    (*conntrack)[id]=std::move(ce);
+  }
+
+  (*d_aliascacherefreshes)++;
+  sendQuery(target, qtype, id);
+}
+
+uint64_t DNSProxy::getAliasCacheSize()
+{
+  return d_aliascache.lock()->size();
 }
 
 
@@ -190,9 +453,6 @@ void DNSProxy::mainloop()
     char buffer[1500];
     ssize_t len;
 
-    struct msghdr msgh;
-    struct iovec iov;
-    cmsgbuf_aligned cbuf;
     ComboAddress fromaddr;
 
     for(;;) {
@@ -213,7 +473,6 @@ void DNSProxy::mainloop()
         continue;
       }
       (*d_resanswers)++;
-      (*d_udpanswers)++;
       dnsheader d;
       memcpy(&d,buffer,sizeof(d));
       {
@@ -246,10 +505,20 @@ void DNSProxy::mainloop()
           continue;
         }
 
-        /* Set up iov and msgh structures. */
-        memset(&msgh, 0, sizeof(struct msghdr));
-        string reply; // needs to be alive at time of sendmsg!
         MOADNSParser mdp(false, p.getString());
+        if(i->second.qtype == QType::A || i->second.qtype == QType::AAAA) {
+          addToAliasCache(i->second.qname, i->second.qtype, mdp);
+        }
+        else if(i->second.qtype == QType::ANY) {
+          addToAliasCache(i->second.qname, QType::A, mdp, false);
+          addToAliasCache(i->second.qname, QType::AAAA, mdp, false);
+        }
+        if(!i->second.complete) {
+          // a refresh of the ALIAS cache, nobody is waiting for this answer
+          i->second.created=0;
+          continue;
+        }
+
         //	  cerr<<"Got completion, "<<mdp.d_answers.size()<<" answers, rcode: "<<mdp.d_header.rcode<<endl;
         if (mdp.d_header.rcode == RCode::NoError) {
           for (auto& answer : mdp.d_answers) {
@@ -273,23 +542,9 @@ void DNSProxy::mainloop()
           i->second.complete->clearRecords();
           i->second.complete->setRcode(RCode::ServFail);
         }
-        reply=i->second.complete->getString();
-        iov.iov_base = (void*)reply.c_str();
-        iov.iov_len = reply.length();
+        sendReply(*i->second.complete);
+        (*d_udpanswers)++;
         i->second.complete.reset();
-        msgh.msg_iov = &iov;
-        msgh.msg_iovlen = 1;
-        msgh.msg_name = (struct sockaddr*)&i->second.remote;
-        msgh.msg_namelen = i->second.remote.getSocklen();
-        msgh.msg_control=nullptr;
-
-        if(i->second.anyLocal) {
-          addCMsgSrcAddr(&msgh, &cbuf, i->second.anyLocal.get_ptr(), 0);
-        }
-        if(sendmsg(i->second.outsock, &msgh, 0) < 0) {
-          int err = errno;
-          g_log<<Logger::Warning<<"dnsproxy.cc: Error sending reply with sendmsg (socket="<<i->second.outsock<<"): "<<stringerror(err)<<endl;
-        }
         i->second.created=0;
       }
     }
@@ -24,6 +24,12 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+#include <boost/multi_index/key_extractors.hpp>
+
 #include "dnspacket.hh"
 #include "lock.hh"
 #include "iputils.hh"
@@ -44,6 +50,11 @@ The sending happens from a source port that is determined by the constructor, bu
 to make sure outside parties can't spoof us.
 
 To fix: how to remove the stale entries that will surely accumulate
+
+The A and AAAA answers for ALIAS targets are cached for the TTL of the answer. Once less than
+'alias-cache-refresh-ttl-perc' percent of that TTL is left, the next hit sends a query for the
+target from here, without a client waiting for it, and the answer replaces the cached one.
+When the cache is full, the least recently used target makes room for a new one.
 */
 
 class DNSProxy
@@ -56,6 +67,7 @@ public:
 
   void mainloop();                  //!< this is the main loop that receives reply packets and sends them out again
   bool recurseFor(DNSPacket* p);
+  uint64_t getAliasCacheSize();
 private:
   struct ConntrackEntry
   {
@@ -73,14 +85,52 @@ private:
 
   typedef map<int,ConntrackEntry> map_t;
 
+  struct AliasCacheEntry
+  {
+    DNSName target;
+    mutable vector<DNSRecord> records; //!< named after the target, empty for NODATA
+    mutable time_t ttd{0};
+    mutable uint32_t ttl{0};
+    uint16_t qtype{0};
+    mutable bool refreshing{false};
+  };
+
+  struct HashTag{};
+  struct SequencedTag{};
+  typedef boost::multi_index_container<
+    AliasCacheEntry,
+    boost::multi_index::indexed_by <
+      boost::multi_index::hashed_unique<boost::multi_index::tag<HashTag>,
+                                        boost::multi_index::composite_key<AliasCacheEntry,
+                                                                          boost::multi_index::member<AliasCacheEntry, DNSName, &AliasCacheEntry::target>,
+                                                                          boost::multi_index::member<AliasCacheEntry, uint16_t, &AliasCacheEntry::qtype> > >,
+      /* least recently used first */
+      boost::multi_index::sequenced<boost::multi_index::tag<SequencedTag> >
+    >
+  > aliascache_t;
+
   // Data
   ComboAddress d_remote;
   AtomicCounter* d_resanswers;
   AtomicCounter* d_udpanswers;
   AtomicCounter* d_resquestions;
+  AtomicCounter* d_aliascachehits;
+  AtomicCounter* d_aliascachemisses;
+  AtomicCounter* d_aliascacherefreshes;
   LockGuarded<map_t> d_conntrack;
+  LockGuarded<aliascache_t> d_aliascache;
+  size_t d_aliascachemaxentries;
+  unsigned int d_aliascacherefreshperc;
   int d_sock;
   const uint16_t d_xor;
 
   int getID_locked(map_t&);
+  void sendQuery(const DNSName& target, uint16_t qtype, uint16_t id);
+  void sendReply(DNSPacket& r);
+  int resolveAlias(const DNSName& target, uint16_t qtype, vector<DNSZoneRecord>& ips);
+  bool completeFromAliasCache(DNSPacket& r, const DNSName& target, const DNSName& aname);
+  bool getFromAliasCache(const DNSName& target, uint16_t qtype, vector<DNSRecord>& records, bool& refresh);
+  void addToAliasCache(const DNSName& target, uint16_t qtype, const MOADNSParser& mdp, bool cacheNoData=true);
+  void addToAliasCache(const DNSName& target, uint16_t qtype, vector<DNSRecord>&& records, uint32_t ttl);
+  void refreshAlias(const DNSName& target, uint16_t qtype);
 };
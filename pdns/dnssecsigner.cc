@@ -31,11 +31,74 @@
 #include "lock.hh"
 #include "arguments.hh"
 #include "statbag.hh"
+#include <array>
+#include <fstream>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
 extern StatBag S;
 
-typedef map<pair<string, string>, string> signaturecache_t;
-static SharedLockGuarded<signaturecache_t> g_signatures;
-static int g_cacheweekno;
+using namespace ::boost::multi_index;
+
+namespace {
+struct SignatureCacheEntry
+{
+  std::string d_pubKey; // getLookupKeyFromPublicKey()
+  std::string d_msgHash; // getLookupKeyFromMessage()
+  std::string d_signature;
+  uint32_t d_inception{0};
+  uint32_t d_expire{0};
+  uint16_t d_tag{0};
+};
+
+/* the cache is split in shards, each with their own lock, and each holding at most its part of
+   max-signature-cache-entries. When a shard is full its oldest entries are evicted */
+struct SignatureCacheShard
+{
+  typedef multi_index_container<
+    SignatureCacheEntry,
+    indexed_by <
+      hashed_unique<composite_key<SignatureCacheEntry,
+                                  member<SignatureCacheEntry, std::string, &SignatureCacheEntry::d_pubKey>,
+                                  member<SignatureCacheEntry, std::string, &SignatureCacheEntry::d_msgHash> > >,
+      sequenced<>
+      >
+    > entries_t;
+
+  entries_t d_entries;
+  int d_weekno{0};
+};
+
+const size_t s_signatureCacheShards = 64;
+}
+
+static std::array<SharedLockGuarded<SignatureCacheShard>, s_signatureCacheShards> g_signatures;
+
+static SharedLockGuarded<SignatureCacheShard>& getSignatureCacheShard(const std::string& msgHash)
+{
+  uint32_t hash = 0;
+  memcpy(&hash, msgHash.data(), std::min(sizeof(hash), msgHash.size()));
+  return g_signatures[hash % s_signatureCacheShards];
+}
+
+static void insertSignature(SignatureCacheShard& shard, SignatureCacheEntry&& entry, size_t maxShardSize)
+{
+  auto existing = shard.d_entries.find(std::tie(entry.d_pubKey, entry.d_msgHash));
+  if (existing != shard.d_entries.end()) {
+    if (existing->d_tag == entry.d_tag) {
+      return; // another thread signed the same RRset in the meantime
+    }
+    /* the same key material with other flags, or a bogus snapshot entry, that would never be a hit */
+    shard.d_entries.erase(existing);
+  }
+  auto& sequence = shard.d_entries.get<1>();
+  sequence.push_back(std::move(entry));
+  while (shard.d_entries.size() > maxShardSize) {
+    sequence.pop_front();
+  }
+}
 
 const static std::set<uint16_t> g_KSKSignedQTypes {QType::DNSKEY, QType::CDS, QType::CDNSKEY};
 AtomicCounter* g_signatureCount;
@@ -61,7 +124,7 @@ static std::string getLookupKeyFromPublicKey(const std::string& pubKey)
   return pdns_sha1sum(pubKey);
 }
 
-static void fillOutRRSIG(DNSSECPrivateKey& dpk, const DNSName& signQName, RRSIGRecordContent& rrc, const sortedRecords_t& toSign)
+void fillOutRRSIG(DNSSECPrivateKey& dpk, const DNSName& signQName, RRSIGRecordContent& rrc, const sortedRecords_t& toSign)
 {
   if(!g_signatureCount)
     g_signatureCount = S.getPointer("signatures");
@@ -74,12 +137,13 @@ static void fillOutRRSIG(DNSSECPrivateKey& dpk, const DNSName& signQName, RRSIGR
   string msg = getMessageForRRSET(signQName, rrc, toSign); // this is what we will hash & sign
   pair<string, string> lookup(getLookupKeyFromPublicKey(drc.d_key), getLookupKeyFromMessage(msg));  // this hash is a memory saving exercise
 
+  auto& shard = getSignatureCacheShard(lookup.second);
   bool doCache = true;
   if (doCache) {
-    auto signatures = g_signatures.read_lock();
-    signaturecache_t::const_iterator iter = signatures->find(lookup);
-    if (iter != signatures->end()) {
-      rrc.d_signature=iter->second;
+    auto signatures = shard.read_lock();
+    auto iter = signatures->d_entries.find(std::tie(lookup.first, lookup.second));
+    if (iter != signatures->d_entries.end() && iter->d_tag == rrc.d_tag) {
+      rrc.d_signature=iter->d_signature;
       return;
     }
     // else cerr<<"Miss!"<<endl;
@@ -90,15 +154,25 @@ static void fillOutRRSIG(DNSSECPrivateKey& dpk, const DNSName& signQName, RRSIGR
   if(doCache) {
     /* we add some jitter here so not all your slaves start pruning their caches at the very same millisecond */
     int weekno = (time(nullptr) - dns_random(3600)) / (86400*7);  // we just spent milliseconds doing a signature, microsecond more won't kill us
-    const static int maxcachesize=::arg().asNum("max-signature-cache-entries", INT_MAX);
+    const static size_t maxcachesize=::arg().asNum("max-signature-cache-entries", INT_MAX);
+    const static size_t maxshardsize=std::max(maxcachesize / s_signatureCacheShards, static_cast<size_t>(1));
 
-    auto signatures = g_signatures.write_lock();
-    if (g_cacheweekno < weekno || signatures->size() >= (uint) maxcachesize) {  // blunt but effective (C) Habbie, mind04
-      g_log<<Logger::Warning<<"Cleared signature cache."<<endl;
-      signatures->clear();
-      g_cacheweekno = weekno;
+    SignatureCacheEntry entry{std::move(lookup.first), std::move(lookup.second), rrc.d_signature, rrc.d_siginception, rrc.d_sigexpire, rrc.d_tag};
+    auto signatures = shard.write_lock();
+    if (signatures->d_weekno < weekno) {
+      /* signatures made with an older inception will not be asked for again */
+      auto& sequence = signatures->d_entries.get<1>();
+      for (auto iter = sequence.begin(); iter != sequence.end(); ) {
+        if (iter->d_inception < rrc.d_siginception) {
+          iter = sequence.erase(iter);
+        }
+        else {
+          ++iter;
+        }
+      }
+      signatures->d_weekno = weekno;
     }
-    (*signatures)[lookup] = rrc.d_signature;
+    insertSignature(*signatures, std::move(entry), maxshardsize);
   }
 }
 
@@ -178,7 +252,119 @@ static void addSignature(DNSSECKeeper& dk, UeberBackend& db, const DNSName& sign
 
 uint64_t signatureCacheSize(const std::string& /* str */)
 {
-  return g_signatures.read_lock()->size();
+  uint64_t ret = 0;
+  for (auto& shard : g_signatures) {
+    ret += shard.read_lock()->d_entries.size();
+  }
+  return ret;
+}
+
+/* snapshot format: a magic line, then per entry the public key lookup key, the message hash and
+   the signature, each preceded by their 16 bits length, followed by the inception, the expiration
+   and the key tag, all in host byte order */
+static const std::string s_signatureCacheMagic{"PDNS signature cache 1\n"};
+
+template <typename T>
+static void writeSnapshotValue(std::ostream& out, T value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool readSnapshotValue(std::istream& input, T& value)
+{
+  return static_cast<bool>(input.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+static void writeSnapshotString(std::ostream& out, const std::string& value)
+{
+  writeSnapshotValue(out, static_cast<uint16_t>(value.size()));
+  out.write(value.data(), value.size());
+}
+
+static bool readSnapshotString(std::istream& input, std::string& value)
+{
+  uint16_t len;
+  if (!readSnapshotValue(input, len)) {
+    return false;
+  }
+  value.resize(len);
+  return static_cast<bool>(input.read(value.data(), len));
+}
+
+uint64_t saveSignatureCache(const std::string& fname)
+{
+  const std::string tmpname = fname + ".tmp";
+  std::ofstream out(tmpname, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("Unable to open '" + tmpname + "' for writing the signature cache: " + stringerror());
+  }
+
+  out.write(s_signatureCacheMagic.data(), s_signatureCacheMagic.size());
+  uint64_t count = 0;
+  for (auto& shard : g_signatures) {
+    auto signatures = shard.read_lock();
+    for (const auto& entry : signatures->d_entries.get<1>()) {
+      writeSnapshotString(out, entry.d_pubKey);
+      writeSnapshotString(out, entry.d_msgHash);
+      writeSnapshotString(out, entry.d_signature);
+      writeSnapshotValue(out, entry.d_inception);
+      writeSnapshotValue(out, entry.d_expire);
+      writeSnapshotValue(out, entry.d_tag);
+      count++;
+    }
+  }
+
+  out.close();
+  if (!out) {
+    unlink(tmpname.c_str());
+    throw std::runtime_error("Error writing the signature cache to '" + tmpname + "'");
+  }
+  if (rename(tmpname.c_str(), fname.c_str()) != 0) {
+    int err = errno;
+    unlink(tmpname.c_str());
+    throw std::runtime_error("Unable to rename '" + tmpname + "' to '" + fname + "': " + stringerror(err));
+  }
+  return count;
+}
+
+uint64_t loadSignatureCache(const std::string& fname)
+{
+  std::ifstream input(fname, std::ios::binary);
+  if (!input) {
+    return 0;
+  }
+
+  std::string magic(s_signatureCacheMagic.size(), '\0');
+  if (!input.read(magic.data(), magic.size()) || magic != s_signatureCacheMagic) {
+    throw std::runtime_error("'" + fname + "' is not a signature cache snapshot");
+  }
+
+  /* only signatures that fillOutRRSIG() would make right now can ever be looked up again */
+  const uint32_t inception = getStartOfWeek() - 7*86400;
+  const uint32_t now = time(nullptr);
+  const size_t maxcachesize = ::arg().asNum("max-signature-cache-entries", INT_MAX);
+  const size_t maxshardsize = std::max(maxcachesize / s_signatureCacheShards, static_cast<size_t>(1));
+
+  uint64_t count = 0;
+  SignatureCacheEntry entry;
+  while (readSnapshotString(input, entry.d_pubKey)) {
+    if (!readSnapshotString(input, entry.d_msgHash) ||
+        !readSnapshotString(input, entry.d_signature) ||
+        !readSnapshotValue(input, entry.d_inception) ||
+        !readSnapshotValue(input, entry.d_expire) ||
+        !readSnapshotValue(input, entry.d_tag)) {
+      throw std::runtime_error("Truncated signature cache snapshot '" + fname + "'");
+    }
+    if (entry.d_inception != inception || entry.d_expire <= now || entry.d_msgHash.empty() || entry.d_signature.empty()) {
+      continue;
+    }
+    auto signatures = getSignatureCacheShard(entry.d_msgHash).write_lock();
+    insertSignature(*signatures, std::move(entry), maxshardsize);
+    entry = SignatureCacheEntry();
+    count++;
+  }
+  return count;
 }
 
 static bool rrsigncomp(const DNSZoneRecord& a, const DNSZoneRecord& b)
@@ -22,6 +22,7 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#include <functional>
 #include <vector>
 #include <iostream>
 
@@ -35,6 +36,7 @@
 #include "iputils.hh"
 #include "statbag.hh"
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include "namespaces.hh"
 using namespace boost::multi_index;
@@ -62,6 +64,8 @@ public:
   unsigned int d_maxInFlight;
   unsigned int d_timeoutSeconds;
   int d_burst;
+  //! When set, items it refuses are passed over until it accepts them, later items are sent in the meantime
+  std::function<bool(const typename Container::value_type&)> d_mayBeSent;
   
   uint64_t getTimeouts()
   {
@@ -102,8 +106,32 @@ private:
   bool d_init;
   
   uint64_t d_unexpectedResponse, d_timeouts;
+
+  bool findSendable();
+  /* what had happened when no item could be sent, there is no use looking again before that changes */
+  uint64_t d_blockedCompleted{0};
+  time_t d_blockedSecond{0};
+  uint64_t d_completed{0};
 };
 
+// Moves the first item d_mayBeSent accepts to d_iter, items before d_iter are the ones in flight
+template<typename Container, typename SendReceive> bool Inflighter<Container, SendReceive>::findSendable()
+{
+  time_t now = time(nullptr);
+  if (d_blockedSecond == now && d_blockedCompleted == d_completed) {
+    return false;
+  }
+  for (auto iter = d_iter; iter != d_container.end(); ++iter) {
+    if (d_mayBeSent(*iter)) {
+      std::iter_swap(d_iter, iter);
+      return true;
+    }
+  }
+  d_blockedSecond = now;
+  d_blockedCompleted = d_completed;
+  return false;
+}
+
 template<typename Container, typename SendReceive> bool Inflighter<Container, SendReceive>::run()
 {
   if(!d_init)
@@ -114,6 +142,8 @@ template<typename Container, typename SendReceive> bool Inflighter<Container, Se
 
     // 'send' as many items as allowed, limited by 'max in flight' and our burst parameter (which limits query rate growth)
     while(d_iter != d_container.end() && d_ttdWatch.size() < d_maxInFlight) { 
+      if(d_mayBeSent && !findSendable())
+        break;
       TTDItem ttdi;
       ttdi.iter = d_iter++;
       ttdi.id = d_sr.send(*ttdi.iter);
@@ -148,6 +178,7 @@ template<typename Container, typename SendReceive> bool Inflighter<Container, Se
           unsigned int usec = 1000000*(now.tv_sec - ival->sentTime.tv_sec) + (now.tv_usec - ival->sentTime.tv_usec);
           d_sr.deliverAnswer(*ival->iter, answer, usec);    // deliver to sender/receiver
           d_ttdWatch.erase(ival);
+          d_completed++;
           break; // we can send new questions!
         }
         else {
@@ -171,12 +202,16 @@ template<typename Container, typename SendReceive> bool Inflighter<Container, Se
             waiters_index.erase(valiter++);
             // cerr<<"Have timeout for id="<< valiter->id <<endl;
             d_timeouts++;
+            d_completed++;
           }
           else 
             break; // if this one was too new, rest will be too
         }
       }
     }
+    else if(d_iter != d_container.end()) {
+      usleep(100000); // nothing in flight and nothing d_mayBeSent accepts yet, wait for the next second
+    }
     if(d_ttdWatch.empty() && d_iter == d_container.end())
       break;
   }
@@ -20,6 +20,28 @@ LuaContext* AuthLua4::getLua()
   return d_lw.get();
 }
 
+AuthLua4::luacall_lua_record_t AuthLua4::getLuaRecordFunction(const std::string& code)
+{
+  auto func = d_luaRecordFunctions.find(code);
+  if (func != d_luaRecordFunctions.end()) {
+    return func->second;
+  }
+
+  if (d_luaRecordFunctions.size() >= s_maxLuaRecordFunctions) {
+    d_luaRecordFunctions.clear();
+  }
+  // code starting with ';' is a chunk of statements, otherwise it is an expression
+  string body;
+  if (!code.empty() && code[0] != ';') {
+    body = "return " + code;
+  }
+  else {
+    body = code.substr(1);
+  }
+  auto compiled = d_lw->executeCode<luacall_lua_record_t>("return function(...) " + body + "\nend");
+  return d_luaRecordFunctions.emplace(code, std::move(compiled)).first->second;
+}
+
 void AuthLua4::postPrepareContext() {
   d_lw->writeFunction("resolve", [](const std::string& qname, uint16_t qtype) {
       std::vector<DNSZoneRecord> ret;
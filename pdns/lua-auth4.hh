@@ -17,6 +17,10 @@ public:
   bool axfrfilter(const ComboAddress&, const DNSName&, const DNSResourceRecord&, std::vector<DNSResourceRecord>&);
   LuaContext* getLua();
 
+  typedef std::function<boost::variant<std::string, std::vector<std::pair<int, std::string>>>()> luacall_lua_record_t;
+  //! The code of a LUA record as a function of this state, compiled on first use
+  luacall_lua_record_t getLuaRecordFunction(const std::string& code);
+
   std::unique_ptr<DNSPacket> prequery(const DNSPacket& p);
 
   ~AuthLua4(); // this is so unique_ptr works with an incomplete type
@@ -41,6 +45,9 @@ private:
   luacall_update_policy_t d_update_policy;
   luacall_axfr_filter_t d_axfr_filter;
   luacall_prequery_t d_prequery;
+
+  std::unordered_map<std::string, luacall_lua_record_t> d_luaRecordFunctions;
+  static const size_t s_maxLuaRecordFunctions{10000};
 };
 std::vector<shared_ptr<DNSRecordContent>> luaSynth(const std::string& code, const DNSName& qname,
                                                    const DNSName& zone, int zoneid, const DNSPacket& dnsp, uint16_t qtype, unique_ptr<AuthLua4>& LUA);
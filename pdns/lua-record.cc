@@ -1,5 +1,8 @@
 #include <thread>
 #include <future>
+#include <condition_variable>
+#include <deque>
+#include <optional>
 #include <boost/format.hpp>
 #include <utility>
 #include <algorithm>
@@ -7,6 +10,7 @@
 #include "version.hh"
 #include "ext/luawrapper/include/LuaContext.hpp"
 #include "lock.hh"
+#include "threadname.hh"
 #include "lua-auth4.hh"
 #include "sstuff.hh"
 #include "minicurl.hh"
@@ -32,12 +36,11 @@
    add list of current monitors
       expire them too?
 
-   pool of UeberBackends?
-
    Pool checks ?
  */
 
 extern int  g_luaRecordExecLimit;
+extern int  g_luaRecordResultCacheTTL;
 
 using iplist_t = vector<pair<int, string> >;
 using wiplist_t = std::unordered_map<int, string>;
@@ -49,19 +52,16 @@ class IsUpOracle
 private:
   struct CheckDesc
   {
+    CheckDesc(const ComboAddress& rem_, const string& url_, const opts_t& opts_) :
+      rem(rem_), url(url_), opts(opts_.begin(), opts_.end())
+    {
+    }
     ComboAddress rem;
     string url;
-    opts_t opts;
+    std::map<string, string> opts; // ordered, so descriptions compare cheaply
     bool operator<(const CheckDesc& rhs) const
     {
-      std::map<string,string> oopts, rhsoopts;
-      for(const auto& m : opts)
-        oopts[m.first]=m.second;
-      for(const auto& m : rhs.opts)
-        rhsoopts[m.first]=m.second;
-
-      return std::make_tuple(rem, url, oopts) <
-        std::make_tuple(rhs.rem, rhs.url, rhsoopts);
+      return std::tie(rem, url, opts) < std::tie(rhs.rem, rhs.url, rhs.opts);
     }
   };
   struct CheckState
@@ -73,7 +73,13 @@ private:
     std::atomic<bool> first{true};
     /* last time the status was accessed */
     std::atomic<time_t> lastAccess{0};
+    /* a check is queued or running */
+    std::atomic<bool> busy{false};
+    /* when the next check is due */
+    std::atomic<time_t> nextCheck{0};
   };
+  using statuses_t = map<CheckDesc, std::shared_ptr<CheckState>>;
+  using check_t = std::pair<CheckDesc, std::shared_ptr<CheckState>>;
 
 public:
   IsUpOracle()
@@ -88,8 +94,10 @@ public:
   bool isUp(const CheckDesc& cd);
 
 private:
-  void checkURL(const CheckDesc& cd, const bool status, const bool first = false)
+  void checkURL(const CheckDesc& cd, CheckState& state)
   {
+    const bool status = state.status;
+    const bool first = state.first;
     string remstring;
     try {
       int timeout = 2;
@@ -129,15 +137,17 @@ private:
       if(!status) {
         g_log<<Logger::Info<<"LUA record monitoring declaring "<<remstring<<" UP for URL "<<cd.url<<"!"<<endl;
       }
-      setUp(cd);
+      setStatus(state, true);
     }
     catch(std::exception& ne) {
       if(status || first)
         g_log<<Logger::Info<<"LUA record monitoring declaring "<<remstring<<" DOWN for URL "<<cd.url<<", error: "<<ne.what()<<endl;
-      setDown(cd);
+      setStatus(state, false);
     }
   }
-  void checkTCP(const CheckDesc& cd, const bool status, const bool first = false) {
+  void checkTCP(const CheckDesc& cd, CheckState& state) {
+    const bool status = state.status;
+    const bool first = state.first;
     try {
       int timeout = 2;
       if (cd.opts.count("timeout")) {
@@ -157,91 +167,152 @@ private:
           g_log<<"(source "<<src.toString()<<") ";
         g_log<<"UP!"<<endl;
       }
-      setUp(cd);
+      setStatus(state, true);
     }
     catch (const NetworkError& ne) {
       if(status || first) {
         g_log<<Logger::Info<<"Lua record monitoring declaring TCP/IP "<<cd.rem.toStringWithPort()<<" DOWN: "<<ne.what()<<endl;
       }
-      setDown(cd);
+      setStatus(state, false);
+    }
+  }
+
+  /* The checks run on a pool of at most 'lua-health-checks-max-concurrent' threads, so a slow
+     target only holds up its own thread. checkThread() hands the checks that are due to the
+     pool, every check is scheduled again 'lua-health-checks-interval' seconds after it
+     finished, plus up to 10% of jitter so the checks do not all come due at once. */
+  void workerThread()
+  {
+    setThreadName("pdns/luaupcheck");
+    for (;;) {
+      std::optional<check_t> check;
+      {
+        std::unique_lock<std::mutex> lock(d_workMutex);
+        ++d_idleWorkers;
+        d_workCond.wait(lock, [this] { return !d_work.empty(); });
+        --d_idleWorkers;
+        check.emplace(std::move(d_work.front()));
+        d_work.pop_front();
+      }
+      auto& [desc, state] = *check;
+      struct timeval start;
+      gettimeofday(&start, nullptr);
+      if (desc.url.empty()) { // TCP
+        checkTCP(desc, *state);
+      } else { // URL
+        checkURL(desc, *state);
+      }
+      struct timeval end;
+      gettimeofday(&end, nullptr);
+      d_checks++;
+      d_checksUsec += uSec(end) - uSec(start);
+      time_t interval = g_luaHealthChecksInterval;
+      state->nextCheck = end.tv_sec + interval + dns_random(std::max(interval / 10, static_cast<time_t>(1)) + 1);
+      state->busy = false;
     }
   }
+
+  void queueCheck(const CheckDesc& desc, const std::shared_ptr<CheckState>& state)
+  {
+    std::lock_guard<std::mutex> lock(d_workMutex);
+    d_work.emplace_back(desc, state);
+    if (d_idleWorkers < d_work.size() && d_workers < g_luaHealthChecksMaxConcurrent) {
+      ++d_workers;
+      std::thread worker([this] { workerThread(); });
+      worker.detach();
+    }
+    d_workCond.notify_one();
+  }
+
   void checkThread()
   {
+    setThreadName("pdns/luaupsched");
     while (true)
     {
-      std::chrono::system_clock::time_point checkStart = std::chrono::system_clock::now();
-      std::vector<std::future<void>> results;
-      std::vector<CheckDesc> toDelete;
+      time_t now = time(nullptr);
+      auto current = std::atomic_load(&d_statuses);
+      std::shared_ptr<statuses_t> next;
+
+      // new targets and expired ones need a new copy of the statuses
       {
-        // make sure there's no insertion
-        auto statuses = d_statuses.read_lock();
-        for (auto& it: *statuses) {
-          auto& desc = it.first;
-          auto& state = it.second;
-
-          if (desc.url.empty()) { // TCP
-            results.push_back(std::async(std::launch::async, &IsUpOracle::checkTCP, this, desc, state->status.load(), state->first.load()));
-          } else { // URL
-            results.push_back(std::async(std::launch::async, &IsUpOracle::checkURL, this, desc, state->status.load(), state->first.load()));
-          }
-          if (std::chrono::system_clock::from_time_t(state->lastAccess) < (checkStart - std::chrono::seconds(g_luaHealthChecksExpireDelay))) {
-            toDelete.push_back(desc);
-          }
+        std::lock_guard<std::mutex> lock(d_pendingMutex);
+        if (!d_pending.empty()) {
+          next = std::make_shared<statuses_t>(*current);
+          next->merge(d_pending);
+          d_pending.clear();
         }
       }
-      // we can release the lock as nothing will be deleted
-      for (auto& future: results) {
-        future.wait();
+      std::vector<CheckDesc> toDelete;
+      for (const auto& [desc, state] : next ? *next : *current) {
+        if (state->lastAccess < now - g_luaHealthChecksExpireDelay && !state->busy) {
+          toDelete.push_back(desc);
+        }
       }
       if (!toDelete.empty()) {
-        auto statuses = d_statuses.write_lock();
-        for (auto& it: toDelete) {
-          statuses->erase(it);
+        if (!next) {
+          next = std::make_shared<statuses_t>(*current);
+        }
+        for (const auto& desc : toDelete) {
+          next->erase(desc);
         }
       }
-      std::this_thread::sleep_until(checkStart + std::chrono::seconds(g_luaHealthChecksInterval));
-    }
-  }
-
-  typedef map<CheckDesc, std::unique_ptr<CheckState>> statuses_t;
-  SharedLockGuarded<statuses_t> d_statuses;
+      if (next) {
+        std::atomic_store(&d_statuses, std::shared_ptr<const statuses_t>(std::move(next)));
+        ++d_generation;
+        current = std::atomic_load(&d_statuses);
+      }
 
-  std::unique_ptr<std::thread> d_checkerThread;
-  std::atomic_flag d_checkerThreadStarted;
+      size_t queued = 0;
+      for (const auto& [desc, state] : *current) {
+        if (!state->busy && state->nextCheck <= now) {
+          state->busy = true;
+          queueCheck(desc, state);
+        }
+      }
+      {
+        std::lock_guard<std::mutex> lock(d_workMutex);
+        queued = d_work.size();
+      }
+      S.set("lua-health-checks-queued", queued);
+      S.set("lua-health-checks-targets", current->size());
+      uint64_t checks = d_checks.exchange(0);
+      uint64_t usec = d_checksUsec.exchange(0);
+      if (checks > 0) {
+        S.deposit("lua-health-checks", checks);
+        S.set("lua-health-check-latency", usec / checks);
+      }
 
-  void setStatus(const CheckDesc& cd, bool status)
-  {
-    auto statuses = d_statuses.write_lock();
-    auto& state = (*statuses)[cd];
-    state->status = status;
-    if (state->first) {
-      state->first = false;
+      std::unique_lock<std::mutex> lock(d_pendingMutex);
+      d_pendingCond.wait_for(lock, std::chrono::seconds(1), [this] { return !d_pending.empty(); });
     }
   }
 
-  void setDown(const ComboAddress& rem, const std::string& url=std::string(), const opts_t& opts = opts_t())
+  void setStatus(CheckState& state, bool status)
   {
-    CheckDesc cd{rem, url, opts};
-    setStatus(cd, false);
+    state.status = status;
+    state.first = false;
   }
 
-  void setUp(const ComboAddress& rem, const std::string& url=std::string(), const opts_t& opts = opts_t())
-  {
-    CheckDesc cd{rem, url, opts};
+  // Read without locks by the threads answering queries, replaced as a whole by checkThread()
+  std::shared_ptr<const statuses_t> d_statuses{std::make_shared<const statuses_t>()};
+  std::atomic<uint64_t> d_generation{0};
 
-    setStatus(cd, true);
-  }
+  // targets seen by isUp() that checkThread() has not picked up yet
+  std::mutex d_pendingMutex;
+  std::condition_variable d_pendingCond;
+  statuses_t d_pending;
 
-  void setDown(const CheckDesc& cd)
-  {
-    setStatus(cd, false);
-  }
+  std::mutex d_workMutex;
+  std::condition_variable d_workCond;
+  std::deque<check_t> d_work;
+  size_t d_workers{0};
+  size_t d_idleWorkers{0};
 
-  void setUp(const CheckDesc& cd)
-  {
-    setStatus(cd, true);
-  }
+  std::atomic<uint64_t> d_checks{0};
+  std::atomic<uint64_t> d_checksUsec{0};
+
+  std::unique_ptr<std::thread> d_checkerThread;
+  std::atomic_flag d_checkerThreadStarted;
 };
 
 bool IsUpOracle::isUp(const CheckDesc& cd)
@@ -250,23 +321,28 @@ bool IsUpOracle::isUp(const CheckDesc& cd)
     d_checkerThread = std::make_unique<std::thread>([this] { return checkThread(); });
   }
   time_t now = time(nullptr);
-  {
-    auto statuses = d_statuses.read_lock();
-    auto iter = statuses->find(cd);
-    if (iter != statuses->end()) {
-      iter->second->lastAccess = now;
-      return iter->second->status;
-    }
+  // every thread keeps the statuses it last saw until checkThread() publishes new ones
+  static thread_local std::shared_ptr<const statuses_t> t_statuses;
+  static thread_local uint64_t t_generation{std::numeric_limits<uint64_t>::max()};
+  uint64_t generation = d_generation.load();
+  if (generation != t_generation) {
+    t_statuses = std::atomic_load(&d_statuses);
+    t_generation = generation;
+  }
+  auto iter = t_statuses->find(cd);
+  if (iter != t_statuses->end()) {
+    iter->second->lastAccess = now;
+    return iter->second->status;
   }
   // try to parse options so we don't insert any malformed content
   if (cd.opts.count("source")) {
     ComboAddress src(cd.opts.at("source"));
   }
   {
-    auto statuses = d_statuses.write_lock();
+    std::lock_guard<std::mutex> lock(d_pendingMutex);
     // Make sure we don't insert new entry twice now we have the lock
-    if (statuses->find(cd) == statuses->end()) {
-      (*statuses)[cd] = std::make_unique<CheckState>(now);
+    if (d_pending.emplace(cd, std::make_shared<CheckState>(now)).second) {
+      d_pendingCond.notify_one();
     }
   }
   return false;
@@ -491,16 +567,17 @@ static ComboAddress pickclosest(const ComboAddress& bestwho, const vector<ComboA
 
 static std::vector<DNSZoneRecord> lookup(const DNSName& name, uint16_t qtype, int zoneid)
 {
-  static LockGuarded<UeberBackend> s_ub;
+  // the UeberBackend of the packet being answered is busy, every thread gets a second one
+  static thread_local std::unique_ptr<UeberBackend> t_ub;
+  if (!t_ub) {
+    t_ub = std::make_unique<UeberBackend>();
+  }
 
   DNSZoneRecord dr;
   vector<DNSZoneRecord> ret;
-  {
-    auto ub = s_ub.lock();
-    ub->lookup(QType(qtype), name, zoneid);
-    while (ub->get(dr)) {
-      ret.push_back(dr);
-    }
+  t_ub->lookup(QType(qtype), name, zoneid);
+  while (t_ub->get(dr)) {
+    ret.push_back(dr);
   }
   return ret;
 }
@@ -1125,7 +1202,63 @@ static void setupLuaRecords(LuaContext& lua)
     });
 }
 
+struct LuaRecordResult
+{
+  std::vector<shared_ptr<DNSRecordContent>> records;
+  time_t ttd;
+};
+
+// per thread, so the threads evaluating LUA records do not share anything
+static thread_local std::unordered_map<std::string, LuaRecordResult> t_luaRecordResults;
+static const size_t s_maxLuaRecordResults{10000};
+
+// The result of a LUA record is cached for the record, the name and type asked and the /24 or /56 of 'bestwho'
+static std::string luaRecordResultKey(const std::string& code, const DNSName& query, int zoneid, uint16_t qtype, const ComboAddress& bestwho)
+{
+  std::string key = code;
+  key.append(1, '\0');
+  key.append(query.toDNSStringLC());
+  key.append(reinterpret_cast<const char*>(&qtype), sizeof(qtype));
+  key.append(reinterpret_cast<const char*>(&zoneid), sizeof(zoneid));
+  key.append(Netmask(bestwho, bestwho.isIPv4() ? 24 : 56).getMaskedNetwork().toByteString());
+  return key;
+}
+
+static std::vector<shared_ptr<DNSRecordContent>> luaSynthUncached(const std::string& code, const DNSName& query, const DNSName& zone, int zoneid, const DNSPacket& dnsp, uint16_t qtype, unique_ptr<AuthLua4>& LUA);
+
 std::vector<shared_ptr<DNSRecordContent>> luaSynth(const std::string& code, const DNSName& query, const DNSName& zone, int zoneid, const DNSPacket& dnsp, uint16_t qtype, unique_ptr<AuthLua4>& LUA)
+{
+  if (g_luaRecordResultCacheTTL <= 0) {
+    return luaSynthUncached(code, query, zone, zoneid, dnsp, qtype, LUA);
+  }
+
+  const ComboAddress bestwho = dnsp.hasEDNSSubnet() ? dnsp.getRealRemote().getNetwork() : dnsp.getInnerRemote();
+  auto key = luaRecordResultKey(code, query, zoneid, qtype, bestwho);
+  time_t now = time(nullptr);
+  auto cached = t_luaRecordResults.find(key);
+  if (cached != t_luaRecordResults.end() && cached->second.ttd > now) {
+    return cached->second.records;
+  }
+
+  auto ret = luaSynthUncached(code, query, zone, zoneid, dnsp, qtype, LUA);
+  if (t_luaRecordResults.size() >= s_maxLuaRecordResults) {
+    for (auto entry = t_luaRecordResults.begin(); entry != t_luaRecordResults.end();) {
+      if (entry->second.ttd <= now) {
+        entry = t_luaRecordResults.erase(entry);
+      }
+      else {
+        ++entry;
+      }
+    }
+    if (t_luaRecordResults.size() >= s_maxLuaRecordResults) {
+      t_luaRecordResults.clear();
+    }
+  }
+  t_luaRecordResults[std::move(key)] = {ret, now + g_luaRecordResultCacheTTL};
+  return ret;
+}
+
+static std::vector<shared_ptr<DNSRecordContent>> luaSynthUncached(const std::string& code, const DNSName& query, const DNSName& zone, int zoneid, const DNSPacket& dnsp, uint16_t qtype, unique_ptr<AuthLua4>& LUA)
 {
   if(!LUA ||                  // we don't have a Lua state yet
      !g_LuaRecordSharedState) { // or we want a new one even if we had one
@@ -1161,13 +1294,20 @@ std::vector<shared_ptr<DNSRecordContent>> luaSynth(const std::string& code, cons
   lua.writeVariable("bestwho", s_lua_record_ctx->bestwho);
 
   try {
-    string actual;
-    if(!code.empty() && code[0]!=';')
-      actual = "return " + code;
-    else
-      actual = code.substr(1);
+    boost::variant<string, vector<pair<int, string> > > content;
+    if (g_LuaRecordSharedState) {
+      // the state is kept, so is the code of the record compiled into it
+      content = LUA->getLuaRecordFunction(code)();
+    }
+    else {
+      string actual;
+      if(!code.empty() && code[0]!=';')
+        actual = "return " + code;
+      else
+        actual = code.substr(1);
 
-    auto content=lua.executeCode<boost::variant<string, vector<pair<int, string> > > >(actual);
+      content = lua.executeCode<boost::variant<string, vector<pair<int, string> > > >(actual);
+    }
 
     vector<string> contents;
     if(auto str = boost::get<string>(&content))
@@ -0,0 +1,124 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace pdns
+{
+/* Bounded lock-free queue with any number of producers and a single consumer.
+   This is Dmitry Vyukov's bounded queue: each slot carries a sequence number
+   telling producers when the slot is free and the consumer when it holds an item,
+   so producers only contend on the tail index and never on the consumer. */
+template <typename T>
+class MPSCQueue
+{
+public:
+  /* the capacity is rounded up to the next power of two */
+  explicit MPSCQueue(size_t capacity)
+  {
+    size_t rounded = 2;
+    while (rounded < capacity) {
+      rounded <<= 1;
+    }
+    d_mask = rounded - 1;
+    d_slots = std::make_unique<Slot[]>(rounded);
+    for (size_t idx = 0; idx < rounded; idx++) {
+      d_slots[idx].d_sequence.store(idx, std::memory_order_relaxed);
+    }
+  }
+
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+  /* returns false if the queue is full */
+  bool push(T item)
+  {
+    size_t pos = d_tail.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot& slot = d_slots[pos & d_mask];
+      size_t seq = slot.d_sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (d_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.d_item = std::move(item);
+          slot.d_sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0) {
+        return false;
+      }
+      else {
+        pos = d_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /* consumer only, returns false if the queue is empty */
+  bool pop(T& item)
+  {
+    size_t pos = d_head.load(std::memory_order_relaxed);
+    Slot& slot = d_slots[pos & d_mask];
+    size_t seq = slot.d_sequence.load(std::memory_order_acquire);
+    if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+      return false;
+    }
+    item = std::move(slot.d_item);
+    slot.d_sequence.store(pos + d_mask + 1, std::memory_order_release);
+    d_head.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /* approximate when called concurrently with push() or pop() */
+  size_t size() const
+  {
+    size_t head = d_head.load(std::memory_order_relaxed);
+    size_t tail = d_tail.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  bool empty() const
+  {
+    return size() == 0;
+  }
+
+  size_t capacity() const
+  {
+    return d_mask + 1;
+  }
+
+private:
+  struct Slot
+  {
+    std::atomic<size_t> d_sequence;
+    T d_item;
+  };
+
+  std::unique_ptr<Slot[]> d_slots;
+  size_t d_mask;
+  /* keep the producers' and the consumer's index on different cache lines */
+  alignas(64) std::atomic<size_t> d_tail{0};
+  alignas(64) std::atomic<size_t> d_head{0};
+};
+}
@@ -33,6 +33,7 @@
 #include "responsestats.hh"
 
 #include "auth-main.hh"
+#include "auth-rrl.hh"
 #include "dns.hh"
 #include "dnsbackend.hh"
 #include "dnspacket.hh"
@@ -214,9 +215,35 @@ UDPNameserver::UDPNameserver( bool additional_socket )
   bindAddresses();
 }
 
+//! returns the answer to send for p, which might have been replaced by slipped, or nullptr if it has to be dropped
+static const string* rateLimit(DNSPacket& p, const string& answer, string& slipped)
+{
+  if (!g_rrl.enabled()) {
+    return &answer;
+  }
+
+  switch (g_rrl.check(p.getInnerRemote(), answer, time(nullptr))) {
+  case AuthRRL::Verdict::Send:
+    return &answer;
+  case AuthRRL::Verdict::Slip:
+    if (AuthRRL::makeSlip(answer, slipped)) {
+      return &slipped;
+    }
+    return nullptr;
+  case AuthRRL::Verdict::Drop:
+  default:
+    return nullptr;
+  }
+}
+
 void UDPNameserver::send(DNSPacket& p)
 {
-  const string& buffer=p.getString();
+  string slipped;
+  const string* limited = rateLimit(p, p.getString(), slipped);
+  if (limited == nullptr) {
+    return;
+  }
+  const string& buffer = *limited;
   g_rs.submitResponse(p, true);
 
   struct msghdr msgh;
@@ -237,20 +264,8 @@ void UDPNameserver::send(DNSPacket& p)
     g_log<<Logger::Error<<"Error sending reply with sendmsg (socket="<<p.getSocket()<<", dest="<<p.d_remote.toStringWithPort()<<"): "<<stringerror()<<endl;
 }
 
-bool UDPNameserver::receive(DNSPacket& packet, std::string& buffer)
+Utility::sock_t UDPNameserver::waitForSocket()
 {
-  ComboAddress remote;
-  extern StatBag S;
-  ssize_t len=-1;
-  Utility::sock_t sock=-1;
-
-  struct msghdr msgh;
-  struct iovec iov;
-  cmsgbuf_aligned cbuf;
-
-  remote.sin6.sin6_family=AF_INET6; // make sure it is big enough
-  fillMSGHdr(&msgh, &iov, &cbuf, sizeof(cbuf), &buffer.at(0), buffer.size(), &remote);
-  
   int err;
   vector<struct pollfd> rfds= d_rfds;
 
@@ -270,18 +285,37 @@ bool UDPNameserver::receive(DNSPacket& packet, std::string& buffer)
     
   for(auto &pfd :  rfds) {
     if(pfd.revents & POLLIN) {
-      sock=pfd.fd;        
-      if((len=recvmsg(sock, &msgh, 0)) < 0 ) {
-        if(errno != EAGAIN)
-          g_log<<Logger::Error<<"recvfrom gave error, ignoring: "<<stringerror()<<endl;
-        return false;
-      }
-      break;
+      return pfd.fd;
     }
   }
-  if(sock==-1)
-    throw PDNSException("poll betrayed us! (should not happen)");
-  
+
+  throw PDNSException("poll betrayed us! (should not happen)");
+}
+
+bool UDPNameserver::receive(DNSPacket& packet, std::string& buffer)
+{
+  ComboAddress remote;
+  ssize_t len=-1;
+
+  struct msghdr msgh;
+  struct iovec iov;
+  cmsgbuf_aligned cbuf;
+
+  remote.sin6.sin6_family=AF_INET6; // make sure it is big enough
+  fillMSGHdr(&msgh, &iov, &cbuf, sizeof(cbuf), &buffer.at(0), buffer.size(), &remote);
+
+  Utility::sock_t sock = waitForSocket();
+  if((len=recvmsg(sock, &msgh, 0)) < 0 ) {
+    if(errno != EAGAIN)
+      g_log<<Logger::Error<<"recvfrom gave error, ignoring: "<<stringerror()<<endl;
+    return false;
+  }
+
+  return preparePacket(packet, buffer, len, sock, remote, &msgh);
+}
+
+bool UDPNameserver::preparePacket(DNSPacket& packet, std::string& buffer, ssize_t len, Utility::sock_t sock, const ComboAddress& remote, struct msghdr* msgh)
+{
   DLOG(g_log<<"Received a packet " << len <<" bytes long from "<< remote.toString()<<endl);
 
   BOOST_STATIC_ASSERT(offsetof(sockaddr_in, sin_port) == offsetof(sockaddr_in6, sin6_port));
@@ -293,13 +327,13 @@ bool UDPNameserver::receive(DNSPacket& packet, std::string& buffer)
   packet.setRemote(&remote);
 
   ComboAddress dest;
-  if(HarvestDestinationAddress(&msgh, &dest)) {
+  if(HarvestDestinationAddress(msgh, &dest)) {
 //    cerr<<"Setting d_anyLocal to '"<<dest.toString()<<"'"<<endl;
     packet.d_anyLocal = dest;
   }            
 
   struct timeval recvtv;
-  if(HarvestTimestamp(&msgh, &recvtv)) {
+  if(HarvestTimestamp(msgh, &recvtv)) {
     packet.d_dt.setTimeval(recvtv);
   }
   else
@@ -334,3 +368,102 @@ bool UDPNameserver::receive(DNSPacket& packet, std::string& buffer)
   
   return true;
 }
+
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+UDPNameserver::MultipleMessages::MultipleMessages(size_t vectorSize, size_t bufferSize) :
+  d_received(vectorSize), d_receiveVector(vectorSize), d_answers(vectorSize), d_sendVector(vectorSize), d_sendIOVs(vectorSize), d_sendCBufs(vectorSize), d_bufferSize(bufferSize)
+{
+  for (auto& received : d_received) {
+    received.buffer.resize(d_bufferSize);
+  }
+}
+
+size_t UDPNameserver::receive(MultipleMessages& batch)
+{
+  for (size_t idx = 0; idx < batch.d_received.size(); idx++) {
+    auto& received = batch.d_received.at(idx);
+    // the previous round might have stripped a proxy protocol header
+    received.buffer.resize(batch.d_bufferSize);
+    received.remote.sin6.sin6_family = AF_INET6; // make sure it is big enough
+    fillMSGHdr(&batch.d_receiveVector.at(idx).msg_hdr, &received.iov, &received.cbuf, sizeof(received.cbuf), &received.buffer.at(0), received.buffer.size(), &received.remote);
+    batch.d_receiveVector.at(idx).msg_len = 0;
+  }
+
+  batch.d_socket = waitForSocket();
+  /* we know that at least one datagram is waiting, get as many as possible
+     without blocking to save on syscalls */
+  int got = recvmmsg(batch.d_socket, batch.d_receiveVector.data(), batch.d_receiveVector.size(), MSG_WAITFORONE, nullptr);
+  if (got < 0) {
+    if (errno != EAGAIN)
+      g_log<<Logger::Error<<"recvmmsg gave error, ignoring: "<<stringerror()<<endl;
+    return 0;
+  }
+
+  return got;
+}
+
+bool UDPNameserver::getPacket(MultipleMessages& batch, size_t idx, DNSPacket& packet)
+{
+  auto& received = batch.d_received.at(idx);
+  auto& hdr = batch.d_receiveVector.at(idx);
+  return preparePacket(packet, received.buffer, hdr.msg_len, batch.d_socket, received.remote, &hdr.msg_hdr);
+}
+
+void UDPNameserver::queue(MultipleMessages& batch, DNSPacket& p)
+{
+  if (batch.d_queued == batch.d_answers.size()) {
+    flush(batch);
+  }
+
+  string slipped;
+  const string* limited = rateLimit(p, p.getString(), slipped);
+  if (limited == nullptr) {
+    return;
+  }
+  const string& buffer = *limited;
+  g_rs.submitResponse(p, true);
+
+  if(buffer.length() > p.getMaxReplyLen()) {
+    g_log<<Logger::Error<<"Weird, trying to send a message that needs truncation, "<< buffer.length()<<" > "<<p.getMaxReplyLen()<<". Question was for "<<p.qdomain<<"|"<<p.qtype.toString()<<endl;
+  }
+
+  auto& answer = batch.d_answers.at(batch.d_queued++);
+  answer.buffer.assign(buffer);
+  answer.remote = p.d_remote;
+  answer.anyLocal = p.d_anyLocal;
+  answer.socket = p.getSocket();
+}
+
+void UDPNameserver::flush(MultipleMessages& batch)
+{
+  size_t sent = 0;
+  while (sent < batch.d_queued) {
+    // sendmmsg() works on a single socket, gather the answers going out of the same one
+    const Utility::sock_t sock = batch.d_answers.at(sent).socket;
+    size_t count = 0;
+    for (size_t idx = sent; idx < batch.d_queued && batch.d_answers.at(idx).socket == sock; idx++, count++) {
+      auto& answer = batch.d_answers.at(idx);
+      auto& msgh = batch.d_sendVector.at(count).msg_hdr;
+      fillMSGHdr(&msgh, &batch.d_sendIOVs.at(count), &batch.d_sendCBufs.at(count), 0, &answer.buffer.at(0), answer.buffer.length(), &answer.remote);
+      msgh.msg_control=nullptr;
+      if (answer.anyLocal) {
+        addCMsgSrcAddr(&msgh, &batch.d_sendCBufs.at(count), answer.anyLocal.get_ptr(), 0);
+      }
+    }
+
+    size_t done = 0;
+    while (done < count) {
+      int res = sendmmsg(sock, &batch.d_sendVector.at(done), count - done, 0);
+      if (res <= 0) {
+        // skip the answer that could not be sent, and try the remaining ones
+        g_log<<Logger::Error<<"Error sending reply with sendmmsg (socket="<<sock<<", dest="<<batch.d_answers.at(sent + done).remote.toStringWithPort()<<"): "<<stringerror()<<endl;
+        res = 1;
+      }
+      done += res;
+    }
+    sent += count;
+  }
+
+  batch.d_queued = 0;
+}
+#endif /* HAVE_RECVMMSG && HAVE_SENDMMSG && MSG_WAITFORONE */
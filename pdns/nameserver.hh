@@ -84,12 +84,61 @@ public:
   inline bool canReusePort() {
     return d_can_reuseport;
   };
-  
+
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+  /** Buffers to receive several datagrams with a single recvmmsg() call, and to send
+      the answers we can give right away (packet cache hits) with a single sendmmsg() */
+  class MultipleMessages
+  {
+  public:
+    MultipleMessages(size_t vectorSize, size_t bufferSize);
+    size_t size() const
+    {
+      return d_received.size();
+    }
+
+  private:
+    friend class UDPNameserver;
+
+    struct Received
+    {
+      std::string buffer;
+      ComboAddress remote;
+      struct iovec iov;
+      cmsgbuf_aligned cbuf;
+    };
+    struct Answer
+    {
+      std::string buffer;
+      ComboAddress remote;
+      boost::optional<ComboAddress> anyLocal;
+      Utility::sock_t socket;
+    };
+
+    std::vector<Received> d_received;
+    std::vector<struct mmsghdr> d_receiveVector;
+    std::vector<Answer> d_answers;
+    std::vector<struct mmsghdr> d_sendVector;
+    std::vector<struct iovec> d_sendIOVs;
+    std::vector<cmsgbuf_aligned> d_sendCBufs;
+    size_t d_bufferSize;
+    size_t d_queued{0};
+    Utility::sock_t d_socket{-1};
+  };
+
+  size_t receive(MultipleMessages& batch); //!< receives up to batch.size() datagrams from one socket, returns how many
+  bool getPacket(MultipleMessages& batch, size_t idx, DNSPacket& packet); //!< fills packet from the idx-th received datagram, false if it has to be dropped
+  void queue(MultipleMessages& batch, DNSPacket& answer); //!< queues an answer, to be sent by flush()
+  void flush(MultipleMessages& batch); //!< sends all queued answers
+#endif /* HAVE_RECVMMSG && HAVE_SENDMMSG && MSG_WAITFORONE */
+
 private:
   bool d_additional_socket;
   bool d_can_reuseport{false};
   vector<int> d_sockets;
   void bindAddresses();
+  Utility::sock_t waitForSocket();
+  bool preparePacket(DNSPacket& packet, std::string& buffer, ssize_t len, Utility::sock_t sock, const ComboAddress& remote, struct msghdr* msgh);
   vector<pollfd> d_rfds;
 };
 
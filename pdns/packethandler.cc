@@ -587,15 +587,24 @@ void PacketHandler::doAdditionalProcessing(DNSPacket& p, std::unique_ptr<DNSPack
   }
 
   DNSZoneRecord dzr;
-  for(const auto& name : lookup) {
-    B.lookup(QType(QType::ANY), name, d_sd.domain_id, &p);
-    while(B.get(dzr)) {
-      if(dzr.dr.d_type == QType::A || dzr.dr.d_type == QType::AAAA) {
-        dzr.dr.d_place=DNSResourceRecord::ADDITIONAL;
-        r->addRecord(std::move(dzr));
+  B.prefetch(QType(QType::ANY), vector<DNSName>(lookup.begin(), lookup.end()), d_sd.domain_id);
+  try {
+    for(const auto& name : lookup) {
+      B.lookup(QType(QType::ANY), name, d_sd.domain_id, &p);
+      while(B.get(dzr)) {
+        if(dzr.dr.d_type == QType::A || dzr.dr.d_type == QType::AAAA) {
+          dzr.dr.d_place=DNSResourceRecord::ADDITIONAL;
+          r->addRecord(std::move(dzr));
+        }
       }
     }
   }
+  catch (...) {
+    B.endPrefetch();
+    throw;
+  }
+  // names answered from the query cache never reached the backends, their prefetched records must not be used later
+  B.endPrefetch();
 }
 
 vector<ComboAddress> PacketHandler::getIPAddressFor(const DNSName &target, const uint16_t qtype) {
@@ -824,13 +833,22 @@ bool PacketHandler::getNSEC3Hashes(bool narrow, const std::string& hashed, bool
     incrementHash(after);
   }
   else {
+    bool wantBefore = decrement || mode < 2;
+    if (g_nsec3Cache.getNeighbours(d_sd.qname, d_sd.domain_id, d_sd.serial, hashed, wantBefore, unhashed, before, after)) {
+      if (!wantBefore)
+        before=hashed;
+      return true;
+    }
+
     DNSName hashedName = DNSName(toBase32Hex(hashed));
     DNSName beforeName, afterName;
-    if (!decrement && mode >= 2)
+    if (!wantBefore)
       beforeName = hashedName;
     ret=d_sd.db->getBeforeAndAfterNamesAbsolute(d_sd.domain_id, hashedName, unhashed, beforeName, afterName);
     before=fromBase32Hex(beforeName.toString());
     after=fromBase32Hex(afterName.toString());
+    if (ret && wantBefore)
+      g_nsec3Cache.insertNeighbours(d_sd.qname, d_sd.domain_id, d_sd.serial, before, after, unhashed);
   }
   return ret;
 }
@@ -859,7 +877,7 @@ void PacketHandler::addNSEC3(DNSPacket& p, std::unique_ptr<DNSPacket>& r, const
   // add matching NSEC3 RR
   if (mode != 3) {
     unhashed=(mode == 0 || mode == 1 || mode == 5) ? target : closest;
-    hashed=hashQNameWithSalt(ns3rc, unhashed);
+    hashed=g_nsec3Cache.hash(ns3rc, unhashed);
     DLOG(g_log<<"1 hash: "<<toBase32Hex(hashed)<<" "<<unhashed<<endl);
 
     getNSEC3Hashes(narrow, hashed, false, unhashed, before, after, mode);
@@ -879,7 +897,7 @@ void PacketHandler::addNSEC3(DNSPacket& p, std::unique_ptr<DNSPacket>& r, const
       }
       doNextcloser = true;
       unhashed=closest;
-      hashed=hashQNameWithSalt(ns3rc, unhashed);
+      hashed=g_nsec3Cache.hash(ns3rc, unhashed);
       DLOG(g_log<<"1 hash: "<<toBase32Hex(hashed)<<" "<<unhashed<<endl);
 
       getNSEC3Hashes(narrow, hashed, false, unhashed, before, after);
@@ -899,7 +917,7 @@ void PacketHandler::addNSEC3(DNSPacket& p, std::unique_ptr<DNSPacket>& r, const
     }
     while( next.chopOff() && !(next==closest));
 
-    hashed=hashQNameWithSalt(ns3rc, unhashed);
+    hashed=g_nsec3Cache.hash(ns3rc, unhashed);
     DLOG(g_log<<"2 hash: "<<toBase32Hex(hashed)<<" "<<unhashed<<endl);
 
     getNSEC3Hashes(narrow, hashed, true, unhashed, before, after);
@@ -911,7 +929,7 @@ void PacketHandler::addNSEC3(DNSPacket& p, std::unique_ptr<DNSPacket>& r, const
   if (mode == 2 || mode == 4) {
     unhashed=g_wildcarddnsname+closest;
 
-    hashed=hashQNameWithSalt(ns3rc, unhashed);
+    hashed=g_nsec3Cache.hash(ns3rc, unhashed);
     DLOG(g_log<<"3 hash: "<<toBase32Hex(hashed)<<" "<<unhashed<<endl);
 
     getNSEC3Hashes(narrow, hashed, (mode != 2), unhashed, before, after);
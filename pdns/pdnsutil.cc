@@ -23,6 +23,10 @@
 #include "auth-packetcache.hh"
 #include "auth-querycache.hh"
 #include "auth-zonecache.hh"
+#include "auth-axfrcache.hh"
+#include "auth-compiledzone.hh"
+#include "auth-memoryzones.hh"
+#include "auth-nsec3cache.hh"
 #include "zoneparser-tng.hh"
 #include "signingpipe.hh"
 #include "dns_random.hh"
@@ -46,6 +50,10 @@ StatBag S;
 AuthPacketCache PC;
 AuthQueryCache QC;
 AuthZoneCache g_zoneCache;
+AuthCompiledZones g_compiledZones;
+AuthMemoryZones g_memoryZones;
+AuthAXFRCache g_axfrCache;
+AuthNSEC3Cache g_nsec3Cache;
 uint16_t g_maxNSEC3Iterations{0};
 
 namespace po = boost::program_options;
@@ -138,6 +146,7 @@ static void loadMainConfig(const std::string& configdir)
   ::arg().set("cache-ttl","Seconds to store packets in the PacketCache")="20";
   ::arg().set("negquery-cache-ttl","Seconds to store negative query results in the QueryCache")="60";
   ::arg().set("query-cache-ttl","Seconds to store query results in the QueryCache")="20";
+  ::arg().set("query-coalescing-timeout","Milliseconds to wait for another thread already sending the same query to the backends, 0 to disable")="0";
   ::arg().set("default-soa-content","Default SOA content")="a.misconfigured.dns.server.invalid hostmaster.@ 0 10800 3600 604800 3600";
   ::arg().set("chroot","Switch to this chroot jail")="";
   ::arg().set("dnssec-key-cache-ttl","Seconds to cache DNSSEC keys from the database")="30";
@@ -1871,6 +1880,10 @@ static void testSpeed(const DNSName& zone, const string& /* remote */, int cores
       ;
   cerr<<"Done, "<<csp.d_signed<<" signed, "<<csp.d_queued<<" queued, "<<csp.d_outstanding<<" outstanding"<< endl;
   cerr<<"Net speed: "<<csp.d_signed/ (dt.udiff()/1000000.0) << " sigs/s"<<endl;
+  unsigned int n = 0;
+  for (const auto& stats : csp.getWorkerStats()) {
+    cerr<<"Worker "<<n++<<": "<<stats.d_signed<<" signed ("<<stats.d_stolen<<" stolen), "<<(stats.d_busyUsec ? stats.d_signed / (stats.d_busyUsec / 1000000.0) : 0)<<" sigs/s"<<endl;
+  }
 }
 
 static void verifyCrypto(const string& zone)
@@ -32,6 +32,7 @@
 #include <algorithm>
 #include <sstream>
 #include "dnsrecords.hh"
+#include <array>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -126,13 +127,10 @@ Resolver::~Resolver()
   }
 }
 
-uint16_t Resolver::sendResolve(const ComboAddress& remote, const ComboAddress& local,
-                               const DNSName &domain, int type, int *localsock, bool dnssecOK,
-                               const DNSName& tsigkeyname, const DNSName& tsigalgorithm,
-                               const string& tsigsecret)
+uint16_t Resolver::makeQuery(vector<uint8_t>& packet, const DNSName& domain, int type, bool dnssecOK,
+                             const DNSName& tsigkeyname, const DNSName& tsigalgorithm, const string& tsigsecret)
 {
   uint16_t randomid;
-  vector<uint8_t> packet;
   DNSPacketWriter pw(packet, domain, type);
   pw.getHeader()->id = randomid = dns_random_uint16();
 
@@ -154,7 +152,11 @@ uint16_t Resolver::sendResolve(const ComboAddress& remote, const ComboAddress& l
     trc.d_eRcode=0;
     addTSIG(pw, trc, tsigkeyname, tsigsecret, "", false);
   }
+  return randomid;
+}
 
+int Resolver::getSocket(const ComboAddress& remote, const ComboAddress& local)
+{
   int sock;
 
   // choose socket based on local
@@ -181,6 +183,17 @@ uint16_t Resolver::sendResolve(const ComboAddress& remote, const ComboAddress& l
       locals[lstr] = sock;
     }
   }
+  return sock;
+}
+
+uint16_t Resolver::sendResolve(const ComboAddress& remote, const ComboAddress& local,
+                               const DNSName &domain, int type, int *localsock, bool dnssecOK,
+                               const DNSName& tsigkeyname, const DNSName& tsigalgorithm,
+                               const string& tsigsecret)
+{
+  vector<uint8_t> packet;
+  uint16_t randomid = makeQuery(packet, domain, type, dnssecOK, tsigkeyname, tsigalgorithm, tsigsecret);
+  int sock = getSocket(remote, local);
 
   if (localsock != nullptr) {
     *localsock = sock;
@@ -191,6 +204,65 @@ uint16_t Resolver::sendResolve(const ComboAddress& remote, const ComboAddress& l
   return randomid;
 }
 
+uint16_t Resolver::queueResolve(const ComboAddress& remote, const ComboAddress& local,
+                                const DNSName &domain, int type, bool dnssecOK,
+                                const DNSName& tsigkeyname, const DNSName& tsigalgorithm,
+                                const string& tsigsecret)
+{
+  vector<uint8_t> packet;
+  uint16_t randomid = makeQuery(packet, domain, type, dnssecOK, tsigkeyname, tsigalgorithm, tsigsecret);
+  int sock = getSocket(remote, local);
+
+  d_queued.push_back({sock, remote, std::string(packet.begin(), packet.end())});
+  if (d_queued.size() >= s_maxBatch) {
+    flushQueued();
+  }
+  return randomid;
+}
+
+void Resolver::flushQueued()
+{
+  // a request that cannot be sent is skipped, it will time out like an unanswered one
+  string error;
+  size_t sent = 0;
+  while (sent < d_queued.size()) {
+#if defined(HAVE_SENDMMSG)
+    // sendmmsg() works on a single socket, gather the requests going out of the same one
+    const int sock = d_queued.at(sent).d_sock;
+    std::array<struct mmsghdr, s_maxBatch> msgs;
+    std::array<struct iovec, s_maxBatch> iovs;
+    size_t count = 0;
+    for (size_t idx = sent; idx < d_queued.size() && count < s_maxBatch && d_queued.at(idx).d_sock == sock; idx++, count++) {
+      auto& request = d_queued.at(idx);
+      fillMSGHdr(&msgs.at(count).msg_hdr, &iovs.at(count), nullptr, 0, &request.d_packet.at(0), request.d_packet.size(), &request.d_remote);
+      msgs.at(count).msg_len = 0;
+    }
+
+    size_t done = 0;
+    while (done < count) {
+      int res = sendmmsg(sock, &msgs.at(done), count - done, 0);
+      if (res <= 0) {
+        error = "Unable to ask query of '" + d_queued.at(sent + done).d_remote.toStringWithPort() + "': " + stringerror();
+        res = 1;
+      }
+      done += res;
+    }
+    sent += count;
+#else
+    const auto& request = d_queued.at(sent);
+    if (sendto(request.d_sock, request.d_packet.data(), request.d_packet.size(), 0, reinterpret_cast<const struct sockaddr*>(&request.d_remote), request.d_remote.getSocklen()) < 0) {
+      error = "Unable to ask query of '" + request.d_remote.toStringWithPort() + "': " + stringerror();
+    }
+    sent++;
+#endif /* HAVE_SENDMMSG */
+  }
+  d_queued.clear();
+
+  if (!error.empty()) {
+    throw ResolverException(error);
+  }
+}
+
 namespace pdns {
   namespace resolver {
     int parseResult(MOADNSParser& mdp, const DNSName& origQname, uint16_t /* origQtype */, uint16_t id, Resolver::res_t* result)
@@ -227,7 +299,7 @@ namespace pdns {
   } // namespace resolver
 } // namespace pdns
 
-bool Resolver::tryGetSOASerial(DNSName *domain, ComboAddress* remote, uint32_t *theirSerial, uint32_t *theirInception, uint32_t *theirExpire, uint16_t* id)
+bool Resolver::receiveResponses()
 {
   auto fds = std::make_unique<struct pollfd[]>(locals.size());
   size_t i = 0, k;
@@ -255,19 +327,55 @@ bool Resolver::tryGetSOASerial(DNSName *domain, ComboAddress* remote, uint32_t *
 
   if (sock < 0) return false; // false alarm
 
-  int err;
-  remote->sin6.sin6_family = AF_INET6; // make sure getSocklen() below returns a large enough value
-  socklen_t addrlen=remote->getSocklen();
+#if defined(HAVE_RECVMMSG)
+  /* we know that at least one datagram is waiting, get as many as possible
+     without blocking to save on syscalls */
+  std::array<struct mmsghdr, s_maxBatch> msgs;
+  std::array<struct iovec, s_maxBatch> iovs;
+  std::array<ComboAddress, s_maxBatch> remotes;
+  d_receiveBuffers.resize(s_maxBatch * 3000);
+  for (size_t idx = 0; idx < s_maxBatch; idx++) {
+    remotes.at(idx).sin6.sin6_family = AF_INET6; // make sure it is big enough
+    fillMSGHdr(&msgs.at(idx).msg_hdr, &iovs.at(idx), nullptr, 0, &d_receiveBuffers.at(idx * 3000), 3000, &remotes.at(idx));
+    msgs.at(idx).msg_len = 0;
+  }
+  int got = recvmmsg(sock, msgs.data(), msgs.size(), MSG_DONTWAIT, nullptr);
+  if (got < 0) {
+    if (errno == EAGAIN)
+      return false;
+
+    throw ResolverException("recvmmsg error waiting for answer: "+stringerror());
+  }
+  for (int idx = 0; idx < got; idx++) {
+    d_received.push_back({sock, remotes.at(idx), std::string(&d_receiveBuffers.at(idx * 3000), msgs.at(idx).msg_len)});
+  }
+#else
+  ComboAddress from;
+  from.sin6.sin6_family = AF_INET6; // make sure getSocklen() below returns a large enough value
+  socklen_t addrlen = from.getSocklen();
   char buf[3000];
-  err = recvfrom(sock, buf, sizeof(buf), 0,(struct sockaddr*)(remote), &addrlen);
+  int err = recvfrom(sock, buf, sizeof(buf), 0, reinterpret_cast<struct sockaddr*>(&from), &addrlen);
   if(err < 0) {
     if(errno == EAGAIN)
       return false;
 
     throw ResolverException("recvfrom error waiting for answer: "+stringerror());
   }
+  d_received.push_back({sock, from, std::string(buf, err)});
+#endif /* HAVE_RECVMMSG */
+  return true;
+}
+
+bool Resolver::tryGetSOASerial(DNSName *domain, ComboAddress* remote, uint32_t *theirSerial, uint32_t *theirInception, uint32_t *theirExpire, uint16_t* id)
+{
+  if (d_received.empty() && !receiveResponses()) {
+    return false;
+  }
+  auto response = std::move(d_received.front());
+  d_received.pop_front();
+  *remote = response.d_remote;
 
-  MOADNSParser mdp(false, (char*)buf, err);
+  MOADNSParser mdp(false, response.d_packet);
   *id=mdp.d_header.id;
   *domain = mdp.d_qname;
 
@@ -20,6 +20,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #pragma once
+#include <deque>
 #include <string>
 #include <vector>
 #include <sys/types.h>
@@ -66,14 +67,35 @@ public:
   uint16_t sendResolve(const ComboAddress& remote, const ComboAddress& local, const DNSName &domain, int type, int *localsock, bool dnssecOk=false,
     const DNSName& tsigkeyname=DNSName(), const DNSName& tsigalgorithm=DNSName(), const string& tsigsecret="");
 
-  //! see if we got a SOA response from our sendResolve
+  //! like sendResolve, but the request is only sent by the next flushQueued(), along with the other queued ones
+  uint16_t queueResolve(const ComboAddress& remote, const ComboAddress& local, const DNSName &domain, int type, bool dnssecOk=false,
+    const DNSName& tsigkeyname=DNSName(), const DNSName& tsigalgorithm=DNSName(), const string& tsigsecret="");
+  //! sends the requests queued by queueResolve, with a single sendmmsg() per socket where available
+  void flushQueued();
+
+  //! see if we got a SOA response from our sendResolve, reading all the responses already waiting on the socket at once where recvmmsg() is available
   bool tryGetSOASerial(DNSName *theirDomain, ComboAddress* remote, uint32_t* theirSerial, uint32_t* theirInception, uint32_t* theirExpire, uint16_t* id);
   
   //! convenience function that calls resolve above
   void getSoaSerial(const ComboAddress&, const DNSName &, uint32_t *);
   
 private:
+  uint16_t makeQuery(vector<uint8_t>& packet, const DNSName& domain, int type, bool dnssecOK, const DNSName& tsigkeyname, const DNSName& tsigalgorithm, const string& tsigsecret);
+  int getSocket(const ComboAddress& remote, const ComboAddress& local);
+  bool receiveResponses();
+
+  struct Datagram
+  {
+    int d_sock;
+    ComboAddress d_remote;
+    std::string d_packet;
+  };
+
+  static const size_t s_maxBatch = 64;
   std::map<std::string, int> locals;
+  std::vector<Datagram> d_queued;
+  std::deque<Datagram> d_received; //!< read from a socket, not handed out by tryGetSOASerial() yet
+  std::vector<char> d_receiveBuffers;
 };
 
 namespace pdns {
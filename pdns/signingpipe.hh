@@ -20,18 +20,26 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #pragma once
-#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 #include "dnsseckeeper.hh"
 #include "dns.hh"
-
-void writeLStringToSocket(int fd, const string& msg);
-bool readLStringFromSocket(int fd, string& msg);
+#include "lock.hh"
 
 /** input: DNSZoneRecords ordered in qname,qtype (we emit a signature chunk on a break)
  *  output: "chunks" of those very same DNSZoneRecords, interleaved with signatures
+ *
+ *  Every RRset is a numbered job, handed over to the workers without being copied. A worker
+ *  takes the oldest job of its own queue and, when that queue is empty, steals the oldest
+ *  job of another worker. Signed RRsets are put into the chunks in the order of their
+ *  numbers, so the output has the order of the input.
  */
 
 class ChunkedSigningPipe
@@ -39,7 +47,14 @@ class ChunkedSigningPipe
 public:
   typedef vector<DNSZoneRecord> rrset_t; 
   typedef rrset_t chunk_t; // for now
-  
+
+  struct WorkerStats
+  {
+    uint64_t d_signed{0}; //!< RRsets signed by this worker
+    uint64_t d_stolen{0}; //!< of which were taken from the queue of another worker
+    uint64_t d_busyUsec{0}; //!< time spent signing
+  };
+
   ChunkedSigningPipe(const ChunkedSigningPipe&) = delete;
   void operator=(const ChunkedSigningPipe&) = delete;
   ChunkedSigningPipe(DNSName  signerName, bool mustSign, unsigned int numWorkers, unsigned int maxChunkRecords);
@@ -47,20 +62,35 @@ public:
   bool submit(const DNSZoneRecord& rr);
   chunk_t getChunk(bool final=false);
   unsigned int getReady() const;
+  std::vector<WorkerStats> getWorkerStats() const;
 
   std::atomic<unsigned long> d_signed;
   unsigned int d_queued;
   unsigned int d_outstanding;
 
 private:
+  struct Job
+  {
+    uint64_t d_seq;
+    std::unique_ptr<rrset_t> d_rrset;
+  };
+
+  struct Worker
+  {
+    LockGuarded<std::deque<Job>> d_jobs;
+    std::atomic<uint64_t> d_signed{0};
+    std::atomic<uint64_t> d_stolen{0};
+    std::atomic<uint64_t> d_busyUsec{0};
+  };
+
   void flushToSign();	
-  void dedupRRSet();
+  static void dedupRRSet(rrset_t& rrset);
   void sendRRSetToWorker(); // dispatch RRSET to worker
   void addSignedToChunks(std::unique_ptr<chunk_t>& signedChunk);
-  pair<vector<int>, vector<int> > waitForRW(bool rd, bool wr, int seconds);
+  void collectSigned(bool wait); // moves the signed RRsets that are next in line to the chunks
 
-  static void* helperWorker(ChunkedSigningPipe* csp, int fd);
-  void worker(int fd);
+  bool takeJob(unsigned int self, Job& job);
+  void worker(unsigned int self);
 
   unsigned int d_numworkers;
   unsigned int d_submitted;
@@ -70,10 +100,20 @@ private:
   DNSName d_signer;
   
   chunk_t::size_type d_maxchunkrecords;
-  
-  std::vector<int> d_sockets;
-  std::set<int> d_eof;
-  std::map<int,int> d_outstandings;
+
+  std::vector<std::unique_ptr<Worker>> d_workers;
+
+  std::mutex d_mutex;
+  std::condition_variable d_jobsCond;
+  std::condition_variable d_doneCond;
+  /* protected by d_mutex */
+  std::map<uint64_t, std::unique_ptr<rrset_t>> d_done;
+  std::string d_error;
+  unsigned int d_available{0}; // jobs in the worker queues that no worker has claimed yet
+  bool d_exit{false};
+
+  uint64_t d_nextSeq{0};
+  uint64_t d_nextOut{0};
 
   vector<std::thread> d_threads;
   bool d_mustSign;
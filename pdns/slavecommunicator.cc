@@ -39,6 +39,7 @@
 #include "dns.hh"
 #include "arguments.hh"
 #include "auth-caches.hh"
+#include "auth-xfrspool.hh"
 
 #include "base64.hh"
 #include "inflighter.cc"
@@ -303,6 +304,18 @@ static bool catalogDiff(const DomainInfo& di, vector<CatalogInfo>& fromXFR, vect
   return false;
 }
 
+// The records catalogProcess() looks at, the other records of a consumer zone are only stored
+static bool isCatalogRecord(const DNSName& zone, const DNSResourceRecord& rr)
+{
+  if (rr.qname == zone) {
+    return rr.qtype == QType::SOA;
+  }
+  if (rr.qname == DNSName("version") + zone) {
+    return rr.qtype == QType::TXT;
+  }
+  return rr.qname.isPartOf(DNSName("zones") + zone);
+}
+
 static bool catalogProcess(const DomainInfo& di, vector<DNSResourceRecord>& rrs, string logPrefix)
 {
   logPrefix += "Catalog-Zone ";
@@ -401,7 +414,6 @@ static bool catalogProcess(const DomainInfo& di, vector<DNSResourceRecord>& rrs,
         }
       }
     }
-    rr.disabled = true;
   }
   if (!ci.d_zone.empty()) {
     fromXFR.emplace_back(ci);
@@ -578,13 +590,14 @@ static bool processRecordForZS(const DNSName& domain, bool& firstNSEC3, DNSResou
    3) The code walks through the zone records do determine DNSSEC status (secured, nsec/nsec3, optout)
    4) It inserts the zone into the database
       With the right 'ordername' fields
+      The records are spooled while they come in (see AuthXFRSpool) and fed
+      in batches, only the names of the zone are kept in memory
    5) It updates the Empty Non Terminals
 */
 
-static vector<DNSResourceRecord> doAxfr(const ComboAddress& raddr, const DNSName& domain, const TSIGTriplet& tt, const ComboAddress& laddr,  unique_ptr<AuthLua4>& pdl, ZoneStatus& zs)
+static void doAxfr(const ComboAddress& raddr, const DNSName& domain, const TSIGTriplet& tt, const ComboAddress& laddr,  unique_ptr<AuthLua4>& pdl, ZoneStatus& zs, AuthXFRSpool& spool, vector<DNSResourceRecord>* catalogRecords)
 {
   uint16_t axfr_timeout=::arg().asNum("axfr-fetch-timeout");
-  vector<DNSResourceRecord> rrs;
   AXFRRetriever retriever(raddr, domain, tt, (laddr.sin4.sin_family == 0) ? nullptr : &laddr, ((size_t) ::arg().asNum("xfr-max-received-mbytes")) * 1024 * 1024, axfr_timeout);
   Resolver::res_t recs;
   bool first=true;
@@ -628,12 +641,13 @@ static vector<DNSResourceRecord> doAxfr(const ComboAddress& raddr, const DNSName
           soa_received = true;
         }
 
-        rrs.push_back(rr);
-
+        if (catalogRecords != nullptr && isCatalogRecord(domain, rr)) {
+          catalogRecords->push_back(rr);
+        }
+        spool.push(rr);
       }
     }
   }
-  return rrs;
 }
 
 
@@ -737,7 +751,9 @@ void CommunicatorClass::suck(const DNSName &domain, const ComboAddress& remote,
     bool hadNarrow=false;
 
 
-    vector<DNSResourceRecord> rrs;
+    AuthXFRSpool spool(::arg().asNum("axfr-ingest-batch-size"), ::arg()["axfr-spool-directory"]);
+    vector<DNSResourceRecord> catalogRecords;
+    auto* catalogSink = di.kind == DomainInfo::Consumer ? &catalogRecords : nullptr;
     if (dk.isSecuredZone(domain, false)) {
       hadDnssecZone=true;
       hadPresigned = dk.isPresigned(domain, false);
@@ -759,7 +775,6 @@ void CommunicatorClass::suck(const DNSName &domain, const ComboAddress& remote,
           g_log<<Logger::Notice<<logPrefix<<"IXFR turned into an AXFR"<<endl;
           logPrefix[0]='A'; // IXFR -> AXFR
           bool firstNSEC3=true;
-          rrs.reserve(axfr.size());
           for(const auto& dr : axfr) {
             auto rr = DNSResourceRecord::fromWire(dr);
             (rr.qname += domain).makeUsLowerCase();
@@ -770,7 +785,10 @@ void CommunicatorClass::suck(const DNSName &domain, const ComboAddress& remote,
               auto sd = getRR<SOARecordContent>(dr);
               zs.soa_serial = sd->d_st.serial;
             }
-            rrs.push_back(rr);
+            if (catalogSink != nullptr && isCatalogRecord(domain, rr)) {
+              catalogSink->push_back(rr);
+            }
+            spool.push(rr);
           }
         }
         else {
@@ -781,17 +799,18 @@ void CommunicatorClass::suck(const DNSName &domain, const ComboAddress& remote,
       }
     }
 
-    if(rrs.empty()) {
+    if(spool.empty()) {
       g_log<<Logger::Notice<<logPrefix<<"starting AXFR"<<endl;
-      rrs = doAxfr(remote, domain, tt, laddr, pdl, zs);
+      doAxfr(remote, domain, tt, laddr, pdl, zs, spool, catalogSink);
       logPrefix = "A" + logPrefix; // XFR -> AXFR
-      g_log<<Logger::Notice<<logPrefix<<"retrieval finished"<<endl;
+      g_log<<Logger::Notice<<logPrefix<<"retrieval finished, "<<spool.size()<<" record"<<addS(spool.size())<<(spool.spilled() ? " spooled to disk" : "")<<endl;
     }
 
     if (di.kind == DomainInfo::Consumer) {
-      if (!catalogProcess(di, rrs, logPrefix)) {
+      if (!catalogProcess(di, catalogRecords, logPrefix)) {
         g_log << Logger::Warning << logPrefix << "Catalog-Zone update failed, only import records" << endl;
       }
+      vector<DNSResourceRecord>().swap(catalogRecords);
     }
 
     if(zs.isNSEC3) {
@@ -865,78 +884,85 @@ void CommunicatorClass::suck(const DNSName &domain, const ComboAddress& remote,
     map<DNSName,bool> nonterm;
 
 
-    for(DNSResourceRecord& rr :  rrs) {
-      if(!zs.isPresigned) {
-        if (rr.qtype.getCode() == QType::RRSIG)
-          continue;
-        if(zs.isDnssecZone && rr.qtype.getCode() == QType::DNSKEY && !::arg().mustDo("direct-dnskey"))
-          continue;
-      }
-
-      // Figure out auth and ents
-      rr.auth=true;
-      shorter=rr.qname;
-      rrterm.clear();
-      do {
-        if(doent) {
-          if (!zs.qnames.count(shorter))
-            rrterm.insert(shorter);
-        }
-        if(zs.nsset.count(shorter) && rr.qtype.getCode() != QType::DS)
-          rr.auth=false;
-
-        if (shorter==domain) // stop at apex
-          break;
-      }while(shorter.chopOff());
-
-      // Insert ents
-      if(doent && !rrterm.empty()) {
-        bool auth;
-        if (!rr.auth && rr.qtype.getCode() == QType::NS) {
-          if (zs.isNSEC3)
-            ordername=DNSName(toBase32Hex(hashQNameWithSalt(zs.ns3pr, rr.qname)));
-          auth=(!zs.isNSEC3 || !zs.optOutFlag || zs.secured.count(ordername));
-        } else
-          auth=rr.auth;
-
-        for(const auto &nt: rrterm){
-          if (!nonterm.count(nt))
-              nonterm.insert(pair<DNSName, bool>(nt, auth));
-            else if (auth)
-              nonterm[nt]=true;
+    spool.replay([&](vector<DNSResourceRecord>& batch) {
+      for(DNSResourceRecord& rr : batch) {
+        // a consumer zone is stored disabled, but for its SOA
+        if (di.kind == DomainInfo::Consumer && !(rr.qname == domain && rr.qtype == QType::SOA)) {
+          rr.disabled = true;
         }
 
-        if(nonterm.size() > maxent) {
-          g_log<<Logger::Warning<<logPrefix<<"zone has too many empty non terminals"<<endl;
-          nonterm.clear();
-          doent=false;
+        if(!zs.isPresigned) {
+          if (rr.qtype.getCode() == QType::RRSIG)
+            continue;
+          if(zs.isDnssecZone && rr.qtype.getCode() == QType::DNSKEY && !::arg().mustDo("direct-dnskey"))
+            continue;
         }
-      }
 
-      // RRSIG is always auth, even inside a delegation
-      if (rr.qtype.getCode() == QType::RRSIG)
+        // Figure out auth and ents
         rr.auth=true;
-
-      // Add ordername and insert record
-      if (zs.isDnssecZone && rr.qtype.getCode() != QType::RRSIG) {
-        if (zs.isNSEC3) {
-          // NSEC3
-          ordername=DNSName(toBase32Hex(hashQNameWithSalt(zs.ns3pr, rr.qname)));
-          if(!zs.isNarrow && (rr.auth || (rr.qtype.getCode() == QType::NS && (!zs.optOutFlag || zs.secured.count(ordername))))) {
-            di.backend->feedRecord(rr, ordername, true);
-          } else
-            di.backend->feedRecord(rr, DNSName());
-        } else {
-          // NSEC
-          if (rr.auth || rr.qtype.getCode() == QType::NS) {
-            ordername=rr.qname.makeRelative(domain);
-            di.backend->feedRecord(rr, ordername);
+        shorter=rr.qname;
+        rrterm.clear();
+        do {
+          if(doent) {
+            if (!zs.qnames.count(shorter))
+              rrterm.insert(shorter);
+          }
+          if(zs.nsset.count(shorter) && rr.qtype.getCode() != QType::DS)
+            rr.auth=false;
+
+          if (shorter==domain) // stop at apex
+            break;
+        }while(shorter.chopOff());
+
+        // Insert ents
+        if(doent && !rrterm.empty()) {
+          bool auth;
+          if (!rr.auth && rr.qtype.getCode() == QType::NS) {
+            if (zs.isNSEC3)
+              ordername=DNSName(toBase32Hex(hashQNameWithSalt(zs.ns3pr, rr.qname)));
+            auth=(!zs.isNSEC3 || !zs.optOutFlag || zs.secured.count(ordername));
           } else
-            di.backend->feedRecord(rr, DNSName());
+            auth=rr.auth;
+
+          for(const auto &nt: rrterm){
+            if (!nonterm.count(nt))
+                nonterm.insert(pair<DNSName, bool>(nt, auth));
+              else if (auth)
+                nonterm[nt]=true;
+          }
+
+          if(nonterm.size() > maxent) {
+            g_log<<Logger::Warning<<logPrefix<<"zone has too many empty non terminals"<<endl;
+            nonterm.clear();
+            doent=false;
+          }
         }
-      } else
-        di.backend->feedRecord(rr, DNSName());
-    }
+
+        // RRSIG is always auth, even inside a delegation
+        if (rr.qtype.getCode() == QType::RRSIG)
+          rr.auth=true;
+
+        // Add ordername and insert record
+        if (zs.isDnssecZone && rr.qtype.getCode() != QType::RRSIG) {
+          if (zs.isNSEC3) {
+            // NSEC3
+            ordername=DNSName(toBase32Hex(hashQNameWithSalt(zs.ns3pr, rr.qname)));
+            if(!zs.isNarrow && (rr.auth || (rr.qtype.getCode() == QType::NS && (!zs.optOutFlag || zs.secured.count(ordername))))) {
+              di.backend->feedRecord(rr, ordername, true);
+            } else
+              di.backend->feedRecord(rr, DNSName());
+          } else {
+            // NSEC
+            if (rr.auth || rr.qtype.getCode() == QType::NS) {
+              ordername=rr.qname.makeRelative(domain);
+              di.backend->feedRecord(rr, ordername);
+            } else
+              di.backend->feedRecord(rr, DNSName());
+          }
+        } else
+          di.backend->feedRecord(rr, DNSName());
+      }
+    });
 
     // Insert empty non-terminals
     if(doent && !nonterm.empty()) {
@@ -1040,46 +1066,115 @@ struct SlaveSenderReceiver
 
   map<uint32_t, Answer> d_freshness;
 
-  SlaveSenderReceiver()
+  SlaveSenderReceiver(size_t maxInFlightPerPrimary, size_t maxPerSecondPerPrimary) :
+    d_maxInFlightPerPrimary(maxInFlightPerPrimary), d_maxPerSecondPerPrimary(maxPerSecondPerPrimary)
   {
   }
 
-  void deliverTimeout(const Identifier& /* i */)
+  // whether the limits of the primary of that zone allow a check now, 0 means no limit
+  bool mayBeSent(const DomainNotificationInfo& dni)
   {
+    const auto& primary = d_primaries[*dni.di.masters.begin()];
+    if (d_maxInFlightPerPrimary != 0 && primary.d_inFlight >= d_maxInFlightPerPrimary) {
+      return false;
+    }
+    return d_maxPerSecondPerPrimary == 0 || primary.d_second != time(nullptr) || primary.d_sentThisSecond < d_maxPerSecondPerPrimary;
+  }
+
+  void deliverTimeout(const Identifier& i)
+  {
+    done(std::get<1>(i));
   }
 
   Identifier send(DomainNotificationInfo& dni)
   {
-    shuffle(dni.di.masters.begin(), dni.di.masters.end(), pdns::dns_random_engine());
+    const ComboAddress& remote = *dni.di.masters.begin();
+    uint16_t id;
     try {
-      return std::make_tuple(dni.di.zone,
-                             *dni.di.masters.begin(),
-                             d_resolver.sendResolve(*dni.di.masters.begin(),
-                                                    dni.localaddr,
-                                                    dni.di.zone,
-                                                    QType::SOA,
-                                                    nullptr,
-                                                    dni.dnssecOk, dni.tsigkeyname, dni.tsigalgname, dni.tsigsecret)
-        );
+      // sent by receive(), with the other checks of this burst
+      id = d_resolver.queueResolve(remote,
+                                   dni.localaddr,
+                                   dni.di.zone,
+                                   QType::SOA,
+                                   dni.dnssecOk, dni.tsigkeyname, dni.tsigalgname, dni.tsigsecret);
     }
     catch(PDNSException& e) {
       throw runtime_error("While attempting to query freshness of '"+dni.di.zone.toLogString()+"': "+e.reason);
     }
+
+    auto& primary = d_primaries[remote];
+    primary.d_inFlight++;
+    time_t now = time(nullptr);
+    if (primary.d_second != now) {
+      primary.d_second = now;
+      primary.d_sentThisSecond = 0;
+    }
+    primary.d_sentThisSecond++;
+    return std::make_tuple(dni.di.zone, remote, id);
   }
 
   bool receive(Identifier& id, Answer& a)
   {
+    try {
+      d_resolver.flushQueued();
+    }
+    catch(PDNSException& e) {
+      throw runtime_error("While sending freshness checks: "+e.reason);
+    }
     return d_resolver.tryGetSOASerial(&(std::get<0>(id)), &(std::get<1>(id)), &a.theirSerial, &a.theirInception, &a.theirExpire, &(std::get<2>(id)));
   }
 
   void deliverAnswer(const DomainNotificationInfo& dni, const Answer& a, unsigned int /* usec */)
   {
     d_freshness[dni.di.id]=a;
+    done(*dni.di.masters.begin());
   }
 
   Resolver d_resolver;
+
+private:
+  struct PrimaryState
+  {
+    size_t d_inFlight{0};
+    time_t d_second{0};
+    size_t d_sentThisSecond{0};
+  };
+
+  void done(const ComboAddress& remote)
+  {
+    auto& primary = d_primaries[remote];
+    if (primary.d_inFlight > 0) {
+      primary.d_inFlight--;
+    }
+  }
+
+  map<ComboAddress, PrimaryState> d_primaries;
+  const size_t d_maxInFlightPerPrimary;
+  const size_t d_maxPerSecondPerPrimary;
 };
 
+// Interleaves the zones of the different primaries, so the checks of a primary with many zones
+// do not come first and the per primary limits rarely have to pass over them
+static void interleaveByPrimary(vector<DomainNotificationInfo>& sdomains)
+{
+  map<ComboAddress, vector<DomainNotificationInfo>> byPrimary;
+  size_t largest = 0;
+  for (auto& dni : sdomains) {
+    auto& zones = byPrimary[*dni.di.masters.begin()];
+    zones.push_back(std::move(dni));
+    largest = std::max(largest, zones.size());
+  }
+  sdomains.clear();
+
+  for (size_t pos = 0; pos < largest; ++pos) {
+    for (auto& [primary, zones] : byPrimary) {
+      if (pos < zones.size()) {
+        sdomains.push_back(std::move(zones[pos]));
+      }
+    }
+  }
+}
+
 void CommunicatorClass::addSlaveCheckRequest(const DomainInfo& di, const ComboAddress& remote)
 {
   auto data = d_data.lock();
@@ -1155,6 +1250,8 @@ void CommunicatorClass::slaveRefresh(PacketHandler *P)
     P->trySuperMasterSynchronous(dp, tsigkeyname); // FIXME could use some error logging
   }
   if(rdomains.empty()) { // if we have priority domains, check them first
+    // the backends decide which zones are due, most of them (like the generic SQL ones) by going over
+    // every secondary zone and its SOA, so the cost of a cycle grows with the number of secondaries
     B->getUnfreshSlaveInfos(&rdomains);
   }
   sdomains.reserve(rdomains.size());
@@ -1189,6 +1286,8 @@ void CommunicatorClass::slaveRefresh(PacketHandler *P)
       DomainNotificationInfo dni;
       dni.di = di;
       dni.dnssecOk = checkSignatures;
+      // pick the primary to query now, so the checks can be spread over the primaries
+      shuffle(dni.di.masters.begin(), dni.di.masters.end(), pdns::dns_random_engine());
 
       if(dk.getTSIGForAccess(di.zone, sr.master, &dni.tsigkeyname)) {
         string secret64;
@@ -1236,11 +1335,15 @@ void CommunicatorClass::slaveRefresh(PacketHandler *P)
       " checking, "<<data->d_suckdomains.size()<<" queued for AXFR"<<endl;
   }
 
-  SlaveSenderReceiver ssr;
+  SlaveSenderReceiver ssr(::arg().asNum("xfr-max-inflight-soa-checks-per-primary"), ::arg().asNum("xfr-max-soa-checks-per-second-per-primary"));
+  const size_t checks = sdomains.size();
+  interleaveByPrimary(sdomains);
 
   Inflighter<vector<DomainNotificationInfo>, SlaveSenderReceiver> ifl(sdomains, ssr);
 
-  ifl.d_maxInFlight = 200;
+  ifl.d_maxInFlight = ::arg().asNum("xfr-max-inflight-soa-checks");
+  ifl.d_burst = 64; // the checks of a burst are sent together, with a single sendmmsg() per socket
+  ifl.d_mayBeSent = [&ssr](const DomainNotificationInfo& dni) { return ssr.mayBeSent(dni); };
 
   for(;;) {
     try {
@@ -1254,6 +1357,8 @@ void CommunicatorClass::slaveRefresh(PacketHandler *P)
       g_log<<Logger::Error<<"While checking domain freshness: " << re.reason<<endl;
     }
   }
+  S.deposit("secondary-soa-checks", checks);
+  S.deposit("secondary-soa-check-timeouts", ifl.getTimeouts());
 
   if (ifl.getTimeouts()) {
     g_log<<Logger::Warning<<"Received serial number updates for "<<ssr.d_freshness.size()<<" zone"<<addS(ssr.d_freshness.size())<<", had "<<ifl.getTimeouts()<<" timeout"<<addS(ifl.getTimeouts())<<endl;
@@ -1262,6 +1367,7 @@ void CommunicatorClass::slaveRefresh(PacketHandler *P)
   }
 
   time_t now = time(nullptr);
+  time_t maxLag = 0;
   for(auto& val : sdomains) {
     DomainInfo& di(val.di);
     // If our di comes from packethandler (caused by incoming NOTIFY), di.backend will not be filled out,
@@ -1323,6 +1429,11 @@ void CommunicatorClass::slaveRefresh(PacketHandler *P)
     }
     catch(...) {}
 
+    // how long after its refresh time this zone got checked
+    if (hasSOA && di.last_check > 0) {
+      maxLag = std::max(maxLag, now - static_cast<time_t>(di.last_check + sd.refresh));
+    }
+
     uint32_t theirserial = ssr.d_freshness[di.id].theirSerial;
     uint32_t ourserial = sd.serial;
     const ComboAddress remote = *di.masters.begin();
@@ -1390,6 +1501,7 @@ void CommunicatorClass::slaveRefresh(PacketHandler *P)
       addSuckRequest(di.zone, remote, prio);
     }
   }
+  S.set("secondary-refresh-lag", maxLag);
 }
 
 vector<pair<DNSName, ComboAddress> > CommunicatorClass::getSuckRequests() {
@@ -62,6 +62,7 @@
 #include "noinitvector.hh"
 #include "gss_context.hh"
 #include "pdnsexception.hh"
+#include "mplexer.hh"
 extern AuthPacketCache PC;
 extern StatBag S;
 
@@ -80,6 +81,10 @@ unsigned int TCPNameserver::d_idleTimeout;
 unsigned int TCPNameserver::d_maxConnectionDuration;
 LockGuarded<std::map<ComboAddress,size_t,ComboAddress::addressOnlyLessThan>> TCPNameserver::s_clientsCount;
 
+typedef Distributor<DNSPacket, DNSPacket, PacketHandler> DNSDistributor;
+// the backend threads the TCP workers hand their cache misses to, shared by all of them
+static std::unique_ptr<DNSDistributor> s_workerDistributor{nullptr};
+
 void TCPNameserver::go()
 {
   g_log<<Logger::Error<<"Creating backend connection for TCP"<<endl;
@@ -91,6 +96,14 @@ void TCPNameserver::go()
     g_log<<Logger::Error<<"TCP server is unable to launch backends - will try again when questions come in: "<<ae.reason<<endl;
   }
 
+  if (!d_workerPipes.empty() && ::arg().asNum("distributor-threads", 1) > 1) {
+    s_workerDistributor = std::unique_ptr<DNSDistributor>(DNSDistributor::Create(::arg().asNum("distributor-threads", 1)));
+  }
+  for (const auto& pipes : d_workerPipes) {
+    std::thread worker(workerThread, pipes.first);
+    worker.detach();
+  }
+
   std::thread th([this](){thread();});
   th.detach();
 }
@@ -449,6 +462,676 @@ void TCPNameserver::doConnection(int fd)
 }
 
 
+/* With tcp-worker-threads set, connections are not given a thread of their own but are
+   spread over a fixed number of workers, each serving its connections from a multiplexer.
+   Pipelined queries are read back to back, cache misses go to a Distributor shared by all
+   workers and their answers are written as they come back, so they might be sent out of order.
+   With distributor-threads set to 1, each worker answers its cache misses itself.
+   Transfers are handed to a short-lived thread and the connection goes back to its worker
+   once they are done. */
+
+struct TCPNameserver::WorkerConnection
+{
+  enum class IOState : uint8_t { None, Reading, Writing };
+
+  WorkerConnection(int fd, const ComboAddress& remote, int workerPipe) :
+    d_remote(remote), d_fd(fd), d_workerPipe(workerPipe)
+  {
+  }
+
+  bool pendingOutput() const
+  {
+    return d_outpos < d_outbuf.size();
+  }
+
+  bool hasCompleteQuery() const
+  {
+    if (d_needProxyHeader || d_inbuf.size() < 2) {
+      return false;
+    }
+    size_t pktlen = (d_inbuf.at(0) << 8) + d_inbuf.at(1);
+    return d_inbuf.size() >= pktlen + 2;
+  }
+
+  ComboAddress d_remote;
+  std::optional<ComboAddress> d_innerRemote;
+  std::unique_ptr<DNSPacket> d_pendingTransfer{nullptr};
+  PacketBuffer d_inbuf;
+  std::string d_outbuf;
+  size_t d_outpos{0};
+  size_t d_transactions{0};
+  size_t d_inFlight{0};
+  uint64_t d_id{0};
+  time_t d_start{0};
+  int d_fd;
+  int d_workerPipe;
+  IOState d_state{IOState::None};
+  bool d_innerTCP{false};
+  bool d_needProxyHeader{false};
+  bool d_closeAfterWrite{false};
+};
+
+class TCPNameserver::Worker
+{
+public:
+  Worker(int pipe) :
+    d_mplexer(FDMultiplexer::getMultiplexerSilent()), d_pipe(pipe), d_logDNSQueries(::arg().mustDo("log-dns-queries"))
+  {
+    if (!d_mplexer) {
+      throw PDNSException("Unable to create a multiplexer for the TCP worker");
+    }
+
+    int fds[2];
+    if (::pipe(fds) < 0)
+      unixDie("Creating pipe");
+    setCloseOnExec(fds[0]);
+    setCloseOnExec(fds[1]);
+    setNonBlocking(fds[0]);
+    setNonBlocking(fds[1]);
+    d_answerPipe = {fds[0], fds[1]};
+
+    d_distributor = s_workerDistributor.get();
+    if (d_distributor == nullptr) {
+      d_ownDistributor = std::unique_ptr<DNSDistributor>(DNSDistributor::Create(1));
+      d_distributor = d_ownDistributor.get();
+    }
+  }
+
+  void run();
+
+private:
+  enum class QueryResult : uint8_t { Answered, Queued, Transfer, Close };
+
+  struct BackendAnswer
+  {
+    std::unique_ptr<DNSPacket> d_reply;
+    uint64_t d_connId;
+    int d_fd;
+  };
+
+  void queueAnswer(int fd, uint64_t connId, std::unique_ptr<DNSPacket>& reply);
+  void handleAnswers();
+  void adopt(std::unique_ptr<WorkerConnection>&& conn);
+  void handleReadable(WorkerConnection* conn);
+  void service(WorkerConnection* conn);
+  bool processProxyHeader(WorkerConnection* conn);
+  void processBuffered(WorkerConnection* conn);
+  QueryResult processQuery(WorkerConnection* conn, const char* mesg, uint16_t pktlen);
+  bool flush(WorkerConnection* conn);
+  void watch(WorkerConnection* conn, WorkerConnection::IOState state);
+  void unwatch(WorkerConnection* conn);
+  void startTransfer(WorkerConnection* conn);
+  void expireParked(time_t now);
+  std::unique_ptr<WorkerConnection> release(WorkerConnection* conn);
+  void close(WorkerConnection* conn);
+
+  static constexpr size_t s_readSize{4096};
+  static constexpr size_t s_maxPendingOutput{65536};
+  static constexpr size_t s_maxInFlight{64};
+
+  std::map<int, std::unique_ptr<WorkerConnection>> d_connections;
+  // filled by the threads of d_distributor, emptied by us after a byte on d_answerPipe
+  LockGuarded<std::vector<BackendAnswer>> d_answers;
+  std::unique_ptr<FDMultiplexer> d_mplexer;
+  DNSDistributor* d_distributor{nullptr};
+  std::unique_ptr<DNSDistributor> d_ownDistributor{nullptr};
+  char d_readBuffer[s_readSize];
+  time_t d_lastParkedCheck{0};
+  uint64_t d_nextConnId{1};
+  std::pair<int, int> d_answerPipe;
+  int d_pipe;
+  bool d_logDNSQueries;
+};
+
+static void appendPacket(DNSPacket& p, std::string& buffer)
+{
+  uint16_t len=htons(p.getString(true).length());
+
+  // this also calls p.getString; call it after our explicit call so throwsOnTruncation=true is honoured
+  g_rs.submitResponse(p, false, true);
+
+  buffer.append((const char*)&len, 2);
+  buffer.append(p.getString());
+}
+
+void TCPNameserver::Worker::run()
+{
+  d_mplexer->addReadFD(d_pipe, [this](int fd, FDMultiplexer::funcparam_t& /* param */) {
+    WorkerConnection* tmp = nullptr;
+    if (read(fd, &tmp, sizeof(tmp)) != sizeof(tmp)) {
+      unixDie("read from TCP worker pipe");
+    }
+    adopt(std::unique_ptr<WorkerConnection>(tmp));
+  });
+
+  d_mplexer->addReadFD(d_answerPipe.first, [this](int fd, FDMultiplexer::funcparam_t& /* param */) {
+    char wakeups[64];
+    while (read(fd, wakeups, sizeof(wakeups)) == sizeof(wakeups)) {
+    }
+    handleAnswers();
+  });
+
+  struct timeval now;
+  for (;;) {
+    d_mplexer->run(&now, 1000);
+
+    for (const bool writes : {false, true}) {
+      for (const auto& timeout : d_mplexer->getTimeouts(now, writes)) {
+        auto conn = boost::any_cast<WorkerConnection*>(timeout.second);
+        if (d_maxConnectionDuration && now.tv_sec >= conn->d_start + static_cast<time_t>(d_maxConnectionDuration)) {
+          g_log<<Logger::Notice<<"TCP Remote "<<conn->d_remote<<" exceeded the maximum TCP connection duration, dropping."<<endl;
+        }
+        else {
+          g_log<<Logger::Info<<"TCP connection from "<<conn->d_remote<<" timed out while "<<(writes ? "writing" : "reading")<<endl;
+        }
+        close(conn);
+      }
+    }
+
+    if (d_maxConnectionDuration && now.tv_sec != d_lastParkedCheck) {
+      d_lastParkedCheck = now.tv_sec;
+      expireParked(now.tv_sec);
+    }
+  }
+}
+
+// connections waiting for the backends are not watched by the multiplexer, so it does not time them out
+void TCPNameserver::Worker::expireParked(time_t now)
+{
+  std::vector<WorkerConnection*> expired;
+  for (const auto& entry : d_connections) {
+    const auto& conn = entry.second;
+    if (conn->d_state == WorkerConnection::IOState::None && conn->d_inFlight > 0 && now >= conn->d_start + static_cast<time_t>(d_maxConnectionDuration)) {
+      expired.push_back(conn.get());
+    }
+  }
+
+  for (const auto& conn : expired) {
+    g_log<<Logger::Notice<<"TCP Remote "<<conn->d_remote<<" exceeded the maximum TCP connection duration while waiting for the backends, dropping."<<endl;
+    close(conn);
+  }
+}
+
+// called from the Distributor threads, or from our own thread with distributor-threads set to 1
+void TCPNameserver::Worker::queueAnswer(int fd, uint64_t connId, std::unique_ptr<DNSPacket>& reply)
+{
+  bool wakeup;
+  {
+    auto answers = d_answers.lock();
+    wakeup = answers->empty();
+    answers->push_back({std::move(reply), connId, fd});
+  }
+
+  if (wakeup) {
+    char byte = 0;
+    // a full pipe already holds a wake-up for the worker
+    while (write(d_answerPipe.second, &byte, sizeof(byte)) < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      if (errno != EINTR) {
+        unixDie("write to TCP worker answer pipe");
+      }
+    }
+  }
+}
+
+void TCPNameserver::Worker::handleAnswers()
+{
+  std::vector<BackendAnswer> answers;
+  d_answers.lock()->swap(answers);
+
+  std::set<WorkerConnection*> answered;
+  for (auto& answer : answers) {
+    auto it = d_connections.find(answer.d_fd);
+    if (it == d_connections.end() || it->second->d_id != answer.d_connId) {
+      continue; // the connection was closed while the backend was working on it
+    }
+    auto conn = it->second.get();
+    conn->d_inFlight--;
+    if (answer.d_reply) {
+      appendPacket(*answer.d_reply, conn->d_outbuf);
+    }
+    else {
+      conn->d_closeAfterWrite = true; // unable to write an answer
+    }
+    answered.insert(conn);
+  }
+
+  for (const auto& conn : answered) {
+    service(conn);
+  }
+}
+
+void TCPNameserver::Worker::adopt(std::unique_ptr<WorkerConnection>&& conn)
+{
+  auto raw = conn.get();
+  if (!raw->d_id) {
+    raw->d_id = d_nextConnId++;
+  }
+  d_connections[raw->d_fd] = std::move(conn);
+  // a connection coming back from a transfer might have further queries buffered already
+  service(raw);
+}
+
+void TCPNameserver::Worker::handleReadable(WorkerConnection* conn)
+{
+  ssize_t got = read(conn->d_fd, d_readBuffer, sizeof(d_readBuffer));
+  if (got < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return;
+    }
+    g_log<<Logger::Info<<"Error reading DNS data from TCP client "<<conn->d_remote<<": "<<stringerror()<<endl;
+    close(conn);
+    return;
+  }
+  if (got == 0) {
+    if (!conn->d_inbuf.empty()) {
+      g_log<<Logger::Info<<"TCP client "<<conn->d_remote<<" closed the connection in the middle of a query"<<endl;
+    }
+    close(conn);
+    return;
+  }
+
+  conn->d_inbuf.insert(conn->d_inbuf.end(), d_readBuffer, d_readBuffer + got);
+  service(conn);
+}
+
+void TCPNameserver::Worker::service(WorkerConnection* conn)
+{
+  for (;;) {
+    processBuffered(conn);
+
+    if (!flush(conn)) {
+      close(conn);
+      return;
+    }
+    if (conn->pendingOutput()) {
+      watch(conn, WorkerConnection::IOState::Writing);
+      return;
+    }
+    if (conn->d_inFlight > 0 && (conn->d_pendingTransfer || conn->d_closeAfterWrite || conn->d_inFlight >= s_maxInFlight)) {
+      // stop reading until the backends catch up, handleAnswers() takes it from there
+      unwatch(conn);
+      return;
+    }
+    if (conn->d_pendingTransfer) {
+      startTransfer(conn);
+      return;
+    }
+    if (conn->d_closeAfterWrite) {
+      close(conn);
+      return;
+    }
+    if (!conn->hasCompleteQuery()) {
+      watch(conn, WorkerConnection::IOState::Reading);
+      return;
+    }
+  }
+}
+
+bool TCPNameserver::Worker::processProxyHeader(WorkerConnection* conn)
+{
+  ssize_t used = isProxyHeaderComplete(conn->d_inbuf);
+  if (used < 0) {
+    if (conn->d_inbuf.size() >= g_proxyProtocolMaximumSize) {
+      g_log<<Logger::Info<<"Error reading PROXYv2 header from TCP client "<<conn->d_remote<<": PROXYv2 header too big"<<endl;
+      conn->d_closeAfterWrite = true;
+    }
+    return false;
+  }
+  if (used == 0) {
+    g_log<<Logger::Info<<"Error reading PROXYv2 header from TCP client "<<conn->d_remote<<": PROXYv2 header was invalid"<<endl;
+    conn->d_closeAfterWrite = true;
+    return false;
+  }
+  if (static_cast<size_t>(used) > g_proxyProtocolMaximumSize) {
+    g_log<<Logger::Info<<"Error reading PROXYv2 header from TCP client "<<conn->d_remote<<": PROXYv2 header too big"<<endl;
+    conn->d_closeAfterWrite = true;
+    return false;
+  }
+
+  PacketBuffer proxyData(conn->d_inbuf.begin(), conn->d_inbuf.begin() + used);
+  ComboAddress psource, pdestination;
+  bool proxyProto, tcp;
+  std::vector<ProxyProtocolValue> ppvalues;
+
+  used = parseProxyHeader(proxyData, proxyProto, psource, pdestination, tcp, ppvalues);
+  if (used <= 0) {
+    g_log<<Logger::Info<<"Error reading PROXYv2 header from TCP client "<<conn->d_remote<<": PROXYv2 header was invalid"<<endl;
+    conn->d_closeAfterWrite = true;
+    return false;
+  }
+
+  conn->d_inbuf.erase(conn->d_inbuf.begin(), conn->d_inbuf.begin() + used);
+  conn->d_innerRemote = psource;
+  conn->d_innerTCP = tcp;
+  conn->d_needProxyHeader = false;
+  return true;
+}
+
+void TCPNameserver::Worker::processBuffered(WorkerConnection* conn)
+{
+  if (conn->d_needProxyHeader && !processProxyHeader(conn)) {
+    return;
+  }
+
+  size_t consumed = 0;
+  while (!conn->d_closeAfterWrite && !conn->d_pendingTransfer && conn->d_inFlight < s_maxInFlight && conn->d_outbuf.size() - conn->d_outpos < s_maxPendingOutput) {
+    size_t available = conn->d_inbuf.size() - consumed;
+    if (available < 2) {
+      break;
+    }
+    uint16_t pktlen = (conn->d_inbuf.at(consumed) << 8) + conn->d_inbuf.at(consumed + 1);
+    if (available < static_cast<size_t>(pktlen) + 2) {
+      break;
+    }
+
+    const char* mesg = reinterpret_cast<const char*>(&conn->d_inbuf.at(consumed + 2));
+    consumed += pktlen + 2;
+
+    QueryResult result;
+    try {
+      result = processQuery(conn, mesg, pktlen);
+    }
+    catch (const PDNSException& ae) {
+      g_log<<Logger::Error<<"TCP worker had error: "<<ae.reason<<endl;
+      result = QueryResult::Close;
+    }
+    catch (const std::exception& e) {
+      g_log<<Logger::Error<<"TCP worker caught STL error: "<<e.what()<<endl;
+      result = QueryResult::Close;
+    }
+
+    if (result == QueryResult::Close) {
+      conn->d_closeAfterWrite = true;
+    }
+  }
+
+  if (consumed == conn->d_inbuf.size()) {
+    // release the memory, most connections sit idle between queries
+    PacketBuffer().swap(conn->d_inbuf);
+  }
+  else if (consumed > 0) {
+    conn->d_inbuf.erase(conn->d_inbuf.begin(), conn->d_inbuf.begin() + consumed);
+  }
+}
+
+TCPNameserver::Worker::QueryResult TCPNameserver::Worker::processQuery(WorkerConnection* conn, const char* mesg, uint16_t pktlen)
+{
+  conn->d_transactions++;
+  if (d_maxTransactionsPerConn && conn->d_transactions > d_maxTransactionsPerConn) {
+    g_log << Logger::Notice<<"TCP Remote "<< conn->d_remote <<" exceeded the number of transactions per connection, dropping."<<endl;
+    return QueryResult::Close;
+  }
+
+  const ComboAddress& accountremote = conn->d_innerRemote ? *conn->d_innerRemote : conn->d_remote;
+  S.inc("tcp-queries");
+  if (accountremote.sin4.sin_family == AF_INET6)
+    S.inc("tcp6-queries");
+  else
+    S.inc("tcp4-queries");
+
+  auto packet = make_unique<DNSPacket>(true);
+  packet->d_dt.set(); // timing, the Distributor drops questions that waited too long
+  packet->setRemote(&conn->d_remote);
+  packet->d_tcp = true;
+  if (conn->d_innerRemote) {
+    packet->d_inner_remote = conn->d_innerRemote;
+    packet->d_tcp = conn->d_innerTCP;
+  }
+  packet->setSocket(conn->d_fd);
+  if (packet->parse(mesg, pktlen) < 0) {
+    return QueryResult::Close;
+  }
+
+  if (packet->hasEDNSCookie())
+    S.inc("tcp-cookie-queries");
+
+  if (packet->qtype.getCode() == QType::AXFR || packet->qtype.getCode() == QType::IXFR) {
+    conn->d_pendingTransfer = std::move(packet);
+    return QueryResult::Transfer;
+  }
+
+  if (d_logDNSQueries) {
+    g_log << Logger::Notice<<"TCP Remote "<< packet->getRemoteString() <<" wants '" << packet->qdomain<<"|"<<packet->qtype.toString() <<
+    "', do = " <<packet->d_dnssecOk <<", bufsize = "<< packet->getMaxReplyLen();
+  }
+
+  if (PC.enabled()) {
+    auto cached = make_unique<DNSPacket>(false);
+    if (packet->couldBeCached() && PC.get(*packet, *cached)) { // short circuit - does the PacketCache recognize this question?
+      if (d_logDNSQueries)
+        g_log<<": packetcache HIT"<<endl;
+      cached->setRemote(&packet->d_remote);
+      cached->d_inner_remote = packet->d_inner_remote;
+      cached->d.id=packet->d.id;
+      cached->d.rd=packet->d.rd; // copy in recursion desired bit
+      cached->commitD(); // commit d to the packet                        inlined
+
+      appendPacket(*cached, conn->d_outbuf); // presigned, don't do it again
+      return QueryResult::Answered;
+    }
+    if (d_logDNSQueries)
+      g_log<<": packetcache MISS"<<endl;
+  }
+  else {
+    if (d_logDNSQueries) {
+      g_log<<endl;
+    }
+  }
+
+  if (d_distributor->isOverloaded()) {
+    g_log<<Logger::Info<<"Dropping TCP connection from "<<conn->d_remote<<", backends are overloaded"<<endl;
+    S.inc("overload-drops");
+    return QueryResult::Close;
+  }
+
+  // we really need to ask the backend :-) the answer comes back through handleAnswers()
+  const int fd = conn->d_fd;
+  const uint64_t connId = conn->d_id;
+  conn->d_inFlight++;
+  try {
+    d_distributor->question(*packet, [this, fd, connId](std::unique_ptr<DNSPacket>& reply, int /* start */) {
+      queueAnswer(fd, connId, reply);
+    });
+  }
+  catch (DistributorFatal& df) { // same as for UDP, the queued questions are lost
+    _exit(1);
+  }
+  return QueryResult::Queued;
+}
+
+bool TCPNameserver::Worker::flush(WorkerConnection* conn)
+{
+  while (conn->pendingOutput()) {
+    ssize_t res = write(conn->d_fd, conn->d_outbuf.data() + conn->d_outpos, conn->d_outbuf.size() - conn->d_outpos);
+    if (res < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      g_log<<Logger::Info<<"Error writing DNS data to TCP client "<<conn->d_remote<<": "<<stringerror()<<endl;
+      return false;
+    }
+    conn->d_outpos += res;
+  }
+
+  std::string().swap(conn->d_outbuf);
+  conn->d_outpos = 0;
+  return true;
+}
+
+void TCPNameserver::Worker::watch(WorkerConnection* conn, WorkerConnection::IOState state)
+{
+  struct timeval ttd;
+  gettimeofday(&ttd, nullptr);
+  ttd.tv_sec += d_idleTimeout;
+  if (d_maxConnectionDuration) {
+    ttd.tv_sec = std::min(ttd.tv_sec, static_cast<time_t>(conn->d_start + d_maxConnectionDuration));
+  }
+
+  auto callback = [this](int /* fd */, FDMultiplexer::funcparam_t& param) {
+    auto ours = boost::any_cast<WorkerConnection*>(param);
+    if (ours->d_state == WorkerConnection::IOState::Reading) {
+      handleReadable(ours);
+    }
+    else {
+      service(ours);
+    }
+  };
+
+  if (conn->d_state == state) {
+    if (state == WorkerConnection::IOState::Reading) {
+      d_mplexer->setReadTTD(conn->d_fd, ttd, 0);
+    }
+    else {
+      d_mplexer->setWriteTTD(conn->d_fd, ttd, 0);
+    }
+    return;
+  }
+
+  if (conn->d_state == WorkerConnection::IOState::None) {
+    if (state == WorkerConnection::IOState::Reading) {
+      d_mplexer->addReadFD(conn->d_fd, callback, conn, &ttd);
+    }
+    else {
+      d_mplexer->addWriteFD(conn->d_fd, callback, conn, &ttd);
+    }
+  }
+  else if (state == WorkerConnection::IOState::Reading) {
+    d_mplexer->alterFDToRead(conn->d_fd, callback, conn, &ttd);
+  }
+  else {
+    d_mplexer->alterFDToWrite(conn->d_fd, callback, conn, &ttd);
+  }
+  conn->d_state = state;
+}
+
+void TCPNameserver::Worker::unwatch(WorkerConnection* conn)
+{
+  if (conn->d_state == WorkerConnection::IOState::Reading) {
+    d_mplexer->removeReadFD(conn->d_fd);
+  }
+  else if (conn->d_state == WorkerConnection::IOState::Writing) {
+    d_mplexer->removeWriteFD(conn->d_fd);
+  }
+  conn->d_state = WorkerConnection::IOState::None;
+}
+
+std::unique_ptr<TCPNameserver::WorkerConnection> TCPNameserver::Worker::release(WorkerConnection* conn)
+{
+  unwatch(conn);
+
+  auto it = d_connections.find(conn->d_fd);
+  auto owned = std::move(it->second);
+  d_connections.erase(it);
+  return owned;
+}
+
+void TCPNameserver::Worker::close(WorkerConnection* conn)
+{
+  auto owned = release(conn);
+  closeWorkerConnection(owned);
+}
+
+void TCPNameserver::Worker::startTransfer(WorkerConnection* conn)
+{
+  // transfers wait for the client at every chunk, so they get a thread of their own
+  auto owned = release(conn);
+  WorkerConnection* raw = owned.release();
+  try {
+    std::thread xfrThread([raw]() { doWorkerTransfer(std::unique_ptr<WorkerConnection>(raw)); });
+    xfrThread.detach();
+  }
+  catch (const std::exception& e) {
+    g_log<<Logger::Error<<"Error creating TCP transfer thread: "<<e.what()<<endl;
+    owned.reset(raw);
+    closeWorkerConnection(owned);
+  }
+}
+
+void TCPNameserver::workerThread(int pipe)
+{
+  setThreadName("pdns/tcpWorker");
+  try {
+    Worker(pipe).run();
+  }
+  catch(const PDNSException& ae) {
+    g_log<<Logger::Error<<"TCP worker thread dying because of fatal error: "<<ae.reason<<endl;
+  }
+  catch(const std::exception& e) {
+    g_log<<Logger::Error<<"TCP worker thread dying because of fatal error: "<<e.what()<<endl;
+  }
+  _exit(1); // take rest of server with us
+}
+
+void TCPNameserver::closeWorkerConnection(std::unique_ptr<WorkerConnection>& conn)
+{
+  d_connectionroom_sem->post();
+
+  try {
+    closesocket(conn->d_fd);
+  }
+  catch(const PDNSException& e) {
+    g_log<<Logger::Error<<"Error closing TCP socket: "<<e.reason<<endl;
+  }
+  decrementClientCount(conn->d_remote);
+  conn.reset();
+}
+
+void TCPNameserver::doWorkerTransfer(std::unique_ptr<WorkerConnection> conn)
+{
+  setThreadName("pdns/tcpXFR");
+  auto packet = std::move(conn->d_pendingTransfer);
+  try {
+    if (packet->qtype.getCode() == QType::AXFR) {
+      doAXFR(packet->qdomain, packet, conn->d_fd);
+    }
+    else {
+      doIXFR(packet, conn->d_fd);
+    }
+  }
+  catch(PDNSException &ae) {
+    g_log<<Logger::Error<<"TCP transfer to "<<conn->d_remote<<" had error: "<<ae.reason<<endl;
+    closeWorkerConnection(conn);
+    return;
+  }
+  catch(NetworkError &e) {
+    g_log<<Logger::Info<<"TCP transfer to "<<conn->d_remote<<" died because of network error: "<<e.what()<<endl;
+    closeWorkerConnection(conn);
+    return;
+  }
+  catch(std::exception &e) {
+    g_log<<Logger::Error<<"TCP transfer to "<<conn->d_remote<<" died because of STL error: "<<e.what()<<endl;
+    closeWorkerConnection(conn);
+    return;
+  }
+
+  // hand the connection back to its worker
+  WorkerConnection* tmp = conn.release();
+  if (write(tmp->d_workerPipe, &tmp, sizeof(tmp)) != sizeof(tmp)) {
+    unixDie("write to TCP worker pipe");
+  }
+}
+
+void TCPNameserver::dispatchToWorker(int fd, const ComboAddress& remote)
+{
+  auto conn = make_unique<WorkerConnection>(fd, remote, d_workerPipes.at(d_nextWorker++ % d_workerPipes.size()).second);
+  conn->d_needProxyHeader = g_proxyProtocolACL.match(remote);
+  conn->d_start = time(nullptr);
+  setNonBlocking(fd);
+
+  // this is passed to the worker over the pipe and released there
+  WorkerConnection* tmp = conn.release();
+  if (write(tmp->d_workerPipe, &tmp, sizeof(tmp)) != sizeof(tmp)) {
+    unixDie("write to TCP worker pipe");
+  }
+}
+
+
 bool TCPNameserver::canDoAXFR(std::unique_ptr<DNSPacket>& q, bool isAXFR, std::unique_ptr<PacketHandler>& packetHandler)
 {
   if(::arg().mustDo("disable-axfr"))
@@ -677,6 +1360,15 @@ int TCPNameserver::doAXFR(const DNSName &target, std::unique_ptr<DNSPacket>& q,
   }
 
 
+  // an unchanged zone is sent from the messages of its previous transfer, only the TSIGs are computed again
+  std::shared_ptr<const AuthAXFRCache::Transfer> cached;
+  std::unique_ptr<AuthAXFRCache::Recording> recording;
+  if (g_axfrCache.enabled()) {
+    const uint8_t variant = (securedZone ? 1 : 0) | (presignedZone ? 2 : 0) | (NSEC3Zone ? 4 : 0) | (isCatalogZone ? 8 : 0);
+    // waits if another transfer is recording this serial right now
+    cached = g_axfrCache.get(target, sd.serial, variant, recording);
+  }
+
   // SOA *must* go out first, our signing pipe might reorder
   DLOG(g_log<<logPrefix<<"sending out SOA"<<endl);
   DNSZoneRecord soa = makeEditedDNSZRFromSOAData(dk, sd);
@@ -695,6 +1387,29 @@ int TCPNameserver::doAXFR(const DNSName &target, std::unique_ptr<DNSPacket>& q,
   trc.d_mac = outpacket->d_trc.d_mac;
   outpacket = getFreshAXFRPacket(q);
 
+  auto sendRecords = [&](const vector<DNSZoneRecord>& rrs) {
+    outpacket->getRRS() = rrs;
+    if(haveTSIGDetails && !tsigkeyname.empty())
+      outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true);
+    sendPacket(outpacket, outsock, false);
+    trc.d_mac=outpacket->d_trc.d_mac;
+    outpacket=getFreshAXFRPacket(q);
+  };
+
+  if (cached) {
+    for (const auto& chunk : cached->d_chunks) {
+      sendRecords(chunk);
+    }
+
+    outpacket->addRecord(std::move(soa));
+    if(haveTSIGDetails && !tsigkeyname.empty())
+      outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true);
+
+    sendPacket(outpacket, outsock);
+
+    g_log<<Logger::Notice<<logPrefix<<"AXFR finished, sent "<<cached->d_records<<" records from the AXFR cache"<<endl;
+    return 1;
+  }
 
   DNSZoneRecord zrr;
   vector<DNSZoneRecord> zrrs;
@@ -992,6 +1707,25 @@ int TCPNameserver::doAXFR(const DNSName &target, std::unique_ptr<DNSPacket>& q,
 
 send:
 
+  if (recording && !recording->reserve(zrrs.size())) {
+    recording.reset();
+  }
+
+  // while recording, the messages are only sent once the whole zone has been recorded and stored,
+  // so the transfers waiting for it do not go at the pace of our client
+  auto sendChunk = [&](const vector<DNSZoneRecord>& rrs) {
+    if (!recording) {
+      sendRecords(rrs);
+    }
+    else if (!recording->add(rrs)) {
+      // too large to be cached after all, catch up with what was held back
+      for (const auto& chunk : recording->getChunks()) {
+        sendRecords(chunk);
+      }
+      recording.reset();
+    }
+  };
+
   /* now write all other records */
 
   typedef map<DNSName, NSECXEntry, CanonDNSNameCompare> nsecxrepo_t;
@@ -1028,13 +1762,9 @@ send:
 
     if(csp.submit(loopZRR)) {
       for(;;) {
-        outpacket->getRRS() = csp.getChunk();
-        if(!outpacket->getRRS().empty()) {
-          if(haveTSIGDetails && !tsigkeyname.empty())
-            outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true);
-          sendPacket(outpacket, outsock, false);
-          trc.d_mac=outpacket->d_trc.d_mac;
-          outpacket=getFreshAXFRPacket(q);
+        auto chunk = csp.getChunk();
+        if(!chunk.empty()) {
+          sendChunk(chunk);
         }
         else
           break;
@@ -1081,13 +1811,9 @@ send:
           zrr.auth=true;
           if(csp.submit(zrr)) {
             for(;;) {
-              outpacket->getRRS() = csp.getChunk();
-              if(!outpacket->getRRS().empty()) {
-                if(haveTSIGDetails && !tsigkeyname.empty())
-                  outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true);
-                sendPacket(outpacket, outsock, false);
-                trc.d_mac=outpacket->d_trc.d_mac;
-                outpacket=getFreshAXFRPacket(q);
+              auto chunk = csp.getChunk();
+              if(!chunk.empty()) {
+                sendChunk(chunk);
               }
               else
                 break;
@@ -1115,13 +1841,9 @@ send:
       zrr.auth=true;
       if(csp.submit(zrr)) {
         for(;;) {
-          outpacket->getRRS() = csp.getChunk();
-          if(!outpacket->getRRS().empty()) {
-            if(haveTSIGDetails && !tsigkeyname.empty())
-              outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true);
-            sendPacket(outpacket, outsock, false);
-            trc.d_mac=outpacket->d_trc.d_mac;
-            outpacket=getFreshAXFRPacket(q);
+          auto chunk = csp.getChunk();
+          if(!chunk.empty()) {
+            sendChunk(chunk);
           }
           else
             break;
@@ -1136,28 +1858,38 @@ send:
   cerr<<"Ready for consumption: "<<csp.getReady()<<endl;
   * */
   for(;;) {
-    outpacket->getRRS() = csp.getChunk(true); // flush the pipe
-    if(!outpacket->getRRS().empty()) {
-      if(haveTSIGDetails && !tsigkeyname.empty())
-        outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true); // first answer is 'normal'
+    auto chunk = csp.getChunk(true); // flush the pipe
+    if(!chunk.empty()) {
       try {
-        sendPacket(outpacket, outsock, false);
+        sendChunk(chunk);
       }
       catch (PDNSException& pe) {
         throw PDNSException("during axfr-out of "+target.toString()+", this happened: "+pe.reason);
       }
-      trc.d_mac=outpacket->d_trc.d_mac;
-      outpacket=getFreshAXFRPacket(q);
     }
     else
       break;
   }
 
   udiff=dt.udiffNoReset();
-  if(securedZone)
+  if(securedZone) {
     g_log<<Logger::Debug<<logPrefix<<"done signing: "<<csp.d_signed/(udiff/1000000.0)<<" sigs/s, "<<endl;
+    unsigned int n = 0;
+    for (const auto& stats : csp.getWorkerStats()) {
+      g_log<<Logger::Debug<<logPrefix<<"signing worker "<<n++<<": "<<stats.d_signed<<" signed ("<<stats.d_stolen<<" stolen), "<<(stats.d_busyUsec ? stats.d_signed / (stats.d_busyUsec / 1000000.0) : 0)<<" sigs/s"<<endl;
+    }
+  }
 
+  if (recording) {
+    // the transfers waiting for this one can go now, and so can we
+    const auto transfer = recording->commit();
+    recording.reset();
+    for (const auto& chunk : transfer->d_chunks) {
+      sendRecords(chunk);
+    }
+  }
   DLOG(g_log<<logPrefix<<"done writing out records"<<endl);
+
   /* and terminate with yet again the SOA record */
   outpacket=getFreshAXFRPacket(q);
   outpacket->addRecord(std::move(soa));
@@ -1314,6 +2046,15 @@ TCPNameserver::TCPNameserver()
   d_connectionroom_sem = make_unique<Semaphore>( ::arg().asNum( "max-tcp-connections" ));
   d_maxTCPConnections = ::arg().asNum( "max-tcp-connections" );
 
+  for (int n = 0; n < ::arg().asNum("tcp-worker-threads"); ++n) {
+    int fds[2];
+    if (pipe(fds) < 0)
+      unixDie("Creating pipe");
+    setCloseOnExec(fds[0]);
+    setCloseOnExec(fds[1]);
+    d_workerPipes.emplace_back(fds[0], fds[1]);
+  }
+
   vector<string>locals;
   stringtok(locals,::arg()["local-address"]," ,");
   if(locals.empty())
@@ -1427,6 +2168,11 @@ void TCPNameserver::thread()
             if(room<1)
               g_log<<Logger::Warning<<"Limit of simultaneous TCP connections reached - raise max-tcp-connections"<<endl;
 
+            if (!d_workerPipes.empty()) {
+              dispatchToWorker(fd, remote);
+              continue;
+            }
+
             try {
               std::thread connThread(doConnection, fd);
               connThread.detach();
@@ -56,6 +56,13 @@ private:
   static void doConnection(int fd);
   static void decrementClientCount(const ComboAddress& remote);
   void thread(void);
+  void dispatchToWorker(int fd, const ComboAddress& remote);
+
+  class Worker;
+  struct WorkerConnection;
+  static void workerThread(int pipe);
+  static void closeWorkerConnection(std::unique_ptr<WorkerConnection>& conn);
+  static void doWorkerTransfer(std::unique_ptr<WorkerConnection> conn);
   static LockGuarded<std::map<ComboAddress,size_t,ComboAddress::addressOnlyLessThan>> s_clientsCount;
   static LockGuarded<std::unique_ptr<PacketHandler>> s_P;
   static std::unique_ptr<Semaphore> d_connectionroom_sem;
@@ -68,4 +75,6 @@ private:
 
   vector<int>d_sockets;
   vector<struct pollfd> d_prfds;
+  vector<std::pair<int,int>> d_workerPipes;
+  size_t d_nextWorker{0};
 };
@@ -0,0 +1,239 @@
+/*
+    PowerDNS Versatile Database Driven Nameserver
+    Copyright (C) 2023  PowerDNS.COM BV
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation
+
+    Additionally, the license of this program contains a special
+    exception which allows to distribute the program in binary form when
+    it is linked against OpenSSL.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <atomic>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+#include "auth-axfrcache.hh"
+#include "dnsrecords.hh"
+
+BOOST_AUTO_TEST_SUITE(test_auth_axfrcache_cc)
+
+static std::shared_ptr<AuthAXFRCache::Transfer> makeTransfer(const DNSName& zone, uint32_t serial, uint8_t variant)
+{
+  auto transfer = AuthAXFRCache::make(zone, serial, variant);
+  DNSZoneRecord zrr;
+  zrr.dr.d_name = DNSName("www") + zone;
+  zrr.dr.d_type = QType::A;
+  zrr.dr.d_ttl = 3600;
+  zrr.dr.setContent(DNSRecordContent::mastermake(QType::A, QClass::IN, "192.0.2.1"));
+  transfer->d_chunks.push_back({zrr});
+  transfer->d_records = 1;
+  return transfer;
+}
+
+BOOST_AUTO_TEST_CASE(test_get)
+{
+  const DNSName zoneName("example.org.");
+  AuthAXFRCache cache;
+  BOOST_CHECK(!cache.enabled());
+  cache.insert(makeTransfer(zoneName, 1, 0));
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+
+  cache.setTTL(60);
+  BOOST_CHECK(cache.enabled());
+  BOOST_CHECK(cache.get(zoneName, 1, 0) == nullptr);
+  cache.insert(makeTransfer(zoneName, 1, 0));
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+
+  auto transfer = cache.get(zoneName, 1, 0);
+  BOOST_REQUIRE(transfer != nullptr);
+  BOOST_REQUIRE_EQUAL(transfer->d_chunks.size(), 1U);
+  BOOST_CHECK_EQUAL(transfer->d_chunks.at(0).at(0).dr.d_name, DNSName("www.example.org."));
+  BOOST_CHECK(cache.get(DNSName("EXAMPLE.org."), 1, 0) != nullptr);
+
+  /* the DNSSEC state of the zone changed */
+  BOOST_CHECK(cache.get(zoneName, 1, 1) == nullptr);
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+
+  /* a new serial drops the previous transfer */
+  cache.insert(makeTransfer(zoneName, 1, 0));
+  BOOST_CHECK(cache.get(zoneName, 2, 0) == nullptr);
+  BOOST_CHECK(cache.get(zoneName, 1, 0) == nullptr);
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+
+  /* zones that are too large are not stored */
+  cache.setMaxRecords(1);
+  BOOST_CHECK(cache.fits(1));
+  BOOST_CHECK(!cache.fits(2));
+  auto large = makeTransfer(zoneName, 1, 0);
+  large->d_records = 2;
+  cache.insert(std::move(large));
+  BOOST_CHECK(cache.get(zoneName, 1, 0) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_max_total_records)
+{
+  AuthAXFRCache cache;
+  cache.setTTL(60);
+  cache.setMaxTotalRecords(2);
+  BOOST_CHECK(!cache.fits(3));
+
+  cache.insert(makeTransfer(DNSName("example.org."), 1, 0));
+  sleep(1);
+  cache.insert(makeTransfer(DNSName("example.net."), 1, 0));
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+  BOOST_CHECK_EQUAL(cache.records(), 2U);
+
+  /* the transfer closest to its expiry makes room */
+  cache.insert(makeTransfer(DNSName("example.com."), 1, 0));
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+  BOOST_CHECK_EQUAL(cache.records(), 2U);
+  BOOST_CHECK(cache.get(DNSName("example.org."), 1, 0) == nullptr);
+  BOOST_CHECK(cache.get(DNSName("example.net."), 1, 0) != nullptr);
+  BOOST_CHECK(cache.get(DNSName("example.com."), 1, 0) != nullptr);
+
+  /* replacing the transfer of a zone does not count it twice */
+  cache.insert(makeTransfer(DNSName("example.com."), 2, 0));
+  BOOST_CHECK_EQUAL(cache.records(), 2U);
+  BOOST_CHECK(cache.get(DNSName("example.net."), 1, 0) != nullptr);
+
+  BOOST_CHECK_EQUAL(cache.purge(), 2U);
+  BOOST_CHECK_EQUAL(cache.records(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_recording)
+{
+  const DNSName zoneName("example.org.");
+  AuthAXFRCache cache;
+  cache.setTTL(60);
+  cache.setMaxRecords(2);
+
+  std::unique_ptr<AuthAXFRCache::Recording> recording;
+  BOOST_CHECK(cache.get(zoneName, 1, 0, recording) == nullptr);
+  BOOST_REQUIRE(recording != nullptr);
+
+  /* a second transfer of the same serial waits for the first one to be stored */
+  std::shared_ptr<const AuthAXFRCache::Transfer> waited;
+  std::unique_ptr<AuthAXFRCache::Recording> second;
+  std::thread waiter([&]() { waited = cache.get(zoneName, 1, 0, second); });
+  usleep(100000);
+
+  auto chunk = makeTransfer(zoneName, 1, 0)->d_chunks.at(0);
+  BOOST_CHECK(recording->reserve(1));
+  BOOST_CHECK(recording->add(chunk));
+  recording->commit();
+  waiter.join();
+  BOOST_REQUIRE(waited != nullptr);
+  BOOST_CHECK(second == nullptr);
+  BOOST_CHECK_EQUAL(waited->d_records, 1U);
+
+  /* an abandoned recording is taken over by a waiting transfer */
+  recording.reset();
+  BOOST_CHECK(cache.get(zoneName, 2, 0, recording) == nullptr);
+  BOOST_REQUIRE(recording != nullptr);
+  std::thread taker([&]() { waited = cache.get(zoneName, 2, 0, second); });
+  usleep(100000);
+  recording.reset();
+  taker.join();
+  BOOST_CHECK(waited == nullptr);
+  BOOST_REQUIRE(second != nullptr);
+
+  /* a transfer that turns out too large lets the waiting ones go without recording */
+  std::unique_ptr<AuthAXFRCache::Recording> third;
+  std::thread uncached([&]() { waited = cache.get(zoneName, 2, 0, third); });
+  usleep(100000);
+  BOOST_CHECK(second->add(chunk));
+  BOOST_CHECK(second->add(chunk));
+  BOOST_CHECK(!second->add(chunk));
+  /* the messages held back are still there to be sent */
+  BOOST_CHECK_EQUAL(second->getChunks().size(), 3U);
+  uncached.join();
+  BOOST_CHECK(waited == nullptr);
+  BOOST_CHECK(third == nullptr);
+  second.reset();
+  BOOST_CHECK(cache.get(zoneName, 2, 0) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_stalled_recorder)
+{
+  const DNSName zoneName("example.org.");
+  AuthAXFRCache cache;
+  cache.setTTL(60);
+
+  std::unique_ptr<AuthAXFRCache::Recording> recording;
+  BOOST_CHECK(cache.get(zoneName, 1, 0, recording) == nullptr);
+  BOOST_REQUIRE(recording != nullptr);
+
+  std::shared_ptr<const AuthAXFRCache::Transfer> waited;
+  std::unique_ptr<AuthAXFRCache::Recording> second;
+  std::thread waiter([&]() { waited = cache.get(zoneName, 1, 0, second); });
+
+  /* the first transfer records the whole zone, then sends it to a client that does not read */
+  std::atomic<bool> recorderDone{false};
+  std::thread recorder([&]() {
+    auto chunk = makeTransfer(zoneName, 1, 0)->d_chunks.at(0);
+    for (size_t idx = 0; idx < 10; idx++) {
+      BOOST_CHECK(recording->add(chunk));
+    }
+    auto transfer = recording->commit();
+    recording.reset();
+    BOOST_CHECK_EQUAL(transfer->d_chunks.size(), 10U);
+    for (size_t idx = 0; idx < transfer->d_chunks.size(); idx++) {
+      usleep(200000);
+    }
+    recorderDone = true;
+  });
+
+  waiter.join();
+  /* the second transfer got the zone while the first one was still stuck on its client */
+  BOOST_CHECK(!recorderDone);
+  recorder.join();
+  BOOST_REQUIRE(waited != nullptr);
+  BOOST_CHECK(second == nullptr);
+  BOOST_CHECK_EQUAL(waited->d_records, 10U);
+}
+
+BOOST_AUTO_TEST_CASE(test_purge)
+{
+  AuthAXFRCache cache;
+  cache.setTTL(60);
+  cache.insert(makeTransfer(DNSName("example.org."), 1, 0));
+  cache.insert(makeTransfer(DNSName("sub.example.org."), 1, 0));
+  cache.insert(makeTransfer(DNSName("example.net."), 1, 0));
+  BOOST_CHECK_EQUAL(cache.size(), 3U);
+
+  BOOST_CHECK_EQUAL(cache.purge("example.com$"), 0U);
+  BOOST_CHECK_EQUAL(cache.purgeExact(DNSName("www.example.com.")), 0U);
+
+  /* a name drops the transfers of all the zones holding it */
+  BOOST_CHECK_EQUAL(cache.purge("www.sub.example.org"), 2U);
+  BOOST_CHECK(cache.get(DNSName("example.net."), 1, 0) != nullptr);
+
+  /* a suffix drops its parent zones too */
+  cache.insert(makeTransfer(DNSName("example.org."), 1, 0));
+  cache.insert(makeTransfer(DNSName("sub.example.org."), 1, 0));
+  BOOST_CHECK_EQUAL(cache.purge("sub.example.org$"), 2U);
+  BOOST_CHECK_EQUAL(cache.purge(), 1U);
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,245 @@
+/*
+    PowerDNS Versatile Database Driven Nameserver
+    Copyright (C) 2023  PowerDNS.COM BV
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation
+
+    Additionally, the license of this program contains a special
+    exception which allows to distribute the program in binary form when
+    it is linked against OpenSSL.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <boost/test/unit_test.hpp>
+
+#include "auth-compiledzone.hh"
+#include "dnsparser.hh"
+#include "dnswriter.hh"
+
+BOOST_AUTO_TEST_SUITE(test_auth_compiledzone_cc)
+
+static DNSPacket makeQuery(const DNSName& qname, uint16_t qtype, bool edns, bool dnssecOK, uint16_t bufferSize = 4096)
+{
+  vector<uint8_t> packet;
+  DNSPacketWriter pw(packet, qname, qtype);
+  pw.getHeader()->id = htons(4242);
+  if (edns) {
+    pw.addOpt(bufferSize, 0, dnssecOK ? EDNSOpts::DNSSECOK : 0);
+  }
+  pw.commit();
+
+  DNSPacket query(true);
+  BOOST_REQUIRE_EQUAL(query.parse(reinterpret_cast<const char*>(packet.data()), packet.size()), 0);
+  return query;
+}
+
+static std::string makeAnswer(const DNSName& qname, uint16_t qtype, bool edns, bool withRecord)
+{
+  vector<uint8_t> packet;
+  DNSPacketWriter pw(packet, qname, qtype);
+  pw.getHeader()->qr = 1;
+  pw.getHeader()->aa = 1;
+  if (withRecord) {
+    pw.startRecord(qname, QType::A, 3600, QClass::IN, DNSResourceRecord::ANSWER);
+    pw.xfrIP(htonl(0x7f000001));
+  }
+  if (edns) {
+    pw.addOpt(1232, 0, 0);
+  }
+  pw.commit();
+  return std::string(packet.begin(), packet.end());
+}
+
+static std::shared_ptr<AuthCompiledZones::Zone> makeZone(const DNSName& zoneName, const DNSName& qname)
+{
+  auto zone = std::make_shared<AuthCompiledZones::Zone>();
+  zone->d_zone = zoneName;
+
+  AuthCompiledZones::Name name;
+  AuthCompiledZones::answers_t answers;
+  answers[AuthCompiledZones::NoEDNS].d_packet = makeAnswer(qname, QType::A, false, true);
+  answers[AuthCompiledZones::EDNS].d_packet = makeAnswer(qname, QType::A, true, true);
+  name.d_types.emplace_back(QType::A, std::move(answers));
+  name.d_noData[AuthCompiledZones::NoEDNS].d_packet = makeAnswer(qname, AuthCompiledZones::s_noDataType, false, false);
+  zone->d_names.emplace(qname, std::move(name));
+  zone->d_answers = 2;
+
+  return zone;
+}
+
+BOOST_AUTO_TEST_CASE(test_get)
+{
+  const DNSName zoneName("example.org.");
+  const DNSName qname("www.example.org.");
+  AuthCompiledZones compiled;
+  auto local = compiled.getLocal();
+  DNSPacket cached(false);
+  /* the default of udp-truncation-threshold, which limits the reply size of EDNS queries */
+  DNSPacket::s_udpTruncationThreshold = 1232;
+
+  compiled.setZones({zoneName});
+  BOOST_CHECK(compiled.enabled());
+
+  DNSName pending;
+  uint64_t generation = 0;
+  compiled.waitForPending(pending, generation);
+  BOOST_CHECK_EQUAL(pending, zoneName);
+
+  auto query = makeQuery(qname, QType::A, false, false);
+  BOOST_CHECK(!compiled.get(local, query, cached));
+
+  BOOST_CHECK(compiled.store(generation, makeZone(zoneName, qname)));
+  BOOST_CHECK_EQUAL(compiled.size(), 2U);
+
+  BOOST_CHECK(compiled.get(local, query, cached));
+  BOOST_CHECK_EQUAL(cached.qdomain, qname);
+  {
+    MOADNSParser mdp(false, cached.getString());
+    BOOST_CHECK_EQUAL(mdp.d_qtype, QType::A);
+    BOOST_CHECK_EQUAL(mdp.d_answers.size(), 1U);
+  }
+
+  /* case is taken from the query */
+  auto upperQuery = makeQuery(DNSName("WWW.example.org."), QType::A, false, false);
+  BOOST_CHECK(compiled.get(local, upperQuery, cached));
+  BOOST_CHECK_EQUAL(cached.getString().substr(sizeof(dnsheader) + 1, 3), "WWW");
+
+  /* EDNS */
+  auto ednsQuery = makeQuery(qname, QType::A, true, false);
+  BOOST_CHECK(compiled.get(local, ednsQuery, cached));
+  /* not compiled with the DO bit */
+  auto doQuery = makeQuery(qname, QType::A, true, true);
+  BOOST_CHECK(!compiled.get(local, doQuery, cached));
+  /* a smaller buffer is fine as long as the answer fits */
+  auto smallQuery = makeQuery(qname, QType::A, true, false, 512);
+  BOOST_CHECK(compiled.get(local, smallQuery, cached));
+
+  /* NODATA, with the type patched in */
+  auto noDataQuery = makeQuery(qname, QType::TXT, false, false);
+  BOOST_CHECK(compiled.get(local, noDataQuery, cached));
+  {
+    MOADNSParser mdp(false, cached.getString());
+    BOOST_CHECK_EQUAL(mdp.d_qtype, QType::TXT);
+    BOOST_CHECK_EQUAL(mdp.d_answers.size(), 0U);
+  }
+  /* never answered from a compiled zone */
+  auto dsQuery = makeQuery(qname, QType::DS, false, false);
+  BOOST_CHECK(!compiled.get(local, dsQuery, cached));
+
+  /* not in the zone */
+  auto otherQuery = makeQuery(DNSName("mail.example.org."), QType::A, false, false);
+  BOOST_CHECK(!compiled.get(local, otherQuery, cached));
+  auto otherZoneQuery = makeQuery(DNSName("www.example.net."), QType::A, false, false);
+  BOOST_CHECK(!compiled.get(local, otherZoneQuery, cached));
+}
+
+BOOST_AUTO_TEST_CASE(test_purge)
+{
+  const DNSName zoneName("example.org.");
+  const DNSName qname("www.example.org.");
+  AuthCompiledZones compiled;
+  auto local = compiled.getLocal();
+  DNSPacket cached(false);
+  auto query = makeQuery(qname, QType::A, false, false);
+
+  compiled.setZones({zoneName, DNSName("example.net.")});
+  DNSName pending;
+  uint64_t generation = 0;
+  compiled.waitForPending(pending, generation);
+  BOOST_CHECK_EQUAL(pending, zoneName);
+  compiled.waitForPending(pending, generation);
+  BOOST_CHECK_EQUAL(pending, DNSName("example.net."));
+
+  BOOST_CHECK(compiled.store(1, makeZone(zoneName, qname)));
+  BOOST_CHECK(compiled.get(local, query, cached));
+
+  /* other zones are left alone */
+  BOOST_CHECK_EQUAL(compiled.purge("example.com$"), 0U);
+  BOOST_CHECK_EQUAL(compiled.purgeExact(DNSName("www.example.net.")), 0U);
+  BOOST_CHECK(compiled.get(local, query, cached));
+  compiled.waitForPending(pending, generation);
+  BOOST_CHECK_EQUAL(pending, DNSName("example.net."));
+
+  /* a purge of a name inside the zone drops the whole zone, and queues it again */
+  BOOST_CHECK_EQUAL(compiled.purge("www.example.org"), 2U);
+  BOOST_CHECK(!compiled.get(local, query, cached));
+  BOOST_CHECK_EQUAL(compiled.size(), 0U);
+  compiled.waitForPending(pending, generation);
+  BOOST_CHECK_EQUAL(pending, zoneName);
+  BOOST_CHECK_EQUAL(generation, 2U);
+
+  /* a compilation that started before the purge is discarded */
+  BOOST_CHECK(!compiled.store(1, makeZone(zoneName, qname)));
+  BOOST_CHECK(!compiled.get(local, query, cached));
+
+  BOOST_CHECK(compiled.store(generation, makeZone(zoneName, qname)));
+  BOOST_CHECK(compiled.get(local, query, cached));
+  BOOST_CHECK_EQUAL(compiled.purge("org$"), 2U);
+  BOOST_CHECK(!compiled.get(local, query, cached));
+}
+
+BOOST_AUTO_TEST_CASE(test_purge_dependency)
+{
+  /* answers of example.org. hold records of, or point into, example.net. */
+  const DNSName zoneName("example.org.");
+  const DNSName qname("www.example.org.");
+  AuthCompiledZones compiled;
+  auto local = compiled.getLocal();
+  DNSPacket cached(false);
+  auto query = makeQuery(qname, QType::A, false, false);
+
+  compiled.setZones({zoneName});
+  DNSName pending;
+  uint64_t generation = 0;
+  compiled.waitForPending(pending, generation);
+
+  auto zone = makeZone(zoneName, qname);
+  zone->d_dependencies = {DNSName("ns1.example.net."), DNSName("www.example.net.")};
+  BOOST_CHECK(compiled.store(generation, std::move(zone)));
+  BOOST_CHECK(compiled.get(local, query, cached));
+
+  /* unrelated names are left alone */
+  BOOST_CHECK_EQUAL(compiled.purge("example.com$"), 0U);
+  BOOST_CHECK_EQUAL(compiled.purgeExact(DNSName("mail.example.net.")), 0U);
+  BOOST_CHECK(compiled.get(local, query, cached));
+
+  /* a change to the glue zone drops the zone, and queues it again */
+  BOOST_CHECK_EQUAL(compiled.purge("example.net$"), 2U);
+  BOOST_CHECK(!compiled.get(local, query, cached));
+  compiled.waitForPending(pending, generation);
+  BOOST_CHECK_EQUAL(pending, zoneName);
+  BOOST_CHECK_EQUAL(generation, 2U);
+
+  /* so does a change to the name the answers point to */
+  zone = makeZone(zoneName, qname);
+  zone->d_dependencies = {DNSName("www.example.net.")};
+  BOOST_CHECK(compiled.store(generation, std::move(zone)));
+  BOOST_CHECK(compiled.get(local, query, cached));
+  BOOST_CHECK_EQUAL(compiled.purgeExact(DNSName("www.example.net.")), 2U);
+  BOOST_CHECK(!compiled.get(local, query, cached));
+  compiled.waitForPending(pending, generation);
+
+  /* the dependencies come from the last compilation */
+  BOOST_CHECK(compiled.store(generation, makeZone(zoneName, qname)));
+  BOOST_CHECK_EQUAL(compiled.purge("example.net$"), 0U);
+  BOOST_CHECK(compiled.get(local, query, cached));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
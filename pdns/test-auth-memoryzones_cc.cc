@@ -0,0 +1,164 @@
+/*
+    PowerDNS Versatile Database Driven Nameserver
+    Copyright (C) 2023  PowerDNS.COM BV
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation
+
+    Additionally, the license of this program contains a special
+    exception which allows to distribute the program in binary form when
+    it is linked against OpenSSL.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <boost/test/unit_test.hpp>
+
+#include "auth-memoryzones.hh"
+#include "dnsrecords.hh"
+
+extern StatBag S;
+
+BOOST_AUTO_TEST_SUITE(test_auth_memoryzones_cc)
+
+static DNSZoneRecord makeRecord(const DNSName& name, uint16_t qtype, const std::string& content)
+{
+  DNSZoneRecord zrr;
+  zrr.domain_id = 42;
+  zrr.dr.d_name = name;
+  zrr.dr.d_type = qtype;
+  zrr.dr.d_ttl = 3600;
+  zrr.dr.setContent(DNSRecordContent::mastermake(qtype, QClass::IN, content));
+  return zrr;
+}
+
+static std::shared_ptr<AuthMemoryZones::Zone> makeZone(const DNSName& zoneName)
+{
+  auto zone = std::make_shared<AuthMemoryZones::Zone>();
+  zone->d_zone = zoneName;
+  zone->d_zoneId = 42;
+  zone->d_serial = 1;
+
+  const DNSName www("www." + zoneName.toString());
+  zone->d_names[www].push_back(makeRecord(www, QType::A, "192.0.2.1"));
+  zone->d_names[www].push_back(makeRecord(www, QType::AAAA, "2001:db8::1"));
+  const DNSName wildcard("*.sub." + zoneName.toString());
+  zone->d_names[wildcard].push_back(makeRecord(wildcard, QType::A, "192.0.2.2"));
+  zone->d_records = 3;
+
+  return zone;
+}
+
+BOOST_AUTO_TEST_CASE(test_get)
+{
+  const DNSName zoneName("example.org.");
+  AuthMemoryZones memory;
+  auto local = memory.getLocal();
+  std::vector<DNSZoneRecord> records;
+
+  memory.setZones({zoneName});
+  BOOST_CHECK(memory.enabled());
+
+  DNSName pending;
+  uint64_t generation = 0;
+  BOOST_CHECK(memory.waitForPending(pending, generation, 0));
+  BOOST_CHECK_EQUAL(pending, zoneName);
+  /* nothing else to load */
+  BOOST_CHECK(!memory.waitForPending(pending, generation, 1));
+
+  BOOST_CHECK(!memory.get(local, DNSName("www.example.org."), 42, QType::A, records));
+
+  BOOST_CHECK(memory.store(generation, makeZone(zoneName)));
+  BOOST_CHECK_EQUAL(memory.size(), 3U);
+
+  BOOST_CHECK(memory.get(local, DNSName("www.example.org."), 42, QType::A, records));
+  BOOST_REQUIRE_EQUAL(records.size(), 1U);
+  BOOST_CHECK_EQUAL(records.at(0).dr.d_type, QType::A);
+
+  BOOST_CHECK(memory.get(local, DNSName("www.example.org."), 42, QType::ANY, records));
+  BOOST_CHECK_EQUAL(records.size(), 2U);
+
+  /* case is taken from the question */
+  BOOST_CHECK(memory.get(local, DNSName("WWW.example.org."), 42, QType::AAAA, records));
+  BOOST_REQUIRE_EQUAL(records.size(), 1U);
+  BOOST_CHECK_EQUAL(records.at(0).dr.d_name.toString(), "WWW.example.org.");
+
+  /* names and types that do not exist are answered from memory too */
+  BOOST_CHECK(memory.get(local, DNSName("www.example.org."), 42, QType::TXT, records));
+  BOOST_CHECK(records.empty());
+  BOOST_CHECK(memory.get(local, DNSName("random.example.org."), 42, QType::A, records));
+  BOOST_CHECK(records.empty());
+  BOOST_CHECK(memory.get(local, DNSName("*.sub.example.org."), 42, QType::A, records));
+  BOOST_CHECK_EQUAL(records.size(), 1U);
+
+  /* another zone id, another zone, or no zone id at all */
+  BOOST_CHECK(!memory.get(local, DNSName("www.example.org."), 43, QType::A, records));
+  BOOST_CHECK(!memory.get(local, DNSName("www.example.net."), 42, QType::A, records));
+  BOOST_CHECK(!memory.get(local, DNSName("www.example.org."), -1, QType::A, records));
+
+  /* has() tells the same, without counting hits */
+  const auto hits = S.read("memory-zones-hit");
+  BOOST_CHECK(memory.has(local, DNSName("random.example.org."), 42));
+  BOOST_CHECK(!memory.has(local, DNSName("www.example.org."), 43));
+  BOOST_CHECK(!memory.has(local, DNSName("www.example.net."), 42));
+  BOOST_CHECK_EQUAL(S.read("memory-zones-hit"), hits);
+}
+
+BOOST_AUTO_TEST_CASE(test_purge)
+{
+  const DNSName zoneName("example.org.");
+  const DNSName qname("www.example.org.");
+  AuthMemoryZones memory;
+  auto local = memory.getLocal();
+  std::vector<DNSZoneRecord> records;
+
+  memory.setZones({zoneName, DNSName("example.net.")});
+  DNSName pending;
+  uint64_t generation = 0;
+  BOOST_CHECK(memory.waitForPending(pending, generation, 0));
+  BOOST_CHECK(memory.waitForPending(pending, generation, 0));
+
+  BOOST_CHECK(memory.store(1, makeZone(zoneName)));
+  BOOST_CHECK(memory.get(local, qname, 42, QType::A, records));
+
+  /* other zones are left alone */
+  BOOST_CHECK_EQUAL(memory.purge("example.com$"), 0U);
+  BOOST_CHECK_EQUAL(memory.reload(DNSName("example.net.")), 0U);
+  BOOST_CHECK(memory.get(local, qname, 42, QType::A, records));
+  BOOST_CHECK(memory.waitForPending(pending, generation, 0));
+  BOOST_CHECK_EQUAL(pending, DNSName("example.net."));
+
+  /* a purge of a name inside the zone drops the whole zone, and queues it again */
+  BOOST_CHECK_EQUAL(memory.purgeExact(qname), 3U);
+  BOOST_CHECK(!memory.get(local, qname, 42, QType::A, records));
+  BOOST_CHECK_EQUAL(memory.size(), 0U);
+  BOOST_CHECK(memory.waitForPending(pending, generation, 0));
+  BOOST_CHECK_EQUAL(pending, zoneName);
+  BOOST_CHECK_EQUAL(generation, 2U);
+
+  /* a load that started before the purge is discarded */
+  BOOST_CHECK(!memory.store(1, makeZone(zoneName)));
+  BOOST_CHECK(!memory.get(local, qname, 42, QType::A, records));
+
+  BOOST_CHECK(memory.store(generation, makeZone(zoneName)));
+  BOOST_CHECK(memory.get(local, qname, 42, QType::A, records));
+  BOOST_CHECK_EQUAL(memory.reload(zoneName), 3U);
+  BOOST_CHECK(!memory.get(local, qname, 42, QType::A, records));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,145 @@
+/*
+    PowerDNS Versatile Database Driven Nameserver
+    Copyright (C) 2023  PowerDNS.COM BV
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation
+
+    Additionally, the license of this program contains a special
+    exception which allows to distribute the program in binary form when
+    it is linked against OpenSSL.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <boost/test/unit_test.hpp>
+
+#include "auth-nsec3cache.hh"
+#include "dnssecinfra.hh"
+
+BOOST_AUTO_TEST_SUITE(test_auth_nsec3cache_cc)
+
+BOOST_AUTO_TEST_CASE(test_hash)
+{
+  AuthNSEC3Cache cache;
+  NSEC3PARAMRecordContent ns3rc("1 0 1 ab");
+  const DNSName qname("www.example.org.");
+
+  BOOST_CHECK(cache.hash(ns3rc, qname) == hashQNameWithSalt(ns3rc, qname));
+
+  cache.setTTL(60);
+  cache.setMaxEntries(64);
+  auto hashed = cache.hash(ns3rc, qname);
+  BOOST_CHECK(hashed == hashQNameWithSalt(ns3rc, qname));
+  BOOST_CHECK(cache.hash(ns3rc, DNSName("WWW.example.org.")) == hashed);
+
+  /* the salt and the iterations are part of the key */
+  NSEC3PARAMRecordContent other("1 0 2 ab");
+  BOOST_CHECK(cache.hash(other, qname) == hashQNameWithSalt(other, qname));
+  BOOST_CHECK(cache.hash(other, qname) != hashed);
+}
+
+BOOST_AUTO_TEST_CASE(test_neighbours)
+{
+  const DNSName zone("example.org.");
+  const std::string first(20, '\x10');
+  const std::string second(20, '\x80');
+  const std::string third(20, '\xf0');
+  DNSName unhashed;
+  std::string before;
+  std::string after;
+
+  AuthNSEC3Cache cache;
+  cache.setTTL(60);
+  BOOST_CHECK(!cache.getNeighbours(zone, 1, 2023010100, first, true, unhashed, before, after));
+
+  cache.insertNeighbours(zone, 1, 2023010100, first, second, DNSName("a.example.org."));
+  cache.insertNeighbours(zone, 1, 2023010100, third, first, DNSName("c.example.org."));
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+
+  /* an owner hash, and a hash inside its interval */
+  BOOST_REQUIRE(cache.getNeighbours(zone, 1, 2023010100, first, true, unhashed, before, after));
+  BOOST_CHECK(before == first);
+  BOOST_CHECK(after == second);
+  BOOST_CHECK_EQUAL(unhashed, DNSName("a.example.org."));
+  BOOST_REQUIRE(cache.getNeighbours(zone, 1, 2023010100, std::string(20, '\x50'), true, unhashed, before, after));
+  BOOST_CHECK(before == first);
+
+  /* the interval between second and third has not been learned yet */
+  BOOST_CHECK(!cache.getNeighbours(zone, 1, 2023010100, std::string(20, '\xa0'), true, unhashed, before, after));
+
+  /* the last interval wraps around to the first owner hash */
+  BOOST_REQUIRE(cache.getNeighbours(zone, 1, 2023010100, std::string(20, '\xff'), true, unhashed, before, after));
+  BOOST_CHECK(before == third);
+  BOOST_CHECK(after == first);
+  BOOST_REQUIRE(cache.getNeighbours(zone, 1, 2023010100, std::string(20, '\x01'), false, unhashed, before, after));
+  BOOST_CHECK(after == first);
+
+  /* another serial, or another zone with the same id */
+  BOOST_CHECK(!cache.getNeighbours(zone, 1, 2023010101, first, true, unhashed, before, after));
+  BOOST_CHECK(!cache.getNeighbours(DNSName("example.net."), 1, 2023010100, first, true, unhashed, before, after));
+  cache.insertNeighbours(zone, 1, 2023010101, first, second, DNSName("a.example.org."));
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+  BOOST_CHECK(!cache.getNeighbours(zone, 1, 2023010100, first, true, unhashed, before, after));
+
+  BOOST_CHECK_EQUAL(cache.purge("example.net$"), 0U);
+  BOOST_CHECK_EQUAL(cache.purgeExact(DNSName("www.example.org.")), 1U);
+  BOOST_CHECK(!cache.getNeighbours(zone, 1, 2023010101, first, true, unhashed, before, after));
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_neighbours_full)
+{
+  const DNSName zoneA("example.org.");
+  const DNSName zoneB("example.net.");
+  const DNSName zoneC("example.com.");
+  DNSName unhashed;
+  std::string before;
+  std::string after;
+
+  AuthNSEC3Cache cache;
+  cache.setTTL(2);
+  cache.setMaxEntries(4);
+
+  for (char idx = 1; idx <= 4; idx++) {
+    cache.insertNeighbours(zoneA, 1, 1, std::string(20, idx), std::string(20, idx + 1), DNSName("a.example.org."));
+  }
+  BOOST_CHECK_EQUAL(cache.size(), 4U);
+
+  /* once zone A has expired, its intervals make room for the other zones */
+  sleep(3);
+  cache.setTTL(60);
+  cache.insertNeighbours(zoneB, 2, 1, std::string(20, '\x10'), std::string(20, '\x20'), DNSName("a.example.net."));
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+  BOOST_CHECK(cache.getNeighbours(zoneB, 2, 1, std::string(20, '\x10'), true, unhashed, before, after));
+
+  /* without expired zones, the least recently used one goes */
+  cache.insertNeighbours(zoneC, 3, 1, std::string(20, '\x10'), std::string(20, '\x20'), DNSName("a.example.com."));
+  cache.insertNeighbours(zoneC, 3, 1, std::string(20, '\x20'), std::string(20, '\x30'), DNSName("b.example.com."));
+  cache.insertNeighbours(zoneC, 3, 1, std::string(20, '\x30'), std::string(20, '\x40'), DNSName("c.example.com."));
+  BOOST_CHECK_EQUAL(cache.size(), 4U);
+  sleep(1);
+  BOOST_CHECK(cache.getNeighbours(zoneB, 2, 1, std::string(20, '\x10'), true, unhashed, before, after));
+  cache.insertNeighbours(zoneA, 1, 1, std::string(20, '\x01'), std::string(20, '\x02'), DNSName("a.example.org."));
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+  BOOST_CHECK(cache.getNeighbours(zoneA, 1, 1, std::string(20, '\x01'), true, unhashed, before, after));
+  BOOST_CHECK(cache.getNeighbours(zoneB, 2, 1, std::string(20, '\x10'), true, unhashed, before, after));
+  BOOST_CHECK(!cache.getNeighbours(zoneC, 3, 1, std::string(20, '\x10'), true, unhashed, before, after));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
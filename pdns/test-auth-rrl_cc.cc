@@ -0,0 +1,217 @@
+/*
+    PowerDNS Versatile Database Driven Nameserver
+    Copyright (C) 2023  PowerDNS.COM BV
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation
+
+    Additionally, the license of this program contains a special
+    exception which allows to distribute the program in binary form when
+    it is linked against OpenSSL.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <boost/test/unit_test.hpp>
+
+#include "arguments.hh"
+#include "auth-rrl.hh"
+#include "dnsparser.hh"
+#include "dnswriter.hh"
+
+BOOST_AUTO_TEST_SUITE(test_auth_rrl_cc)
+
+/* the hash of the buckets is seeded from dns_random */
+static void setupRandom()
+{
+  ::arg().set("rng") = "auto";
+  ::arg().set("entropy-source") = "/dev/urandom";
+}
+
+static std::string makeAnswer(const DNSName& qname, uint8_t rcode, bool withRecord, const DNSName& authority = DNSName())
+{
+  vector<uint8_t> packet;
+  DNSPacketWriter pw(packet, qname, QType::A);
+  pw.getHeader()->qr = 1;
+  pw.getHeader()->aa = 1;
+  pw.getHeader()->rcode = rcode;
+  if (withRecord) {
+    pw.startRecord(qname, QType::A, 3600, QClass::IN, DNSResourceRecord::ANSWER);
+    pw.xfrIP(htonl(0x7f000001));
+  }
+  if (!authority.empty()) {
+    pw.startRecord(authority, QType::SOA, 3600, QClass::IN, DNSResourceRecord::AUTHORITY);
+    pw.xfrName(DNSName("ns.") + authority);
+    pw.xfrName(DNSName("hostmaster.") + authority);
+    pw.xfr32BitInt(1);
+    pw.xfr32BitInt(3600);
+    pw.xfr32BitInt(600);
+    pw.xfr32BitInt(86400);
+    pw.xfr32BitInt(300);
+  }
+  pw.commit();
+  return std::string(packet.begin(), packet.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_response_class)
+{
+  const DNSName zone("example.org.");
+  BOOST_CHECK(AuthRRL::getResponseClass(makeAnswer(DNSName("www.example.org."), RCode::NoError, true)) == AuthRRL::ResponseClass::Answer);
+  BOOST_CHECK(AuthRRL::getResponseClass(makeAnswer(DNSName("www.example.org."), RCode::NoError, false, zone)) == AuthRRL::ResponseClass::NoData);
+  BOOST_CHECK(AuthRRL::getResponseClass(makeAnswer(DNSName("www.example.org."), RCode::NXDomain, false, zone)) == AuthRRL::ResponseClass::NXDomain);
+  BOOST_CHECK(AuthRRL::getResponseClass(makeAnswer(DNSName("www.example.org."), RCode::Refused, false)) == AuthRRL::ResponseClass::Error);
+}
+
+BOOST_AUTO_TEST_CASE(test_limits)
+{
+  setupRandom();
+  AuthRRL rrl;
+  BOOST_CHECK(!rrl.enabled());
+  rrl.setLimits(5, 0, 1024, 24, 56);
+  BOOST_CHECK(rrl.enabled());
+
+  const time_t now = 1000000;
+  const ComboAddress client("192.0.2.1");
+  const auto answer = makeAnswer(DNSName("www.example.org."), RCode::NoError, true);
+
+  for (size_t idx = 0; idx < 5; idx++) {
+    BOOST_CHECK(rrl.check(client, answer, now) == AuthRRL::Verdict::Send);
+  }
+  BOOST_CHECK(rrl.check(client, answer, now) == AuthRRL::Verdict::Drop);
+  /* the same /24 shares the bucket */
+  BOOST_CHECK(rrl.check(ComboAddress("192.0.2.42"), answer, now) == AuthRRL::Verdict::Drop);
+
+  /* another prefix, another name or another kind of answer have their own buckets */
+  BOOST_CHECK(rrl.check(ComboAddress("192.0.3.1"), answer, now) == AuthRRL::Verdict::Send);
+  BOOST_CHECK(rrl.check(client, makeAnswer(DNSName("mail.example.org."), RCode::NoError, true), now) == AuthRRL::Verdict::Send);
+  BOOST_CHECK(rrl.check(client, makeAnswer(DNSName("www.example.org."), RCode::Refused, false), now) == AuthRRL::Verdict::Send);
+
+  /* refilled a second later */
+  BOOST_CHECK(rrl.check(client, answer, now + 1) == AuthRRL::Verdict::Send);
+
+  /* exempted clients are never limited */
+  NetmaskGroup exempt;
+  exempt.addMask("192.0.2.0/24");
+  rrl.setExempt(exempt);
+  for (size_t idx = 0; idx < 10; idx++) {
+    BOOST_CHECK(rrl.check(client, answer, now + 1) == AuthRRL::Verdict::Send);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_negative_answers_share_the_zone_bucket)
+{
+  setupRandom();
+  AuthRRL rrl;
+  rrl.setLimits(3, 0, 1024, 24, 56);
+
+  const time_t now = 1000000;
+  const ComboAddress client("2001:db8::1");
+  const DNSName zone("example.org.");
+
+  for (size_t idx = 0; idx < 3; idx++) {
+    BOOST_CHECK(rrl.check(client, makeAnswer(DNSName("random" + std::to_string(idx) + ".example.org."), RCode::NXDomain, false, zone), now) == AuthRRL::Verdict::Send);
+  }
+  BOOST_CHECK(rrl.check(client, makeAnswer(DNSName("other.example.org."), RCode::NXDomain, false, zone), now) == AuthRRL::Verdict::Drop);
+  /* the same /56 */
+  BOOST_CHECK(rrl.check(ComboAddress("2001:db8:0:ff::1"), makeAnswer(DNSName("other.example.org."), RCode::NXDomain, false, zone), now) == AuthRRL::Verdict::Drop);
+  BOOST_CHECK(rrl.check(ComboAddress("2001:db8:0:100::1"), makeAnswer(DNSName("other.example.org."), RCode::NXDomain, false, zone), now) == AuthRRL::Verdict::Send);
+  /* another zone */
+  BOOST_CHECK(rrl.check(client, makeAnswer(DNSName("www.example.net."), RCode::NXDomain, false, DNSName("example.net.")), now) == AuthRRL::Verdict::Send);
+}
+
+BOOST_AUTO_TEST_CASE(test_collisions)
+{
+  setupRandom();
+  AuthRRL rrl;
+  /* a single set, every key collides */
+  rrl.setLimits(2, 0, AuthRRL::s_ways, 24, 56);
+
+  const time_t now = 1000000;
+  const ComboAddress client("192.0.2.1");
+  auto answerFor = [](size_t idx) { return makeAnswer(DNSName("host" + std::to_string(idx) + ".example.org."), RCode::NoError, true); };
+
+  for (size_t idx = 0; idx < AuthRRL::s_ways; idx++) {
+    BOOST_CHECK(rrl.check(client, answerFor(idx), now) == AuthRRL::Verdict::Send);
+    BOOST_CHECK(rrl.check(client, answerFor(idx), now) == AuthRRL::Verdict::Send);
+    BOOST_CHECK(rrl.check(client, answerFor(idx), now) == AuthRRL::Verdict::Drop);
+  }
+
+  /* newcomers evicting an empty bucket do not get a full one */
+  for (size_t idx = AuthRRL::s_ways; idx < AuthRRL::s_ways * 4; idx++) {
+    BOOST_CHECK(rrl.check(client, answerFor(idx), now) == AuthRRL::Verdict::Drop);
+  }
+
+  /* a second later */
+  BOOST_CHECK(rrl.check(client, answerFor(0), now + 1) == AuthRRL::Verdict::Send);
+}
+
+BOOST_AUTO_TEST_CASE(test_older_second)
+{
+  setupRandom();
+  AuthRRL rrl;
+  rrl.setLimits(2, 0, 1024, 24, 56);
+
+  const time_t now = 1000000;
+  const ComboAddress client("192.0.2.1");
+  const auto answer = makeAnswer(DNSName("www.example.org."), RCode::NoError, true);
+
+  BOOST_CHECK(rrl.check(client, answer, now) == AuthRRL::Verdict::Send);
+  BOOST_CHECK(rrl.check(client, answer, now) == AuthRRL::Verdict::Send);
+  /* a thread that read the clock a second earlier does not refill the bucket */
+  BOOST_CHECK(rrl.check(client, answer, now - 1) == AuthRRL::Verdict::Drop);
+  BOOST_CHECK(rrl.check(client, answer, now) == AuthRRL::Verdict::Drop);
+  BOOST_CHECK(rrl.check(client, answer, now + 1) == AuthRRL::Verdict::Send);
+}
+
+BOOST_AUTO_TEST_CASE(test_slip)
+{
+  setupRandom();
+  AuthRRL rrl;
+  rrl.setLimits(1, 2, 1024, 24, 56);
+
+  const time_t now = 1000000;
+  const ComboAddress client("192.0.2.1");
+  const DNSName qname("www.example.org.");
+  const auto answer = makeAnswer(qname, RCode::NoError, true);
+
+  BOOST_CHECK(rrl.check(client, answer, now) == AuthRRL::Verdict::Send);
+  size_t slipped = 0;
+  size_t dropped = 0;
+  for (size_t idx = 0; idx < 10; idx++) {
+    auto verdict = rrl.check(client, answer, now);
+    if (verdict == AuthRRL::Verdict::Slip) {
+      slipped++;
+    }
+    else if (verdict == AuthRRL::Verdict::Drop) {
+      dropped++;
+    }
+  }
+  BOOST_CHECK_EQUAL(slipped, 5U);
+  BOOST_CHECK_EQUAL(dropped, 5U);
+
+  std::string truncated;
+  BOOST_REQUIRE(AuthRRL::makeSlip(answer, truncated));
+  MOADNSParser mdp(false, truncated);
+  BOOST_CHECK_EQUAL(mdp.d_qname, qname);
+  BOOST_CHECK_EQUAL(mdp.d_qtype, QType::A);
+  BOOST_CHECK_EQUAL(mdp.d_header.tc, 1U);
+  BOOST_CHECK_EQUAL(mdp.d_header.qr, 1U);
+  BOOST_CHECK(mdp.d_answers.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
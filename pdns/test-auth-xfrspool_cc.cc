@@ -0,0 +1,106 @@
+/*
+    PowerDNS Versatile Database Driven Nameserver
+    Copyright (C) 2023  PowerDNS.COM BV
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation
+
+    Additionally, the license of this program contains a special
+    exception which allows to distribute the program in binary form when
+    it is linked against OpenSSL.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+
+#include <boost/test/unit_test.hpp>
+
+#include "auth-xfrspool.hh"
+
+BOOST_AUTO_TEST_SUITE(test_auth_xfrspool_cc)
+
+static DNSResourceRecord makeRecord(size_t idx)
+{
+  DNSResourceRecord rr;
+  rr.qname = DNSName("host" + std::to_string(idx) + ".example.com");
+  rr.qtype = idx % 2 == 0 ? QType::A : QType::TXT;
+  rr.content = idx % 2 == 0 ? "192.0.2." + std::to_string(idx % 256) : "\"record " + std::to_string(idx) + "\"";
+  rr.ttl = 3600 + idx;
+  rr.domain_id = 42;
+  rr.auth = idx % 3 != 0;
+  rr.disabled = idx % 5 == 0;
+  return rr;
+}
+
+static void checkReplay(AuthXFRSpool& spool, size_t count, size_t batchSize)
+{
+  size_t idx = 0;
+  spool.replay([&](std::vector<DNSResourceRecord>& batch) {
+    BOOST_CHECK_LE(batch.size(), batchSize);
+    for (const auto& rr : batch) {
+      const auto expected = makeRecord(idx);
+      BOOST_CHECK_EQUAL(rr.qname, expected.qname);
+      BOOST_CHECK_EQUAL(rr.qtype.getCode(), expected.qtype.getCode());
+      BOOST_CHECK_EQUAL(rr.qclass, expected.qclass);
+      BOOST_CHECK_EQUAL(rr.content, expected.content);
+      BOOST_CHECK_EQUAL(rr.ttl, expected.ttl);
+      BOOST_CHECK_EQUAL(rr.domain_id, expected.domain_id);
+      BOOST_CHECK_EQUAL(rr.auth, expected.auth);
+      BOOST_CHECK_EQUAL(rr.disabled, expected.disabled);
+      ++idx;
+    }
+  });
+  BOOST_CHECK_EQUAL(idx, count);
+}
+
+BOOST_AUTO_TEST_CASE(test_in_memory)
+{
+  AuthXFRSpool spool(100, "/tmp");
+  BOOST_CHECK(spool.empty());
+  for (size_t idx = 0; idx < 50; idx++) {
+    spool.push(makeRecord(idx));
+  }
+  BOOST_CHECK_EQUAL(spool.size(), 50U);
+  BOOST_CHECK(!spool.spilled());
+  checkReplay(spool, 50, 100);
+}
+
+BOOST_AUTO_TEST_CASE(test_spilled)
+{
+  AuthXFRSpool spool(16, "/tmp");
+  for (size_t idx = 0; idx < 1000; idx++) {
+    spool.push(makeRecord(idx));
+  }
+  BOOST_CHECK_EQUAL(spool.size(), 1000U);
+  BOOST_CHECK(spool.spilled());
+  checkReplay(spool, 1000, 16);
+  // replaying twice gives the same records
+  checkReplay(spool, 1000, 16);
+}
+
+BOOST_AUTO_TEST_CASE(test_no_directory)
+{
+  AuthXFRSpool spool(16, "/nonexistent/directory");
+  for (size_t idx = 0; idx < 100; idx++) {
+    spool.push(makeRecord(idx));
+  }
+  BOOST_CHECK(!spool.spilled());
+  checkReplay(spool, 100, 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
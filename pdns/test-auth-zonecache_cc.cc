@@ -38,6 +38,7 @@ BOOST_AUTO_TEST_SUITE(test_auth_zonecache_cc)
 BOOST_AUTO_TEST_CASE(test_replace)
 {
   AuthZoneCache cache;
+  auto zones = cache.getLocal();
   cache.setRefreshInterval(3600);
 
   vector<std::tuple<DNSName, int>> zone_indices{
@@ -47,7 +48,7 @@ BOOST_AUTO_TEST_CASE(test_replace)
   cache.replace(zone_indices);
 
   int zoneId = 0;
-  bool found = cache.getEntry(DNSName("example.org."), zoneId);
+  bool found = cache.getEntry(zones, DNSName("example.org."), zoneId);
   if (!found || zoneId != 1) {
     BOOST_FAIL("zone added in replace() not found");
   }
@@ -56,6 +57,7 @@ BOOST_AUTO_TEST_CASE(test_replace)
 BOOST_AUTO_TEST_CASE(test_add_while_pending_replace)
 {
   AuthZoneCache cache;
+  auto zones = cache.getLocal();
   cache.setRefreshInterval(3600);
 
   vector<std::tuple<DNSName, int>> zone_indices{
@@ -65,7 +67,7 @@ BOOST_AUTO_TEST_CASE(test_add_while_pending_replace)
   cache.replace(zone_indices);
 
   int zoneId = 0;
-  bool found = cache.getEntry(DNSName("example.org."), zoneId);
+  bool found = cache.getEntry(zones, DNSName("example.org."), zoneId);
   if (!found || zoneId != 2) {
     BOOST_FAIL("zone added while replace was pending not found");
   }
@@ -74,6 +76,7 @@ BOOST_AUTO_TEST_CASE(test_add_while_pending_replace)
 BOOST_AUTO_TEST_CASE(test_remove_while_pending_replace)
 {
   AuthZoneCache cache;
+  auto zones = cache.getLocal();
   cache.setRefreshInterval(3600);
 
   vector<std::tuple<DNSName, int>> zone_indices{
@@ -83,7 +86,7 @@ BOOST_AUTO_TEST_CASE(test_remove_while_pending_replace)
   cache.replace(zone_indices);
 
   int zoneId = 0;
-  bool found = cache.getEntry(DNSName("example.org."), zoneId);
+  bool found = cache.getEntry(zones, DNSName("example.org."), zoneId);
   if (found) {
     BOOST_FAIL("zone removed while replace was pending is found");
   }
@@ -93,6 +96,7 @@ BOOST_AUTO_TEST_CASE(test_remove_while_pending_replace)
 BOOST_AUTO_TEST_CASE(test_add_while_pending_replace_duplicate)
 {
   AuthZoneCache cache;
+  auto zones = cache.getLocal();
   cache.setRefreshInterval(3600);
 
   vector<std::tuple<DNSName, int>> zone_indices{
@@ -104,7 +108,7 @@ BOOST_AUTO_TEST_CASE(test_add_while_pending_replace_duplicate)
   cache.replace(zone_indices);
 
   int zoneId = 0;
-  bool found = cache.getEntry(DNSName("example.org."), zoneId);
+  bool found = cache.getEntry(zones, DNSName("example.org."), zoneId);
   if (!found || zoneId == 0) {
     BOOST_FAIL("zone added while replace was pending not found");
   }
@@ -113,4 +117,48 @@ BOOST_AUTO_TEST_CASE(test_add_while_pending_replace_duplicate)
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_closest_entry)
+{
+  AuthZoneCache cache;
+  auto zones = cache.getLocal();
+  cache.setRefreshInterval(3600);
+
+  vector<std::tuple<DNSName, int>> zone_indices{
+    {DNSName("example.org."), 1},
+    {DNSName("sub.example.org."), 2},
+    {DNSName("org."), 3},
+  };
+  cache.setReplacePending();
+  cache.replace(zone_indices);
+
+  DNSName zone;
+  int zoneId = 0;
+  BOOST_CHECK(cache.getClosestEntry(zones, DNSName("www.deep.sub.EXAMPLE.org."), zone, zoneId));
+  BOOST_CHECK_EQUAL(zone, DNSName("sub.example.org."));
+  BOOST_CHECK_EQUAL(zoneId, 2);
+
+  BOOST_CHECK(cache.getClosestEntry(zones, DNSName("example.org."), zone, zoneId));
+  BOOST_CHECK_EQUAL(zone, DNSName("example.org."));
+  BOOST_CHECK_EQUAL(zoneId, 1);
+
+  BOOST_CHECK(cache.getClosestEntry(zones, DNSName("powerdns.org."), zone, zoneId));
+  BOOST_CHECK_EQUAL(zone, DNSName("org."));
+  BOOST_CHECK_EQUAL(zoneId, 3);
+
+  BOOST_CHECK(!cache.getClosestEntry(zones, DNSName("example.com."), zone, zoneId));
+
+  // an intermediate node is not an entry
+  BOOST_CHECK(!cache.getEntry(zones, DNSName("deep.sub.example.org."), zoneId));
+
+  cache.remove(DNSName("sub.example.org."));
+  BOOST_CHECK(cache.getClosestEntry(zones, DNSName("www.sub.example.org."), zone, zoneId));
+  BOOST_CHECK_EQUAL(zone, DNSName("example.org."));
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+
+  cache.add(DNSName("."), 4);
+  BOOST_CHECK(cache.getClosestEntry(zones, DNSName("example.com."), zone, zoneId));
+  BOOST_CHECK_EQUAL(zone, DNSName("."));
+  BOOST_CHECK_EQUAL(zoneId, 4);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -42,4 +42,21 @@ BOOST_AUTO_TEST_CASE(test_equality) {
   BOOST_CHECK(!(ns1==ns3));
 }
 
+BOOST_AUTO_TEST_CASE(test_wirerecordcontent) {
+  const DNSName name("powerdns.com.");
+
+  auto txt = DNSRecordContent::mastermake(QType::TXT, 1, "\"hello\" \"world\"");
+  auto wire = WireRecordContent::make(name, QType::TXT, txt->serialize(name, true));
+  BOOST_REQUIRE(std::dynamic_pointer_cast<WireRecordContent>(wire) != nullptr);
+  BOOST_CHECK_EQUAL(wire->getType(), QType::TXT);
+  BOOST_CHECK_EQUAL(wire->getZoneRepresentation(), txt->getZoneRepresentation());
+  BOOST_CHECK_EQUAL(wire->serialize(name, true, true), txt->serialize(name, true, true));
+
+  // types that get looked into while answering are always parsed
+  auto mx = DNSRecordContent::mastermake(QType::MX, 1, "25 smtp.powerdns.com.");
+  auto parsed = WireRecordContent::make(name, QType::MX, mx->serialize(name, true));
+  BOOST_CHECK(std::dynamic_pointer_cast<MXRecordContent>(parsed) != nullptr);
+  BOOST_CHECK(*parsed == *mx);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
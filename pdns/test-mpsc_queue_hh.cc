@@ -0,0 +1,86 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+
+#include "mpsc-queue.hh"
+
+BOOST_AUTO_TEST_SUITE(test_mpsc_queue_hh)
+
+BOOST_AUTO_TEST_CASE(test_mpsc_queue_basic)
+{
+  pdns::MPSCQueue<int> queue(5);
+  BOOST_CHECK_EQUAL(queue.capacity(), 8U);
+  BOOST_CHECK(queue.empty());
+
+  int value;
+  BOOST_CHECK(!queue.pop(value));
+
+  for (int n = 0; n < 8; n++) {
+    BOOST_CHECK(queue.push(n));
+  }
+  BOOST_CHECK_EQUAL(queue.size(), 8U);
+  BOOST_CHECK(!queue.push(8));
+
+  for (int n = 0; n < 8; n++) {
+    BOOST_REQUIRE(queue.pop(value));
+    BOOST_CHECK_EQUAL(value, n);
+  }
+  BOOST_CHECK(!queue.pop(value));
+  BOOST_CHECK(queue.empty());
+
+  /* wrap around a few times */
+  for (int n = 0; n < 100; n++) {
+    BOOST_CHECK(queue.push(n));
+    BOOST_CHECK(queue.push(n + 1));
+    BOOST_REQUIRE(queue.pop(value));
+    BOOST_CHECK_EQUAL(value, n);
+    BOOST_REQUIRE(queue.pop(value));
+    BOOST_CHECK_EQUAL(value, n + 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_mpsc_queue_producers)
+{
+  const size_t producers = 4;
+  const size_t perProducer = 100000;
+  pdns::MPSCQueue<size_t> queue(1024);
+
+  std::vector<std::thread> threads;
+  for (size_t producer = 0; producer < producers; producer++) {
+    threads.emplace_back([&queue, producer]() {
+      for (size_t n = 0; n < perProducer; n++) {
+        while (!queue.push(producer * perProducer + n)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  /* every producer's items have to come out in the order they went in */
+  std::vector<size_t> next(producers, 0);
+  size_t received = 0;
+  while (received < producers * perProducer) {
+    size_t value;
+    if (!queue.pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    size_t producer = value / perProducer;
+    BOOST_REQUIRE_LT(producer, producers);
+    BOOST_REQUIRE_EQUAL(value % perProducer, next.at(producer));
+    next.at(producer)++;
+    received++;
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_CHECK(queue.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
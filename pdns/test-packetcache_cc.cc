@@ -479,4 +479,82 @@ BOOST_AUTO_TEST_CASE(test_AuthPacketCache) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_AuthPacketCacheFlat) {
+  try {
+    ::arg().setSwitch("no-shuffle","Set this to prevent random shuffling of answers - for regression testing")="off";
+
+    AuthPacketCache PC;
+    PC.setTTL(20);
+    PC.setEngine("flat");
+    /* a single set of FlatPacketCache::s_ways entries per shard */
+    PC.setMaxEntries(1);
+
+    const DNSName qname("www.powerdns.com");
+    const std::vector<uint16_t> qtypes{QType::A, QType::AAAA, QType::MX, QType::TXT, QType::NS};
+    std::vector<DNSPacket> queries;
+    std::vector<DNSPacket> responses;
+    DNSPacket r2(false);
+
+    for (const auto qtype : qtypes) {
+      vector<uint8_t> pak;
+      DNSPacketWriter pw(pak, qname, qtype);
+      queries.emplace_back(true);
+      queries.back().parse((char*)&pak[0], pak.size());
+
+      pw.startRecord(qname, QType::A, 16, 1, DNSResourceRecord::ANSWER);
+      pw.xfrIP(htonl(0x7f000001));
+      pw.commit();
+      responses.emplace_back(false);
+      responses.back().parse((char*)&pak[0], pak.size());
+    }
+
+    /* this call is required so the correct hash is set into q->d_hash */
+    BOOST_CHECK_EQUAL(PC.get(queries.at(0), r2), false);
+    PC.insert(queries.at(0), responses.at(0), 3600);
+    BOOST_CHECK_EQUAL(PC.size(), 1U);
+    BOOST_CHECK_EQUAL(PC.get(queries.at(0), r2), true);
+    BOOST_CHECK_EQUAL(r2.qdomain, qname);
+
+    /* replacing the existing entry does not change the size */
+    PC.insert(queries.at(0), responses.at(0), 3600);
+    BOOST_CHECK_EQUAL(PC.size(), 1U);
+
+    /* all the entries for a name end up in the same shard, the last one evicts another */
+    for (size_t idx = 1; idx < queries.size(); idx++) {
+      BOOST_CHECK_EQUAL(PC.get(queries.at(idx), r2), false);
+      PC.insert(queries.at(idx), responses.at(idx), 3600);
+    }
+    BOOST_CHECK_EQUAL(PC.size(), FlatPacketCache::s_ways);
+    BOOST_CHECK_EQUAL(PC.get(queries.back(), r2), true);
+
+    size_t hits = 0;
+    for (auto& query : queries) {
+      if (PC.get(query, r2)) {
+        hits++;
+      }
+    }
+    BOOST_CHECK_EQUAL(hits, FlatPacketCache::s_ways);
+
+    BOOST_CHECK_EQUAL(PC.purge("www.powerdns.net"), 0U);
+    BOOST_CHECK_EQUAL(PC.purge("net$"), 0U);
+    BOOST_CHECK_EQUAL(PC.purge("powerdns.com$"), FlatPacketCache::s_ways);
+    BOOST_CHECK_EQUAL(PC.size(), 0U);
+    BOOST_CHECK_EQUAL(PC.get(queries.back(), r2), false);
+
+    PC.insert(queries.at(0), responses.at(0), 3600);
+    BOOST_CHECK_EQUAL(PC.size(), 1U);
+    BOOST_CHECK_EQUAL(PC.purge("www.powerdns.com"), 1U);
+    BOOST_CHECK_EQUAL(PC.get(queries.at(0), r2), false);
+
+    PC.insert(queries.at(0), responses.at(0), 3600);
+    BOOST_CHECK_EQUAL(PC.purge(), 1U);
+    BOOST_CHECK_EQUAL(PC.size(), 0U);
+    BOOST_CHECK_EQUAL(PC.get(queries.at(0), r2), false);
+  }
+  catch(PDNSException& e) {
+    cerr<<"Had error in AuthPacketCache: "<<e.reason<<endl;
+    throw;
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
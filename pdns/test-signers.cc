@@ -6,15 +6,21 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/assign/list_of.hpp>
 
+#include "arguments.hh"
 #include "base32.hh"
 #include "base64.hh"
 #include "dnsseckeeper.hh"
 #include "dnssecinfra.hh"
 #include "misc.hh"
+#include "statbag.hh"
 
 #include <cstdio>
+#include <fstream>
+#include <set>
 #include <unordered_map>
 
+extern StatBag S;
+
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables): Boost stuff.
 BOOST_AUTO_TEST_SUITE(test_signers)
 
@@ -547,5 +553,204 @@ BOOST_AUTO_TEST_CASE(test_hash_qname_with_salt)
   }
 }
 
+/* mirrors the format written by saveSignatureCache() */
+struct SignatureCacheSnapshotEntry
+{
+  std::string pubKey;
+  std::string msgHash;
+  std::string signature;
+  uint32_t inception{0};
+  uint32_t expire{0};
+  uint16_t tag{0};
+};
+
+static const std::string s_signatureCacheMagic{"PDNS signature cache 1\n"};
+
+static std::vector<SignatureCacheSnapshotEntry> readSignatureCacheSnapshot(const std::string& path)
+{
+  std::ifstream input(path, std::ios::binary);
+  std::string magic(s_signatureCacheMagic.size(), '\0');
+  input.read(magic.data(), magic.size());
+  BOOST_REQUIRE(magic == s_signatureCacheMagic);
+
+  auto readString = [&input](std::string& value) {
+    uint16_t len{0};
+    if (!input.read(reinterpret_cast<char*>(&len), sizeof(len))) {
+      return false;
+    }
+    value.resize(len);
+    return static_cast<bool>(input.read(value.data(), len));
+  };
+
+  std::vector<SignatureCacheSnapshotEntry> entries;
+  SignatureCacheSnapshotEntry entry;
+  while (readString(entry.pubKey)) {
+    BOOST_REQUIRE(readString(entry.msgHash));
+    BOOST_REQUIRE(readString(entry.signature));
+    input.read(reinterpret_cast<char*>(&entry.inception), sizeof(entry.inception));
+    input.read(reinterpret_cast<char*>(&entry.expire), sizeof(entry.expire));
+    input.read(reinterpret_cast<char*>(&entry.tag), sizeof(entry.tag));
+    BOOST_REQUIRE(input);
+    entries.push_back(entry);
+  }
+  return entries;
+}
+
+static void writeSignatureCacheSnapshot(const std::string& path, const std::vector<SignatureCacheSnapshotEntry>& entries)
+{
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(s_signatureCacheMagic.data(), s_signatureCacheMagic.size());
+  auto writeString = [&out](const std::string& value) {
+    uint16_t len = value.size();
+    out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+    out.write(value.data(), value.size());
+  };
+  for (const auto& entry : entries) {
+    writeString(entry.pubKey);
+    writeString(entry.msgHash);
+    writeString(entry.signature);
+    out.write(reinterpret_cast<const char*>(&entry.inception), sizeof(entry.inception));
+    out.write(reinterpret_cast<const char*>(&entry.expire), sizeof(entry.expire));
+    out.write(reinterpret_cast<const char*>(&entry.tag), sizeof(entry.tag));
+  }
+}
+
+/* the shard fillOutRRSIG() uses for that message hash */
+static size_t getSignatureCacheShardIndex(const std::string& msgHash)
+{
+  uint32_t hash = 0;
+  memcpy(&hash, msgHash.data(), std::min(sizeof(hash), msgHash.size()));
+  return hash % 64;
+}
+
+BOOST_AUTO_TEST_CASE(test_signature_cache_snapshot)
+{
+  char path[] = "/tmp/signature-cache.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    BOOST_FAIL("Unable to generate a temporary file");
+  }
+  close(fd);
+  ::arg().set("max-signature-cache-entries", "Maximum number of signatures cache entries") = "";
+  S.declare("signatures", "Number of DNSSEC signatures made");
+  /* fillOutRRSIG() adds some jitter */
+  ::arg().set("rng") = "auto";
+  ::arg().set("entropy-source") = "/dev/urandom";
+  reportBasicTypes();
+
+  DNSKEYRecordContent drc;
+  auto dcke = std::shared_ptr<DNSCryptoKeyEngine>(DNSCryptoKeyEngine::makeFromISCString(drc, rsaSha256SignerParams.iscMap));
+  DNSSECPrivateKey dpk;
+  dpk.setKey(dcke, 256);
+
+  const DNSName zone("example.org.");
+  auto makeRRSIG = [&zone](const DNSName& qname) {
+    RRSIGRecordContent rrc;
+    rrc.d_type = QType::A;
+    rrc.d_labels = qname.countLabels();
+    rrc.d_originalttl = 3600;
+    rrc.d_siginception = getStartOfWeek() - 7 * 86400;
+    rrc.d_sigexpire = getStartOfWeek() + 14 * 86400;
+    rrc.d_signer = zone;
+    return rrc;
+  };
+  const DNSName www("www.example.org.");
+  sortedRecords_t wwwRecords;
+  wwwRecords.insert(DNSRecordContent::mastermake(QType::A, QClass::IN, "192.0.2.1"));
+  const DNSName mail("mail.example.org.");
+  sortedRecords_t mailRecords;
+  mailRecords.insert(DNSRecordContent::mastermake(QType::A, QClass::IN, "192.0.2.2"));
+
+  /* the second signature of the same RRset comes from the cache */
+  const auto sizeBefore = signatureCacheSize("");
+  auto wwwSig = makeRRSIG(www);
+  fillOutRRSIG(dpk, www, wwwSig, wwwRecords);
+  auto mailSig = makeRRSIG(mail);
+  fillOutRRSIG(dpk, mail, mailSig, mailRecords);
+  BOOST_CHECK_EQUAL(S.read("signatures"), 2U);
+  auto again = makeRRSIG(www);
+  fillOutRRSIG(dpk, www, again, wwwRecords);
+  BOOST_CHECK(again.d_signature == wwwSig.d_signature);
+  BOOST_CHECK_EQUAL(S.read("signatures"), 2U);
+  BOOST_CHECK_EQUAL(signatureCacheSize(""), sizeBefore + 2);
+
+  auto saved = saveSignatureCache(path);
+  BOOST_CHECK_EQUAL(saved, sizeBefore + 2);
+  auto entries = readSignatureCacheSnapshot(path);
+  BOOST_REQUIRE_EQUAL(entries.size(), saved);
+  auto findEntry = [&entries](const std::string& signature) {
+    auto iter = std::find_if(entries.begin(), entries.end(), [&signature](const SignatureCacheSnapshotEntry& entry) { return entry.signature == signature; });
+    BOOST_REQUIRE(iter != entries.end());
+    return *iter;
+  };
+  const auto wwwEntry = findEntry(wwwSig.d_signature);
+  BOOST_CHECK_EQUAL(wwwEntry.inception, wwwSig.d_siginception);
+  BOOST_CHECK_EQUAL(wwwEntry.expire, wwwSig.d_sigexpire);
+  BOOST_CHECK_EQUAL(wwwEntry.tag, dpk.getTag());
+  const auto mailEntry = findEntry(mailSig.d_signature);
+
+  /* a current entry, one made with last week's inception, an expired one, and one for the
+     mail RRset whose key tag does not match: that one loads, since the tag can only be checked
+     against the key, but it is never served and the next signature replaces it */
+  auto oldInception = wwwEntry;
+  oldInception.msgHash.back() ^= 1;
+  oldInception.inception -= 7 * 86400;
+  auto expired = wwwEntry;
+  expired.msgHash.back() ^= 2;
+  expired.expire = time(nullptr) - 1;
+  auto wrongTag = mailEntry;
+  wrongTag.tag++;
+  wrongTag.signature = "bogus";
+  writeSignatureCacheSnapshot(path, {wwwEntry, oldInception, expired, wrongTag});
+
+  BOOST_CHECK_EQUAL(loadSignatureCache(path), 2U);
+  BOOST_CHECK_EQUAL(signatureCacheSize(""), sizeBefore + 2);
+  again = makeRRSIG(www);
+  fillOutRRSIG(dpk, www, again, wwwRecords);
+  BOOST_CHECK(again.d_signature == wwwSig.d_signature);
+  BOOST_CHECK_EQUAL(S.read("signatures"), 2U);
+
+  again = makeRRSIG(mail);
+  fillOutRRSIG(dpk, mail, again, mailRecords);
+  BOOST_CHECK(again.d_signature != "bogus");
+  BOOST_CHECK(dcke->verify(getMessageForRRSET(mail, again, mailRecords), again.d_signature));
+  BOOST_CHECK_EQUAL(S.read("signatures"), 3U);
+  auto cached = makeRRSIG(mail);
+  fillOutRRSIG(dpk, mail, cached, mailRecords);
+  BOOST_CHECK(cached.d_signature == again.d_signature);
+  BOOST_CHECK_EQUAL(S.read("signatures"), 3U);
+
+  /* with a single entry per shard, entries loaded into the same shard evict each other */
+  std::set<size_t> usedShards;
+  for (const auto& entry : entries) {
+    usedShards.insert(getSignatureCacheShardIndex(entry.msgHash));
+  }
+  uint8_t shard = 0;
+  while (usedShards.count(shard) != 0) {
+    shard++;
+  }
+  std::vector<SignatureCacheSnapshotEntry> sameShard;
+  for (char idx = 0; idx < 3; idx++) {
+    auto entry = wwwEntry;
+    entry.msgHash = std::string(4, static_cast<char>(shard)) + std::string(12, idx);
+    sameShard.push_back(entry);
+  }
+  BOOST_REQUIRE_EQUAL(getSignatureCacheShardIndex(sameShard.at(0).msgHash), shard);
+  writeSignatureCacheSnapshot(path, sameShard);
+  ::arg().set("max-signature-cache-entries") = "64";
+  BOOST_CHECK_EQUAL(loadSignatureCache(path), 3U);
+  BOOST_CHECK_EQUAL(signatureCacheSize(""), sizeBefore + 3);
+  ::arg().set("max-signature-cache-entries") = "";
+
+  {
+    std::ofstream out(path, std::ios::trunc);
+    out << "not a snapshot";
+  }
+  BOOST_CHECK_THROW(loadSignatureCache(path), std::runtime_error);
+
+  unlink(path);
+  BOOST_CHECK_EQUAL(loadSignatureCache(path), 0U);
+}
+
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables): Boost stuff.
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include "config.h"
 #endif
 
+#include <thread>
 #include <unordered_map>
 
 #include <boost/test/unit_test.hpp>
@@ -15,10 +16,16 @@
 #include <boost/multi_index/key_extractors.hpp>
 
 #include "arguments.hh"
+#include "auth-memoryzones.hh"
 #include "auth-querycache.hh"
+#include "statbag.hh"
 #include "auth-zonecache.hh"
 #include "ueberbackend.hh"
 
+/* declared here, a block scope extern inside the test suite would refer to its namespace */
+extern AuthQueryCache QC;
+extern StatBag S;
+
 class SimpleBackend : public DNSBackend
 {
 public:
@@ -134,6 +141,17 @@ public:
   void lookup(const QType& qtype, const DNSName& qdomain, int zoneId = -1, DNSPacket *pkt_p = nullptr) override
   {
     d_currentScopeMask = 0;
+    auto prefetched = d_prefetchedRecords.find(qdomain);
+    if (qtype == QType::ANY && prefetched != d_prefetchedRecords.end()) {
+      // like the generic SQL backends, hand out what prefetch() fetched
+      d_records = prefetched->second;
+      d_currentZone = zoneId;
+      d_iter = d_records->begin();
+      d_end = d_records->end();
+      d_prefetchedRecords.erase(prefetched);
+      return;
+    }
+
     findZone(qdomain, zoneId, d_records, d_currentZone);
 
     if (d_records) {
@@ -222,12 +240,36 @@ public:
     return true;
   }
 
+  void prefetch(const QType& qtype, const vector<DNSName>& qdomains, int zoneId) override
+  {
+    s_prefetched.push_back(qdomains);
+
+    std::shared_ptr<RecordStorage> records;
+    uint64_t currentZone;
+    if (qtype != QType::ANY || !findZone(DNSName(), zoneId, records, currentZone)) {
+      return;
+    }
+    for (const auto& qdomain : qdomains) {
+      auto copy = std::make_shared<RecordStorage>();
+      auto range = records->get<OrderedNameTypeTag>().equal_range(qdomain);
+      copy->insert(range.first, range.second);
+      d_prefetchedRecords[qdomain] = std::move(copy);
+    }
+  }
+
+  void endPrefetch() override
+  {
+    d_prefetchedRecords.clear();
+  }
+
   /* this is not thread-safe */
   static std::unordered_map<uint64_t, ZoneStorage> s_zones;
   static std::unordered_map<uint64_t, MetaDataStorage> s_metadata;
+  static std::vector<std::vector<DNSName>> s_prefetched;
 
 protected:
   std::string d_suffix;
+  std::map<DNSName, std::shared_ptr<RecordStorage>> d_prefetchedRecords;
   std::shared_ptr<RecordStorage> d_records{nullptr};
   RecordStorage::index<OrderedNameTypeTag>::type::const_iterator d_iter;
   RecordStorage::index<OrderedNameTypeTag>::type::const_iterator d_end;
@@ -296,6 +338,7 @@ public:
 
 std::unordered_map<uint64_t, SimpleBackend::ZoneStorage> SimpleBackend::s_zones;
 std::unordered_map<uint64_t, SimpleBackend::MetaDataStorage> SimpleBackend::s_metadata;
+std::vector<std::vector<DNSName>> SimpleBackend::s_prefetched;
 
 class SimpleBackendFactory : public BackendFactory
 {
@@ -341,6 +384,7 @@ struct UeberBackendSetupArgFixture {
     extern AuthQueryCache QC;
     ::arg().set("query-cache-ttl")="0";
     ::arg().set("negquery-cache-ttl")="0";
+    ::arg().set("query-coalescing-timeout")="0";
     ::arg().set("consistent-backends")="no";
     QC.purge();
     g_zoneCache.setRefreshInterval(0);
@@ -348,6 +392,7 @@ struct UeberBackendSetupArgFixture {
     BackendMakers().clear();
     SimpleBackend::s_zones.clear();
     SimpleBackend::s_metadata.clear();
+    SimpleBackend::s_prefetched.clear();
   };
 };
 
@@ -1180,5 +1225,209 @@ BOOST_AUTO_TEST_CASE(test_multi_backends_metadata) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_query_coalescing) {
+  // a lookup that misses the query cache while another thread is already asking the backend the same question waits for its answer
+
+  SimpleBackend::SimpleDNSZone zoneA(DNSName("powerdns.com."), 1);
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("powerdns.com."), QType::SOA, "ns1.powerdns.com. powerdns.com. 3 600 600 3600000 604800", 3600));
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("www.powerdns.com."), QType::A, "192.168.0.1", 60));
+  SimpleBackend::s_zones[1].insert(zoneA);
+
+  BackendMakers().report(new SimpleBackendFactory());
+  BackendMakers().launch("SimpleBackend:1");
+
+  ::arg().set("query-cache-ttl")="20";
+  ::arg().set("negquery-cache-ttl")="60";
+  ::arg().set("query-coalescing-timeout")="5000";
+  QC.purge();
+  QC.setMaxEntries(100000);
+  UeberBackend::go();
+
+  const auto queriesBefore = S.read("backend-queries");
+  {
+    UeberBackend first;
+    UeberBackend second;
+
+    first.lookup(QType(QType::A), DNSName("www.powerdns.com."), 1);
+    DNSZoneRecord dzr;
+    BOOST_REQUIRE(first.get(dzr));
+
+    std::vector<DNSZoneRecord> records;
+    std::thread waiter([&second, &records]() {
+      records = getRecords(second, DNSName("www.powerdns.com."), QType::A, 1, nullptr);
+    });
+    // give the other thread a chance to start waiting, the result is the same if it does not
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    while (first.get(dzr)) {
+    }
+    waiter.join();
+
+    BOOST_REQUIRE_EQUAL(records.size(), 1U);
+    checkRecordExists(records, DNSName("www.powerdns.com."), QType::A, 1, 0, true);
+  }
+  // only the first lookup reached the backend
+  BOOST_CHECK_EQUAL(S.read("backend-queries") - queriesBefore, 1U);
+
+  ::arg().set("query-coalescing-timeout")="0";
+  UeberBackend::go();
+}
+
+BOOST_AUTO_TEST_CASE(test_query_coalescing_nested) {
+  // a lookup does not wait for a question the same thread is already asking through another UeberBackend
+
+  SimpleBackend::SimpleDNSZone zoneA(DNSName("powerdns.com."), 1);
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("powerdns.com."), QType::SOA, "ns1.powerdns.com. powerdns.com. 3 600 600 3600000 604800", 3600));
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("www.powerdns.com."), QType::A, "192.168.0.1", 60));
+  SimpleBackend::s_zones[1].insert(zoneA);
+
+  BackendMakers().report(new SimpleBackendFactory());
+  BackendMakers().launch("SimpleBackend:1");
+
+  ::arg().set("query-cache-ttl")="20";
+  ::arg().set("negquery-cache-ttl")="60";
+  ::arg().set("query-coalescing-timeout")="5000";
+  QC.purge();
+  QC.setMaxEntries(100000);
+  UeberBackend::go();
+
+  const auto queriesBefore = S.read("backend-queries");
+  const auto start = std::chrono::steady_clock::now();
+  {
+    UeberBackend outer;
+    outer.lookup(QType(QType::A), DNSName("www.powerdns.com."), 1);
+    DNSZoneRecord dzr;
+    BOOST_REQUIRE(outer.get(dzr));
+
+    UeberBackend nested;
+    auto records = getRecords(nested, DNSName("www.powerdns.com."), QType::A, 1, nullptr);
+    BOOST_REQUIRE_EQUAL(records.size(), 1U);
+
+    while (outer.get(dzr)) {
+    }
+  }
+  BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(5000));
+  BOOST_CHECK_EQUAL(S.read("backend-queries") - queriesBefore, 2U);
+
+  ::arg().set("query-coalescing-timeout")="0";
+  UeberBackend::go();
+}
+
+BOOST_AUTO_TEST_CASE(test_prefetch) {
+  // names already in the query cache are not prefetched, and looking for them is not counted as a hit or miss
+
+  SimpleBackend::SimpleDNSZone zoneA(DNSName("powerdns.com."), 1);
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("powerdns.com."), QType::SOA, "ns1.powerdns.com. powerdns.com. 3 600 600 3600000 604800", 3600));
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("ns1.powerdns.com."), QType::A, "192.168.0.1", 60));
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("ns2.powerdns.com."), QType::A, "192.168.0.2", 60));
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("ns3.powerdns.com."), QType::A, "192.168.0.3", 60));
+  SimpleBackend::s_zones[1].insert(zoneA);
+
+  BackendMakers().report(new SimpleBackendFactory());
+  BackendMakers().launch("SimpleBackend:1");
+
+  ::arg().set("query-cache-ttl")="20";
+  ::arg().set("negquery-cache-ttl")="60";
+  QC.purge();
+  QC.setMaxEntries(100000);
+  UeberBackend::go();
+
+  UeberBackend ub;
+  auto records = getRecords(ub, DNSName("ns1.powerdns.com."), QType::A, 1, nullptr);
+  BOOST_REQUIRE_EQUAL(records.size(), 1U);
+
+  const auto hitsBefore = S.read("query-cache-hit");
+  const auto missesBefore = S.read("query-cache-miss");
+  ub.prefetch(QType(QType::A), {DNSName("ns1.powerdns.com."), DNSName("ns2.powerdns.com."), DNSName("ns3.powerdns.com.")}, 1);
+  BOOST_CHECK_EQUAL(S.read("query-cache-hit"), hitsBefore);
+  BOOST_CHECK_EQUAL(S.read("query-cache-miss"), missesBefore);
+
+  BOOST_REQUIRE_EQUAL(SimpleBackend::s_prefetched.size(), 1U);
+  const std::vector<DNSName> expected{DNSName("ns2.powerdns.com."), DNSName("ns3.powerdns.com.")};
+  BOOST_CHECK(SimpleBackend::s_prefetched.at(0) == expected);
+
+  /* with a single name left, there is nothing to batch */
+  records = getRecords(ub, DNSName("ns2.powerdns.com."), QType::A, 1, nullptr);
+  ub.prefetch(QType(QType::A), {DNSName("ns1.powerdns.com."), DNSName("ns2.powerdns.com."), DNSName("ns3.powerdns.com.")}, 1);
+  BOOST_CHECK_EQUAL(SimpleBackend::s_prefetched.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(test_prefetch_cache_hit) {
+  // a prefetched name answered from the query cache must not be answered from the prefetched records later on
+
+  SimpleBackend::SimpleDNSZone zoneA(DNSName("powerdns.com."), 1);
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("powerdns.com."), QType::SOA, "ns1.powerdns.com. powerdns.com. 3 600 600 3600000 604800", 3600));
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("ns1.powerdns.com."), QType::A, "192.168.0.1", 60));
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("ns2.powerdns.com."), QType::A, "192.168.0.2", 60));
+  SimpleBackend::s_zones[1].insert(zoneA);
+
+  BackendMakers().report(new SimpleBackendFactory());
+  BackendMakers().launch("SimpleBackend:1");
+
+  ::arg().set("query-cache-ttl")="20";
+  ::arg().set("negquery-cache-ttl")="60";
+  QC.purge();
+  QC.setMaxEntries(100000);
+  UeberBackend::go();
+
+  UeberBackend ub;
+  UeberBackend other;
+  ub.prefetch(QType(QType::ANY), {DNSName("ns1.powerdns.com."), DNSName("ns2.powerdns.com.")}, 1);
+  BOOST_REQUIRE_EQUAL(SimpleBackend::s_prefetched.size(), 1U);
+
+  /* another thread puts ns2 in the cache in the meantime, so our backend never sees its lookup */
+  auto records = getRecords(other, DNSName("ns2.powerdns.com."), QType::ANY, 1, nullptr);
+  BOOST_REQUIRE_EQUAL(records.size(), 1U);
+  records = getRecords(ub, DNSName("ns1.powerdns.com."), QType::ANY, 1, nullptr);
+  BOOST_REQUIRE_EQUAL(records.size(), 1U);
+  records = getRecords(ub, DNSName("ns2.powerdns.com."), QType::ANY, 1, nullptr);
+  BOOST_REQUIRE_EQUAL(records.size(), 1U);
+  ub.endPrefetch();
+
+  /* the record changes and the cache entry goes away */
+  auto& idx = zoneA.d_records->get<SimpleBackend::OrderedNameTypeTag>();
+  idx.erase(idx.find(std::make_tuple(DNSName("ns2.powerdns.com."), QType::A)));
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("ns2.powerdns.com."), QType::A, "192.168.0.42", 60));
+  QC.purge();
+
+  records = getRecords(ub, DNSName("ns2.powerdns.com."), QType::ANY, 1, nullptr);
+  BOOST_REQUIRE_EQUAL(records.size(), 1U);
+  BOOST_CHECK_EQUAL(records.at(0).dr.getContent()->getZoneRepresentation(), "192.168.0.42");
+}
+
+BOOST_AUTO_TEST_CASE(test_prefetch_memory_zones) {
+  // names of a zone held in memory are answered without the backends, they are not prefetched
+  SimpleBackend::SimpleDNSZone zoneA(DNSName("powerdns.com."), 1);
+  zoneA.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("powerdns.com."), QType::SOA, "ns1.powerdns.com. powerdns.com. 3 600 600 3600000 604800", 3600));
+  SimpleBackend::s_zones[1].insert(zoneA);
+  SimpleBackend::SimpleDNSZone zoneB(DNSName("powerdns.org."), 2);
+  zoneB.d_records->insert(SimpleBackend::SimpleDNSRecord(DNSName("powerdns.org."), QType::SOA, "ns1.powerdns.org. powerdns.org. 3 600 600 3600000 604800", 3600));
+  SimpleBackend::s_zones[1].insert(zoneB);
+
+  BackendMakers().report(new SimpleBackendFactory());
+  BackendMakers().launch("SimpleBackend:1");
+  UeberBackend::go();
+
+  g_memoryZones.setZones({DNSName("powerdns.com.")});
+  DNSName pending;
+  uint64_t generation = 0;
+  BOOST_REQUIRE(g_memoryZones.waitForPending(pending, generation, 1));
+  auto memoryZone = std::make_shared<AuthMemoryZones::Zone>();
+  memoryZone->d_zone = DNSName("powerdns.com.");
+  memoryZone->d_zoneId = 1;
+  BOOST_REQUIRE(g_memoryZones.store(generation, std::move(memoryZone)));
+
+  UeberBackend ub;
+  /* every name is in memory */
+  ub.prefetch(QType(QType::A), {DNSName("ns1.powerdns.com."), DNSName("ns2.powerdns.com."), DNSName("ns3.powerdns.com.")}, 1);
+  BOOST_CHECK(SimpleBackend::s_prefetched.empty());
+
+  /* same names, but for a zone that is not in memory */
+  ub.prefetch(QType(QType::A), {DNSName("ns1.powerdns.org."), DNSName("ns2.powerdns.org.")}, 2);
+  BOOST_REQUIRE_EQUAL(SimpleBackend::s_prefetched.size(), 1U);
+  BOOST_CHECK_EQUAL(SimpleBackend::s_prefetched.at(0).size(), 2U);
+
+  g_memoryZones.purge();
+}
 
 BOOST_AUTO_TEST_SUITE_END();
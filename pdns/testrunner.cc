@@ -9,12 +9,22 @@
 #include "auth-packetcache.hh"
 #include "auth-querycache.hh"
 #include "auth-zonecache.hh"
+#include "auth-axfrcache.hh"
+#include "auth-compiledzone.hh"
+#include "auth-memoryzones.hh"
+#include "auth-nsec3cache.hh"
+#include "auth-rrl.hh"
 #include "statbag.hh"
 
 StatBag S;
 AuthPacketCache PC;
 AuthQueryCache QC;
 AuthZoneCache g_zoneCache;
+AuthCompiledZones g_compiledZones;
+AuthMemoryZones g_memoryZones;
+AuthAXFRCache g_axfrCache;
+AuthNSEC3Cache g_nsec3Cache;
+AuthRRL g_rrl;
 uint16_t g_maxNSEC3Iterations{0};
 
 ArgvMap& arg()
@@ -58,6 +58,12 @@ bool UeberBackend::s_doANYLookupsOnly=false;
 std::mutex UeberBackend::d_mut;
 std::condition_variable UeberBackend::d_cond;
 AtomicCounter* UeberBackend::s_backendQueries = nullptr;
+AtomicCounter* UeberBackend::s_coalescedQueries = nullptr;
+AtomicCounter* UeberBackend::s_authLookups = nullptr;
+AtomicCounter* UeberBackend::s_authLookupUsec = nullptr;
+std::array<UeberBackend::InFlightShard, UeberBackend::s_inFlightShardCount> UeberBackend::s_inFlight;
+thread_local unsigned int UeberBackend::t_inFlightLed = 0;
+unsigned int UeberBackend::s_coalescingTimeoutMs = 0;
 
 //! Loads a module and reports it to all UeberBackend threads
 bool UeberBackend::loadmodule(const string &name)
@@ -100,8 +106,16 @@ void UeberBackend::go()
     s_doANYLookupsOnly = true;
   }
 
+  s_coalescingTimeoutMs = ::arg().asNum("query-coalescing-timeout");
+
   S.declare("backend-queries", "Number of queries sent to the backend(s)");
   s_backendQueries = S.getPointer("backend-queries");
+  S.declare("query-cache-coalesced", "Number of query cache misses answered by a backend query made for another thread");
+  s_coalescedQueries = S.getPointer("query-cache-coalesced");
+  S.declare("auth-lookups", "Number of times the zone enclosing a name was looked up");
+  s_authLookups = S.getPointer("auth-lookups");
+  S.declare("auth-lookup-usec", "Number of microseconds spent looking up the zone enclosing a name");
+  s_authLookupUsec = S.getPointer("auth-lookup-usec");
 
   {
     std::unique_lock<std::mutex> l(d_mut);
@@ -318,6 +332,18 @@ bool UeberBackend::inTransaction()
 }
 
 bool UeberBackend::getAuth(const DNSName &target, const QType& qtype, SOAData* sd, bool cachedOk)
+{
+  DTime dt;
+  dt.set();
+  bool found = getAuthUntimed(target, qtype, sd, cachedOk);
+  if (s_authLookups != nullptr) {
+    ++(*s_authLookups);
+    (*s_authLookupUsec) += dt.udiff();
+  }
+  return found;
+}
+
+bool UeberBackend::getAuthUntimed(const DNSName &target, const QType& qtype, SOAData* sd, bool cachedOk)
 {
   // A backend can respond to our authority request with the 'best' match it
   // has. For example, when asked for a.b.c.example.com. it might respond with
@@ -332,8 +358,10 @@ bool UeberBackend::getAuth(const DNSName &target, const QType& qtype, SOAData* s
   do {
     int zoneId{-1};
     if(cachedOk && g_zoneCache.isEnabled()) {
-      if (g_zoneCache.getEntry(shorter, zoneId)) {
-        // Zone exists in zone cache, directly look up SOA.
+      DNSName zone;
+      if (g_zoneCache.getClosestEntry(d_zoneCache, shorter, zone, zoneId)) {
+        // Closest enclosing zone found in zone cache, directly look up SOA.
+        shorter = std::move(zone);
         DNSZoneRecord zr;
         lookup(QType(QType::SOA), shorter, zoneId, nullptr);
         if (!get(zr)) {
@@ -365,8 +393,8 @@ bool UeberBackend::getAuth(const DNSName &target, const QType& qtype, SOAData* s
           ;
         goto found;
       }
-      // zone does not exist, try again with shorter name
-      continue;
+      // no zone encloses this name
+      break;
     }
 
     d_question.qtype = QType::SOA;
@@ -581,28 +609,117 @@ int UeberBackend::cacheHas(const Question &q, vector<DNSZoneRecord> &rrs)
   return 1;
 }
 
-void UeberBackend::addNegCache(const Question &q)
+bool UeberBackend::addNegCache(const Question &q)
 {
   extern AuthQueryCache QC;
   if(!d_negcache_ttl)
-    return;
+    return false;
   // we should also not be storing negative answers if a pipebackend does scopeMask, but we can't pass a negative scopeMask in an empty set!
   QC.insert(q.qname, q.qtype, vector<DNSZoneRecord>(), d_negcache_ttl, q.zoneId);
+  return true;
 }
 
-void UeberBackend::addCache(const Question &q, vector<DNSZoneRecord> &&rrs)
+bool UeberBackend::addCache(const Question &q, vector<DNSZoneRecord> &&rrs)
 {
   extern AuthQueryCache QC;
 
   if(!d_cache_ttl)
-    return;
+    return false;
 
   for(const auto& rr : rrs) {
    if (rr.scopeMask)
-     return;
+     return false;
   }
 
   QC.insert(q.qname, q.qtype, std::move(rrs), d_cache_ttl, q.zoneId);
+  return true;
+}
+
+UeberBackend::InFlightShard& UeberBackend::getInFlightShard(const InFlightKey& key)
+{
+  return s_inFlight[std::get<0>(key).hash(std::get<1>(key) ^ static_cast<uint32_t>(std::get<2>(key))) % s_inFlightShardCount];
+}
+
+/* Returns true if another thread was already asking the backends the same question, and is done now, so
+   the answer should be in the cache. Otherwise we may register as the one asking, and endInFlight() must be
+   called once the answer is in the cache.
+   We do not coalesce when the answer cannot end up in the cache (positive caching disabled, or the last
+   answer to this question was scoped, as ECS or GeoIP answers are), and we never wait while this thread is
+   itself the one others are waiting for, as a nested UeberBackend would otherwise wait on its own thread. */
+bool UeberBackend::waitForInFlight(const Question &q)
+{
+  endInFlight(); // a previous lookup that was not read to its end
+
+  if (s_coalescingTimeoutMs == 0 || !d_cache_ttl) {
+    return false;
+  }
+
+  auto key = std::tuple(q.qname, q.qtype.getCode(), q.zoneId);
+  auto& shard = getInFlightShard(key);
+  std::unique_lock<std::mutex> lock(shard.lock);
+
+  auto scoped = shard.scoped.find(key);
+  if (scoped != shard.scoped.end()) {
+    if (scoped->second > time(nullptr)) {
+      return false;
+    }
+    shard.scoped.erase(scoped);
+  }
+
+  auto iter = shard.inFlight.find(key);
+  if (iter == shard.inFlight.end()) {
+    d_inFlight = std::make_shared<InFlight>();
+    d_inFlight->key = std::move(key);
+    d_inFlight->owner = std::this_thread::get_id();
+    shard.inFlight.emplace(d_inFlight->key, d_inFlight);
+    ++t_inFlightLed;
+    return false;
+  }
+
+  if (t_inFlightLed > 0) {
+    return false;
+  }
+
+  auto inFlight = iter->second;
+  bool done = inFlight->cond.wait_for(lock, std::chrono::milliseconds(s_coalescingTimeoutMs), [&inFlight] { return inFlight->done; });
+  if (!done || !inFlight->cached) {
+    return false;
+  }
+  if (s_coalescedQueries != nullptr) {
+    ++(*s_coalescedQueries);
+  }
+  return true;
+}
+
+void UeberBackend::endInFlight(bool answered, bool cached)
+{
+  if (!d_inFlight) {
+    return;
+  }
+
+  if (d_inFlight->owner == std::this_thread::get_id()) {
+    --t_inFlightLed;
+  }
+
+  {
+    auto& shard = getInFlightShard(d_inFlight->key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto iter = shard.inFlight.find(d_inFlight->key);
+    if (iter != shard.inFlight.end() && iter->second == d_inFlight) {
+      shard.inFlight.erase(iter);
+    }
+    if (answered && !cached) {
+      // a scoped answer, or negative caching is off: the next threads asking this should not wait for each other
+      if (shard.scoped.size() >= s_maxScopedPerShard) {
+        shard.scoped.clear();
+      }
+      shard.scoped[d_inFlight->key] = time(nullptr) + d_cache_ttl;
+    }
+    d_inFlight->done = true;
+    d_inFlight->cached = cached;
+  }
+  d_inFlight->cond.notify_all();
+  d_inFlight.reset();
 }
 
 void UeberBackend::alsoNotifies(const DNSName &domain, set<string> *ips)
@@ -614,6 +731,7 @@ void UeberBackend::alsoNotifies(const DNSName &domain, set<string> *ips)
 UeberBackend::~UeberBackend()
 {
   DLOG(g_log<<Logger::Error<<"UeberBackend destructor called, removing ourselves from instances, and deleting our backends"<<endl);
+  endInFlight();
   cleanup();
 }
 
@@ -651,7 +769,19 @@ void UeberBackend::lookup(const QType &qtype,const DNSName &qname, int zoneId, D
     d_question.qname=qname;
     d_question.zoneId=d_handle.zoneId;
 
+    if(g_memoryZones.enabled() && g_memoryZones.get(d_memoryZones, qname, zoneId, d_handle.qtype.getCode(), d_answers)) {
+      d_negcached=false;
+      d_cached=true;
+      d_cachehandleiter = d_answers.begin();
+      d_handle.parent=this;
+      return;
+    }
+
     int cstat=cacheHas(d_question, d_answers);
+    if(cstat<0 && waitForInFlight(d_question)) {
+      // another thread just asked the backends the same question
+      cstat=cacheHas(d_question, d_answers);
+    }
     if(cstat<0) { // nothing
       //      cout<<"UeberBackend::lookup("<<qname<<"|"<<DNSRecordContent::NumberToType(qtype.getCode())<<"): uncached"<<endl;
       d_negcached=d_cached=false;
@@ -676,6 +806,43 @@ void UeberBackend::lookup(const QType &qtype,const DNSName &qname, int zoneId, D
   d_handle.parent=this;
 }
 
+void UeberBackend::prefetch(const QType &qtype, const vector<DNSName>& qdomains, int zoneId)
+{
+  if (d_stale || !d_go || qdomains.size() < 2) {
+    return;
+  }
+
+  extern AuthQueryCache QC;
+  const QType lookupType = s_doANYLookupsOnly ? QType(QType::ANY) : qtype;
+
+  /* only a peek, the lookup() that follows counts the hit or miss. Names of a zone
+     held in memory never reach the backends, fetching them would be wasted */
+  const bool memoryZones = g_memoryZones.enabled();
+  vector<DNSName> uncached;
+  for (const auto& qdomain : qdomains) {
+    if (memoryZones && g_memoryZones.has(d_memoryZones, qdomain, zoneId)) {
+      continue;
+    }
+    if ((!d_cache_ttl && !d_negcache_ttl) || !QC.hasEntry(qdomain, lookupType, zoneId)) {
+      uncached.push_back(qdomain);
+    }
+  }
+  if (uncached.size() < 2) {
+    return;
+  }
+
+  for (auto& backend : backends) {
+    backend->prefetch(lookupType, uncached, zoneId);
+  }
+}
+
+void UeberBackend::endPrefetch()
+{
+  for (auto& backend : backends) {
+    backend->endPrefetch();
+  }
+}
+
 void UeberBackend::getAllDomains(vector<DomainInfo>* domains, bool getSerial, bool include_disabled)
 {
   for (auto & backend : backends)
@@ -710,14 +877,16 @@ bool UeberBackend::get(DNSZoneRecord &rr)
   }
 
   // cout<<"end of ueberbackend get, seeing if we should cache"<<endl;
+  bool cached;
   if(d_answers.empty()) {
     // cout<<"adding negcache"<<endl;
-    addNegCache(d_question);
+    cached = addNegCache(d_question);
   }
   else {
     // cout<<"adding query cache"<<endl;
-    addCache(d_question, std::move(d_answers));
+    cached = addCache(d_question, std::move(d_answers));
   }
+  endInFlight(true, cached);
   d_answers.clear();
   return false;
 }
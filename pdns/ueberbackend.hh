@@ -20,15 +20,21 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #pragma once
+#include <array>
 #include <vector>
 #include <map>
 #include <string>
 #include <algorithm>
 #include <mutex>
 #include <condition_variable>
+#include <memory>
+#include <thread>
+#include <tuple>
 
 #include <boost/utility.hpp>
 
+#include "auth-memoryzones.hh"
+#include "auth-zonecache.hh"
 #include "dnspacket.hh"
 #include "dnsbackend.hh"
 #include "lock.hh"
@@ -97,6 +103,10 @@ public:
   };
 
   void lookup(const QType &, const DNSName &qdomain, int zoneId, DNSPacket *pkt_p=nullptr);
+  //! Passes the names that are neither in the query cache nor in a memory zone on to the backends, see DNSBackend::prefetch()
+  void prefetch(const QType &, const vector<DNSName>& qdomains, int zoneId);
+  //! Some of the prefetched names might have been answered from the query cache, tells the backends to drop them
+  void endPrefetch();
 
   /** Determines if we are authoritative for a zone, and at what level */
   bool getAuth(const DNSName &target, const QType &qtype, SOAData* sd, bool cachedOk=true);
@@ -142,9 +152,12 @@ public:
   bool inTransaction();
 
 private:
+  bool getAuthUntimed(const DNSName &target, const QType &qtype, SOAData* sd, bool cachedOk);
   handle d_handle;
   vector<DNSZoneRecord> d_answers;
   vector<DNSZoneRecord>::const_iterator d_cachehandleiter;
+  LocalStateHolder<AuthMemoryZones::zones_t> d_memoryZones{g_memoryZones.getLocal()};
+  LocalStateHolder<AuthZoneCache::ctree_t> d_zoneCache{g_zoneCache.getLocal()};
 
   static std::mutex d_mut;
   static std::condition_variable d_cond;
@@ -162,11 +175,43 @@ private:
   bool d_negcached;
   bool d_cached;
   static AtomicCounter* s_backendQueries;
+  static AtomicCounter* s_coalescedQueries;
+  static AtomicCounter* s_authLookups;
+  static AtomicCounter* s_authLookupUsec;
   static bool d_go;
   bool d_stale;
   static bool s_doANYLookupsOnly;
 
+  /* Lookups that missed the query cache and are being sent to the backends. Other threads missing the
+     cache for the same question wait for the result to be added to the cache, instead of asking the
+     backends again. The table is sharded on the hash of the question, so unrelated misses do not
+     contend on one lock. */
+  using InFlightKey = std::tuple<DNSName, uint16_t, int>;
+  struct InFlight
+  {
+    InFlightKey key;
+    std::condition_variable cond;
+    std::thread::id owner;
+    bool done{false};
+    bool cached{false};
+  };
+  struct InFlightShard
+  {
+    std::mutex lock;
+    std::map<InFlightKey, std::shared_ptr<InFlight>> inFlight;
+    std::map<InFlightKey, time_t> scoped; // questions whose last answer was not cacheable, until when
+  };
+  static constexpr size_t s_inFlightShardCount = 64;
+  static constexpr size_t s_maxScopedPerShard = 1024;
+  static std::array<InFlightShard, s_inFlightShardCount> s_inFlight;
+  static thread_local unsigned int t_inFlightLed; // in-flight entries the current thread is the one asking for
+  static unsigned int s_coalescingTimeoutMs;
+  std::shared_ptr<InFlight> d_inFlight; // set while we are the thread the others are waiting for
+
+  static InFlightShard& getInFlightShard(const InFlightKey& key);
   int cacheHas(const Question &q, vector<DNSZoneRecord> &rrs);
-  void addNegCache(const Question &q);
-  void addCache(const Question &q, vector<DNSZoneRecord>&& rrs);
+  bool addNegCache(const Question &q);
+  bool addCache(const Question &q, vector<DNSZoneRecord>&& rrs);
+  bool waitForInFlight(const Question &q);
+  void endInFlight(bool answered = false, bool cached = false);
 };
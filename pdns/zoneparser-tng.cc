@@ -87,6 +87,9 @@ void ZoneParserTNG::stackFile(const std::string& fname)
     throw std::system_error(ec, "Unable to open file '" + fname + "': " + stringerror(err));
   }
 
+  if (!d_filestates.empty()) {
+    d_includedFiles.emplace_back(fname, st);
+  }
   filestate fs(fp, fname);
   d_filestates.push(fs);
   d_fromfile = true;
@@ -25,6 +25,8 @@
 #include <stdexcept>
 #include <stack>
 #include <deque>
+#include <vector>
+#include <sys/stat.h>
 
 #include "namespaces.hh"
 
@@ -53,6 +55,11 @@ public:
   {
     d_maxIncludes = max;
   }
+  //! the files opened by $INCLUDE so far, with their state when they were opened
+  const std::vector<std::pair<string, struct stat>>& getIncludedFiles() const
+  {
+    return d_includedFiles;
+  }
 private:
   bool getLine();
   bool getTemplateLine();
@@ -75,6 +82,7 @@ private:
   vector<string> d_zonedata;
   vector<string>::iterator d_zonedataline;
   std::stack<filestate> d_filestates;
+  std::vector<std::pair<string, struct stat>> d_includedFiles;
   parts_t d_templateparts;
   size_t d_maxGenerateSteps{0};
   size_t d_maxIncludes{20};